@@ -230,6 +230,7 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 	m_d2dContext->SetTarget(nullptr);
 	m_d2dTargetBitmap = nullptr;
 	m_d3dDepthStencilView = nullptr;
+	m_d3dDepthShaderResourceView = nullptr;
 	m_d3dContext->Flush1(D3D11_CONTEXT_TYPE_ALL, nullptr);
 
 	UpdateRenderTargetSize();
@@ -381,13 +382,16 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 		);
 
 	// 根据需要创建用于 3D 渲染的深度模具视图。
+	// 从功能级别 10_0 起，深度缓冲区使用无类型格式 (R24G8_TYPELESS)，以便光线步进雾也能
+	// 通过 R24_UNORM 着色器资源视图读取它。
+	const bool readableDepth = m_d3dFeatureLevel >= D3D_FEATURE_LEVEL_10_0;
 	CD3D11_TEXTURE2D_DESC1 depthStencilDesc(
-		DXGI_FORMAT_D24_UNORM_S8_UINT, 
+		readableDepth ? DXGI_FORMAT_R24G8_TYPELESS : DXGI_FORMAT_D24_UNORM_S8_UINT,
 		lround(m_d3dRenderTargetSize.Width),
 		lround(m_d3dRenderTargetSize.Height),
 		1, // 此深度模具视图只有一个纹理。
 		1, // 使用单一 mipmap 级别。
-		D3D11_BIND_DEPTH_STENCIL
+		readableDepth ? D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE : D3D11_BIND_DEPTH_STENCIL
 		);
 
 	ComPtr<ID3D11Texture2D1> depthStencil;
@@ -399,7 +403,7 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 			)
 		);
 
-	CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D);
+	CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D, DXGI_FORMAT_D24_UNORM_S8_UINT);
 	DX::ThrowIfFailed(
 		m_d3dDevice->CreateDepthStencilView(
 			depthStencil.Get(),
@@ -407,6 +411,18 @@ void DX::DeviceResources::CreateWindowSizeDependentResources()
 			&m_d3dDepthStencilView
 			)
 		);
+
+	if (readableDepth)
+	{
+		CD3D11_SHADER_RESOURCE_VIEW_DESC depthShaderResourceViewDesc(D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R24_UNORM_X8_TYPELESS);
+		DX::ThrowIfFailed(
+			m_d3dDevice->CreateShaderResourceView(
+				depthStencil.Get(),
+				&depthShaderResourceViewDesc,
+				&m_d3dDepthShaderResourceView
+				)
+			);
+	}
 	
 	// 设置用于确定整个窗口的 3D 渲染视区。
 	m_screenViewport = CD3D11_VIEWPORT(
@@ -38,6 +38,8 @@ namespace DX
 		D3D_FEATURE_LEVEL			GetDeviceFeatureLevel() const			{ return m_d3dFeatureLevel; }
 		ID3D11RenderTargetView1*	GetBackBufferRenderTargetView() const	{ return m_d3dRenderTargetView.Get(); }
 		ID3D11DepthStencilView*		GetDepthStencilView() const				{ return m_d3dDepthStencilView.Get(); }
+		// 以 R24_UNORM 格式读取的深度缓冲区；功能级别低于 10_0 时为 null。
+		ID3D11ShaderResourceView*	GetDepthShaderResourceView() const		{ return m_d3dDepthShaderResourceView.Get(); }
 		D3D11_VIEWPORT				GetScreenViewport() const				{ return m_screenViewport; }
 		DirectX::XMFLOAT4X4			GetOrientationTransform3D() const		{ return m_orientationTransform3D; }
 
@@ -65,6 +67,7 @@ namespace DX
 		// Direct3D 渲染对象。3D 所必需的。
 		Microsoft::WRL::ComPtr<ID3D11RenderTargetView1>	m_d3dRenderTargetView;
 		Microsoft::WRL::ComPtr<ID3D11DepthStencilView>	m_d3dDepthStencilView;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_d3dDepthShaderResourceView;
 		D3D11_VIEWPORT									m_screenViewport;
 
 		// Direct2D 绘制组件。
@@ -33,6 +33,13 @@ namespace DX
 		});
 	}
 
+	// 获取应用包中文件的完整路径，供需要路径而非 StorageFile 的 API 使用。
+	inline std::wstring GetInstalledFilePath(const std::wstring& filename)
+	{
+		auto folder = Windows::ApplicationModel::Package::Current->InstalledLocation;
+		return std::wstring(folder->Path->Data()) + L"\\" + filename;
+	}
+
 	// 将使用与设备无关的像素(DIP)表示的长度转换为使用物理像素表示的长度。
 	inline float ConvertDipsToPixels(float dips, float dpi)
 	{
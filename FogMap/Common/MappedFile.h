@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace DX
+{
+	// Read-only memory mapping of a whole file.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+#if defined(_WIN32)
+		bool Open(const std::wstring& path);
+#endif
+		bool Open(const std::string& path);
+		void Close();
+
+		bool IsOpen() const					{ return m_data != nullptr; }
+		const uint8_t* GetData() const		{ return m_data; }
+		size_t GetSize() const				{ return m_size; }
+
+	private:
+		const uint8_t*	m_data;
+		size_t			m_size;
+#if defined(_WIN32)
+		void*			m_file;
+		void*			m_mapping;
+#else
+		int				m_file;
+#endif
+	};
+}
@@ -0,0 +1,62 @@
+﻿#include "AssetCache.h"
+
+#include <utility>
+
+using namespace FogMap;
+
+AssetCache::AssetCache(FileOpener openFile) :
+	m_openFile(std::move(openFile))
+{
+}
+
+bool AssetCache::OpenPack(const char* name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pack.Close();
+	if (m_openFile(name, m_packFile) && m_pack.Open(m_packFile.GetData(), m_packFile.GetSize()))
+		return true;
+	m_packFile.Close();
+	return false;
+}
+
+bool AssetCache::Find(const char* name, AssetView& view)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pack.Find(name, view))
+		return true;
+
+	auto found = m_files.find(name);
+	if (found == m_files.end())
+	{
+		// Misses are not remembered: an optional file (model.fmesh) is looked for once per load.
+		std::unique_ptr<DX::MappedFile> file(new DX::MappedFile);
+		if (!m_openFile(name, *file))
+			return false;
+		found = m_files.emplace(name, std::move(file)).first;
+	}
+	view = AssetView{ found->second->GetData(), found->second->GetSize() };
+	return true;
+}
+
+void AssetCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pack.Close();
+	m_packFile.Close();
+	m_files.clear();
+}
+
+size_t AssetCache::GetMappedFileCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_files.size() + (m_packFile.IsOpen() ? 1 : 0);
+}
+
+size_t AssetCache::GetMappedSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t size = m_packFile.GetSize();
+	for (const auto& file : m_files)
+		size += file.second->GetSize();
+	return size;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "../Common/MappedFile.h"
+#include "AssetPack.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace FogMap
+{
+	// Startup assets held in memory for the life of the app, independent of any device: the
+	// .fpak pack when there is one, and every loose file mapped the first time it is asked for.
+	// A restored device recreates its objects from here without going back to the disk.
+	class AssetCache
+	{
+	public:
+		// Maps the file called name; the app resolves names inside its package.
+		using FileOpener = std::function<bool(const char* name, DX::MappedFile& file)>;
+
+		explicit AssetCache(FileOpener openFile);
+
+		// Returns false, leaving only loose files to serve, if the pack is missing or malformed.
+		bool OpenPack(const char* name);
+		// Looks in the pack first, then maps the loose file and keeps it. Safe to call from
+		// several jobs at once; views stay valid until Clear.
+		bool Find(const char* name, AssetView& view);
+		void Clear();
+
+		size_t GetMappedFileCount() const;
+		size_t GetMappedSize() const;
+
+	private:
+		FileOpener m_openFile;
+		mutable std::mutex m_mutex;
+		DX::MappedFile m_packFile;
+		AssetPack m_pack;
+		std::map<std::string, std::unique_ptr<DX::MappedFile>> m_files;
+	};
+}
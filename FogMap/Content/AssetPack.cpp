@@ -0,0 +1,139 @@
+﻿#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace FogMap;
+
+namespace
+{
+	inline uint64_t AlignUp(uint64_t offset)
+	{
+		return (offset + 15) & ~uint64_t(15);
+	}
+
+	inline int CompareName(const char* name, size_t length, const char* other, size_t otherLength)
+	{
+		const int order = std::memcmp(name, other, std::min(length, otherLength));
+		return order != 0 ? order : length < otherLength ? -1 : length > otherLength ? 1 : 0;
+	}
+}
+
+bool FogMap::WriteAssetPack(std::vector<AssetPackInput> assets, std::vector<uint8_t>& file)
+{
+	std::sort(assets.begin(), assets.end(), [](const AssetPackInput& a, const AssetPackInput& b) {
+		return CompareName(a.name.data(), a.name.size(), b.name.data(), b.name.size()) < 0;
+	});
+	for (size_t i = 1; i < assets.size(); ++i)
+	{
+		if (assets[i - 1].name == assets[i].name)
+			return false;
+	}
+
+	FPakHeader header = {};
+	header.magic = FPakMagic;
+	header.version = FPakVersion;
+	header.entryCount = static_cast<uint32_t>(assets.size());
+	header.entryOffset = AlignUp(sizeof(FPakHeader));
+
+	std::vector<FPakEntry> entries(assets.size());
+	uint64_t offset = header.entryOffset + entries.size() * sizeof(FPakEntry);
+	for (size_t i = 0; i < assets.size(); ++i)
+	{
+		entries[i].nameOffset = static_cast<uint32_t>(offset);
+		entries[i].nameLength = static_cast<uint32_t>(assets[i].name.size());
+		offset += assets[i].name.size() + 1;
+	}
+	for (size_t i = 0; i < assets.size(); ++i)
+	{
+		offset = AlignUp(offset);
+		entries[i].dataOffset = offset;
+		entries[i].dataSize = assets[i].size;
+		offset += assets[i].size;
+	}
+
+	file.assign(static_cast<size_t>(offset), 0);
+	std::memcpy(file.data(), &header, sizeof(header));
+	if (!entries.empty())
+		std::memcpy(file.data() + header.entryOffset, entries.data(), entries.size() * sizeof(FPakEntry));
+	for (size_t i = 0; i < assets.size(); ++i)
+	{
+		std::memcpy(file.data() + entries[i].nameOffset, assets[i].name.data(), assets[i].name.size());
+		if (assets[i].size != 0)
+			std::memcpy(file.data() + entries[i].dataOffset, assets[i].data, assets[i].size);
+	}
+	return true;
+}
+
+AssetPack::AssetPack() :
+	m_data(nullptr),
+	m_entries(nullptr),
+	m_entryCount(0)
+{
+}
+
+bool AssetPack::Open(const uint8_t* data, size_t size)
+{
+	Close();
+	if (data == nullptr || size < sizeof(FPakHeader))
+		return false;
+
+	FPakHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != FPakMagic || header.version != FPakVersion || (header.entryOffset & 15) != 0 ||
+		header.entryOffset > size || uint64_t(header.entryCount) * sizeof(FPakEntry) > size - header.entryOffset)
+		return false;
+
+	const FPakEntry* entries = reinterpret_cast<const FPakEntry*>(data + header.entryOffset);
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		const FPakEntry& entry = entries[i];
+		if (uint64_t(entry.nameOffset) + entry.nameLength >= size || data[entry.nameOffset + uint64_t(entry.nameLength)] != 0 ||
+			(entry.dataOffset & 15) != 0 || entry.dataOffset > size || entry.dataSize > size - entry.dataOffset)
+			return false;
+		// Find relies on strictly increasing names.
+		if (i > 0)
+		{
+			const FPakEntry& previous = entries[i - 1];
+			if (CompareName(reinterpret_cast<const char*>(data + previous.nameOffset), previous.nameLength,
+				reinterpret_cast<const char*>(data + entry.nameOffset), entry.nameLength) >= 0)
+				return false;
+		}
+	}
+
+	m_data = data;
+	m_entries = entries;
+	m_entryCount = header.entryCount;
+	return true;
+}
+
+void AssetPack::Close()
+{
+	m_data = nullptr;
+	m_entries = nullptr;
+	m_entryCount = 0;
+}
+
+const char* AssetPack::GetName(uint32_t index) const
+{
+	return reinterpret_cast<const char*>(m_data + m_entries[index].nameOffset);
+}
+
+AssetView AssetPack::GetAsset(uint32_t index) const
+{
+	const FPakEntry& entry = m_entries[index];
+	return AssetView{ m_data + entry.dataOffset, static_cast<size_t>(entry.dataSize) };
+}
+
+bool AssetPack::Find(const char* name, AssetView& view) const
+{
+	const size_t length = std::strlen(name);
+	const FPakEntry* end = m_entries + m_entryCount;
+	const FPakEntry* entry = std::lower_bound(m_entries, end, name, [this, length](const FPakEntry& e, const char* key) {
+		return CompareName(reinterpret_cast<const char*>(m_data + e.nameOffset), e.nameLength, key, length) < 0;
+	});
+	if (entry == end || CompareName(reinterpret_cast<const char*>(m_data + entry->nameOffset), entry->nameLength, name, length) != 0)
+		return false;
+	view = AssetView{ m_data + entry->dataOffset, static_cast<size_t>(entry->dataSize) };
+	return true;
+}
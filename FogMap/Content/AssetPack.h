@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace FogMap
+{
+	// .fpak layout (little-endian): FPakHeader, then entryCount FPakEntry records sorted by
+	// name, then the NUL-terminated names, then the contents of every asset. The entry table
+	// and every asset start at a 16-byte aligned offset from the start of the file, so an
+	// .fmesh image keeps its own alignment inside a pack.
+	struct FPakHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t reserved;
+		uint64_t entryOffset;
+	};
+
+	struct FPakEntry
+	{
+		uint64_t dataOffset;
+		uint64_t dataSize;
+		uint32_t nameOffset;
+		uint32_t nameLength;	// without the terminating NUL
+	};
+
+	static constexpr uint32_t FPakMagic = 0x4b415046;	// "FPAK"
+	static constexpr uint32_t FPakVersion = 1;
+
+	struct AssetView
+	{
+		const uint8_t* data;
+		size_t size;
+	};
+
+	struct AssetPackInput
+	{
+		std::string name;
+		const uint8_t* data;
+		size_t size;
+	};
+
+	// Serializes the assets into an .fpak image. Returns false if two inputs share a name.
+	bool WriteAssetPack(std::vector<AssetPackInput> assets, std::vector<uint8_t>& file);
+
+	// Index of a mapped .fpak image. Lookups return views into the image, which must stay
+	// mapped as long as the pack or any view is used.
+	class AssetPack
+	{
+	public:
+		AssetPack();
+
+		// Returns false, leaving the pack empty, if the image is malformed or was written by
+		// another version.
+		bool Open(const uint8_t* data, size_t size);
+		void Close();
+
+		bool IsOpen() const { return m_entries != nullptr; }
+		uint32_t GetAssetCount() const { return m_entryCount; }
+		const char* GetName(uint32_t index) const;
+		AssetView GetAsset(uint32_t index) const;
+		// Binary search over the sorted table of contents.
+		bool Find(const char* name, AssetView& view) const;
+
+	private:
+		const uint8_t* m_data;
+		const FPakEntry* m_entries;
+		uint32_t m_entryCount;
+	};
+}
@@ -0,0 +1,533 @@
+﻿#include "Bvh.h"
+#include "JobSystem.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FOGMAP_BVH_SSE2
+#endif
+
+using namespace FogMap;
+
+namespace
+{
+	static constexpr int BinCount = 16;
+	static constexpr uint32_t MaxLeafSize = 8;
+	static constexpr float TraversalCost = 1.0f;	// relative to one triangle test
+	static constexpr int MaxSahDepth = 64;			// deeper nodes split at the median
+	static constexpr int StackSize = 128;
+	static constexpr uint32_t ParallelBuildThreshold = 16384;
+	static constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+	inline Float3 Min(const Float3& a, const Float3& b) { return Float3{ std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+	inline Float3 Max(const Float3& a, const Float3& b) { return Float3{ std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+	inline float Component(const Float3& v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+	struct Aabb
+	{
+		Float3 boundsMin{ Infinity, Infinity, Infinity };
+		Float3 boundsMax{ -Infinity, -Infinity, -Infinity };
+
+		void Grow(const Float3& p) { boundsMin = Min(boundsMin, p); boundsMax = Max(boundsMax, p); }
+		void Grow(const Aabb& b) { boundsMin = Min(boundsMin, b.boundsMin); boundsMax = Max(boundsMax, b.boundsMax); }
+
+		float HalfArea() const
+		{
+			Float3 e = Sub(boundsMax, boundsMin);
+			return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	struct Primitive
+	{
+		Aabb bounds;
+		Float3 centroid;
+	};
+
+	// Top-down binned SAH build over an index permutation. Every subtree is emitted depth
+	// first, so the first child of an interior node always directly follows it.
+	class Builder
+	{
+	public:
+		Builder(const std::vector<Primitive>& primitives, std::vector<uint32_t>& order, JobSystem& jobs) :
+			m_primitives(primitives), m_order(order), m_jobs(jobs) {}
+
+		void BuildNode(uint32_t first, uint32_t count, int depth, unsigned threadCount, std::vector<BvhNode>& nodes)
+		{
+			Aabb bounds, centroids;
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				const Primitive& p = m_primitives[m_order[i]];
+				bounds.Grow(p.bounds);
+				centroids.Grow(p.centroid);
+			}
+
+			const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+			nodes.push_back(BvhNode{ bounds.boundsMin, first, bounds.boundsMax, count });
+
+			uint32_t leftCount = count <= 1 ? 0 : Split(first, count, depth, bounds, centroids);
+			if (leftCount == 0)
+				return;
+
+			BvhNode& node = nodes[nodeIndex];
+			node.count = 0;
+			const uint32_t rightFirst = first + leftCount, rightCount = count - leftCount;
+			if (threadCount > 1 && count >= ParallelBuildThreshold)
+			{
+				// Build the halves into separate arrays and splice them in afterwards.
+				std::vector<BvhNode> left, right;
+				const unsigned leftThreads = threadCount / 2;
+				JobHandle leftJob = m_jobs.Schedule([&]() { BuildNode(first, leftCount, depth + 1, leftThreads, left); });
+				try
+				{
+					BuildNode(rightFirst, rightCount, depth + 1, threadCount - leftThreads, right);
+				}
+				catch (...)
+				{
+					// The left job references this frame, so it has to finish first.
+					try
+					{
+						m_jobs.Wait(leftJob);
+					}
+					catch (...)
+					{
+					}
+					throw;
+				}
+				m_jobs.Wait(leftJob);
+				Append(left, nodes);
+				nodes[nodeIndex].index = static_cast<uint32_t>(nodes.size());
+				Append(right, nodes);
+			}
+			else
+			{
+				BuildNode(first, leftCount, depth + 1, 1, nodes);
+				nodes[nodeIndex].index = static_cast<uint32_t>(nodes.size());
+				BuildNode(rightFirst, rightCount, depth + 1, 1, nodes);
+			}
+		}
+
+	private:
+		static void Append(const std::vector<BvhNode>& subtree, std::vector<BvhNode>& nodes)
+		{
+			const uint32_t base = static_cast<uint32_t>(nodes.size());
+			for (BvhNode node : subtree)
+			{
+				if (node.count == 0)
+					node.index += base;
+				nodes.push_back(node);
+			}
+		}
+
+		// Partitions the range and returns the size of the left half, or 0 to make a leaf.
+		uint32_t Split(uint32_t first, uint32_t count, int depth, const Aabb& bounds, const Aabb& centroids)
+		{
+			const Float3 extent = Sub(centroids.boundsMax, centroids.boundsMin);
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+			if (!(Component(extent, axis) > 0.0f))
+				return count <= MaxLeafSize ? 0 : MedianSplit(first, count, axis);
+			if (depth >= MaxSahDepth)
+				return MedianSplit(first, count, axis);
+
+			float bestCost = Infinity;
+			int bestAxis = -1, bestBin = 0;
+			for (int a = 0; a < 3; ++a)
+			{
+				const float low = Component(centroids.boundsMin, a);
+				const float size = Component(extent, a);
+				if (!(size > 0.0f))
+					continue;
+				const float scale = BinCount / size;
+
+				Aabb binBounds[BinCount];
+				uint32_t binCounts[BinCount] = {};
+				for (uint32_t i = first; i < first + count; ++i)
+				{
+					const Primitive& p = m_primitives[m_order[i]];
+					int bin = std::min(BinCount - 1, static_cast<int>((Component(p.centroid, a) - low) * scale));
+					binBounds[bin].Grow(p.bounds);
+					++binCounts[bin];
+				}
+
+				// Sweep from the right to collect suffix areas, then from the left to evaluate.
+				float rightArea[BinCount];
+				uint32_t rightCounts[BinCount];
+				Aabb accumulated;
+				uint32_t accumulatedCount = 0;
+				for (int b = BinCount - 1; b > 0; --b)
+				{
+					accumulated.Grow(binBounds[b]);
+					accumulatedCount += binCounts[b];
+					rightArea[b] = accumulated.HalfArea();
+					rightCounts[b] = accumulatedCount;
+				}
+				accumulated = Aabb();
+				accumulatedCount = 0;
+				for (int b = 1; b < BinCount; ++b)
+				{
+					accumulated.Grow(binBounds[b - 1]);
+					accumulatedCount += binCounts[b - 1];
+					if (accumulatedCount == 0 || rightCounts[b] == 0)
+						continue;
+					float cost = accumulated.HalfArea() * accumulatedCount + rightArea[b] * rightCounts[b];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = a;
+						bestBin = b;
+					}
+				}
+			}
+
+			const float parentArea = bounds.HalfArea();
+			const float leafCost = static_cast<float>(count);
+			const float splitCost = TraversalCost + (parentArea > 0.0f ? bestCost / parentArea : Infinity);
+			if (bestAxis < 0)
+				return count <= MaxLeafSize ? 0 : MedianSplit(first, count, axis);
+			if (count <= MaxLeafSize && splitCost >= leafCost)
+				return 0;
+
+			const float low = Component(centroids.boundsMin, bestAxis);
+			const float scale = BinCount / Component(extent, bestAxis);
+			uint32_t* begin = m_order.data() + first;
+			uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t t) {
+				return std::min(BinCount - 1, static_cast<int>((Component(m_primitives[t].centroid, bestAxis) - low) * scale)) < bestBin;
+			});
+			return static_cast<uint32_t>(middle - begin);
+		}
+
+		uint32_t MedianSplit(uint32_t first, uint32_t count, int axis)
+		{
+			uint32_t* begin = m_order.data() + first;
+			std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b) {
+				return Component(m_primitives[a].centroid, axis) < Component(m_primitives[b].centroid, axis);
+			});
+			return count / 2;
+		}
+
+		const std::vector<Primitive>& m_primitives;
+		std::vector<uint32_t>& m_order;
+		JobSystem& m_jobs;
+	};
+
+	struct RayState
+	{
+		Float3 origin;
+		Float3 direction;
+		Float3 inverseDirection;
+		float tMin;
+	};
+
+	inline RayState MakeRayState(const Ray& ray)
+	{
+		return RayState{ ray.origin, ray.direction,
+			Float3{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z }, ray.tMin };
+	}
+
+	// Entry distance of the ray into the node, or Infinity if it misses within [tMin, tMax].
+	inline float IntersectNode(const BvhNode& node, const RayState& ray, float tMax)
+	{
+		float tx0 = (node.boundsMin.x - ray.origin.x) * ray.inverseDirection.x, tx1 = (node.boundsMax.x - ray.origin.x) * ray.inverseDirection.x;
+		float ty0 = (node.boundsMin.y - ray.origin.y) * ray.inverseDirection.y, ty1 = (node.boundsMax.y - ray.origin.y) * ray.inverseDirection.y;
+		float tz0 = (node.boundsMin.z - ray.origin.z) * ray.inverseDirection.z, tz1 = (node.boundsMax.z - ray.origin.z) * ray.inverseDirection.z;
+		float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), ray.tMin));
+		float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+		return tNear <= tFar ? tNear : Infinity;
+	}
+
+	// Moller-Trumbore, two-sided.
+	template<typename Triangle>
+	inline bool IntersectTriangle(const Triangle& triangle, const RayState& ray, float tMax, float& t, float& u, float& v)
+	{
+		Float3 p = Cross(ray.direction, triangle.edge2);
+		float determinant = Dot(triangle.edge1, p);
+		if (std::abs(determinant) < 1e-12f)
+			return false;
+		float inverse = 1.0f / determinant;
+		Float3 s = Sub(ray.origin, triangle.v0);
+		u = Dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		Float3 q = Cross(s, triangle.edge1);
+		v = Dot(ray.direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		t = Dot(triangle.edge2, q) * inverse;
+		return t >= ray.tMin && t < tMax;
+	}
+
+	// Shared single-ray traversal; with anyHit it stops at the first intersection.
+	template<typename Triangle>
+	bool Traverse(const std::vector<BvhNode>& nodes, const std::vector<Triangle>& triangles, const Ray& ray, bool anyHit, RayHit& hit)
+	{
+		hit = RayHit{ ray.tMax, BvhMiss, 0.0f, 0.0f };
+		if (nodes.empty())
+			return false;
+		const RayState state = MakeRayState(ray);
+		if (IntersectNode(nodes[0], state, hit.t) == Infinity)
+			return false;
+
+		uint32_t stack[StackSize];
+		int stackSize = 0;
+		uint32_t current = 0;
+		for (;;)
+		{
+			const BvhNode& node = nodes[current];
+			if (node.count != 0)
+			{
+				for (uint32_t i = node.index; i < node.index + node.count; ++i)
+				{
+					float t, u, v;
+					if (IntersectTriangle(triangles[i], state, hit.t, t, u, v))
+					{
+						hit = RayHit{ t, i, u, v };
+						if (anyHit)
+							return true;
+					}
+				}
+			}
+			else
+			{
+				uint32_t nearChild = current + 1, farChild = node.index;
+				float nearDistance = IntersectNode(nodes[nearChild], state, hit.t);
+				float farDistance = IntersectNode(nodes[farChild], state, hit.t);
+				if (farDistance < nearDistance)
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearDistance, farDistance);
+				}
+				if (nearDistance != Infinity)
+				{
+					if (farDistance != Infinity)
+						stack[stackSize++] = farChild;
+					current = nearChild;
+					continue;
+				}
+			}
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+		return hit.triangle != BvhMiss;
+	}
+}
+
+void Bvh::Build(const Float3* positions, const uint32_t* indices, size_t indexCount, JobSystem& jobs)
+{
+	std::vector<Triangle> triangles(indexCount / 3);
+	for (size_t t = 0; t < triangles.size(); ++t)
+	{
+		const Float3& v0 = positions[indices[t * 3]];
+		triangles[t] = Triangle{ v0, Sub(positions[indices[t * 3 + 1]], v0), Sub(positions[indices[t * 3 + 2]], v0) };
+	}
+	BuildTriangles(triangles, jobs);
+}
+
+void Bvh::Build(const MeshBuffers& buffers, uint32_t lod, JobSystem& jobs)
+{
+	const MeshletLod& level = buffers.lods[lod];
+	std::vector<Triangle> triangles;
+	triangles.reserve(level.triangleCount);
+	for (uint32_t m = level.firstMeshlet; m < level.firstMeshlet + level.meshletCount; ++m)
+	{
+		const Meshlet& meshlet = buffers.meshlets[m];
+		auto position = [&](uint32_t i) -> const Float3& {
+			uint32_t index = buffers.indexFormat == IndexFormat::UInt16 ?
+				static_cast<const uint16_t*>(buffers.indices)[i] : static_cast<const uint32_t*>(buffers.indices)[i];
+			return buffers.positions[meshlet.baseVertex + index];
+		};
+		for (uint32_t i = meshlet.startIndex; i + 2 < meshlet.startIndex + meshlet.indexCount; i += 3)
+		{
+			const Float3& v0 = position(i);
+			triangles.push_back(Triangle{ v0, Sub(position(i + 1), v0), Sub(position(i + 2), v0) });
+		}
+	}
+	BuildTriangles(triangles, jobs);
+}
+
+void Bvh::BuildTriangles(std::vector<Triangle>& triangles, JobSystem& jobs)
+{
+	m_nodes.clear();
+	m_triangles.clear();
+	m_triangleIds.clear();
+	if (triangles.empty())
+		return;
+
+	std::vector<Primitive> primitives(triangles.size());
+	std::vector<uint32_t> order(triangles.size());
+	for (size_t t = 0; t < triangles.size(); ++t)
+	{
+		const Triangle& triangle = triangles[t];
+		Primitive& p = primitives[t];
+		p.bounds.Grow(triangle.v0);
+		p.bounds.Grow(Add(triangle.v0, triangle.edge1));
+		p.bounds.Grow(Add(triangle.v0, triangle.edge2));
+		p.centroid = Float3{ (p.bounds.boundsMin.x + p.bounds.boundsMax.x) * 0.5f,
+			(p.bounds.boundsMin.y + p.bounds.boundsMax.y) * 0.5f, (p.bounds.boundsMin.z + p.bounds.boundsMax.z) * 0.5f };
+		order[t] = static_cast<uint32_t>(t);
+	}
+
+	m_nodes.reserve(triangles.size() / 2 + 1);
+	Builder(primitives, order, jobs).BuildNode(0, static_cast<uint32_t>(triangles.size()), 0, jobs.GetThreadCount(), m_nodes);
+	m_nodes.shrink_to_fit();
+
+	// Store the triangles in leaf order so that a leaf reads one contiguous run.
+	m_triangles.resize(triangles.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		m_triangles[i] = triangles[order[i]];
+	m_triangleIds.swap(order);
+}
+
+bool Bvh::Intersect(const Ray& ray, RayHit& hit) const
+{
+	if (!Traverse(m_nodes, m_triangles, ray, false, hit))
+		return false;
+	hit.triangle = m_triangleIds[hit.triangle];
+	return true;
+}
+
+bool Bvh::Occluded(const Ray& ray) const
+{
+	RayHit hit;
+	return Traverse(m_nodes, m_triangles, ray, true, hit);
+}
+
+#if defined(FOGMAP_BVH_SSE2)
+
+namespace
+{
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+}
+
+void Bvh::Intersect(const RayPacket4& packet, RayHit hits[4]) const
+{
+	const __m128 originX = _mm_loadu_ps(packet.originX), originY = _mm_loadu_ps(packet.originY), originZ = _mm_loadu_ps(packet.originZ);
+	const __m128 directionX = _mm_loadu_ps(packet.directionX), directionY = _mm_loadu_ps(packet.directionY), directionZ = _mm_loadu_ps(packet.directionZ);
+	const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+	const __m128 inverseX = _mm_div_ps(one, directionX), inverseY = _mm_div_ps(one, directionY), inverseZ = _mm_div_ps(one, directionZ);
+	const __m128 tMin = _mm_loadu_ps(packet.tMin);
+	__m128 tMax = _mm_loadu_ps(packet.tMax);
+	__m128 hitU = zero, hitV = zero;
+	__m128i hitTriangle = _mm_set1_epi32(-1);
+
+	// Lanes whose ray enters the node before their current closest hit; entry distances of
+	// missing lanes are +inf so the minimum orders children by their nearest active ray.
+	auto intersectNode = [&](const BvhNode& node, float& distance) {
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), originX), inverseX);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), originX), inverseX);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), originY), inverseY);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), originY), inverseY);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), originZ), inverseZ);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), originZ), inverseZ);
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), tMin));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), tMax));
+		__m128 mask = _mm_cmple_ps(tNear, tFar);
+		__m128 entry = Select(mask, tNear, _mm_set1_ps(Infinity));
+		entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+		entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+		distance = _mm_cvtss_f32(entry);
+		return _mm_movemask_ps(mask) != 0;
+	};
+
+	if (!m_nodes.empty())
+	{
+		uint32_t stack[StackSize];
+		int stackSize = 0;
+		uint32_t current = 0;
+		float distance;
+		bool visit = intersectNode(m_nodes[0], distance);
+		while (visit)
+		{
+			const BvhNode& node = m_nodes[current];
+			if (node.count != 0)
+			{
+				for (uint32_t i = node.index; i < node.index + node.count; ++i)
+				{
+					const Triangle& triangle = m_triangles[i];
+					const __m128 e1x = _mm_set1_ps(triangle.edge1.x), e1y = _mm_set1_ps(triangle.edge1.y), e1z = _mm_set1_ps(triangle.edge1.z);
+					const __m128 e2x = _mm_set1_ps(triangle.edge2.x), e2y = _mm_set1_ps(triangle.edge2.y), e2z = _mm_set1_ps(triangle.edge2.z);
+					__m128 px = _mm_sub_ps(_mm_mul_ps(directionY, e2z), _mm_mul_ps(directionZ, e2y));
+					__m128 py = _mm_sub_ps(_mm_mul_ps(directionZ, e2x), _mm_mul_ps(directionX, e2z));
+					__m128 pz = _mm_sub_ps(_mm_mul_ps(directionX, e2y), _mm_mul_ps(directionY, e2x));
+					__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+					__m128 valid = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), determinant), _mm_set1_ps(1e-12f));
+					__m128 inverse = _mm_div_ps(one, determinant);
+					__m128 sx = _mm_sub_ps(originX, _mm_set1_ps(triangle.v0.x));
+					__m128 sy = _mm_sub_ps(originY, _mm_set1_ps(triangle.v0.y));
+					__m128 sz = _mm_sub_ps(originZ, _mm_set1_ps(triangle.v0.z));
+					__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+					__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+					__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+					__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+					__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qx), _mm_mul_ps(directionY, qy)), _mm_mul_ps(directionZ, qz)), inverse);
+					__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+					valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+					valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+					valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, tMin), _mm_cmplt_ps(t, tMax)));
+					if (_mm_movemask_ps(valid) == 0)
+						continue;
+					tMax = Select(valid, t, tMax);
+					hitU = Select(valid, u, hitU);
+					hitV = Select(valid, v, hitV);
+					__m128i validInt = _mm_castps_si128(valid);
+					hitTriangle = _mm_or_si128(_mm_and_si128(validInt, _mm_set1_epi32(static_cast<int>(i))), _mm_andnot_si128(validInt, hitTriangle));
+				}
+			}
+			else
+			{
+				uint32_t nearChild = current + 1, farChild = node.index;
+				float nearDistance, farDistance;
+				bool nearHit = intersectNode(m_nodes[nearChild], nearDistance);
+				bool farHit = intersectNode(m_nodes[farChild], farDistance);
+				if (farHit && (!nearHit || farDistance < nearDistance))
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearHit, farHit);
+				}
+				if (nearHit)
+				{
+					if (farHit)
+						stack[stackSize++] = farChild;
+					current = nearChild;
+					continue;
+				}
+			}
+			visit = stackSize != 0;
+			if (visit)
+				current = stack[--stackSize];
+		}
+	}
+
+	alignas(16) float t[4], u[4], v[4];
+	alignas(16) int32_t triangle[4];
+	_mm_store_ps(t, tMax);
+	_mm_store_ps(u, hitU);
+	_mm_store_ps(v, hitV);
+	_mm_store_si128(reinterpret_cast<__m128i*>(triangle), hitTriangle);
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		uint32_t index = static_cast<uint32_t>(triangle[lane]);
+		hits[lane] = RayHit{ t[lane], index == BvhMiss ? BvhMiss : m_triangleIds[index], u[lane], v[lane] };
+	}
+}
+
+#else
+
+void Bvh::Intersect(const RayPacket4& packet, RayHit hits[4]) const
+{
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		Ray ray{ Float3{ packet.originX[lane], packet.originY[lane], packet.originZ[lane] },
+			Float3{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] }, packet.tMin[lane], packet.tMax[lane] };
+		Intersect(ray, hits[lane]);
+	}
+}
+
+#endif
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include "Meshlet.h"
+
+namespace FogMap
+{
+	class JobSystem;
+
+	struct Ray
+	{
+		Float3 origin;
+		Float3 direction;
+		float tMin;
+		float tMax;
+	};
+
+	// triangle is BvhMiss if nothing was hit; u and v are the barycentrics of vertices 1 and 2.
+	struct RayHit
+	{
+		float t;
+		uint32_t triangle;
+		float u;
+		float v;
+	};
+
+	static constexpr uint32_t BvhMiss = 0xffffffffu;
+
+	// Four rays in SoA form for the packet traversal. Inactive lanes have tMax < tMin.
+	struct RayPacket4
+	{
+		float originX[4], originY[4], originZ[4];
+		float directionX[4], directionY[4], directionZ[4];
+		float tMin[4];
+		float tMax[4];
+	};
+
+	// 32-byte node. Interior nodes (count == 0) have their first child right after them and
+	// the second at index; leaves cover count triangles starting at index.
+	struct BvhNode
+	{
+		Float3 boundsMin;
+		uint32_t index;
+		Float3 boundsMax;
+		uint32_t count;
+	};
+
+	// Bounding volume hierarchy over a triangle list, built with binned SAH. Triangles are
+	// copied in leaf order, so the BVH does not reference the source buffers once built.
+	class Bvh
+	{
+	public:
+		// Triangle ids reported in RayHit are the triangle's position in the index list. Large
+		// subtrees are built as jobs on up to jobs.GetThreadCount() threads.
+		void Build(const Float3* positions, const uint32_t* indices, size_t indexCount, JobSystem& jobs);
+		// Builds over one level of packed mesh buffers; ids count triangles across its meshlets.
+		void Build(const MeshBuffers& buffers, uint32_t lod, JobSystem& jobs);
+
+		bool Intersect(const Ray& ray, RayHit& hit) const;
+		// Any-hit query, for shadow and visibility rays.
+		bool Occluded(const Ray& ray) const;
+		// Closest hits for four rays traversed together; uses SSE where available.
+		void Intersect(const RayPacket4& packet, RayHit hits[4]) const;
+
+		size_t TriangleCount() const { return m_triangles.size(); }
+		const std::vector<BvhNode>& Nodes() const { return m_nodes; }
+
+	private:
+		struct Triangle
+		{
+			Float3 v0;
+			Float3 edge1;
+			Float3 edge2;
+		};
+
+		void BuildTriangles(std::vector<Triangle>& triangles, JobSystem& jobs);
+
+		std::vector<BvhNode> m_nodes;
+		std::vector<Triangle> m_triangles;
+		std::vector<uint32_t> m_triangleIds;
+	};
+}
@@ -1,10 +1,8 @@
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+cbuffer DrawConstantBuffer : register(b1)
 {
-	matrix model;
-	matrix view;
-	matrix projection;
-	matrix lightView;
-	matrix lightProjection;
+	matrix modelViewProjection;
+	matrix modelLightViewProjection;
+	matrix normalMatrix;
 };
 
 struct VertexShaderInput
@@ -23,8 +21,9 @@ struct PixelShaderInput
 PixelShaderInput main(VertexShaderInput input)
 {
 	PixelShaderInput output;
-	output.pos = mul(mul(mul(float4(input.pos, 1.0f), model), view), projection);
+	float4 pos = float4(input.pos, 1.0f);
+	output.pos = mul(pos, modelViewProjection);
 	output.color = input.color;
-	output.lightViewPos = mul(mul(mul(float4(input.pos, 1.0f), model), lightView), lightProjection);
+	output.lightViewPos = mul(pos, modelLightViewProjection);
 	return output;
 }
@@ -0,0 +1,671 @@
+﻿#include "pch.h"
+#include "D3D11Backend.h"
+
+#include "..\Common\DirectXHelper.h"
+#include "VertexPacking.h"
+
+#include <cstring>
+
+using namespace FogMap;
+
+using namespace DirectX;
+
+static_assert(sizeof(MeshAttributes) == sizeof(VertexColorNormal), "MeshAttributes must match the scene input layout");
+static_assert(sizeof(FogCellVertex) == sizeof(VertexPositionColor), "FogCellVertex must match the cell input layout");
+static_assert(sizeof(LightConstants) == sizeof(LightBuffer), "LightConstants must match the lighting constant buffer");
+static_assert(sizeof(Float4x4) == sizeof(XMFLOAT4X4), "Float4x4 must match XMFLOAT4X4");
+static_assert(sizeof(FogRayMarch) == sizeof(FogRayMarchConstantBuffer) - 2 * sizeof(XMFLOAT4X4), "FogRayMarch must match the ray-march constant buffer");
+
+namespace
+{
+	// Row-vector matrix to the column-major layout the shaders read.
+	inline void StoreTransposed(XMFLOAT4X4& out, const Float4x4& m)
+	{
+		XMStoreFloat4x4(&out, XMMatrixTranspose(XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(&m))));
+	}
+
+	// VSSetConstantBuffers1 offsets count 16-byte constants and must be multiples of 16, so every
+	// draw gets a 256-byte slot of the ring.
+	constexpr UINT DrawConstantStride = 16;
+	constexpr UINT DrawConstantSlots = 256;
+	static_assert(sizeof(DrawConstantBuffer) <= DrawConstantStride * 16, "DrawConstantBuffer must fit a ring slot");
+
+	// Passes the bytes of a compiled shader to create on a job. The cache keeps them mapped,
+	// so recreating a lost device reads nothing from disk.
+	JobHandle LoadShader(JobSystem& jobs, AssetCache& assets, const char* filename, std::function<void(const uint8_t*, size_t)> create)
+	{
+		return jobs.Schedule([&assets, filename, create]() {
+			AssetView view;
+			if (!assets.Find(filename, view))
+				throw ref new Platform::FailureException();
+			create(view.data, view.size);
+		});
+	}
+}
+
+D3D11Backend::D3D11Backend(const std::shared_ptr<DX::DeviceResources>& deviceResources, bool packedVertices,
+	const std::function<void(const char*)>& log) :
+	m_deviceResources(deviceResources),
+	m_packedVertices(packedVertices),
+	m_log(log),
+	m_drawConstantCapacity(DrawConstantStride),
+	m_drawConstantOffset(DrawConstantStride),
+	m_indexFormat(DXGI_FORMAT_R16_UINT),
+	m_positionStride(sizeof(Float3)),
+	m_attributeStride(sizeof(MeshAttributes)),
+	m_frameCellVertexCapacity(0),
+	m_frameCellIndexCapacity(0),
+	m_frameCells(false),
+	m_frameTimers{},
+	m_frameTimerIndex(0),
+	m_frameGpuMilliseconds(0.0)
+{
+}
+
+void D3D11Backend::Submit(const FrameDescription& frame)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+	m_stateCache.BeginFrame(context);
+
+	ReadFrameTimer();
+	FrameTimer& timer = m_frameTimers[m_frameTimerIndex];
+	context->Begin(timer.disjoint.Get());
+	context->End(timer.begin.Get());
+
+	m_stateCache.UpdateConstantBuffer(m_sceneLightingBuffer.Get(), &frame.light, sizeof(LightBuffer));
+	m_frameCells = !frame.fogIndices.empty();
+	if (m_frameCells)
+		UploadFrameCells(frame);
+
+	for (const RenderPass& pass : frame.passes)
+	{
+		if (pass.type == PassType::FogRayMarch && !m_fogMarchPixelShader)
+			continue;
+		BeginPass(pass);
+		if (pass.type == PassType::FogRayMarch)
+		{
+			UploadFogRayMarch(frame.fogMarch, pass.transforms);
+			context->Draw(3, 0);
+		}
+		for (uint32_t i = pass.firstDraw; i < pass.firstDraw + pass.drawCount; ++i)
+			context->DrawIndexed(frame.draws[i].indexCount, frame.draws[i].startIndex, frame.draws[i].baseVertex);
+		EndPass(pass);
+	}
+
+	context->End(timer.end.Get());
+	context->End(timer.disjoint.Get());
+	timer.pending = true;
+	m_frameTimerIndex = (m_frameTimerIndex + 1) % FrameTimerCount;
+}
+
+void D3D11Backend::UploadFrameCells(const FrameDescription& frame)
+{
+	auto device = m_deviceResources->GetD3DDevice();
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Grown to the next power of two, so that the slice count can change from frame to frame
+	// without recreating the buffers.
+	auto grow = [](UINT capacity, size_t size) {
+		while (capacity < size)
+			capacity = capacity != 0 ? capacity * 2 : 1024;
+		return capacity;
+	};
+	if (frame.fogVertices.size() > m_frameCellVertexCapacity)
+	{
+		m_frameCellVertexCapacity = grow(m_frameCellVertexCapacity, frame.fogVertices.size());
+		DX::ThrowIfFailed(device->CreateBuffer(
+			&CD3D11_BUFFER_DESC(m_frameCellVertexCapacity * sizeof(FogCellVertex), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE),
+			nullptr,
+			&m_frameCellVertexBuffer
+		));
+	}
+	if (frame.fogIndices.size() > m_frameCellIndexCapacity)
+	{
+		m_frameCellIndexCapacity = grow(m_frameCellIndexCapacity, frame.fogIndices.size());
+		DX::ThrowIfFailed(device->CreateBuffer(
+			&CD3D11_BUFFER_DESC(m_frameCellIndexCapacity * sizeof(uint16_t), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE),
+			nullptr,
+			&m_frameCellIndexBuffer
+		));
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	DX::ThrowIfFailed(context->Map(m_frameCellVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+	std::memcpy(mapped.pData, frame.fogVertices.data(), frame.fogVertices.size() * sizeof(FogCellVertex));
+	context->Unmap(m_frameCellVertexBuffer.Get(), 0);
+	DX::ThrowIfFailed(context->Map(m_frameCellIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+	std::memcpy(mapped.pData, frame.fogIndices.data(), frame.fogIndices.size() * sizeof(uint16_t));
+	context->Unmap(m_frameCellIndexBuffer.Get(), 0);
+}
+
+void D3D11Backend::UploadFogRayMarch(const FogRayMarch& march, const PassTransforms& transforms)
+{
+	FogRayMarchConstantBuffer constants;
+	StoreTransposed(constants.clipToWorld, march.clipToWorld);
+	StoreTransposed(constants.viewProjection, transforms.modelViewProjection);
+	StoreTransposed(constants.lightViewProjection, transforms.modelLightViewProjection);
+	// The rest is laid out alike.
+	std::memcpy(&constants.eyePosition, &march.eyePosition, sizeof(FogRayMarch) - sizeof(Float4x4));
+	m_stateCache.UpdateConstantBuffer(m_fogMarchConstantBuffer.Get(), &constants, sizeof(constants));
+}
+
+void D3D11Backend::ReadFrameTimer()
+{
+	// The oldest set, about to be reused. If the GPU has not got that far the sample is lost
+	// rather than waited for.
+	FrameTimer& timer = m_frameTimers[m_frameTimerIndex];
+	if (!timer.pending)
+		return;
+	timer.pending = false;
+
+	auto context = m_deviceResources->GetD3DDeviceContext();
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	UINT64 begin, end;
+	if (context->GetData(timer.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+		context->GetData(timer.begin.Get(), &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+		context->GetData(timer.end.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+		!disjoint.Disjoint && end > begin)
+	{
+		m_frameGpuMilliseconds = static_cast<double>(end - begin) * 1000.0 / static_cast<double>(disjoint.Frequency);
+	}
+}
+
+void D3D11Backend::BeginPass(const RenderPass& pass)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	const UINT drawConstants = WriteDrawConstants(pass.transforms);
+	m_stateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	if (m_drawConstantCapacity > DrawConstantStride)
+		m_stateCache.SetVSConstantBuffer(1, m_drawConstantBuffer.Get(), drawConstants, DrawConstantStride);
+	else
+		m_stateCache.SetVSConstantBuffer(1, m_drawConstantBuffer.Get());
+
+	switch (pass.type)
+	{
+	case PassType::Shadow:
+	{
+		// The shadow pass only fetches the position stream.
+		ID3D11Buffer* positionBuffer = m_positionBuffer.Get();
+		m_stateCache.SetVertexBuffers(1, &positionBuffer, &m_positionStride);
+		m_stateCache.SetIndexBuffer(m_indexBuffer.Get(), m_indexFormat);
+		m_stateCache.SetInputLayout(m_shadowInputLayout.Get());
+
+		m_stateCache.SetRenderTarget(m_shadowRTV.Get(), m_shadowDSV.Get());
+		static const D3D11_VIEWPORT vp{ 0.0f, 0.0f, float(ShadowMapSize), float(ShadowMapSize), 0.0f, 1.0f };
+		m_stateCache.SetViewport(vp);
+		static const float color[]{ 0.0f, 0.0f, 0.0f, 1.0f };
+		context->ClearRenderTargetView(m_shadowRTV.Get(), color);
+		context->ClearDepthStencilView(m_shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+		m_stateCache.SetVertexShader(m_shadowVertexShader.Get());
+		if (m_packedVertices)
+			m_stateCache.SetVSConstantBuffer(2, m_meshConstantBuffer.Get());
+		m_stateCache.SetPixelShader(m_shadowPixelShader.Get());
+		break;
+	}
+	case PassType::Scene:
+	{
+		m_stateCache.SetRenderTarget(m_deviceResources->GetBackBufferRenderTargetView(), m_deviceResources->GetDepthStencilView());
+		m_stateCache.SetViewport(m_deviceResources->GetScreenViewport());
+
+		ID3D11Buffer* sceneBuffers[]{ m_positionBuffer.Get(), m_attributeBuffer.Get() };
+		UINT sceneStrides[]{ m_positionStride, m_attributeStride };
+		m_stateCache.SetVertexBuffers(2, sceneBuffers, sceneStrides);
+		m_stateCache.SetIndexBuffer(m_indexBuffer.Get(), m_indexFormat);
+		m_stateCache.SetInputLayout(m_inputLayout.Get());
+
+		m_stateCache.SetVertexShader(m_sceneVertexShader.Get());
+		if (m_packedVertices)
+			m_stateCache.SetVSConstantBuffer(2, m_meshConstantBuffer.Get());
+
+		m_stateCache.SetPixelShader(m_scenePixelShader.Get());
+		m_stateCache.SetPSShaderResource(0, m_shadowSRV.Get());
+		m_stateCache.SetPSSampler(0, m_sceneSampler.Get());
+		m_stateCache.SetPSConstantBuffer(0, m_sceneLightingBuffer.Get());
+		break;
+	}
+	case PassType::FogCells:
+	{
+		m_stateCache.SetBlendState(m_blendState.Get());
+
+		ID3D11Buffer* cellVertexBuffer = m_frameCells ? m_frameCellVertexBuffer.Get() : m_cellVertexBuffer.Get();
+		UINT stride = sizeof(VertexPositionColor);
+		m_stateCache.SetVertexBuffers(1, &cellVertexBuffer, &stride);
+		m_stateCache.SetIndexBuffer(m_frameCells ? m_frameCellIndexBuffer.Get() : m_cellIndexBuffer.Get(), DXGI_FORMAT_R16_UINT);
+		m_stateCache.SetInputLayout(m_cellInputLayout.Get());
+
+		m_stateCache.SetVertexShader(m_cellVertexShader.Get());
+
+		m_stateCache.SetPixelShader(m_cellPixelShader.Get());
+		m_stateCache.SetPSShaderResource(0, m_shadowSRV.Get());
+		m_stateCache.SetPSSampler(0, m_sceneSampler.Get());
+		break;
+	}
+	case PassType::FogRayMarch:
+	{
+		// The depth buffer is read, so it cannot stay bound for output; nothing is depth tested.
+		m_stateCache.SetRenderTarget(m_deviceResources->GetBackBufferRenderTargetView(), nullptr);
+		m_stateCache.SetViewport(m_deviceResources->GetScreenViewport());
+		m_stateCache.SetBlendState(m_fogMarchBlendState.Get());
+		m_stateCache.SetInputLayout(nullptr);
+
+		m_stateCache.SetVertexShader(m_fogMarchVertexShader.Get());
+
+		m_stateCache.SetPixelShader(m_fogMarchPixelShader.Get());
+		m_stateCache.SetPSShaderResource(0, m_shadowSRV.Get());
+		m_stateCache.SetPSShaderResource(1, m_deviceResources->GetDepthShaderResourceView());
+		m_stateCache.SetPSSampler(0, m_sceneSampler.Get());
+		m_stateCache.SetPSConstantBuffer(1, m_fogMarchConstantBuffer.Get());
+		break;
+	}
+	}
+}
+
+UINT D3D11Backend::WriteDrawConstants(const PassTransforms& transforms)
+{
+	auto context = m_deviceResources->GetD3DDeviceContext();
+
+	// Appending never touches a slot a queued draw may still read; only a wrap discards, and the
+	// driver renames the buffer for the draws in flight.
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (m_drawConstantOffset + DrawConstantStride > m_drawConstantCapacity)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		m_drawConstantOffset = 0;
+	}
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	DX::ThrowIfFailed(context->Map(m_drawConstantBuffer.Get(), 0, mapType, 0, &mapped));
+	DrawConstantBuffer* constants = reinterpret_cast<DrawConstantBuffer*>(static_cast<uint8_t*>(mapped.pData) + m_drawConstantOffset * 16);
+	StoreTransposed(constants->modelViewProjection, transforms.modelViewProjection);
+	StoreTransposed(constants->modelLightViewProjection, transforms.modelLightViewProjection);
+	StoreTransposed(constants->normal, transforms.normal);
+	context->Unmap(m_drawConstantBuffer.Get(), 0);
+
+	const UINT firstConstant = m_drawConstantOffset;
+	m_drawConstantOffset += DrawConstantStride;
+	return firstConstant;
+}
+
+void D3D11Backend::EndPass(const RenderPass& pass)
+{
+	if (pass.type != PassType::FogCells && pass.type != PassType::FogRayMarch)
+		return;
+
+	// Release shadow map SRV and reset blend state
+	m_stateCache.SetPSShaderResource(0, nullptr);
+	m_stateCache.SetBlendState(nullptr);
+	// The depth buffer can then be bound for output again.
+	if (pass.type == PassType::FogRayMarch)
+		m_stateCache.SetPSShaderResource(1, nullptr);
+}
+
+JobHandle D3D11Backend::CreateDeviceDependentResourcesAsync(JobSystem& jobs, AssetCache& assets)
+{
+	JobHandle createSceneVSJob = LoadShader(jobs, assets, m_packedVertices ? "ScenePackedVertexShader.cso" : "SceneVertexShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(
+			data,
+			size,
+			nullptr,
+			&m_sceneVertexShader
+		));
+
+		// Slot 0 holds positions, slot 1 the remaining attributes.
+		static const D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		static const D3D11_INPUT_ELEMENT_DESC packedVertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(
+			m_packedVertices ? packedVertexDesc : vertexDesc,
+			m_packedVertices ? ARRAYSIZE(packedVertexDesc) : ARRAYSIZE(vertexDesc),
+			data,
+			size,
+			&m_inputLayout
+		));
+		static const float input[]{ 0.0f, 0.0f, 0.0f, 0.0f };
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateSamplerState(
+			&CD3D11_SAMPLER_DESC(D3D11_FILTER_MIN_MAG_MIP_LINEAR,
+				D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_WRAP,
+				0.0f, 1, D3D11_COMPARISON_ALWAYS, input, 0, D3D11_FLOAT32_MAX),
+			&m_sceneSampler
+		));
+	});
+	JobHandle createScenePSJob = LoadShader(jobs, assets, "ScenePixelShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			data,
+			size,
+			nullptr,
+			&m_scenePixelShader
+		));
+		// Passes sub-allocate from a ring when the driver can bind constant-buffer ranges and
+		// map them with NO_OVERWRITE; otherwise every pass discards a single slot.
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+		m_deviceResources->GetD3DDevice()->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+		m_drawConstantCapacity = options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer ?
+			DrawConstantStride * DrawConstantSlots : DrawConstantStride;
+		m_drawConstantOffset = m_drawConstantCapacity;
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&CD3D11_BUFFER_DESC(m_drawConstantCapacity * 16, D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE),
+			nullptr,
+			&m_drawConstantBuffer
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&CD3D11_BUFFER_DESC(sizeof(LightBuffer), D3D11_BIND_CONSTANT_BUFFER),
+			nullptr,
+			&m_sceneLightingBuffer
+		));
+	});
+
+	JobHandle createShadowVSJob = LoadShader(jobs, assets, m_packedVertices ? "ShadowPackedVertexShader.cso" : "ShadowVertexShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(
+			data,
+			size,
+			nullptr,
+			&m_shadowVertexShader
+		));
+
+		static const D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		static const D3D11_INPUT_ELEMENT_DESC packedVertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(
+			m_packedVertices ? packedVertexDesc : vertexDesc,
+			1,
+			data,
+			size,
+			&m_shadowInputLayout
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateTexture2D(
+			&CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_D24_UNORM_S8_UINT, ShadowMapSize, ShadowMapSize, 1, 1, D3D11_BIND_DEPTH_STENCIL),
+			nullptr,
+			&m_shadowDepthStencilBuffer
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateDepthStencilView(
+			m_shadowDepthStencilBuffer.Get(),
+			&CD3D11_DEPTH_STENCIL_VIEW_DESC(m_shadowDepthStencilBuffer.Get(), D3D11_DSV_DIMENSION_TEXTURE2D),
+			&m_shadowDSV
+		));
+	});
+	JobHandle createShadowPSJob = LoadShader(jobs, assets, "ShadowPixelShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			data,
+			size,
+			nullptr,
+			&m_shadowPixelShader
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateTexture2D(
+			&CD3D11_TEXTURE2D_DESC(DXGI_FORMAT_R32G32B32A32_FLOAT, ShadowMapSize, ShadowMapSize, 1, 1, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE),
+			nullptr,
+			&m_shadowTexture
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateRenderTargetView(
+			m_shadowTexture.Get(),
+			&CD3D11_RENDER_TARGET_VIEW_DESC(m_shadowTexture.Get(), D3D11_RTV_DIMENSION_TEXTURE2D),
+			&m_shadowRTV
+		));
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateShaderResourceView(
+			m_shadowTexture.Get(),
+			&CD3D11_SHADER_RESOURCE_VIEW_DESC(m_shadowTexture.Get(), D3D11_SRV_DIMENSION_TEXTURE2D),
+			&m_shadowSRV
+		));
+	});
+
+	JobHandle createCellVSJob = LoadShader(jobs, assets, "CellVertexShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(
+			data,
+			size,
+			nullptr,
+			&m_cellVertexShader
+		));
+
+		static const D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		};
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateInputLayout(
+			vertexDesc,
+			ARRAYSIZE(vertexDesc),
+			data,
+			size,
+			&m_cellInputLayout
+		));
+	});
+	JobHandle createCellPSJob = LoadShader(jobs, assets, "CellPixelShader.cso", [this](const uint8_t* data, size_t size) {
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(
+			data,
+			size,
+			nullptr,
+			&m_cellPixelShader
+		));
+	});
+
+	JobHandle createBlendJob = jobs.Schedule([this]() {
+		D3D11_BLEND_DESC desc;
+		desc.AlphaToCoverageEnable = FALSE;
+		desc.IndependentBlendEnable = FALSE;
+		const D3D11_RENDER_TARGET_BLEND_DESC defaultRenderTargetBlendDesc =
+		{
+			TRUE,
+			D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA, D3D11_BLEND_OP_ADD,
+			D3D11_BLEND_ONE, D3D11_BLEND_ZERO, D3D11_BLEND_OP_ADD,
+			D3D11_COLOR_WRITE_ENABLE_ALL,
+		};
+		for (UINT i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+			desc.RenderTarget[i] = defaultRenderTargetBlendDesc;
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBlendState(&desc, &m_blendState));
+	});
+
+	// Both shaders need shader model 4, and the depth buffer is only readable from 10_0 up.
+	JobHandle createFogMarchVSJob, createFogMarchPSJob;
+	if (m_deviceResources->GetDeviceFeatureLevel() >= D3D_FEATURE_LEVEL_10_0)
+	{
+		createFogMarchVSJob = LoadShader(jobs, assets, "FogRayMarchVertexShader.cso", [this](const uint8_t* data, size_t size) {
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateVertexShader(
+				data,
+				size,
+				nullptr,
+				&m_fogMarchVertexShader
+			));
+		});
+		createFogMarchPSJob = LoadShader(jobs, assets, "FogRayMarchPixelShader.cso", [this](const uint8_t* data, size_t size) {
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreatePixelShader(
+				data,
+				size,
+				nullptr,
+				&m_fogMarchPixelShader
+			));
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+				&CD3D11_BUFFER_DESC(sizeof(FogRayMarchConstantBuffer), D3D11_BIND_CONSTANT_BUFFER),
+				nullptr,
+				&m_fogMarchConstantBuffer
+			));
+
+			// Premultiplied: the shader's colour is the fog's light and its alpha the opacity.
+			D3D11_BLEND_DESC desc;
+			desc.AlphaToCoverageEnable = FALSE;
+			desc.IndependentBlendEnable = FALSE;
+			const D3D11_RENDER_TARGET_BLEND_DESC renderTargetBlendDesc =
+			{
+				TRUE,
+				D3D11_BLEND_ONE, D3D11_BLEND_INV_SRC_ALPHA, D3D11_BLEND_OP_ADD,
+				D3D11_BLEND_ONE, D3D11_BLEND_ZERO, D3D11_BLEND_OP_ADD,
+				D3D11_COLOR_WRITE_ENABLE_ALL,
+			};
+			for (UINT i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+				desc.RenderTarget[i] = renderTargetBlendDesc;
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBlendState(&desc, &m_fogMarchBlendState));
+		});
+	}
+
+	JobHandle createFrameTimersJob = jobs.Schedule([this]() {
+		for (FrameTimer& timer : m_frameTimers)
+		{
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP_DISJOINT), &timer.disjoint));
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), &timer.begin));
+			DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), &timer.end));
+			timer.pending = false;
+		}
+		m_frameTimerIndex = 0;
+	});
+
+	return jobs.Schedule(nullptr, { createSceneVSJob, createScenePSJob, createShadowVSJob, createShadowPSJob,
+		createCellVSJob, createCellPSJob, createFogMarchVSJob, createFogMarchPSJob, createBlendJob, createFrameTimersJob });
+}
+
+void D3D11Backend::SetMesh(const MeshBuffers& buffers)
+{
+	const UINT indexSize = buffers.indexFormat == IndexFormat::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	m_indexFormat = buffers.indexFormat == IndexFormat::UInt16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+	const void* positionData = buffers.positions;
+	const void* attributeData = buffers.attributes;
+	UINT positionSize = sizeof(Float3);
+	UINT attributeSize = sizeof(MeshAttributes);
+	std::vector<PackedPosition> packedPositions;
+	std::vector<PackedNormal> packedNormals;
+	if (m_packedVertices)
+	{
+		// Quantize against the mesh bounds; the colour is uniform across the mesh and moves
+		// into the mesh constant buffer.
+		VertexQuantization quantization = ComputeQuantization(buffers.boundsMin, buffers.boundsMax);
+		packedPositions.resize(buffers.vertexCount);
+		packedNormals.resize(buffers.vertexCount);
+		VertexPackingError error = PackVertices(buffers.positions, buffers.attributes, buffers.vertexCount, quantization,
+			packedPositions.data(), packedNormals.data());
+		LogPackingError(error, m_log);
+		positionData = packedPositions.data();
+		attributeData = packedNormals.data();
+		positionSize = sizeof(PackedPosition);
+		attributeSize = sizeof(PackedNormal);
+
+		const Float3& color = buffers.vertexCount != 0 ? buffers.attributes[0].color : Float3{ 0.0f, 0.0f, 0.0f };
+		MeshConstantBuffer meshConstants{
+			XMFLOAT4(quantization.offset.x, quantization.offset.y, quantization.offset.z, 0.0f),
+			XMFLOAT4(quantization.scale.x, quantization.scale.y, quantization.scale.z, 0.0f),
+			XMFLOAT4(color.x, color.y, color.z, 1.0f) };
+		D3D11_SUBRESOURCE_DATA meshConstantData = { 0 };
+		meshConstantData.pSysMem = &meshConstants;
+		DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+			&CD3D11_BUFFER_DESC(sizeof(MeshConstantBuffer), D3D11_BIND_CONSTANT_BUFFER),
+			&meshConstantData,
+			&m_meshConstantBuffer
+		));
+	}
+	m_positionStride = positionSize;
+	m_attributeStride = attributeSize;
+
+	D3D11_SUBRESOURCE_DATA positionBufferData = { 0 };
+	positionBufferData.pSysMem = positionData;
+	positionBufferData.SysMemPitch = 0;
+	positionBufferData.SysMemSlicePitch = 0;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&CD3D11_BUFFER_DESC(positionSize * buffers.vertexCount, D3D11_BIND_VERTEX_BUFFER),
+		&positionBufferData,
+		&m_positionBuffer
+	));
+
+	D3D11_SUBRESOURCE_DATA attributeBufferData = { 0 };
+	attributeBufferData.pSysMem = attributeData;
+	attributeBufferData.SysMemPitch = 0;
+	attributeBufferData.SysMemSlicePitch = 0;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&CD3D11_BUFFER_DESC(attributeSize * buffers.vertexCount, D3D11_BIND_VERTEX_BUFFER),
+		&attributeBufferData,
+		&m_attributeBuffer
+	));
+
+	D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+	indexBufferData.pSysMem = buffers.indices;
+	indexBufferData.SysMemPitch = 0;
+	indexBufferData.SysMemSlicePitch = 0;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&CD3D11_BUFFER_DESC(indexSize * buffers.indexCount, D3D11_BIND_INDEX_BUFFER),
+		&indexBufferData,
+		&m_indexBuffer
+	));
+}
+
+void D3D11Backend::SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices)
+{
+	D3D11_SUBRESOURCE_DATA vertexBufferData = { 0 };
+	vertexBufferData.pSysMem = vertices.data();
+	vertexBufferData.SysMemPitch = 0;
+	vertexBufferData.SysMemSlicePitch = 0;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&CD3D11_BUFFER_DESC(static_cast<UINT>(vertices.size() * sizeof(FogCellVertex)), D3D11_BIND_VERTEX_BUFFER),
+		&vertexBufferData,
+		&m_cellVertexBuffer
+	));
+
+	D3D11_SUBRESOURCE_DATA indexBufferData = { 0 };
+	indexBufferData.pSysMem = indices.data();
+	indexBufferData.SysMemPitch = 0;
+	indexBufferData.SysMemSlicePitch = 0;
+	DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(
+		&CD3D11_BUFFER_DESC(static_cast<UINT>(indices.size() * sizeof(uint16_t)), D3D11_BIND_INDEX_BUFFER),
+		&indexBufferData,
+		&m_cellIndexBuffer
+	));
+}
+
+void D3D11Backend::ReleaseDeviceDependentResources()
+{
+	m_stateCache.Reset();
+	m_positionBuffer.Reset();
+	m_attributeBuffer.Reset();
+	m_indexBuffer.Reset();
+	m_inputLayout.Reset();
+	m_drawConstantBuffer.Reset();
+	m_meshConstantBuffer.Reset();
+
+	m_sceneLightingBuffer.Reset();
+	m_sceneVertexShader.Reset();
+	m_scenePixelShader.Reset();
+	m_sceneSampler.Reset();
+
+	m_shadowTexture.Reset();
+	m_shadowRTV.Reset();
+	m_shadowSRV.Reset();
+	m_shadowInputLayout.Reset();
+	m_shadowVertexShader.Reset();
+	m_shadowPixelShader.Reset();
+	m_shadowDepthStencilBuffer.Reset();
+	m_shadowDSV.Reset();
+
+	m_cellVertexBuffer.Reset();
+	m_cellIndexBuffer.Reset();
+	m_cellInputLayout.Reset();
+	m_cellVertexShader.Reset();
+	m_cellPixelShader.Reset();
+	m_frameCellVertexBuffer.Reset();
+	m_frameCellIndexBuffer.Reset();
+	m_frameCellVertexCapacity = 0;
+	m_frameCellIndexCapacity = 0;
+
+	m_fogMarchVertexShader.Reset();
+	m_fogMarchPixelShader.Reset();
+	m_fogMarchConstantBuffer.Reset();
+	m_fogMarchBlendState.Reset();
+
+	m_blendState.Reset();
+
+	for (FrameTimer& timer : m_frameTimers)
+	{
+		timer.disjoint.Reset();
+		timer.begin.Reset();
+		timer.end.Reset();
+		timer.pending = false;
+	}
+}
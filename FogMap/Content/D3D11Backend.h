@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include "..\Common\DeviceResources.h"
+#include "AssetCache.h"
+#include "D3D11StateCache.h"
+#include "JobSystem.h"
+#include "RenderBackend.h"
+#include "ShaderStructures.h"
+
+namespace FogMap
+{
+	// RenderBackend on the D3D11 device of DX::DeviceResources, drawing with the compiled .hlsl
+	// shaders. The scene mesh can be uploaded in the packed PackedPosition/PackedNormal layout.
+	// FogRayMarch passes read the depth buffer, which takes feature level 10_0; below it they
+	// are skipped.
+	class D3D11Backend : public RenderBackend
+	{
+	public:
+		// log, if set, receives the packing error of a packed mesh (see RendererSettings::log).
+		D3D11Backend(const std::shared_ptr<DX::DeviceResources>& deviceResources, bool packedVertices,
+			const std::function<void(const char*)>& log);
+
+		// Takes the compiled shaders from assets and creates the pipeline state and render targets
+		// on jobs. SetMesh and SetFogCells may only be called once the returned job has finished.
+		JobHandle CreateDeviceDependentResourcesAsync(JobSystem& jobs, AssetCache& assets);
+		// Drops every device object, so that a lost device can be released and recreated.
+		void ReleaseDeviceDependentResources();
+
+		void SetMesh(const MeshBuffers& buffers) override;
+		void SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices) override;
+		void Submit(const FrameDescription& frame) override;
+
+		// Binds and uploads of the last Submit, including the ones skipped as redundant.
+		const D3D11StateCounters& GetStateCounters() const { return m_stateCache.GetCounters(); }
+		// GPU time of a recent Submit, read back a few frames late so that nothing stalls; 0 until
+		// the first one arrives.
+		double GetFrameGpuMilliseconds() const { return m_frameGpuMilliseconds; }
+
+	private:
+		void BeginPass(const RenderPass& pass);
+		void EndPass(const RenderPass& pass);
+		// Appends the pass's constants to the ring and returns their first constant.
+		UINT WriteDrawConstants(const PassTransforms& transforms);
+		void ReadFrameTimer();
+		void UploadFrameCells(const FrameDescription& frame);
+		void UploadFogRayMarch(const FogRayMarch& march, const PassTransforms& transforms);
+
+		// Timestamps around each Submit, one set per frame that can be in flight.
+		static constexpr UINT FrameTimerCount = 3;
+		struct FrameTimer
+		{
+			Microsoft::WRL::ComPtr<ID3D11Query>	disjoint;
+			Microsoft::WRL::ComPtr<ID3D11Query>	begin;
+			Microsoft::WRL::ComPtr<ID3D11Query>	end;
+			bool pending;
+		};
+
+		std::shared_ptr<DX::DeviceResources> m_deviceResources;
+		bool m_packedVertices;
+		std::function<void(const char*)> m_log;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_positionBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_attributeBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_indexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>			m_inputLayout;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_drawConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_meshConstantBuffer;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_sceneLightingBuffer;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_sceneVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_scenePixelShader;
+		Microsoft::WRL::ComPtr<ID3D11SamplerState>			m_sceneSampler;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_shadowTexture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>		m_shadowRTV;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_shadowSRV;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>			m_shadowInputLayout;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_shadowVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_shadowPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_shadowDepthStencilBuffer;
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilView>		m_shadowDSV;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_cellVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_cellIndexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout>			m_cellInputLayout;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_cellVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_cellPixelShader;
+		// Dynamic, for the fog cells of FrameDescription.
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_frameCellVertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_frameCellIndexBuffer;
+		UINT	m_frameCellVertexCapacity;
+		UINT	m_frameCellIndexCapacity;
+		bool	m_frameCells;
+
+		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_fogMarchVertexShader;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_fogMarchPixelShader;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_fogMarchConstantBuffer;
+		Microsoft::WRL::ComPtr<ID3D11BlendState>			m_fogMarchBlendState;
+
+		Microsoft::WRL::ComPtr<ID3D11BlendState>			m_blendState;
+
+		FrameTimer	m_frameTimers[FrameTimerCount];
+		UINT		m_frameTimerIndex;
+		double		m_frameGpuMilliseconds;
+
+		D3D11StateCache m_stateCache;
+		UINT	m_drawConstantCapacity;		// in 16-byte constants
+		UINT	m_drawConstantOffset;
+		DXGI_FORMAT	m_indexFormat;
+		uint32	m_positionStride;
+		uint32	m_attributeStride;
+	};
+}
@@ -0,0 +1,186 @@
+﻿#include "pch.h"
+#include "D3D11StateCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace FogMap;
+
+D3D11StateCache::D3D11StateCache() :
+	m_context(nullptr)
+{
+	BeginFrame(nullptr);
+}
+
+void D3D11StateCache::BeginFrame(ID3D11DeviceContext1* context)
+{
+	m_context = context;
+	m_counters = D3D11StateCounters{ 0, 0, 0, 0 };
+	m_renderTargetKnown = false;
+	m_viewportKnown = false;
+	m_blendStateKnown = false;
+	m_topologyKnown = false;
+	m_inputLayoutKnown = false;
+	m_indexBufferKnown = false;
+	m_vertexShaderKnown = false;
+	m_pixelShaderKnown = false;
+	std::fill(std::begin(m_vertexBuffersKnown), std::end(m_vertexBuffersKnown), false);
+	std::fill(std::begin(m_vsConstantBuffersKnown), std::end(m_vsConstantBuffersKnown), false);
+	std::fill(std::begin(m_psConstantBuffersKnown), std::end(m_psConstantBuffersKnown), false);
+	std::fill(std::begin(m_psShaderResourcesKnown), std::end(m_psShaderResourcesKnown), false);
+	std::fill(std::begin(m_psSamplersKnown), std::end(m_psSamplersKnown), false);
+}
+
+void D3D11StateCache::Reset()
+{
+	BeginFrame(nullptr);
+	m_uploads.clear();
+}
+
+void D3D11StateCache::SetRenderTarget(ID3D11RenderTargetView* target, ID3D11DepthStencilView* depthStencil)
+{
+	if (m_renderTargetKnown && m_renderTarget == target && m_depthStencil == depthStencil)
+	{
+		++m_counters.bindsSkipped;
+		return;
+	}
+	m_renderTarget = target;
+	m_depthStencil = depthStencil;
+	m_renderTargetKnown = true;
+	++m_counters.bindsIssued;
+	m_context->OMSetRenderTargets(1, &target, depthStencil);
+}
+
+void D3D11StateCache::SetViewport(const D3D11_VIEWPORT& viewport)
+{
+	if (m_viewportKnown && std::memcmp(&m_viewport, &viewport, sizeof(viewport)) == 0)
+	{
+		++m_counters.bindsSkipped;
+		return;
+	}
+	m_viewport = viewport;
+	m_viewportKnown = true;
+	++m_counters.bindsIssued;
+	m_context->RSSetViewports(1, &viewport);
+}
+
+void D3D11StateCache::SetBlendState(ID3D11BlendState* blendState)
+{
+	if (Change(m_blendState, blendState, m_blendStateKnown))
+	{
+		static const float factor[]{ 0.0f, 0.0f, 0.0f, 0.0f };
+		m_context->OMSetBlendState(blendState, factor, 0xffffffff);
+	}
+}
+
+void D3D11StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (Change(m_topology, topology, m_topologyKnown))
+		m_context->IASetPrimitiveTopology(topology);
+}
+
+void D3D11StateCache::SetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	if (Change(m_inputLayout, inputLayout, m_inputLayoutKnown))
+		m_context->IASetInputLayout(inputLayout);
+}
+
+void D3D11StateCache::SetVertexBuffers(UINT count, ID3D11Buffer* const* buffers, const UINT* strides)
+{
+	// One call for the whole range when any slot in it changed.
+	bool changed = false;
+	for (UINT i = 0; i < count; ++i)
+	{
+		changed |= !m_vertexBuffersKnown[i] || m_vertexBuffers[i] != buffers[i] || m_vertexStrides[i] != strides[i];
+		m_vertexBuffers[i] = buffers[i];
+		m_vertexStrides[i] = strides[i];
+		m_vertexBuffersKnown[i] = true;
+	}
+	if (!changed)
+	{
+		++m_counters.bindsSkipped;
+		return;
+	}
+	++m_counters.bindsIssued;
+	static const UINT offsets[MaxSlots]{};
+	m_context->IASetVertexBuffers(0, count, buffers, strides, offsets);
+}
+
+void D3D11StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format)
+{
+	if (m_indexBufferKnown && m_indexBuffer == buffer && m_indexFormat == format)
+	{
+		++m_counters.bindsSkipped;
+		return;
+	}
+	m_indexBuffer = buffer;
+	m_indexFormat = format;
+	m_indexBufferKnown = true;
+	++m_counters.bindsIssued;
+	m_context->IASetIndexBuffer(buffer, format, 0);
+}
+
+void D3D11StateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Change(m_vertexShader, shader, m_vertexShaderKnown))
+		m_context->VSSetShader(shader, nullptr, 0);
+}
+
+void D3D11StateCache::SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT constantCount)
+{
+	if (m_vsConstantBuffersKnown[slot] && m_vsConstantBuffers[slot] == buffer &&
+		m_vsConstantRanges[slot][0] == firstConstant && m_vsConstantRanges[slot][1] == constantCount)
+	{
+		++m_counters.bindsSkipped;
+		return;
+	}
+	m_vsConstantBuffers[slot] = buffer;
+	m_vsConstantRanges[slot][0] = firstConstant;
+	m_vsConstantRanges[slot][1] = constantCount;
+	m_vsConstantBuffersKnown[slot] = true;
+	++m_counters.bindsIssued;
+	if (constantCount == 0)
+		m_context->VSSetConstantBuffers1(slot, 1, &buffer, nullptr, nullptr);
+	else
+		m_context->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+}
+
+void D3D11StateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Change(m_pixelShader, shader, m_pixelShaderKnown))
+		m_context->PSSetShader(shader, nullptr, 0);
+}
+
+void D3D11StateCache::SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+	if (Change(m_psConstantBuffers[slot], buffer, m_psConstantBuffersKnown[slot]))
+		m_context->PSSetConstantBuffers1(slot, 1, &buffer, nullptr, nullptr);
+}
+
+void D3D11StateCache::SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view)
+{
+	if (Change(m_psShaderResources[slot], view, m_psShaderResourcesKnown[slot]))
+		m_context->PSSetShaderResources(slot, 1, &view);
+}
+
+void D3D11StateCache::SetPSSampler(UINT slot, ID3D11SamplerState* sampler)
+{
+	if (Change(m_psSamplers[slot], sampler, m_psSamplersKnown[slot]))
+		m_context->PSSetSamplers(slot, 1, &sampler);
+}
+
+void D3D11StateCache::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+	auto upload = std::find_if(m_uploads.begin(), m_uploads.end(), [buffer](const UploadedBuffer& u) { return u.buffer == buffer; });
+	if (upload == m_uploads.end())
+		upload = m_uploads.insert(m_uploads.end(), UploadedBuffer{ buffer, {} });
+	else if (upload->contents.size() == size && std::memcmp(upload->contents.data(), data, size) == 0)
+	{
+		++m_counters.uploadsSkipped;
+		return;
+	}
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	upload->contents.assign(bytes, bytes + size);
+	++m_counters.uploadsIssued;
+	m_context->UpdateSubresource1(buffer, 0, NULL, data, 0, 0, 0);
+}
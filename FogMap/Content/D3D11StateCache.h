@@ -0,0 +1,116 @@
+﻿#pragma once
+
+#include <vector>
+
+namespace FogMap
+{
+	// Binds and constant-buffer uploads of one frame, split into the calls that reached the
+	// context and the ones the cache dropped because the state was already in place.
+	struct D3D11StateCounters
+	{
+		uint32_t bindsIssued;
+		uint32_t bindsSkipped;
+		uint32_t uploadsIssued;
+		uint32_t uploadsSkipped;
+	};
+
+	// Shadows the pipeline state D3D11Backend binds and forwards only the calls that change it.
+	// Bindings are forgotten by BeginFrame, since the app and Direct2D rebind the context
+	// between frames; constant-buffer contents are kept until Reset, so an upload of unchanged
+	// data is dropped even across frames. Only offset-0 vertex buffers, single-slot views and
+	// vertex shader constant-buffer ranges are supported, which is all the backend uses.
+	class D3D11StateCache
+	{
+	public:
+		static constexpr UINT MaxSlots = 4;
+
+		D3D11StateCache();
+
+		void BeginFrame(ID3D11DeviceContext1* context);
+		// Forgets the uploaded contents too; call when the buffers are released.
+		void Reset();
+		const D3D11StateCounters& GetCounters() const { return m_counters; }
+
+		void SetRenderTarget(ID3D11RenderTargetView* target, ID3D11DepthStencilView* depthStencil);
+		void SetViewport(const D3D11_VIEWPORT& viewport);
+		void SetBlendState(ID3D11BlendState* blendState);
+
+		void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+		void SetInputLayout(ID3D11InputLayout* inputLayout);
+		void SetVertexBuffers(UINT count, ID3D11Buffer* const* buffers, const UINT* strides);
+		void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format);
+
+		void SetVertexShader(ID3D11VertexShader* shader);
+		// firstConstant and constantCount select a range in 16-byte constants, as for
+		// VSSetConstantBuffers1; a count of 0 binds the whole buffer.
+		void SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer, UINT firstConstant = 0, UINT constantCount = 0);
+		void SetPixelShader(ID3D11PixelShader* shader);
+		void SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer);
+		void SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view);
+		void SetPSSampler(UINT slot, ID3D11SamplerState* sampler);
+
+		// UpdateSubresource1 of a whole constant buffer, dropped when the buffer already holds
+		// exactly these bytes.
+		void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, UINT size);
+
+	private:
+		// Returns whether the call has to be issued, and records the new value if so.
+		template <typename T>
+		bool Change(T& current, const T& value, bool& known)
+		{
+			if (known && current == value)
+			{
+				++m_counters.bindsSkipped;
+				return false;
+			}
+			current = value;
+			known = true;
+			++m_counters.bindsIssued;
+			return true;
+		}
+
+		struct UploadedBuffer
+		{
+			ID3D11Buffer* buffer;
+			std::vector<uint8_t> contents;
+		};
+
+		ID3D11DeviceContext1* m_context;
+		D3D11StateCounters m_counters;
+
+		ID3D11RenderTargetView* m_renderTarget;
+		ID3D11DepthStencilView* m_depthStencil;
+		bool m_renderTargetKnown;
+		D3D11_VIEWPORT m_viewport;
+		bool m_viewportKnown;
+		ID3D11BlendState* m_blendState;
+		bool m_blendStateKnown;
+
+		D3D11_PRIMITIVE_TOPOLOGY m_topology;
+		bool m_topologyKnown;
+		ID3D11InputLayout* m_inputLayout;
+		bool m_inputLayoutKnown;
+		ID3D11Buffer* m_vertexBuffers[MaxSlots];
+		UINT m_vertexStrides[MaxSlots];
+		bool m_vertexBuffersKnown[MaxSlots];
+		ID3D11Buffer* m_indexBuffer;
+		DXGI_FORMAT m_indexFormat;
+		bool m_indexBufferKnown;
+
+		ID3D11VertexShader* m_vertexShader;
+		bool m_vertexShaderKnown;
+		ID3D11Buffer* m_vsConstantBuffers[MaxSlots];
+		UINT m_vsConstantRanges[MaxSlots][2];
+		bool m_vsConstantBuffersKnown[MaxSlots];
+		ID3D11PixelShader* m_pixelShader;
+		bool m_pixelShaderKnown;
+		ID3D11Buffer* m_psConstantBuffers[MaxSlots];
+		bool m_psConstantBuffersKnown[MaxSlots];
+		ID3D11ShaderResourceView* m_psShaderResources[MaxSlots];
+		bool m_psShaderResourcesKnown[MaxSlots];
+		ID3D11SamplerState* m_psSamplers[MaxSlots];
+		bool m_psSamplersKnown[MaxSlots];
+
+		std::vector<UploadedBuffer> m_uploads;
+	};
+}
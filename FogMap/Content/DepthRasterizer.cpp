@@ -0,0 +1,160 @@
+﻿#include "DepthRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace FogMap;
+
+namespace
+{
+	struct ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	inline ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t)
+	{
+		return ClipVertex{ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+	}
+
+	// Sutherland-Hodgman against the plane distance(v) >= 0. Returns the new vertex count.
+	template<typename Distance>
+	int ClipPolygon(const ClipVertex* in, int count, ClipVertex* out, Distance distance)
+	{
+		int written = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			float da = distance(a), db = distance(b);
+			if (da >= 0.0f)
+				out[written++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				out[written++] = Lerp(a, b, da / (da - db));
+		}
+		return written;
+	}
+
+	struct ScreenVertex
+	{
+		float x, y, z;
+	};
+
+	// Edges that are exactly hit by a pixel centre belong to the triangle only if they are top
+	// or left edges; with clockwise winding in y-down screen space those run right or upwards.
+	inline bool IsTopLeft(const ScreenVertex& a, const ScreenVertex& b)
+	{
+		return (a.y == b.y && b.x > a.x) || b.y < a.y;
+	}
+
+	void RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, DepthTarget& target)
+	{
+		const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (!(area > 0.0f))
+			return;
+
+		int minX = std::max(0, static_cast<int>(std::floor(std::min({ v0.x, v1.x, v2.x }) - 0.5f)));
+		int minY = std::max(0, static_cast<int>(std::floor(std::min({ v0.y, v1.y, v2.y }) - 0.5f)));
+		int maxX = std::min(static_cast<int>(target.width) - 1, static_cast<int>(std::ceil(std::max({ v0.x, v1.x, v2.x }))));
+		int maxY = std::min(static_cast<int>(target.height) - 1, static_cast<int>(std::ceil(std::max({ v0.y, v1.y, v2.y }))));
+
+		const bool topLeft0 = IsTopLeft(v1, v2), topLeft1 = IsTopLeft(v2, v0), topLeft2 = IsTopLeft(v0, v1);
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const float py = y + 0.5f;
+			float* row = &target.depth[size_t(y) * target.width];
+			for (int x = minX; x <= maxX; ++x)
+			{
+				const float px = x + 0.5f;
+				float w0 = (v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x);
+				float w1 = (v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x);
+				float w2 = (v1.x - v0.x) * (py - v0.y) - (v1.y - v0.y) * (px - v0.x);
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f ||
+					(w0 == 0.0f && !topLeft0) || (w1 == 0.0f && !topLeft1) || (w2 == 0.0f && !topLeft2))
+					continue;
+
+				float z = (w0 * v0.z + w1 * v1.z + w2 * v2.z) / area;
+				if (z < row[x])
+					row[x] = z;
+			}
+		}
+	}
+
+	inline uint32_t ReadIndex(const void* indices, IndexFormat format, size_t i)
+	{
+		return format == IndexFormat::UInt16 ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+	}
+}
+
+void FogMap::ResizeDepthTarget(DepthTarget& target, uint32_t width, uint32_t height, float clearValue)
+{
+	target.width = width;
+	target.height = height;
+	target.depth.assign(size_t(width) * height, clearValue);
+}
+
+void FogMap::RasterizeDepth(const void* positions, size_t stride, const void* indices, IndexFormat indexFormat,
+	uint32_t startIndex, uint32_t indexCount, int32_t baseVertex, const Float4x4& transform, DepthTarget& target)
+{
+	const uint8_t* base = static_cast<const uint8_t*>(positions);
+	const float halfWidth = target.width * 0.5f, halfHeight = target.height * 0.5f;
+
+	for (uint32_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		ClipVertex polygon[5], clipped[5];
+		for (int i = 0; i < 3; ++i)
+		{
+			Float3 p;
+			std::memcpy(&p, base + (int64_t(ReadIndex(indices, indexFormat, startIndex + t + i)) + baseVertex) * stride, sizeof(p));
+			Float4 clip = TransformPoint(p, transform);
+			polygon[i] = ClipVertex{ clip.x, clip.y, clip.z, clip.w };
+		}
+
+		// Each plane adds at most one vertex, so two planes keep a triangle within five.
+		int count = ClipPolygon(polygon, 3, clipped, [](const ClipVertex& v) { return v.z; });
+		count = ClipPolygon(clipped, count, polygon, [](const ClipVertex& v) { return v.w - v.z; });
+		if (count < 3)
+			continue;
+
+		ScreenVertex screen[5];
+		for (int i = 0; i < count; ++i)
+		{
+			const ClipVertex& v = polygon[i];
+			screen[i] = ScreenVertex{ (v.x / v.w + 1.0f) * halfWidth, (1.0f - v.y / v.w) * halfHeight, v.z / v.w };
+		}
+		for (int i = 1; i + 1 < count; ++i)
+			RasterizeTriangle(screen[0], screen[i], screen[i + 1], target);
+	}
+}
+
+void FogMap::RasterizeDepth(const MeshBuffers& buffers, uint32_t lod, const Float4x4& transform, DepthTarget& target)
+{
+	const MeshletLod& level = buffers.lods[lod];
+	for (uint32_t i = level.firstMeshlet; i < level.firstMeshlet + level.meshletCount; ++i)
+	{
+		const Meshlet& meshlet = buffers.meshlets[i];
+		RasterizeDepth(buffers.positions, sizeof(Float3), buffers.indices, buffers.indexFormat,
+			meshlet.startIndex, meshlet.indexCount, static_cast<int32_t>(meshlet.baseVertex), transform, target);
+	}
+}
+
+DepthComparison FogMap::CompareDepth(const DepthTarget& a, const DepthTarget& b)
+{
+	DepthComparison result{ 0, 0.0f };
+	if (a.width != b.width || a.height != b.height)
+	{
+		result.differingPixels = std::max(a.depth.size(), b.depth.size());
+		result.maxDifference = 1.0f;
+		return result;
+	}
+	for (size_t i = 0; i < a.depth.size(); ++i)
+	{
+		if (a.depth[i] != b.depth[i])
+		{
+			++result.differingPixels;
+			result.maxDifference = std::max(result.maxDifference, std::abs(a.depth[i] - b.depth[i]));
+		}
+	}
+	return result;
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include "MatrixMath.h"
+#include "Meshlet.h"
+
+namespace FogMap
+{
+	// Single-channel float render target, row-major with row 0 at the top.
+	struct DepthTarget
+	{
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> depth;
+	};
+
+	void ResizeDepthTarget(DepthTarget& target, uint32_t width, uint32_t height, float clearValue = 1.0f);
+
+	// Reference rasterizer for the shadow pass. Transforms the positions found stride bytes
+	// apart by transform and rasterizes the indexed triangles the way D3D11 does with the
+	// default rasterizer state: clip to 0 <= z <= w, clockwise front faces with back faces
+	// culled, top-left fill rule at pixel centres, LESS depth test. Like ShadowPixelShader it
+	// writes z / w.
+	void RasterizeDepth(const void* positions, size_t stride, const void* indices, IndexFormat indexFormat,
+		uint32_t startIndex, uint32_t indexCount, int32_t baseVertex, const Float4x4& transform, DepthTarget& target);
+
+	// Draws one level of packed mesh buffers meshlet by meshlet, as MainRenderer does.
+	void RasterizeDepth(const MeshBuffers& buffers, uint32_t lod, const Float4x4& transform, DepthTarget& target);
+
+	struct DepthComparison
+	{
+		size_t differingPixels;
+		float maxDifference;
+	};
+
+	DepthComparison CompareDepth(const DepthTarget& a, const DepthTarget& b);
+}
@@ -0,0 +1,293 @@
+﻿#include "EpipolarSampler.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+using namespace FogMap;
+
+namespace
+{
+	// The part (enter, exit) of the line origin + t * direction inside [0, width] x [0, height];
+	// false if it misses.
+	bool ClipToRectangle(float originX, float originY, float directionX, float directionY, float width, float height,
+		float& enter, float& exit)
+	{
+		enter = -std::numeric_limits<float>::max();
+		exit = std::numeric_limits<float>::max();
+		const float origin[2]{ originX, originY }, direction[2]{ directionX, directionY }, size[2]{ width, height };
+		for (int k = 0; k < 2; ++k)
+		{
+			if (direction[k] == 0.0f)
+			{
+				if (origin[k] < 0.0f || origin[k] > size[k])
+					return false;
+				continue;
+			}
+			float t0 = -origin[k] / direction[k], t1 = (size[k] - origin[k]) / direction[k];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			enter = std::max(enter, t0);
+			exit = std::min(exit, t1);
+		}
+		return exit > enter;
+	}
+
+	// The edge of [0, width] x [0, height] as one closed path of length 2 * (width + height), clockwise from the
+	// top-left corner.
+	void PerimeterPoint(float p, float width, float height, float& x, float& y)
+	{
+		if (p < width)
+		{
+			x = p;
+			y = 0.0f;
+		}
+		else if (p < width + height)
+		{
+			x = width;
+			y = p - width;
+		}
+		else if (p < 2.0f * width + height)
+		{
+			x = 2.0f * width + height - p;
+			y = height;
+		}
+		else
+		{
+			x = 0.0f;
+			y = 2.0f * (width + height) - p;
+		}
+	}
+
+	// Inverse of PerimeterPoint for a point on the edge, taking the nearest side.
+	float PerimeterPosition(float x, float y, float width, float height)
+	{
+		const float distances[4]{ std::fabs(y), std::fabs(width - x), std::fabs(height - y), std::fabs(x) };
+		const int side = static_cast<int>(std::min_element(distances, distances + 4) - distances);
+		switch (side)
+		{
+		case 0: return std::min(std::max(x, 0.0f), width);
+		case 1: return width + std::min(std::max(y, 0.0f), height);
+		case 2: return width + height + std::min(std::max(width - x, 0.0f), width);
+		default: return 2.0f * width + height + std::min(std::max(height - y, 0.0f), height);
+		}
+	}
+}
+
+void FogMap::ProjectLightDirection(const Float3& lightDirection, const Float4x4& viewProjection, uint32_t width, uint32_t height,
+	float& x, float& y)
+{
+	const Float4 clip = Transform(Float4{ -lightDirection.x, -lightDirection.y, -lightDirection.z, 0.0f }, viewProjection);
+	// Offset from the screen centre in pixels, times w.
+	float offsetX = clip.x * 0.5f * width, offsetY = -clip.y * 0.5f * height;
+	const float length = std::sqrt(offsetX * offsetX + offsetY * offsetY);
+	const float limit = 64.0f * (width + height);
+	const float scale = std::fabs(clip.w) * limit > length ? 1.0f / clip.w : (clip.w < 0.0f ? -limit : limit) / std::max(length, 1e-30f);
+	x = 0.5f * width + offsetX * scale;
+	y = 0.5f * height + offsetY * scale;
+}
+
+EpipolarSampler::EpipolarSampler() :
+	m_left(0.0f),
+	m_top(0.0f),
+	m_width(0),
+	m_height(0),
+	m_lightX(0.0f),
+	m_lightY(0.0f),
+	m_counters{ 0, 0, 0, 0, 0 },
+	m_fallbackRays(0),
+	m_fallbackSamples(0)
+{
+}
+
+void EpipolarSampler::Build(const FogEpipolarSettings& settings, uint32_t left, uint32_t top, uint32_t width, uint32_t height,
+	float lightX, float lightY, const FogRaySource& source, JobSystem& jobs)
+{
+	m_settings = settings;
+	m_settings.lineCount = std::max(m_settings.lineCount, 1u);
+	m_settings.lineSamples = std::max(m_settings.lineSamples, 2u);
+	m_settings.marchStep = std::max(m_settings.marchStep, 1u);
+	// Lines are laid out relative to the rectangle's top-left corner.
+	m_left = static_cast<float>(left);
+	m_top = static_cast<float>(top);
+	m_width = width;
+	m_height = height;
+	m_lightX = lightX - m_left;
+	m_lightY = lightY - m_top;
+	lightX = m_lightX;
+	lightY = m_lightY;
+	m_counters = EpipolarCounters{ 0, 0, 0, 0, 0 };
+	m_fallbackRays = 0;
+	m_fallbackSamples = 0;
+
+	// A line belongs to the edge point where it leaves the rectangle; an edge point the light's
+	// ray enters through leaves elsewhere, and that line is already in the set.
+	const uint32_t lineCount = m_settings.lineCount;
+	const float w = static_cast<float>(width), h = static_cast<float>(height);
+	const float perimeter = 2.0f * (w + h);
+	m_lines.resize(lineCount);
+	for (uint32_t i = 0; i < lineCount; ++i)
+	{
+		Line& line = m_lines[i];
+		PerimeterPoint((i + 0.5f) * perimeter / lineCount, w, h, line.endX, line.endY);
+		const float dx = line.endX - lightX, dy = line.endY - lightY;
+		const float outward = line.endY == 0.0f ? -dy : line.endX == w ? dx : line.endY == h ? dy : -dx;
+		float enter, exit;
+		line.valid = outward > 0.0f && ClipToRectangle(lightX, lightY, dx, dy, w, h, enter, exit) && enter < 1.0f;
+		enter = std::max(enter, 0.0f);
+		line.startX = lightX + enter * dx;
+		line.startY = lightY + enter * dy;
+		const float lineX = line.endX - line.startX, lineY = line.endY - line.startY;
+		const float length2 = lineX * lineX + lineY * lineY;
+		line.valid &= length2 > 0.0f;
+		line.stepX = lineX / (m_settings.lineSamples - 1);
+		line.stepY = lineY / (m_settings.lineSamples - 1);
+		line.indexX = line.valid ? lineX / length2 * (m_settings.lineSamples - 1) : 0.0f;
+		line.indexY = line.valid ? lineY / length2 * (m_settings.lineSamples - 1) : 0.0f;
+		m_counters.lines += line.valid;
+	}
+
+	m_samples.resize(size_t(lineCount) * m_settings.lineSamples);
+	std::atomic<uint64_t> coarseRays(0), refinedRays(0), samples(0);
+	jobs.ParallelFor(lineCount, 4, [&](size_t begin, size_t end) {
+		uint64_t coarse = 0, refined = 0, taken = 0;
+		for (size_t line = begin; line < end; ++line)
+		{
+			if (m_lines[line].valid)
+				BuildLine(static_cast<uint32_t>(line), source, coarse, refined, taken);
+		}
+		coarseRays.fetch_add(coarse, std::memory_order_relaxed);
+		refinedRays.fetch_add(refined, std::memory_order_relaxed);
+		samples.fetch_add(taken, std::memory_order_relaxed);
+	});
+	m_counters.coarseRays = coarseRays.load();
+	m_counters.refinedRays = refinedRays.load();
+	m_counters.samples = samples.load();
+}
+
+void EpipolarSampler::BuildLine(uint32_t index, const FogRaySource& source, uint64_t& coarseRays, uint64_t& refinedRays, uint64_t& samples)
+{
+	const Line& line = m_lines[index];
+	const uint32_t count = m_settings.lineSamples;
+	Sample* lineSamples = &m_samples[size_t(index) * count];
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		lineSamples[i].depth = source.SceneDepth(m_left + line.startX + i * line.stepX, m_top + line.startY + i * line.stepY);
+		lineSamples[i].marched = false;
+	}
+
+	// Every marchStep-th sample and both sides of every depth edge are marched; between two
+	// marched samples there is then no edge.
+	const auto march = [&](uint32_t i) {
+		samples += source.March(m_left + line.startX + i * line.stepX, m_top + line.startY + i * line.stepY, lineSamples[i].result);
+		lineSamples[i].marched = true;
+	};
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const bool edge = i + 1 < count && IsDepthEdge(lineSamples[i].depth, lineSamples[i + 1].depth);
+		if (i % m_settings.marchStep == 0 || i + 1 == count || edge || (i > 0 && IsDepthEdge(lineSamples[i - 1].depth, lineSamples[i].depth)))
+		{
+			march(i);
+			++(i % m_settings.marchStep == 0 || i + 1 == count ? coarseRays : refinedRays);
+		}
+	}
+
+	// Where two marched samples disagree a shadow boundary lies between them: bisect down to
+	// the boundary and interpolate the rest.
+	const std::function<void(uint32_t, uint32_t)> refine = [&](uint32_t a, uint32_t b) {
+		const FogRayResult& first = lineSamples[a].result;
+		const FogRayResult& last = lineSamples[b].result;
+		if (b - a < 2)
+			return;
+		if (std::fabs(first.scattering - last.scattering) > m_settings.scatteringThreshold ||
+			std::fabs(first.transmittance - last.transmittance) > m_settings.scatteringThreshold)
+		{
+			const uint32_t middle = (a + b) / 2;
+			march(middle);
+			++refinedRays;
+			refine(a, middle);
+			refine(middle, b);
+			return;
+		}
+		for (uint32_t i = a + 1; i < b; ++i)
+		{
+			const float t = float(i - a) / (b - a);
+			lineSamples[i].result.scattering = first.scattering + (last.scattering - first.scattering) * t;
+			lineSamples[i].result.transmittance = first.transmittance + (last.transmittance - first.transmittance) * t;
+		}
+	};
+	for (uint32_t a = 0, b = 1; b < count; ++b)
+	{
+		if (lineSamples[b].marched)
+		{
+			refine(a, b);
+			a = b;
+		}
+	}
+}
+
+bool EpipolarSampler::IsDepthEdge(float a, float b) const
+{
+	return std::fabs(a - b) > m_settings.depthThreshold * std::min(a, b);
+}
+
+void EpipolarSampler::Resolve(uint32_t x, uint32_t y, const FogRaySource& source, FogRayResult& result) const
+{
+	const float px = x + 0.5f - m_left, py = y + 0.5f - m_top;
+	const float dx = px - m_lightX, dy = py - m_lightY;
+	const float w = static_cast<float>(m_width), h = static_cast<float>(m_height);
+	float enter, exit;
+	float weightSum = 0.0f;
+	result = FogRayResult{ 0.0f, 0.0f };
+	if ((dx != 0.0f || dy != 0.0f) && ClipToRectangle(m_lightX, m_lightY, dx, dy, w, h, enter, exit))
+	{
+		// Lines either side of where the pixel's own line leaves the screen.
+		const uint32_t lineCount = m_settings.lineCount, count = m_settings.lineSamples;
+		const float position = PerimeterPosition(m_lightX + exit * dx, m_lightY + exit * dy, w, h) * lineCount / (2.0f * (w + h)) - 0.5f;
+		const float lineFloor = std::floor(position);
+		const float lineWeight[2]{ 1.0f - (position - lineFloor), position - lineFloor };
+		const uint32_t first = lineFloor < 0.0f ? lineCount - 1 : std::min(static_cast<uint32_t>(lineFloor), lineCount - 1);
+		const float depth = source.SceneDepth(x + 0.5f, y + 0.5f);
+		for (uint32_t k = 0; k < 2; ++k)
+		{
+			const uint32_t index = first + k < lineCount ? first + k : first + k - lineCount;
+			const Line& line = m_lines[index];
+			if (!line.valid || lineWeight[k] <= 0.0f)
+				continue;
+			float t = (px - line.startX) * line.indexX + (py - line.startY) * line.indexY;
+			t = std::min(std::max(t, 0.0f), float(count - 1));
+			const uint32_t i = std::min(static_cast<uint32_t>(t), count - 2);
+			const float sampleWeight[2]{ 1.0f - (t - i), t - i };
+			const Sample* samples = &m_samples[size_t(index) * count + i];
+			for (uint32_t j = 0; j < 2; ++j)
+			{
+				const float weight = lineWeight[k] * sampleWeight[j];
+				if (weight <= 0.0f || IsDepthEdge(depth, samples[j].depth))
+					continue;
+				result.scattering += samples[j].result.scattering * weight;
+				result.transmittance += samples[j].result.transmittance * weight;
+				weightSum += weight;
+			}
+		}
+	}
+	// Samples with a tenth of the weight between them are too far from the pixel to stand for it.
+	if (weightSum > 0.1f)
+	{
+		result.scattering /= weightSum;
+		result.transmittance /= weightSum;
+		return;
+	}
+	const uint32_t samples = source.March(x + 0.5f, y + 0.5f, result);
+	m_fallbackRays.fetch_add(1, std::memory_order_relaxed);
+	m_fallbackSamples.fetch_add(samples, std::memory_order_relaxed);
+}
+
+EpipolarCounters EpipolarSampler::GetCounters() const
+{
+	EpipolarCounters counters = m_counters;
+	counters.fallbackRays = m_fallbackRays.load();
+	counters.samples += m_fallbackSamples.load();
+	return counters;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "FogCells.h"
+
+#include <atomic>
+#include <vector>
+
+namespace FogMap
+{
+	class JobSystem;
+
+	// The pass whose rays an EpipolarSampler places. Points are in pixels of the render target,
+	// pixel (x, y) covering [x, x + 1) x [y, y + 1).
+	class FogRaySource
+	{
+	public:
+		virtual ~FogRaySource() {}
+
+		// View depth of the scene under the point.
+		virtual float SceneDepth(float x, float y) const = 0;
+		// Marches the ray through the point up to the scene; returns the samples taken.
+		virtual uint32_t March(float x, float y, FogRayResult& result) const = 0;
+	};
+
+	struct EpipolarCounters
+	{
+		uint32_t lines;				// that cross the screen
+		uint64_t coarseRays;		// marched every marchStep samples along a line
+		uint64_t refinedRays;		// marched at depth edges and between rays that disagree
+		uint64_t fallbackRays;		// pixels that found no line sample at their depth
+		uint64_t samples;			// fog samples taken by all of them
+	};
+
+	// Screen position in pixels of the point at infinity a directional light comes from, or
+	// when it lies behind the camera, of the one its rays run towards; either is where the
+	// epipolar lines meet. A light nearly parallel to the image plane is pulled in to 64 screen
+	// sizes from the centre, where the lines are as good as parallel. Row 0 is at the top.
+	void ProjectLightDirection(const Float3& lightDirection, const Float4x4& viewProjection, uint32_t width, uint32_t height,
+		float& x, float& y);
+
+	// In-scattering from a directional light changes smoothly along the screen lines through the
+	// light's projection, and sharply only where the lines cross a shadow boundary or a depth
+	// edge of the scene. Build marches rays at a few samples per line and refines only at depth
+	// edges and where two of them disagree; Resolve then interpolates every pixel from the samples around it.
+	class EpipolarSampler
+	{
+	public:
+		EpipolarSampler();
+
+		// Lays out settings.lineCount lines from (lightX, lightY), which may lie outside, to points
+		// evenly spaced around the edge of the pixels [left, left + width) x [top, top + height),
+		// the part of the target the fog covers. Drops those that miss it, and marches and
+		// interpolates lineSamples samples along each, spread over the jobs.
+		void Build(const FogEpipolarSettings& settings, uint32_t left, uint32_t top, uint32_t width, uint32_t height,
+			float lightX, float lightY, const FogRaySource& source, JobSystem& jobs);
+		// The fog of pixel (x, y) of the rectangle, interpolated from the two nearest samples on
+		// each of the two nearest lines that lie at the pixel's depth. With too little weight on
+		// such samples the pixel's own ray is marched. Safe to call from several threads after
+		// Build.
+		void Resolve(uint32_t x, uint32_t y, const FogRaySource& source, FogRayResult& result) const;
+
+		// Of the last Build and the Resolve calls since.
+		EpipolarCounters GetCounters() const;
+
+	private:
+		struct Line
+		{
+			float startX, startY;
+			float endX, endY;		// on the screen edge
+			float stepX, stepY;		// between samples
+			float indexX, indexY;	// sample index per pixel along the line
+			bool valid;
+		};
+
+		struct Sample
+		{
+			FogRayResult result;
+			float depth;
+			bool marched;
+		};
+
+		void BuildLine(uint32_t line, const FogRaySource& source, uint64_t& coarseRays, uint64_t& refinedRays, uint64_t& samples);
+		bool IsDepthEdge(float a, float b) const;
+
+		FogEpipolarSettings m_settings;
+		float m_left;
+		float m_top;
+		uint32_t m_width;
+		uint32_t m_height;
+		float m_lightX;			// relative to (m_left, m_top)
+		float m_lightY;
+		std::vector<Line> m_lines;
+		// lineCount x lineSamples, line by line.
+		std::vector<Sample> m_samples;
+
+		EpipolarCounters m_counters;
+		mutable std::atomic<uint64_t> m_fallbackRays;
+		mutable std::atomic<uint64_t> m_fallbackSamples;
+	};
+}
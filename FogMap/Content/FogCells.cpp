@@ -0,0 +1,189 @@
+﻿#include "FogCells.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace FogMap;
+
+namespace
+{
+	// Rows of the view matrix's rotation: view depth is -z, and x and y run right and up.
+	inline Float3 ViewAxis(const Float4x4& view)
+	{
+		return Float3{ -view.m[0][2], -view.m[1][2], -view.m[2][2] };
+	}
+
+	// View depths of the volume's corners and their range beyond nearZ; false if the volume
+	// is empty or entirely in front of nearZ.
+	bool ViewDepthRange(const FogSettings& settings, const Float4x4& view, float nearZ, Float3* corners, float* depths,
+		float& nearest, float& farthest)
+	{
+		const Float3 axis = ViewAxis(view);
+		const float offset = -view.m[3][2];
+		const Float3& lo = settings.boundsMin;
+		const Float3& hi = settings.boundsMax;
+		nearest = std::numeric_limits<float>::max();
+		farthest = -std::numeric_limits<float>::max();
+		for (int i = 0; i < 8; ++i)
+		{
+			corners[i] = Float3{ (i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y, (i & 4) ? hi.z : lo.z };
+			depths[i] = Dot(axis, corners[i]) + offset;
+			nearest = std::min(nearest, depths[i]);
+			farthest = std::max(farthest, depths[i]);
+		}
+		nearest = std::max(nearest, nearZ);
+		return farthest > nearest && hi.z > lo.z;
+	}
+
+	// Alpha of slices spacing apart in view depth, from the optical depth per unit of the
+	// volume's z extent.
+	inline float ViewSliceAlpha(const FogSettings& settings, float spacing)
+	{
+		return static_cast<float>(-std::expm1(-static_cast<double>(settings.opticalDepth) / (settings.boundsMax.z - settings.boundsMin.z) * spacing));
+	}
+}
+
+float FogMap::FogSliceAlpha(float opticalDepth, uint32_t sliceCount)
+{
+	return static_cast<float>(-std::expm1(-static_cast<double>(opticalDepth) / sliceCount));
+}
+
+void FogMap::BuildFogCells(const FogSettings& settings, const Float4& diffuseColor, std::vector<FogCellVertex>& vertices,
+	std::vector<uint16_t>& indices, std::vector<FogCellLevel>& levels)
+{
+	const uint32_t maxSlices = std::min(std::max(settings.sliceCount, 1u), FogMaxSliceCount);
+	const uint32_t minSlices = settings.frameBudgetMs > 0.0f ? std::min(std::max(settings.minSliceCount, 1u), maxSlices) : maxSlices;
+	levels.clear();
+	for (uint32_t slices = maxSlices;; slices = std::max(slices / 2, minSlices))
+	{
+		const uint32_t baseVertex = levels.empty() ? 0 : levels.back().baseVertex + levels.back().vertexCount;
+		const uint32_t firstIndex = levels.empty() ? 0 : levels.back().firstIndex + levels.back().indexCount;
+		levels.push_back(FogCellLevel{ slices, firstIndex, slices * 6, baseVertex, slices * 4, FogSliceAlpha(settings.opticalDepth, slices) });
+		if (slices == minSlices)
+			break;
+	}
+	vertices.resize(levels.back().baseVertex + levels.back().vertexCount);
+	indices.resize(levels.back().firstIndex + levels.back().indexCount);
+
+	const Float3& lo = settings.boundsMin;
+	const Float3& hi = settings.boundsMax;
+	for (const FogCellLevel& level : levels)
+	{
+		const Float4 color{ diffuseColor.x, diffuseColor.y, diffuseColor.z, level.alpha };
+		FogCellVertex* cellVertices = vertices.data() + level.baseVertex;
+		uint16_t* cellIndices = indices.data() + level.firstIndex;
+		for (uint32_t z = 0; z < level.sliceCount; ++z)
+		{
+			const float depth = z * (hi.z - lo.z) / level.sliceCount + lo.z;
+			cellVertices[z * 4 + 0] = FogCellVertex{ Float3{ lo.x, lo.y, depth }, color };
+			cellVertices[z * 4 + 1] = FogCellVertex{ Float3{ hi.x, lo.y, depth }, color };
+			cellVertices[z * 4 + 2] = FogCellVertex{ Float3{ lo.x, hi.y, depth }, color };
+			cellVertices[z * 4 + 3] = FogCellVertex{ Float3{ hi.x, hi.y, depth }, color };
+
+			const uint16_t base = static_cast<uint16_t>(z * 4);
+			cellIndices[z * 6 + 0] = base + 0;
+			cellIndices[z * 6 + 1] = base + 2;
+			cellIndices[z * 6 + 2] = base + 1;
+			cellIndices[z * 6 + 3] = base + 1;
+			cellIndices[z * 6 + 4] = base + 2;
+			cellIndices[z * 6 + 5] = base + 3;
+		}
+	}
+}
+
+void FogMap::BuildViewFogSlices(const FogSettings& settings, uint32_t sliceCount, const Float4& diffuseColor, const Float4x4& view,
+	float nearZ, std::vector<FogCellVertex>& vertices, std::vector<uint16_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	const Float3 right{ view.m[0][0], view.m[1][0], view.m[2][0] };
+	const Float3 up{ view.m[0][1], view.m[1][1], view.m[2][1] };
+
+	Float3 corners[8];
+	float depths[8];
+	float nearest, farthest;
+	if (!ViewDepthRange(settings, view, nearZ, corners, depths, nearest, farthest))
+		return;
+
+	const uint32_t slices = std::min(std::max(sliceCount, 1u), FogMaxViewSliceCount);
+	const float spacing = (farthest - nearest) / slices;
+	const Float4 color{ diffuseColor.x, diffuseColor.y, diffuseColor.z, ViewSliceAlpha(settings, spacing) };
+
+	// Corner pairs along x, y and z.
+	static const int edges[12][2]{ { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+	vertices.reserve(size_t(slices) * 6);
+	indices.reserve(size_t(slices) * 12);
+	for (uint32_t s = 0; s < slices; ++s)
+	{
+		const float depth = farthest - (s + 0.5f) * spacing;
+		Float3 points[6];
+		int count = 0;
+		for (const auto& edge : edges)
+		{
+			const float da = depths[edge[0]] - depth, db = depths[edge[1]] - depth;
+			if ((da < 0.0f) != (db < 0.0f) && count < 6)
+				points[count++] = Add(corners[edge[0]], Scale(Sub(corners[edge[1]], corners[edge[0]]), da / (da - db)));
+		}
+		if (count < 3)
+			continue;
+
+		// The cut of a box by a plane is convex: order it by angle around its centre, clockwise
+		// on screen so that it faces the camera.
+		Float3 center{ 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < count; ++i)
+			center = Add(center, points[i]);
+		center = Scale(center, 1.0f / count);
+		float angles[6];
+		int order[6];
+		for (int i = 0; i < count; ++i)
+		{
+			const Float3 d = Sub(points[i], center);
+			angles[i] = std::atan2(Dot(d, up), Dot(d, right));
+			order[i] = i;
+		}
+		std::sort(order, order + count, [&angles](int a, int b) { return angles[a] > angles[b]; });
+
+		const uint16_t base = static_cast<uint16_t>(vertices.size());
+		for (int i = 0; i < count; ++i)
+			vertices.push_back(FogCellVertex{ points[order[i]], color });
+		for (int i = 1; i + 1 < count; ++i)
+		{
+			indices.push_back(base);
+			indices.push_back(static_cast<uint16_t>(base + i));
+			indices.push_back(static_cast<uint16_t>(base + i + 1));
+		}
+	}
+}
+
+void FogMap::BuildFogRayMarch(const FogSettings& settings, uint32_t sliceCount, const Float4& diffuseColor, const Float4x4& view,
+	const Float4x4& projection, float nearZ, FogRayMarch& march)
+{
+	march.clipToWorld = MatrixInverse(MatrixMultiply(view, projection));
+	// The view matrix is a rotation after a translation by -eye.
+	const Float3 translation{ view.m[3][0], view.m[3][1], view.m[3][2] };
+	march.eyePosition = Float3{
+		-(translation.x * view.m[0][0] + translation.y * view.m[0][1] + translation.z * view.m[0][2]),
+		-(translation.x * view.m[1][0] + translation.y * view.m[1][1] + translation.z * view.m[1][2]),
+		-(translation.x * view.m[2][0] + translation.y * view.m[2][1] + translation.z * view.m[2][2]) };
+	march.viewAxis = ViewAxis(view);
+	march.boundsMin = settings.boundsMin;
+	march.boundsMax = settings.boundsMax;
+	march.color = diffuseColor;
+
+	Float3 corners[8];
+	float depths[8];
+	float nearest, farthest;
+	if (!ViewDepthRange(settings, view, nearZ, corners, depths, nearest, farthest))
+	{
+		march.firstDepth = march.spacing = march.alpha = march.sampleCount = 0.0f;
+		return;
+	}
+	const uint32_t samples = std::min(std::max(sliceCount, 1u), FogMaxViewSliceCount);
+	march.spacing = (farthest - nearest) / samples;
+	march.firstDepth = farthest - 0.5f * march.spacing;
+	march.alpha = ViewSliceAlpha(settings, march.spacing);
+	march.sampleCount = static_cast<float>(samples);
+}
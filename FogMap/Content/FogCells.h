@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include "MatrixMath.h"
+#include "MeshData.h"
+
+namespace FogMap
+{
+	// Same memory layout as VertexPositionColor.
+	struct FogCellVertex
+	{
+		Float3 pos;
+		Float4 color;
+	};
+
+	// A level has its own vertex range and 16-bit indices, so that is the limit on its slices.
+	constexpr uint32_t FogMaxSliceCount = 16384;
+	// View-aligned slices have up to six vertices each.
+	constexpr uint32_t FogMaxViewSliceCount = 65536 / 6;
+	// A marched ray stops once less of the background than this shows through: whatever lies
+	// behind cannot move an 8-bit channel by half a step any more.
+	constexpr float FogRayMarchMinTransmittance = 1.0f / 512.0f;
+
+	enum class FogSlicing
+	{
+		WorldZ,			// quads at constant z, built once
+		ViewAligned,	// camera-facing polygons clipped to the volume, built every frame
+		RayMarch,		// the view-aligned samples taken per pixel by one full-screen pass
+		Epipolar,		// RayMarch, marching only rays on epipolar lines of the light (CPU
+						// reference; other backends march every pixel)
+		Froxel,			// RayMarch's integral read from a froxel grid filled once per frame
+						// (CPU reference; other backends march every pixel)
+	};
+
+	// Epipolar sampling of the FogRayMarch pass. Lines radiate from the light's screen position
+	// across the fog's screen rectangle; rays are marched at every marchStep-th of their samples
+	// and on both sides of every depth edge, then by bisection wherever two marched rays still
+	// disagree. The other samples are interpolated along the line, and every pixel from the two
+	// lines nearest it.
+	struct FogEpipolarSettings
+	{
+		uint32_t lineCount = 512;			// 0 marches every pixel
+		uint32_t lineSamples = 256;
+		uint32_t marchStep = 16;
+		float depthThreshold = 0.05f;		// relative view-depth change that counts as an edge
+		float scatteringThreshold = 0.02f;	// of scattering or transmittance between marched rays
+	};
+
+	// The frustum-aligned grid of the FogRayMarch pass (FogSlicing::Froxel), see FroxelGrid.
+	struct FogFroxelSettings
+	{
+		uint32_t width = 160;				// 0 marches every pixel
+		uint32_t height = 90;
+		uint32_t depth = 64;				// slices over the fog's depth range
+		// Weight of the reprojected previous frame in every froxel; 0 turns off the reprojection
+		// and with it the depth jitter.
+		float historyWeight = 0.9f;
+		// The weight instead in frames whose light view differs from the previous frame's, so the
+		// shadows in the fog catch up with a moving light within a few frames.
+		float movingLightHistoryWeight = 0.5f;
+	};
+
+	struct FogSettings
+	{
+		Float3 boundsMin = Float3{ -4.5f, 0.0f, -2.0f };
+		Float3 boundsMax = Float3{ 4.5f, 4.0f, 2.0f };
+		FogSlicing slicing = FogSlicing::WorldZ;
+		uint32_t sliceCount = 64;		// the fixed count, or the most the adaptive mode uses; samples
+										// along the view axis for RayMarch and Epipolar
+		// Optical depth of the whole volume along z; the per-slice alpha follows from it, so the
+		// fog is equally dense at any slice count. The default is 64 slices of alpha 0.03.
+		float opticalDepth = 1.9493892f;
+		// Adaptive mode: frame time the slice count is fitted to, 0 for a fixed count. Levels
+		// halve the slice count down to minSliceCount.
+		float frameBudgetMs = 0.0f;
+		uint32_t minSliceCount = 8;
+		FogEpipolarSettings epipolar;
+		FogFroxelSettings froxels;
+	};
+
+	// One slice count; its quads are vertices [baseVertex, baseVertex + vertexCount) and
+	// indices [firstIndex, firstIndex + indexCount), relative to baseVertex.
+	struct FogCellLevel
+	{
+		uint32_t sliceCount;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		float alpha;
+	};
+
+	// 1 - exp(-opticalDepth / sliceCount): sliceCount slices of this alpha let through
+	// exp(-opticalDepth) of the background.
+	float FogSliceAlpha(float opticalDepth, uint32_t sliceCount);
+
+	// The fog volume as quads at constant z spanning the x and y bounds, stacked back to front
+	// from boundsMin.z. Level 0 has settings.sliceCount slices; in adaptive mode every further
+	// level halves that down to minSliceCount. Every vertex gets the light's diffuse colour and
+	// the level's slice alpha.
+	void BuildFogCells(const FogSettings& settings, const Float4& diffuseColor, std::vector<FogCellVertex>& vertices,
+		std::vector<uint16_t>& indices, std::vector<FogCellLevel>& levels);
+
+	// Slices facing the camera of the right-handed view matrix: planes perpendicular to the view
+	// axis, evenly spaced in view depth over the part of the volume beyond nearZ, each clipped
+	// to the volume and triangulated as a fan, back to front. Every pixel then gets samples in
+	// proportion to its path through the fog, and the alpha comes from the optical depth per
+	// unit of the volume's z extent and the slice spacing.
+	void BuildViewFogSlices(const FogSettings& settings, uint32_t sliceCount, const Float4& diffuseColor, const Float4x4& view,
+		float nearZ, std::vector<FogCellVertex>& vertices, std::vector<uint16_t>& indices);
+
+	// Parameters of the FogRayMarch pass, in the memory layout of FogRayMarchConstantBuffer
+	// without its light matrix. A pixel's ray runs from the eye to the world position of its
+	// scene depth; it is sampled where it crosses the planes BuildViewFogSlices would place,
+	// depth firstDepth - s * spacing for s in [0, sampleCount), nearest first.
+	struct FogRayMarch
+	{
+		Float4x4 clipToWorld;	// inverse of view * projection
+		Float3 eyePosition;
+		float firstDepth;		// view depth of the farthest sample plane
+		Float3 viewAxis;		// unit, view depth per world unit
+		float spacing;
+		Float3 boundsMin;
+		float alpha;			// of one sample, as of one view-aligned slice
+		Float3 boundsMax;
+		float sampleCount;
+		Float4 color;
+	};
+
+	// The fog along one ray: the light it adds, as a fraction of the fog colour, and the share of
+	// the background that shows through.
+	struct FogRayResult
+	{
+		float scattering;
+		float transmittance;
+	};
+
+	// The ray-march equivalent of BuildViewFogSlices(settings, sliceCount, ...), for the same
+	// integral in one pass. sampleCount is 0 when no part of the volume lies beyond nearZ.
+	void BuildFogRayMarch(const FogSettings& settings, uint32_t sliceCount, const Float4& diffuseColor, const Float4x4& view,
+		const Float4x4& projection, float nearZ, FogRayMarch& march);
+}
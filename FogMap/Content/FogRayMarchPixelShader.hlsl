@@ -0,0 +1,82 @@
+Texture2D shadowMap : register(t0);
+Texture2D<float> sceneDepth : register(t1);
+SamplerState samplerClamp : register(s0);
+
+cbuffer FogRayMarchConstantBuffer : register(b1)
+{
+	matrix clipToWorld;
+	matrix viewProjection;
+	matrix lightViewProjection;
+	float3 eyePosition;
+	float firstDepth;
+	float3 viewAxis;
+	float spacing;
+	float3 boundsMin;
+	float sampleAlpha;
+	float3 boundsMax;
+	float sampleCount;
+	float4 fogColor;
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float2 ndc : TEXCOORD0;
+};
+
+// The fog in front of the scene, premultiplied: its light in rgb and its opacity in a.
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+	// The pixel's ray, from the eye (t = 0) to the far plane (t = 1).
+	float4 end = mul(float4(input.ndc, 1.0f, 1.0f), clipToWorld);
+	float3 ray = end.xyz / end.w - eyePosition;
+	float rayDepth = dot(ray, viewAxis);
+
+	// The part of the ray inside the volume.
+	float3 t0 = (boundsMin - eyePosition) / ray;
+	float3 t1 = (boundsMax - eyePosition) / ray;
+	float3 tNear = min(t0, t1);
+	float3 tFar = max(t0, t1);
+	float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.0f));
+	float exit = min(min(tFar.x, tFar.y), min(tFar.z, 1.0f));
+	if (!(exit > enter) || !(rayDepth > 0.0f) || sampleCount <= 0.0f)
+		discard;
+
+	// Sample planes between the two view depths, nearest first, until one fails the depth
+	// test a slice fragment there would fail.
+	int nearest = (int)min(floor((firstDepth - enter * rayDepth) / spacing), sampleCount - 1.0f);
+	int farthest = (int)max(ceil((firstDepth - exit * rayDepth) / spacing), 0.0f);
+	uint depthBits = (uint)(sceneDepth.Load(int3(input.pos.xy, 0)) * 16777215.0f + 0.5f);
+	float3 light = float3(0.0f, 0.0f, 0.0f);
+	float transmittance = 1.0f;
+	int samples = 0;
+	for (int s = nearest; s >= farthest; --s)
+	{
+		float4 position = float4(eyePosition + ray * ((firstDepth - s * spacing) / rayDepth), 1.0f);
+		float4 clipPos = mul(position, viewProjection);
+		if ((uint)(saturate(clipPos.z / clipPos.w) * 16777215.0f + 0.5f) >= depthBits)
+			break;
+
+		// The shadow test of CellPixelShader.
+		float4 lightViewPos = mul(position, lightViewProjection);
+		float2 projectTexCoord = float2(lightViewPos.x / lightViewPos.w / 2.0f + 0.5f, -lightViewPos.y / lightViewPos.w / 2.0f + 0.5f);
+		float visibility = 1.0f;
+		if ((saturate(projectTexCoord.x) == projectTexCoord.x) && (saturate(projectTexCoord.y) == projectTexCoord.y))
+		{
+			float selfDepth = lightViewPos.z / lightViewPos.w - 0.001f;
+			if (selfDepth > shadowMap.SampleLevel(samplerClamp, projectTexCoord, 0).r)
+				visibility = 0.0f;
+		}
+
+		float alpha = sampleAlpha * visibility;
+		light += transmittance * alpha * fogColor.rgb;
+		transmittance *= 1.0f - alpha;
+		++samples;
+		// FogRayMarchMinTransmittance: nothing behind can move an 8-bit channel by half a step.
+		if (transmittance < 1.0f / 512.0f)
+			break;
+	}
+	if (samples == 0)
+		discard;
+	return float4(light, 1.0f - transmittance);
+}
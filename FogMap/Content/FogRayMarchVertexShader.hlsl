@@ -0,0 +1,15 @@
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float2 ndc : TEXCOORD0;
+};
+
+// One clockwise triangle covering the screen, (-1, -1), (-1, 3), (3, -1), drawn without
+// vertex buffers.
+PixelShaderInput main(uint id : SV_VertexID)
+{
+	PixelShaderInput output;
+	output.ndc = float2(id == 2 ? 3.0f : -1.0f, id == 1 ? 3.0f : -1.0f);
+	output.pos = float4(output.ndc, 0.0f, 1.0f);
+	return output;
+}
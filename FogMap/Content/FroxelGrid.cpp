@@ -0,0 +1,262 @@
+﻿#include "FroxelGrid.h"
+#include "JobSystem.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace FogMap;
+
+namespace
+{
+	// Jitter sequences repeat after this many frames.
+	constexpr uint32_t JitterPeriod = 16;
+
+	// Van der Corput sequence in base 2: 1/2, 1/4, 3/4, 1/8, ...
+	float RadicalInverse(uint32_t index)
+	{
+		float value = 0.0f, scale = 0.5f;
+		for (; index != 0; index >>= 1, scale *= 0.5f)
+			value += (index & 1) * scale;
+		return value;
+	}
+
+	inline bool SameBounds(const Float3& a, const Float3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	inline bool SameMatrix(const Float4x4& a, const Float4x4& b)
+	{
+		return std::memcmp(a.m, b.m, sizeof(a.m)) == 0;
+	}
+}
+
+FroxelGrid::FroxelGrid() :
+	m_frame{},
+	m_previous{},
+	m_hasHistory(false),
+	m_frameIndex(0),
+	m_timings{ 0.0, 0.0 }
+{
+	m_settings.width = m_settings.height = m_settings.depth = 0;
+}
+
+void FroxelGrid::Reset()
+{
+	m_hasHistory = false;
+	m_frameIndex = 0;
+}
+
+void FroxelGrid::Build(const FogFroxelSettings& settings, const FogRayMarch& march, const Float4x4& viewProjection,
+	const Float4x4& lightViewProjection, const FogLightSource& light, JobSystem& jobs)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+
+	FogFroxelSettings grid = settings;
+	grid.width = std::max(grid.width, 1u);
+	grid.height = std::max(grid.height, 1u);
+	grid.depth = std::max(grid.depth, 1u);
+	grid.historyWeight = std::min(std::max(grid.historyWeight, 0.0f), 0.99f);
+	grid.movingLightHistoryWeight = std::min(std::max(grid.movingLightHistoryWeight, 0.0f), grid.historyWeight);
+	if (grid.width != m_settings.width || grid.height != m_settings.height || grid.depth != m_settings.depth)
+		m_hasHistory = false;
+	m_settings = grid;
+
+	// Last frame's froxels become the history.
+	std::swap(m_density, m_history);
+	const size_t columns = size_t(grid.width) * grid.height, count = columns * grid.depth;
+	m_density.resize(count);
+	m_history.resize(count);
+	m_integrated.resize(count);
+
+	m_frame.viewProjection = viewProjection;
+	m_frame.lightViewProjection = lightViewProjection;
+	m_frame.eyePosition = march.eyePosition;
+	m_frame.viewAxis = march.viewAxis;
+	m_frame.boundsMin = march.boundsMin;
+	m_frame.boundsMax = march.boundsMax;
+	m_timings = FroxelTimings{ 0.0, 0.0 };
+	if (!(march.sampleCount > 0.0f))
+	{
+		m_frame.sliceDepth = 0.0f;
+		m_hasHistory = false;
+		return;
+	}
+	// The depth range the march's samples stand for, half a spacing either side of them.
+	const float farDepth = march.firstDepth + 0.5f * march.spacing;
+	m_frame.nearDepth = farDepth - march.sampleCount * march.spacing;
+	m_frame.sliceDepth = (farDepth - m_frame.nearDepth) / grid.depth;
+	if (!SameBounds(m_frame.boundsMin, m_previous.boundsMin) || !SameBounds(m_frame.boundsMax, m_previous.boundsMax))
+		m_hasHistory = false;
+
+	// Every sample blends away alpha of what lies behind it over one spacing.
+	const float extinction = -std::log1p(-std::min(march.alpha, 0.999999f)) / march.spacing;
+	const float jitter = grid.historyWeight > 0.0f ? RadicalInverse(m_frameIndex % JitterPeriod + 1) : 0.5f;
+	const float historyWeight = SameMatrix(m_frame.lightViewProjection, m_previous.lightViewProjection) ?
+		grid.historyWeight : grid.movingLightHistoryWeight;
+	jobs.ParallelFor(columns, 64, [&](size_t begin, size_t end) {
+		for (size_t column = begin; column < end; ++column)
+			FillColumn(static_cast<uint32_t>(column % grid.width), static_cast<uint32_t>(column / grid.width), march, extinction, jitter,
+				historyWeight, light);
+	});
+	const Clock::time_point filled = Clock::now();
+
+	const float sliceDepth = m_frame.sliceDepth;
+	jobs.ParallelFor(columns, 64, [&](size_t begin, size_t end) {
+		for (size_t column = begin; column < end; ++column)
+		{
+			const float* density = &m_density[column * grid.depth];
+			FogRayResult* integrated = &m_integrated[column * grid.depth];
+			float scattering = 0.0f, transmittance = 1.0f;
+			for (uint32_t k = 0; k < grid.depth; ++k)
+			{
+				if (density[k] > 0.0f)
+				{
+					const float alpha = 1.0f - std::exp(-density[k] * sliceDepth);
+					scattering += transmittance * alpha;
+					transmittance -= transmittance * alpha;
+				}
+				integrated[k] = FogRayResult{ scattering, transmittance };
+			}
+		}
+	});
+	const Clock::time_point integratedTime = Clock::now();
+
+	m_timings.fillMs = std::chrono::duration<double, std::milli>(filled - start).count();
+	m_timings.integrateMs = std::chrono::duration<double, std::milli>(integratedTime - filled).count();
+	m_previous = m_frame;
+	m_hasHistory = grid.historyWeight > 0.0f;
+	++m_frameIndex;
+}
+
+void FroxelGrid::FillColumn(uint32_t x, uint32_t y, const FogRayMarch& march, float extinction, float jitter, float historyWeight,
+	const FogLightSource& light)
+{
+	const uint32_t depth = m_settings.depth;
+	float* column = &m_density[Column(x, y)];
+	std::fill(column, column + depth, 0.0f);
+
+	// The ray through the cell's centre, scaled to one unit of view depth.
+	const Float4 end = Transform(Float4{ (x + 0.5f) / m_settings.width * 2.0f - 1.0f, 1.0f - (y + 0.5f) / m_settings.height * 2.0f, 1.0f, 1.0f },
+		march.clipToWorld);
+	const Float3& eye = march.eyePosition;
+	Float3 ray{ end.x / end.w - eye.x, end.y / end.w - eye.y, end.z / end.w - eye.z };
+	const float rayDepth = Dot(ray, march.viewAxis);
+	if (!(rayDepth > 0.0f))
+		return;
+	ray = Scale(ray, 1.0f / rayDepth);
+
+	// The view depths of the ray inside the volume; froxels clear of them stay empty and
+	// skip the reprojection.
+	float enter = 0.0f, exit = std::numeric_limits<float>::max();
+	const float origin[3]{ eye.x, eye.y, eye.z }, direction[3]{ ray.x, ray.y, ray.z };
+	const float lo[3]{ march.boundsMin.x, march.boundsMin.y, march.boundsMin.z };
+	const float hi[3]{ march.boundsMax.x, march.boundsMax.y, march.boundsMax.z };
+	for (int k = 0; k < 3; ++k)
+	{
+		if (direction[k] == 0.0f)
+		{
+			if (origin[k] < lo[k] || origin[k] > hi[k])
+				return;
+			continue;
+		}
+		float t0 = (lo[k] - origin[k]) / direction[k], t1 = (hi[k] - origin[k]) / direction[k];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		enter = std::max(enter, t0);
+		exit = std::min(exit, t1);
+	}
+	if (!(exit > enter))
+		return;
+	const float nearDepth = m_frame.nearDepth, sliceDepth = m_frame.sliceDepth;
+	const uint32_t first = static_cast<uint32_t>(std::min(std::max(std::floor((enter - nearDepth) / sliceDepth), 0.0f), float(depth)));
+	const uint32_t last = static_cast<uint32_t>(std::min(std::max(std::ceil((exit - nearDepth) / sliceDepth), 0.0f), float(depth)));
+
+	// Along the ray the previous frame's clip position and view depth are linear in view depth.
+	const Float4 previousOrigin = TransformPoint(eye, m_previous.viewProjection);
+	const Float4 previousStep = Transform(Float4{ ray.x, ray.y, ray.z, 0.0f }, m_previous.viewProjection);
+	const float previousDepthOrigin = (Dot(Sub(eye, m_previous.eyePosition), m_previous.viewAxis) - m_previous.nearDepth) / m_previous.sliceDepth - 0.5f;
+	const float previousDepthStep = Dot(ray, m_previous.viewAxis) / m_previous.sliceDepth;
+	const float width = static_cast<float>(m_settings.width), height = static_cast<float>(m_settings.height);
+	for (uint32_t k = first; k < last; ++k)
+	{
+		const float sample = nearDepth + (k + jitter) * sliceDepth;
+		float density = sample >= enter && sample <= exit ? extinction * light.Visibility(Add(eye, Scale(ray, sample))) : 0.0f;
+		if (m_hasHistory)
+		{
+			// The history holds whole froxels: fetch it at the froxel's centre, not at the
+			// jittered sample, which would blur it along the column every frame.
+			const float t = nearDepth + (k + 0.5f) * sliceDepth;
+			const float w = previousOrigin.w + t * previousStep.w;
+			if (w > 0.0f)
+			{
+				const float hx = ((previousOrigin.x + t * previousStep.x) / w * 0.5f + 0.5f) * width - 0.5f;
+				const float hy = (0.5f - (previousOrigin.y + t * previousStep.y) / w * 0.5f) * height - 0.5f;
+				const float hz = previousDepthOrigin + t * previousDepthStep;
+				if (hx >= -0.5f && hx <= width - 0.5f && hy >= -0.5f && hy <= height - 0.5f && hz >= -0.5f && hz <= m_settings.depth - 0.5f)
+					density += (History(hx, hy, hz) - density) * historyWeight;
+			}
+		}
+		column[k] = density;
+	}
+}
+
+float FroxelGrid::History(float x, float y, float z) const
+{
+	const float size[3]{ float(m_settings.width), float(m_settings.height), float(m_settings.depth) };
+	const float position[3]{ x, y, z };
+	uint32_t lo[3], hi[3];
+	float weight[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		const float p = std::min(std::max(position[k], 0.0f), size[k] - 1.0f);
+		lo[k] = static_cast<uint32_t>(p);
+		hi[k] = std::min(lo[k] + 1, static_cast<uint32_t>(size[k]) - 1);
+		weight[k] = p - lo[k];
+	}
+	const auto at = [&](uint32_t i, uint32_t j, uint32_t k) {
+		return m_history[Column(i, j) + k];
+	};
+	const auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+	return lerp(
+		lerp(lerp(at(lo[0], lo[1], lo[2]), at(hi[0], lo[1], lo[2]), weight[0]), lerp(at(lo[0], hi[1], lo[2]), at(hi[0], hi[1], lo[2]), weight[0]), weight[1]),
+		lerp(lerp(at(lo[0], lo[1], hi[2]), at(hi[0], lo[1], hi[2]), weight[0]), lerp(at(lo[0], hi[1], hi[2]), at(hi[0], hi[1], hi[2]), weight[0]), weight[1]),
+		weight[2]);
+}
+
+FogRayResult FroxelGrid::Sample(float u, float v, float viewDepth) const
+{
+	if (!(m_frame.sliceDepth > 0.0f) || m_integrated.empty())
+		return FogRayResult{ 0.0f, 1.0f };
+
+	// Cell centres across the screen, slice boundaries in depth; boundary 0 is the near end of
+	// the column, without fog.
+	const float size[3]{ float(m_settings.width) - 1.0f, float(m_settings.height) - 1.0f, float(m_settings.depth) };
+	const float position[3]{ u * m_settings.width - 0.5f, v * m_settings.height - 0.5f, (viewDepth - m_frame.nearDepth) / m_frame.sliceDepth };
+	uint32_t lo[3], hi[3];
+	float weight[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		const float p = std::min(std::max(position[k], 0.0f), size[k]);
+		lo[k] = static_cast<uint32_t>(p);
+		hi[k] = std::min(lo[k] + 1, static_cast<uint32_t>(size[k]));
+		weight[k] = p - lo[k];
+	}
+	FogRayResult result{ 0.0f, 0.0f };
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const float w = ((corner & 1) ? weight[0] : 1.0f - weight[0]) * ((corner & 2) ? weight[1] : 1.0f - weight[1]) *
+			((corner & 4) ? weight[2] : 1.0f - weight[2]);
+		const uint32_t boundary = (corner & 4) ? hi[2] : lo[2];
+		const FogRayResult fog = boundary == 0 ? FogRayResult{ 0.0f, 1.0f } :
+			m_integrated[Column((corner & 1) ? hi[0] : lo[0], (corner & 2) ? hi[1] : lo[1]) + boundary - 1];
+		result.scattering += w * fog.scattering;
+		result.transmittance += w * fog.transmittance;
+	}
+	return result;
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include "FogCells.h"
+
+#include <vector>
+
+namespace FogMap
+{
+	class JobSystem;
+
+	// The light a FroxelGrid fill samples.
+	class FogLightSource
+	{
+	public:
+		virtual ~FogLightSource() {}
+
+		// 1 where the world position is lit, 0 where it is in shadow.
+		virtual float Visibility(const Float3& position) const = 0;
+	};
+
+	// Time the last FroxelGrid::Build took in each step.
+	struct FroxelTimings
+	{
+		double fillMs;
+		double integrateMs;
+	};
+
+	// Frustum-aligned grid of the fog (froxels): settings.width x settings.height cells across the
+	// screen, each cut into settings.depth slices evenly spaced in view depth over the fog's
+	// depth range. Build fills every froxel once with the fog's density at one point of it, lit or
+	// in shadow, jittered in depth from frame to frame; blends in the previous frame's grid
+	// reprojected to the same world position, so the jittered points add up to many samples per
+	// slice over a few frames; and integrates every column front to back. The history weighs
+	// less in frames where the light has moved, so shadows in the fog do not trail behind it.
+	// Sample then reads the fog in front of any scene depth with one trilinear lookup, whatever
+	// the screen resolution, so the grid costs the same every frame.
+	class FroxelGrid
+	{
+	public:
+		FroxelGrid();
+
+		// The grid for the frame described by march, with viewProjection its world-to-clip
+		// transform, light the shadow test and lightViewProjection the light's transform behind
+		// it, with the fill and the integration spread over the jobs. A froxel's extinction per
+		// unit of view depth is that of march's samples.
+		void Build(const FogFroxelSettings& settings, const FogRayMarch& march, const Float4x4& viewProjection,
+			const Float4x4& lightViewProjection, const FogLightSource& light, JobSystem& jobs);
+		// Drops the history, as after a cut.
+		void Reset();
+
+		// The fog in front of view depth viewDepth at the screen position (u, v), both in [0, 1]
+		// with v = 0 at the top.
+		FogRayResult Sample(float u, float v, float viewDepth) const;
+
+		const FroxelTimings& GetTimings() const { return m_timings; }
+
+	private:
+		// The depth slicing and camera of one frame.
+		struct Frame
+		{
+			Float4x4 viewProjection;
+			Float4x4 lightViewProjection;
+			Float3 eyePosition;
+			Float3 viewAxis;
+			Float3 boundsMin;
+			Float3 boundsMax;
+			float nearDepth;
+			float sliceDepth;		// 0 without fog
+		};
+
+		void FillColumn(uint32_t x, uint32_t y, const FogRayMarch& march, float extinction, float jitter, float historyWeight,
+			const FogLightSource& light);
+		float History(float x, float y, float z) const;
+		size_t Column(uint32_t x, uint32_t y) const { return (size_t(y) * m_settings.width + x) * m_settings.depth; }
+
+		FogFroxelSettings m_settings;
+		Frame m_frame;
+		Frame m_previous;
+		bool m_hasHistory;
+		uint32_t m_frameIndex;
+		// Extinction per unit of view depth where lit, column by column, nearest slice first;
+		// the froxels of the previous frame, after blending, in m_history.
+		std::vector<float> m_density;
+		std::vector<float> m_history;
+		// The fog from the near end of the column to the far side of each slice.
+		std::vector<FogRayResult> m_integrated;
+		FroxelTimings m_timings;
+	};
+}
@@ -0,0 +1,320 @@
+﻿#include "JobSystem.h"
+
+using namespace FogMap;
+
+namespace FogMap
+{
+	struct JobNode
+	{
+		std::function<void()> body;
+		std::atomic<uint32_t> references;	// handles, the scheduler and waiting continuations
+		std::atomic<uint32_t> blockers;		// unfinished dependencies, plus one until scheduled
+		std::atomic<bool> done;
+		std::atomic<bool> waited;			// someone sleeps in Wait on this job
+		std::mutex mutex;					// guards finished, continuations and exception
+		bool finished;
+		std::vector<JobNode*> continuations;
+		std::exception_ptr exception;
+	};
+}
+
+namespace
+{
+	// The scheduler whose worker runs on this thread, if any.
+	struct WorkerIdentity
+	{
+		const JobSystem* system;
+		unsigned queue;
+	};
+	thread_local WorkerIdentity t_worker{ nullptr, 0 };
+
+	void AddReference(JobNode* node)
+	{
+		node->references.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void DropReference(JobNode* node)
+	{
+		if (node->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete node;
+	}
+
+	// Spins this many failed searches before a thread goes to sleep.
+	constexpr int IdleSpins = 64;
+}
+
+JobHandle::JobHandle(const JobHandle& other) :
+	m_node(other.m_node)
+{
+	if (m_node)
+		AddReference(m_node);
+}
+
+JobHandle::~JobHandle()
+{
+	if (m_node)
+		DropReference(m_node);
+}
+
+bool JobHandle::IsDone() const
+{
+	return m_node && m_node->done.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(unsigned threadCount) :
+	m_queueCount(std::max(threadCount, 1u)),
+	m_epoch(0),
+	m_sleepers(0),
+	m_outstanding(0),
+	m_stop(false)
+{
+	// Queues 0 .. threadCount - 2 belong to the workers, the last one is shared.
+	m_queues.reset(new Queue[m_queueCount]);
+	for (unsigned i = 0; i + 1 < m_queueCount; ++i)
+		m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+		m_epoch.fetch_add(1);
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+	// Without workers, whatever is left runs here.
+	while (RunOne(m_queueCount - 1))
+	{
+	}
+}
+
+JobHandle JobSystem::Schedule(std::function<void()> body, const JobHandle* dependencies, size_t dependencyCount)
+{
+	JobNode* node = new JobNode;
+	node->body = std::move(body);
+	node->references.store(2, std::memory_order_relaxed);	// the handle and the scheduler
+	node->blockers.store(1, std::memory_order_relaxed);
+	node->done.store(false, std::memory_order_relaxed);
+	node->waited.store(false, std::memory_order_relaxed);
+	node->finished = false;
+	m_outstanding.fetch_add(1, std::memory_order_relaxed);
+
+	std::exception_ptr inherited;
+	for (size_t i = 0; i < dependencyCount; ++i)
+	{
+		JobNode* dependency = dependencies[i].m_node;
+		if (!dependency)
+			continue;
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->finished)
+		{
+			if (!inherited)
+				inherited = dependency->exception;
+			continue;
+		}
+		node->blockers.fetch_add(1, std::memory_order_relaxed);
+		AddReference(node);
+		dependency->continuations.push_back(node);
+	}
+	if (inherited)
+	{
+		// Dependencies registered above may be finishing concurrently.
+		std::lock_guard<std::mutex> lock(node->mutex);
+		if (!node->exception)
+			node->exception = inherited;
+	}
+
+	Release(node);
+	return JobHandle(node);
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+	JobNode* node = job.m_node;
+	if (!node)
+		return;
+	const unsigned queue = CurrentQueue();
+	auto done = [node]() { return node->done.load(std::memory_order_acquire); };
+	int spins = 0;
+	while (!done())
+	{
+		const uint64_t epoch = m_epoch.load();
+		if (RunOne(queue))
+		{
+			spins = 0;
+			continue;
+		}
+		if (++spins < IdleSpins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		node->waited.store(true);
+		Sleep(epoch, done);
+		spins = 0;
+	}
+	if (node->exception)
+		std::rethrow_exception(node->exception);
+}
+
+void JobSystem::WorkerLoop(unsigned index)
+{
+	t_worker = WorkerIdentity{ this, index };
+	auto stopped = [this]() { return m_stop.load() && m_outstanding.load() == 0; };
+	int spins = 0;
+	while (!stopped())
+	{
+		const uint64_t epoch = m_epoch.load();
+		if (RunOne(index))
+		{
+			spins = 0;
+			continue;
+		}
+		if (++spins < IdleSpins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		Sleep(epoch, stopped);
+		spins = 0;
+	}
+	t_worker = WorkerIdentity{ nullptr, 0 };
+}
+
+unsigned JobSystem::CurrentQueue() const
+{
+	return t_worker.system == this ? t_worker.queue : m_queueCount - 1;
+}
+
+template<typename Done>
+void JobSystem::Sleep(uint64_t epoch, Done done)
+{
+	std::unique_lock<std::mutex> lock(m_sleepMutex);
+	m_sleepers.fetch_add(1);
+	m_wake.wait(lock, [&]() { return m_epoch.load() != epoch || done(); });
+	m_sleepers.fetch_sub(1);
+}
+
+void JobSystem::Push(JobNode* node)
+{
+	Queue& queue = m_queues[CurrentQueue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(node);
+		queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+	}
+	// Pairs with Sleep: either the sleeper sees the new epoch or this sees the sleeper.
+	m_epoch.fetch_add(1);
+	if (m_sleepers.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wake.notify_one();
+	}
+}
+
+JobNode* JobSystem::PopOrSteal(unsigned own)
+{
+	// Newest job of our own deque first, which keeps nested Waits depth-first and so bounds
+	// the stack; then the oldest of everyone else's. Threads other than the workers share
+	// the last deque as their own.
+	{
+		Queue& queue = m_queues[own];
+		if (queue.size.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				JobNode* node = queue.jobs.back();
+				queue.jobs.pop_back();
+				queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+				return node;
+			}
+		}
+	}
+	for (unsigned i = 1; i < m_queueCount; ++i)
+	{
+		Queue& queue = m_queues[(own + i) % m_queueCount];
+		if (queue.size.load(std::memory_order_relaxed) == 0)
+			continue;
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			continue;
+		JobNode* node = queue.jobs.front();
+		queue.jobs.pop_front();
+		queue.size.store(queue.jobs.size(), std::memory_order_relaxed);
+		return node;
+	}
+	return nullptr;
+}
+
+bool JobSystem::RunOne(unsigned queue)
+{
+	JobNode* node = PopOrSteal(queue);
+	if (!node)
+		return false;
+	Execute(node);
+	return true;
+}
+
+void JobSystem::Execute(JobNode* node)
+{
+	if (!node->exception && node->body)
+	{
+		try
+		{
+			node->body();
+		}
+		catch (...)
+		{
+			node->exception = std::current_exception();
+		}
+	}
+	// Let captured state go before anyone can observe the job as done.
+	node->body = nullptr;
+	Finish(node);
+}
+
+void JobSystem::Finish(JobNode* node)
+{
+	std::vector<JobNode*> continuations;
+	{
+		std::lock_guard<std::mutex> lock(node->mutex);
+		node->finished = true;
+		continuations.swap(node->continuations);
+	}
+	node->done.store(true);
+
+	for (JobNode* continuation : continuations)
+	{
+		if (node->exception)
+		{
+			std::lock_guard<std::mutex> lock(continuation->mutex);
+			if (!continuation->exception)
+				continuation->exception = node->exception;
+		}
+		Release(continuation);
+		DropReference(continuation);
+	}
+
+	// Wake a thread waiting on this job, or the destructor's workers once nothing is left.
+	const bool last = m_outstanding.fetch_sub(1) == 1 && m_stop.load();
+	if (node->waited.load() || last)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_epoch.fetch_add(1);
+		}
+		m_wake.notify_all();
+	}
+	DropReference(node);
+}
+
+void JobSystem::Release(JobNode* node)
+{
+	if (node->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		Push(node);
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FogMap
+{
+	struct JobNode;
+
+	// Shared reference to a scheduled job; empty when default-constructed.
+	class JobHandle
+	{
+	public:
+		JobHandle() : m_node(nullptr) {}
+		JobHandle(const JobHandle& other);
+		JobHandle(JobHandle&& other) : m_node(other.m_node) { other.m_node = nullptr; }
+		JobHandle& operator=(JobHandle other) { std::swap(m_node, other.m_node); return *this; }
+		~JobHandle();
+
+		explicit operator bool() const { return m_node != nullptr; }
+		bool IsDone() const;
+
+	private:
+		friend class JobSystem;
+		explicit JobHandle(JobNode* node) : m_node(node) {}
+
+		JobNode* m_node;
+	};
+
+	// Work-stealing scheduler. Each worker thread owns a deque: jobs made ready on a worker are
+	// pushed to its back and popped from there, idle workers steal from the front of the
+	// others. Jobs scheduled from any other thread go to a shared deque. A job starts once its
+	// dependency counter reaches zero; if a dependency threw, the job is skipped and finishes
+	// with the same exception, so a failure travels down the graph as in a PPL task chain.
+	// Threads blocked in Wait run queued jobs meanwhile, so Wait may be called from jobs.
+	class JobSystem
+	{
+	public:
+		// Starts threadCount - 1 workers; the thread calling Wait or ParallelFor makes up the rest.
+		explicit JobSystem(unsigned threadCount);
+		// Runs every job already scheduled before stopping the workers.
+		~JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		unsigned GetThreadCount() const { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+		// Runs body once all dependencies have finished. An empty body makes a join point.
+		JobHandle Schedule(std::function<void()> body, const JobHandle* dependencies, size_t dependencyCount);
+		JobHandle Schedule(std::function<void()> body, std::initializer_list<JobHandle> dependencies = {})
+		{
+			return Schedule(std::move(body), dependencies.begin(), dependencies.size());
+		}
+		JobHandle Then(const JobHandle& job, std::function<void()> body)
+		{
+			return Schedule(std::move(body), &job, 1);
+		}
+		JobHandle WhenAll(const std::vector<JobHandle>& jobs)
+		{
+			return Schedule(nullptr, jobs.data(), jobs.size());
+		}
+
+		// Runs queued jobs on the calling thread until job has finished, then rethrows its
+		// exception, if any.
+		void Wait(const JobHandle& job);
+
+		// Calls body(begin, end) on [begin, end) chunks of grain items until count is covered,
+		// on up to GetThreadCount() threads including the calling one, and returns when all
+		// chunks are done.
+		template<typename Body>
+		void ParallelFor(size_t count, size_t grain, Body body)
+		{
+			std::atomic<size_t> next(0);
+			auto loop = [&]() {
+				for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain))
+					body(begin, std::min(count, begin + grain));
+			};
+			const size_t helpers = std::min<size_t>((count + grain - 1) / grain, GetThreadCount()) - (count > 0);
+			std::vector<JobHandle> jobs;
+			jobs.reserve(helpers);
+			for (size_t i = 0; i < helpers; ++i)
+				jobs.push_back(Schedule(loop));
+			std::exception_ptr exception;
+			try
+			{
+				loop();
+			}
+			catch (...)
+			{
+				exception = std::current_exception();
+				next = count;
+			}
+			// The helpers reference this frame, so all of them have to finish before returning.
+			for (const JobHandle& job : jobs)
+			{
+				try
+				{
+					Wait(job);
+				}
+				catch (...)
+				{
+					if (!exception)
+						exception = std::current_exception();
+				}
+			}
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+
+	private:
+		struct alignas(64) Queue
+		{
+			std::mutex mutex;
+			std::deque<JobNode*> jobs;
+			std::atomic<size_t> size{ 0 };		// jobs.size(), readable without the lock
+		};
+
+		void WorkerLoop(unsigned index);
+		unsigned CurrentQueue() const;
+		void Push(JobNode* node);
+		JobNode* PopOrSteal(unsigned queue);
+		bool RunOne(unsigned queue);
+		void Execute(JobNode* node);
+		void Finish(JobNode* node);
+		void Release(JobNode* node);
+		// Blocks until something was pushed after epoch was read, or until done() holds.
+		template<typename Done>
+		void Sleep(uint64_t epoch, Done done);
+
+		std::vector<std::thread> m_threads;
+		std::unique_ptr<Queue[]> m_queues;		// one per worker, then the shared one
+		unsigned m_queueCount;
+
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		std::atomic<uint64_t> m_epoch;
+		std::atomic<unsigned> m_sleepers;
+		std::atomic<size_t> m_outstanding;		// scheduled but not finished
+		std::atomic<bool> m_stop;
+	};
+}
@@ -1,13 +1,18 @@
 ﻿#pragma once
 
 #include "..\Common\DeviceResources.h"
-#include "ShaderStructures.h"
+#include "AssetCache.h"
+#include "D3D11Backend.h"
+#include "JobSystem.h"
+#include "RendererCore.h"
 #include "..\Common\StepTimer.h"
 
-#include <vector>
+#include <atomic>
 
 namespace FogMap
 {
+	// Drives RendererCore with the app's timer and window, and draws its frames through
+	// D3D11Backend.
 	class MainRenderer
 	{
 	public:
@@ -19,45 +24,29 @@ namespace FogMap
 		void Render();
 
 	private:
-		std::shared_ptr<DX::DeviceResources> m_deviceResources;
-
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_vertexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_indexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11InputLayout>			m_inputLayout;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_mvpBuffer;
-
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_sceneLightingBuffer;
-		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_sceneVertexShader;
-		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_scenePixelShader;
-		Microsoft::WRL::ComPtr<ID3D11SamplerState>			m_sceneSampler;
-
-		Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_shadowTexture;
-		Microsoft::WRL::ComPtr<ID3D11RenderTargetView>		m_shadowRTV;
-		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_shadowSRV;
-		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_shadowVertexShader;
-		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_shadowPixelShader;
-		Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_shadowDepthStencilBuffer;
-		Microsoft::WRL::ComPtr<ID3D11DepthStencilView>		m_shadowDSV;
-
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_cellVertexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11Buffer>				m_cellIndexBuffer;
-		Microsoft::WRL::ComPtr<ID3D11InputLayout>			m_cellInputLayout;
-		Microsoft::WRL::ComPtr<ID3D11VertexShader>			m_cellVertexShader;
-		Microsoft::WRL::ComPtr<ID3D11PixelShader>			m_cellPixelShader;
+		static RendererSettings Settings();
+		// Where RendererCore and D3D11Backend report to: the debugger output.
+		static void Log(const char* message);
 
-		Microsoft::WRL::ComPtr<ID3D11BlendState>			m_blendState;
-
-		ModelViewProjectionConstantBuffer m_mvpBufferData;
-		LightBuffer m_lightBufferData;
-		uint32	m_indexCount;
-		uint32	m_cellIndexCount;
-
-		DirectX::XMFLOAT3 m_lightDirection;
-		float m_lightSpeed = 0.3f;
-
-		std::vector<VertexPositionColorNormal> vertices;
-		std::vector<unsigned short> indices;
+		std::shared_ptr<DX::DeviceResources> m_deviceResources;
 
-		bool	m_loadingComplete;
+		// Everything loaded from disk outlives the device: shader bytecode stays mapped in
+		// m_assets and the parsed mesh and its BVH stay in m_core.
+		AssetCache m_assets;
+		RendererCore m_core;
+		D3D11Backend m_backend;
+		JobHandle m_meshJob;
+		// Nothing in the app queries the BVH yet, so nothing waits for it; a CPU query would
+		// have to Wait on this job first.
+		JobHandle m_bvhJob;
+		// Ends with the exception of any load job that failed; kept until Render reports it.
+		JobHandle m_uploadJob;
+
+		// Set by the upload job, read by Render on the UI thread.
+		std::atomic<bool>	m_loadingComplete;
+
+		// Last, so that its destructor finishes the load jobs while everything they touch
+		// still exists.
+		JobSystem m_jobs;
 	};
 }
@@ -0,0 +1,204 @@
+﻿#pragma once
+
+#include "VectorMath.h"
+
+namespace FogMap
+{
+	// Row-vector 4x4 matrix (v' = v * M), the layout of an untransposed XMFLOAT4X4. The
+	// constructors below follow the DirectXMath functions of the same name, so portable code
+	// can rebuild the exact transforms MainRenderer uploads.
+	struct Float4x4
+	{
+		float m[4][4];
+	};
+
+	inline Float4x4 MatrixIdentity()
+	{
+		return Float4x4{ { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } };
+	}
+
+	// Row i of a * b is a[i][0] * b[0] + ... + a[i][3] * b[3]. The vector paths sum in the same
+	// order as the scalar one, without fused multiply-adds, so all of them give the same bits.
+	inline Float4x4 MatrixMultiply(const Float4x4& a, const Float4x4& b)
+	{
+		Float4x4 result;
+#if defined(FOGMAP_VECTOR_SSE2)
+		const __m128 b0 = _mm_loadu_ps(b.m[0]), b1 = _mm_loadu_ps(b.m[1]), b2 = _mm_loadu_ps(b.m[2]), b3 = _mm_loadu_ps(b.m[3]);
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128 row = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+			_mm_storeu_ps(result.m[i], row);
+		}
+#elif defined(FOGMAP_VECTOR_NEON)
+		const float32x4_t b0 = vld1q_f32(b.m[0]), b1 = vld1q_f32(b.m[1]), b2 = vld1q_f32(b.m[2]), b3 = vld1q_f32(b.m[3]);
+		for (int i = 0; i < 4; ++i)
+		{
+			float32x4_t row = vmulq_n_f32(b0, a.m[i][0]);
+			row = vaddq_f32(row, vmulq_n_f32(b1, a.m[i][1]));
+			row = vaddq_f32(row, vmulq_n_f32(b2, a.m[i][2]));
+			row = vaddq_f32(row, vmulq_n_f32(b3, a.m[i][3]));
+			vst1q_f32(result.m[i], row);
+		}
+#else
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+				result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+#endif
+		return result;
+	}
+
+	// Normal transform of m for row vectors: the cofactors of its upper 3x3, i.e. the inverse
+	// transpose scaled by the determinant, which renormalisation removes. Singular matrices
+	// still give a finite result. Row and column 3 are those of the identity.
+	inline Float4x4 MatrixNormal(const Float4x4& m)
+	{
+		auto cross = [](const float* a, const float* b, float* out) {
+			out[0] = a[1] * b[2] - a[2] * b[1];
+			out[1] = a[2] * b[0] - a[0] * b[2];
+			out[2] = a[0] * b[1] - a[1] * b[0];
+			out[3] = 0.0f;
+		};
+		Float4x4 result;
+		cross(m.m[1], m.m[2], result.m[0]);
+		cross(m.m[2], m.m[0], result.m[1]);
+		cross(m.m[0], m.m[1], result.m[2]);
+		result.m[3][0] = result.m[3][1] = result.m[3][2] = 0.0f;
+		result.m[3][3] = 1.0f;
+		return result;
+	}
+
+	// Inverse of an invertible m by cofactor expansion, in double so that unprojecting depths
+	// close to the far plane keeps the precision of the depth buffer.
+	inline Float4x4 MatrixInverse(const Float4x4& m)
+	{
+		double a[16];
+		for (int i = 0; i < 16; ++i)
+			a[i] = m.m[i / 4][i % 4];
+		double c[16];
+		c[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+		c[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+		c[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+		c[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+		c[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+		c[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+		c[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+		c[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+		c[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+		c[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+		c[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+		c[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+		c[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+		c[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+		c[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+		c[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+		const double inverseDeterminant = 1.0 / (a[0] * c[0] + a[1] * c[4] + a[2] * c[8] + a[3] * c[12]);
+		Float4x4 result;
+		for (int i = 0; i < 16; ++i)
+			result.m[i / 4][i % 4] = static_cast<float>(c[i] * inverseDeterminant);
+		return result;
+	}
+
+	inline Float4x4 MatrixRotationY(float angle)
+	{
+		const float s = std::sin(angle), c = std::cos(angle);
+		return Float4x4{ { { c, 0, -s, 0 }, { 0, 1, 0, 0 }, { s, 0, c, 0 }, { 0, 0, 0, 1 } } };
+	}
+
+	inline Float4x4 MatrixLookAtRH(const Float3& eye, const Float3& at, const Float3& up)
+	{
+		const Float3 r2 = Normalize(Sub(eye, at));
+		const Float3 r0 = Normalize(Cross(up, r2));
+		const Float3 r1 = Cross(r2, r0);
+		return Float4x4{ { { r0.x, r1.x, r2.x, 0 }, { r0.y, r1.y, r2.y, 0 }, { r0.z, r1.z, r2.z, 0 },
+			{ -Dot(r0, eye), -Dot(r1, eye), -Dot(r2, eye), 1 } } };
+	}
+
+	inline Float4x4 MatrixPerspectiveFovRH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+	{
+		const float height = std::cos(0.5f * fovAngleY) / std::sin(0.5f * fovAngleY);
+		const float width = height / aspectRatio;
+		const float range = farZ / (nearZ - farZ);
+		return Float4x4{ { { width, 0, 0, 0 }, { 0, height, 0, 0 }, { 0, 0, range, -1 }, { 0, 0, range * nearZ, 0 } } };
+	}
+
+	inline Float4x4 MatrixOrthographicRH(float width, float height, float nearZ, float farZ)
+	{
+		const float range = 1.0f / (nearZ - farZ);
+		return Float4x4{ { { 2.0f / width, 0, 0, 0 }, { 0, 2.0f / height, 0, 0 }, { 0, 0, range, 0 }, { 0, 0, range * nearZ, 1 } } };
+	}
+
+	// v * M.
+	inline Float4 Transform(const Float4& v, const Float4x4& t)
+	{
+		const float (&m)[4][4] = t.m;
+		return Float4{
+			v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0] + v.w * m[3][0],
+			v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1] + v.w * m[3][1],
+			v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2] + v.w * m[3][2],
+			v.x * m[0][3] + v.y * m[1][3] + v.z * m[2][3] + v.w * m[3][3] };
+	}
+
+	// p * M with w = 1.
+	inline Float4 TransformPoint(const Float3& p, const Float4x4& t)
+	{
+		return Transform(Float4{ p.x, p.y, p.z, 1.0f }, t);
+	}
+
+	// n * (float3x3)M.
+	inline Float3 TransformNormal(const Float3& n, const Float4x4& t)
+	{
+		const float (&m)[4][4] = t.m;
+		return Float3{
+			n.x * m[0][0] + n.y * m[1][0] + n.z * m[2][0],
+			n.x * m[0][1] + n.y * m[1][1] + n.z * m[2][1],
+			n.x * m[0][2] + n.y * m[1][2] + n.z * m[2][2] };
+	}
+
+	// TransformPoint of points[0, count) into out, which must not overlap points.
+	inline void TransformPoints(const Float3* points, size_t count, const Float4x4& t, Float4* out)
+	{
+		size_t i = 0;
+#if defined(FOGMAP_VECTOR_AVX2)
+		// Two points per register, one in each 128-bit lane.
+		auto both = [](__m128 v) { return _mm256_insertf128_ps(_mm256_castps128_ps256(v), v, 1); };
+		auto pair = [](float lo, float hi) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(lo)), _mm_set1_ps(hi), 1); };
+		const __m256 m0 = both(_mm_loadu_ps(t.m[0])), m1 = both(_mm_loadu_ps(t.m[1])), m2 = both(_mm_loadu_ps(t.m[2])), m3 = both(_mm_loadu_ps(t.m[3]));
+		for (; i + 2 <= count; i += 2)
+		{
+			const Float3& p = points[i];
+			const Float3& q = points[i + 1];
+			__m256 row = _mm256_mul_ps(pair(p.x, q.x), m0);
+			row = _mm256_add_ps(row, _mm256_mul_ps(pair(p.y, q.y), m1));
+			row = _mm256_add_ps(row, _mm256_mul_ps(pair(p.z, q.z), m2));
+			_mm256_storeu_ps(&out[i].x, _mm256_add_ps(row, m3));
+		}
+#endif
+#if defined(FOGMAP_VECTOR_SSE2)
+		// 1 * m[3] is m[3] exactly, so the w term is a plain add.
+		const __m128 r0 = _mm_loadu_ps(t.m[0]), r1 = _mm_loadu_ps(t.m[1]), r2 = _mm_loadu_ps(t.m[2]), r3 = _mm_loadu_ps(t.m[3]);
+		for (; i < count; ++i)
+		{
+			const Float3& p = points[i];
+			__m128 row = _mm_mul_ps(_mm_set1_ps(p.x), r0);
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(p.y), r1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(p.z), r2));
+			_mm_storeu_ps(&out[i].x, _mm_add_ps(row, r3));
+		}
+#elif defined(FOGMAP_VECTOR_NEON)
+		const float32x4_t r0 = vld1q_f32(t.m[0]), r1 = vld1q_f32(t.m[1]), r2 = vld1q_f32(t.m[2]), r3 = vld1q_f32(t.m[3]);
+		for (; i < count; ++i)
+		{
+			const Float3& p = points[i];
+			float32x4_t row = vmulq_n_f32(r0, p.x);
+			row = vaddq_f32(row, vmulq_n_f32(r1, p.y));
+			row = vaddq_f32(row, vmulq_n_f32(r2, p.z));
+			vst1q_f32(&out[i].x, vaddq_f32(row, r3));
+		}
+#endif
+		for (; i < count; ++i)
+			out[i] = TransformPoint(points[i], t);
+	}
+}
@@ -0,0 +1,149 @@
+﻿#include "MeshCache.h"
+
+#include <cstring>
+
+using namespace FogMap;
+
+namespace
+{
+	inline uint64_t AlignUp(uint64_t offset)
+	{
+		return (offset + 15) & ~uint64_t(15);
+	}
+
+	inline uint64_t RotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	inline uint64_t ReadWord(const uint8_t* p)
+	{
+		uint64_t word;
+		std::memcpy(&word, p, sizeof(word));
+		return word;
+	}
+
+	inline size_t IndexSize(IndexFormat format)
+	{
+		return format == IndexFormat::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	static constexpr uint64_t Prime1 = 0x9e3779b185ebca87ull;
+	static constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4full;
+}
+
+uint64_t FogMap::HashMeshSource(const void* data, size_t size)
+{
+	// Four independent lanes over 32-byte blocks, in the spirit of xxHash64.
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+	uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+	for (; end - p >= 32; p += 32)
+		for (int i = 0; i < 4; ++i)
+			lanes[i] = RotateLeft(lanes[i] + ReadWord(p + i * 8) * Prime2, 31) * Prime1;
+
+	uint64_t hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	hash += static_cast<uint64_t>(size);
+	for (; end - p >= 8; p += 8)
+		hash = RotateLeft(hash ^ (RotateLeft(ReadWord(p) * Prime2, 31) * Prime1), 27) * Prime1;
+	for (; p < end; ++p)
+		hash = RotateLeft(hash ^ (*p * Prime1), 11) * Prime2;
+
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+void FogMap::WriteMeshCache(const MeshBuffers& buffers, uint64_t sourceHash, uint64_t sourceSize, std::vector<uint8_t>& file)
+{
+	FMeshHeader header = {};
+	header.magic = FMeshMagic;
+	header.version = FMeshVersion;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.vertexCount = buffers.vertexCount;
+	header.indexCount = buffers.indexCount;
+	header.indexFormat = static_cast<uint32_t>(buffers.indexFormat);
+	header.meshletCount = buffers.meshletCount;
+	header.lodCount = buffers.lodCount;
+	header.boundsMin = buffers.boundsMin;
+	header.boundsMax = buffers.boundsMax;
+
+	const uint64_t positionBytes = uint64_t(buffers.vertexCount) * sizeof(Float3);
+	const uint64_t attributeBytes = uint64_t(buffers.vertexCount) * sizeof(MeshAttributes);
+	const uint64_t indexBytes = uint64_t(buffers.indexCount) * IndexSize(buffers.indexFormat);
+	const uint64_t meshletBytes = uint64_t(buffers.meshletCount) * sizeof(Meshlet);
+	const uint64_t lodBytes = uint64_t(buffers.lodCount) * sizeof(MeshletLod);
+	header.positionOffset = AlignUp(sizeof(FMeshHeader));
+	header.attributeOffset = AlignUp(header.positionOffset + positionBytes);
+	header.indexOffset = AlignUp(header.attributeOffset + attributeBytes);
+	header.meshletOffset = AlignUp(header.indexOffset + indexBytes);
+	header.lodOffset = AlignUp(header.meshletOffset + meshletBytes);
+
+	file.assign(static_cast<size_t>(header.lodOffset + lodBytes), 0);
+	std::memcpy(file.data(), &header, sizeof(header));
+	if (positionBytes != 0)
+	{
+		std::memcpy(file.data() + header.positionOffset, buffers.positions, static_cast<size_t>(positionBytes));
+		std::memcpy(file.data() + header.attributeOffset, buffers.attributes, static_cast<size_t>(attributeBytes));
+	}
+	if (indexBytes != 0)
+		std::memcpy(file.data() + header.indexOffset, buffers.indices, static_cast<size_t>(indexBytes));
+	if (meshletBytes != 0)
+		std::memcpy(file.data() + header.meshletOffset, buffers.meshlets, static_cast<size_t>(meshletBytes));
+	if (lodBytes != 0)
+		std::memcpy(file.data() + header.lodOffset, buffers.lods, static_cast<size_t>(lodBytes));
+}
+
+bool FogMap::ReadMeshCache(const uint8_t* data, size_t size, uint64_t sourceHash, uint64_t sourceSize, MeshBuffers& buffers)
+{
+	if (data == nullptr || size < sizeof(FMeshHeader))
+		return false;
+
+	FMeshHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != FMeshMagic || header.version != FMeshVersion ||
+		header.sourceHash != sourceHash || header.sourceSize != sourceSize ||
+		header.indexFormat > static_cast<uint32_t>(IndexFormat::UInt32) || header.meshletCount == 0 || header.lodCount == 0)
+		return false;
+
+	const IndexFormat indexFormat = static_cast<IndexFormat>(header.indexFormat);
+	auto inRange = [size](uint64_t offset, uint64_t bytes) {
+		return (offset & 15) == 0 && offset <= size && bytes <= size - offset;
+	};
+	if (!inRange(header.positionOffset, uint64_t(header.vertexCount) * sizeof(Float3)) ||
+		!inRange(header.attributeOffset, uint64_t(header.vertexCount) * sizeof(MeshAttributes)) ||
+		!inRange(header.indexOffset, uint64_t(header.indexCount) * IndexSize(indexFormat)) ||
+		!inRange(header.meshletOffset, uint64_t(header.meshletCount) * sizeof(Meshlet)) ||
+		!inRange(header.lodOffset, uint64_t(header.lodCount) * sizeof(MeshletLod)))
+		return false;
+
+	const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+	for (uint32_t i = 0; i < header.meshletCount; ++i)
+	{
+		if (uint64_t(meshlets[i].startIndex) + meshlets[i].indexCount > header.indexCount ||
+			uint64_t(meshlets[i].baseVertex) + meshlets[i].vertexCount > header.vertexCount)
+			return false;
+	}
+	const MeshletLod* lods = reinterpret_cast<const MeshletLod*>(data + header.lodOffset);
+	for (uint32_t i = 0; i < header.lodCount; ++i)
+	{
+		if (lods[i].meshletCount == 0 || uint64_t(lods[i].firstMeshlet) + lods[i].meshletCount > header.meshletCount)
+			return false;
+	}
+
+	buffers.positions = reinterpret_cast<const Float3*>(data + header.positionOffset);
+	buffers.attributes = reinterpret_cast<const MeshAttributes*>(data + header.attributeOffset);
+	buffers.vertexCount = header.vertexCount;
+	buffers.indices = data + header.indexOffset;
+	buffers.indexCount = header.indexCount;
+	buffers.indexFormat = indexFormat;
+	buffers.meshlets = meshlets;
+	buffers.meshletCount = header.meshletCount;
+	buffers.lods = lods;
+	buffers.lodCount = header.lodCount;
+	buffers.boundsMin = header.boundsMin;
+	buffers.boundsMax = header.boundsMax;
+	return true;
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "Meshlet.h"
+
+namespace FogMap
+{
+	// .fmesh layout (little-endian): FMeshHeader followed by the position, attribute, index, meshlet
+	// and LOD arrays of a packed mesh, each at a 16-byte aligned offset from the start of the file.
+	struct FMeshHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t indexFormat;
+		uint32_t meshletCount;
+		uint32_t lodCount;
+		Float3 boundsMin;
+		Float3 boundsMax;
+		uint64_t positionOffset;
+		uint64_t attributeOffset;
+		uint64_t indexOffset;
+		uint64_t meshletOffset;
+		uint64_t lodOffset;
+	};
+
+	static constexpr uint32_t FMeshMagic = 0x48534d46;	// "FMSH"
+	static constexpr uint32_t FMeshVersion = 3;
+
+	// Fast non-cryptographic hash used to detect stale caches.
+	uint64_t HashMeshSource(const void* data, size_t size);
+
+	// Serializes upload-ready buffers (see PackMesh) into a .fmesh image.
+	void WriteMeshCache(const MeshBuffers& buffers, uint64_t sourceHash, uint64_t sourceSize, std::vector<uint8_t>& file);
+
+	// Points buffers straight into a mapped .fmesh image. Returns false if the image is
+	// malformed, was written by another version, or was built from a different source.
+	bool ReadMeshCache(const uint8_t* data, size_t size, uint64_t sourceHash, uint64_t sourceSize, MeshBuffers& buffers);
+}
@@ -0,0 +1,21 @@
+﻿#include "MeshData.h"
+
+#include <algorithm>
+
+using namespace FogMap;
+
+void FogMap::ComputeBounds(const Float3* positions, size_t count, Float3& boundsMin, Float3& boundsMax)
+{
+	if (count == 0)
+	{
+		boundsMin = boundsMax = Float3{ 0.0f, 0.0f, 0.0f };
+		return;
+	}
+	boundsMin = boundsMax = positions[0];
+	for (size_t i = 1; i < count; ++i)
+	{
+		const Float3& p = positions[i];
+		boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+		boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+	}
+}
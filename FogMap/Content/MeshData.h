@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace FogMap
+{
+	// Platform-neutral mesh types, usable without DirectXMath.
+	struct Float3
+	{
+		float x, y, z;
+	};
+
+	struct Float4
+	{
+		float x, y, z, w;
+	};
+
+	// Everything but the position. Positions live in a stream of their own so that depth-only
+	// passes fetch 12 bytes per vertex; same memory layout as VertexColorNormal.
+	struct MeshAttributes
+	{
+		Float3 color;
+		Float3 norm;
+	};
+
+	enum class IndexFormat
+	{
+		UInt16,
+		UInt32,
+	};
+
+	// A level of detail: a range of Mesh::indices sharing the mesh's vertices.
+	struct MeshLod
+	{
+		uint32_t startIndex;
+		uint32_t indexCount;
+		float error;
+	};
+
+	// Welded triangle list as produced by the loaders. Without lods, all indices form LOD 0.
+	struct Mesh
+	{
+		std::vector<Float3> positions;
+		std::vector<MeshAttributes> attributes;		// parallel to positions
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		Float3 boundsMin;
+		Float3 boundsMax;
+	};
+
+	void ComputeBounds(const Float3* positions, size_t count, Float3& boundsMin, Float3& boundsMax);
+}
@@ -0,0 +1,205 @@
+﻿#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace FogMap;
+
+namespace
+{
+	static constexpr int CacheSize = 32;
+	static constexpr uint32_t Unassigned = 0xffffffffu;
+
+	float VertexScore(int cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The three vertices of the last triangle get a fixed score so that the next
+			// triangle does not simply reuse the same edge.
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = std::pow(1.0f - (cachePosition - 3) * (1.0f / (CacheSize - 3)), 1.5f);
+		}
+		// Prefer vertices with few triangles left so they can leave the working set early.
+		return score + 2.0f / std::sqrt(static_cast<float>(remainingTriangles));
+	}
+}
+
+VertexCacheStats FogMap::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0, uniqueVertices = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t v = indices[i];
+		// A vertex is in the FIFO if fewer than cacheSize misses happened since it was inserted.
+		if (insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize)
+		{
+			++misses;
+			insertedAt[v] = misses;
+		}
+		if (!referenced[v])
+		{
+			referenced[v] = true;
+			++uniqueVertices;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indexCount >= 3 ? static_cast<float>(misses) / (indexCount / 3) : 0.0f;
+	stats.atvr = uniqueVertices != 0 ? static_cast<float>(misses) / uniqueVertices : 0.0f;
+	return stats;
+}
+
+void FogMap::OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Per-vertex lists of triangles not emitted yet: adjacency[offsets[v], offsets[v] + remaining[v]).
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		++remaining[indices[i]];
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+	std::vector<float> triangleScore(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> result(triangleCount * 3);
+	uint32_t cache[CacheSize + 3];
+	int cacheCount = 0;
+	size_t cursor = 0;
+
+	for (size_t out = 0; out < triangleCount; ++out)
+	{
+		// Best triangle touching the cache; fall back to the next unemitted one in input order.
+		uint32_t best = Unassigned;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			uint32_t v = cache[i];
+			for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+			{
+				uint32_t t = adjacency[a];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+		if (best == Unassigned)
+		{
+			while (emitted[cursor]) ++cursor;
+			best = static_cast<uint32_t>(cursor);
+		}
+
+		emitted[best] = true;
+		const uint32_t* triangle = &indices[best * 3];
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t v = triangle[i];
+			result[out * 3 + i] = v;
+			uint32_t* live = &adjacency[offsets[v]];
+			uint32_t last = --remaining[v];
+			for (uint32_t a = 0; a <= last; ++a)
+			{
+				if (live[a] == best)
+				{
+					live[a] = live[last];
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache.
+		uint32_t newCache[CacheSize + 3];
+		int newCount = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t v = triangle[i];
+			if (newCount == 0 || (newCache[0] != v && (newCount < 2 || newCache[1] != v)))
+				newCache[newCount++] = v;
+		}
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore everything that moved or fell out of the cache, then the triangles using it.
+		for (int i = 0; i < newCount; ++i)
+		{
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < CacheSize ? i : -1;
+			float score = VertexScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+				triangleScore[adjacency[a]] += delta;
+		}
+		cacheCount = newCount < CacheSize ? newCount : CacheSize;
+		for (int i = 0; i < cacheCount; ++i)
+			cache[i] = newCache[i];
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void FogMap::OptimizeVertexFetch(Mesh& mesh)
+{
+	std::vector<uint32_t> remap(mesh.positions.size(), Unassigned);
+	uint32_t next = 0;
+	for (uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == Unassigned)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	std::vector<Float3> positions(next);
+	std::vector<MeshAttributes> attributes(next);
+	for (size_t v = 0; v < mesh.positions.size(); ++v)
+	{
+		if (remap[v] != Unassigned)
+		{
+			positions[remap[v]] = mesh.positions[v];
+			attributes[remap[v]] = mesh.attributes[v];
+		}
+	}
+	mesh.positions.swap(positions);
+	mesh.attributes.swap(attributes);
+}
+
+MeshOptimizationReport FogMap::OptimizeMesh(Mesh& mesh)
+{
+	MeshOptimizationReport report;
+	report.before = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.positions.size());
+	OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.positions.size());
+	OptimizeVertexFetch(mesh);
+	report.after = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.positions.size());
+	return report;
+}
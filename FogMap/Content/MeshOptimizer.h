@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+namespace FogMap
+{
+	// Post-transform cache efficiency of an index buffer, measured with a FIFO cache.
+	struct VertexCacheStats
+	{
+		float acmr;		// transformed vertices per triangle
+		float atvr;		// transformed vertices per referenced vertex
+	};
+
+	struct MeshOptimizationReport
+	{
+		VertexCacheStats before;
+		VertexCacheStats after;
+	};
+
+	VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+	// Reorders triangles for post-transform cache reuse (Forsyth's linear-speed algorithm).
+	// The corner order inside each triangle, and therefore the winding, is kept.
+	void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+	// Lays the vertices out in first-use order of the index buffer and drops unused ones.
+	void OptimizeVertexFetch(Mesh& mesh);
+
+	// Runs both passes and reports the cache statistics before and after.
+	MeshOptimizationReport OptimizeMesh(Mesh& mesh);
+}
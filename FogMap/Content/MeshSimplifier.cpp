@@ -0,0 +1,331 @@
+﻿#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace FogMap;
+
+namespace
+{
+	static constexpr uint32_t Unassigned = 0xffffffffu;
+
+	struct Quadric
+	{
+		double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+
+		void AddPlane(double a, double b, double c, double d)
+		{
+			a2 += a * a; b2 += b * b; c2 += c * c;
+			ab += a * b; ac += a * c; bc += b * c;
+			ad += a * d; bd += b * d; cd += c * d;
+			d2 += d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac;
+			bc += q.bc; ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2;
+		}
+
+		// Sum of squared distances of p to the accumulated planes.
+		double Evaluate(const Float3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double error = a2 * x * x + b2 * y * y + c2 * z * z + 2 * (ab * x * y + ac * x * z + bc * y * z)
+				+ 2 * (ad * x + bd * y + cd * z) + d2;
+			return std::max(error, 0.0);
+		}
+	};
+
+	struct PositionKey
+	{
+		uint32_t bits[3];
+		bool operator==(const PositionKey& other) const { return std::memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			uint64_t h = (uint64_t(key.bits[0]) * 73856093u) ^ (uint64_t(key.bits[1]) * 19349663u) ^ (uint64_t(key.bits[2]) * 83492791u);
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	// Collapse state of one mesh. Simplify may be called again with a lower target to carry
+	// on from the current result: the quadrics keep the planes of the original triangles, so
+	// the error of every result is measured against the input, not against the last result.
+	class Simplifier
+	{
+	public:
+		Simplifier(const Mesh& mesh, const uint32_t* indices, size_t indexCount);
+
+		// Collapses until the result has at most targetIndexCount indices or the next collapse
+		// would cost more than maxError.
+		void Simplify(size_t targetIndexCount, float maxError);
+		const std::vector<uint32_t>& Result() const { return m_result; }
+		// Largest collapse error so far, in model units.
+		float Error() const { return static_cast<float>(std::sqrt(m_resultCost)); }
+
+	private:
+		const Mesh& m_mesh;
+		std::vector<uint32_t> m_result;
+		std::vector<uint32_t> m_classOf;
+		std::vector<uint32_t> m_siblingOffsets;
+		std::vector<uint32_t> m_siblings;
+		std::vector<Quadric> m_quadrics;
+		std::vector<bool> m_locked;
+		double m_resultCost;
+	};
+
+	Simplifier::Simplifier(const Mesh& mesh, const uint32_t* indices, size_t indexCount) :
+		m_mesh(mesh),
+		m_result(indices, indices + indexCount - indexCount % 3),
+		m_resultCost(0.0)
+	{
+		const size_t vertexCount = mesh.positions.size();
+
+		// Collapse whole positions: vertices that only differ in their normal form one class
+		// whose representative (the first such vertex) carries the quadric.
+		m_classOf.resize(vertexCount);
+		{
+			std::unordered_map<PositionKey, uint32_t, PositionKeyHash> classes;
+			classes.reserve(vertexCount);
+			for (uint32_t v = 0; v < vertexCount; ++v)
+			{
+				PositionKey key;
+				std::memcpy(key.bits, &mesh.positions[v], sizeof(key.bits));
+				m_classOf[v] = classes.emplace(key, v).first->second;
+			}
+		}
+		m_siblingOffsets.assign(vertexCount + 1, 0);
+		m_siblings.resize(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v) ++m_siblingOffsets[m_classOf[v] + 1];
+		for (size_t v = 0; v < vertexCount; ++v) m_siblingOffsets[v + 1] += m_siblingOffsets[v];
+		{
+			std::vector<uint32_t> fill(m_siblingOffsets.begin(), m_siblingOffsets.end() - 1);
+			for (uint32_t v = 0; v < vertexCount; ++v) m_siblings[fill[m_classOf[v]]++] = v;
+		}
+
+		// Plane quadrics, and locks for boundary and non-manifold positions.
+		m_quadrics.assign(vertexCount, Quadric{});
+		m_locked.assign(vertexCount, false);
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(m_result.size());
+		for (size_t t = 0; t < m_result.size(); t += 3)
+		{
+			uint32_t c[3] = { m_classOf[m_result[t]], m_classOf[m_result[t + 1]], m_classOf[m_result[t + 2]] };
+			const Float3& p0 = mesh.positions[c[0]];
+			Float3 n = Cross(Sub(mesh.positions[c[1]], p0), Sub(mesh.positions[c[2]], p0));
+			float length = Length(n);
+			if (length > 0.0f)
+			{
+				n = Float3{ n.x / length, n.y / length, n.z / length };
+				for (uint32_t k : c)
+					m_quadrics[k].AddPlane(n.x, n.y, n.z, -Dot(n, p0));
+			}
+			for (int e = 0; e < 3; ++e)
+			{
+				uint32_t a = std::min(c[e], c[(e + 1) % 3]), b = std::max(c[e], c[(e + 1) % 3]);
+				if (a != b) ++edgeUse[uint64_t(a) << 32 | b];
+			}
+		}
+		for (const auto& edge : edgeUse)
+		{
+			if (edge.second != 2)
+			{
+				m_locked[static_cast<uint32_t>(edge.first >> 32)] = true;
+				m_locked[static_cast<uint32_t>(edge.first)] = true;
+			}
+		}
+	}
+
+	void Simplifier::Simplify(size_t targetIndexCount, float maxError)
+	{
+		const Mesh& mesh = m_mesh;
+		const size_t vertexCount = mesh.positions.size();
+		std::vector<uint32_t>& result = m_result;
+		const std::vector<uint32_t>& classOf = m_classOf;
+		std::vector<Quadric>& quadrics = m_quadrics;
+
+		const double maxCost = double(maxError) * maxError;
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1), adjacency;
+		std::vector<uint32_t> collapseTarget(vertexCount, Unassigned);
+		std::vector<bool> touched(vertexCount);
+		std::vector<Collapse> candidates;
+
+		while (result.size() > targetIndexCount)
+		{
+			// Triangles around each class, for the flip test.
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (uint32_t v : result) ++adjacencyOffsets[classOf[v] + 1];
+			for (size_t v = 0; v < vertexCount; ++v) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			adjacency.resize(result.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < result.size(); ++i) adjacency[fill[classOf[result[i]]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			// Cheapest collapse along an edge for every movable class.
+			candidates.clear();
+			std::vector<Collapse> best(vertexCount, Collapse{ Unassigned, Unassigned, 0.0 });
+			for (size_t t = 0; t < result.size(); t += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					uint32_t a = classOf[result[t + e]], b = classOf[result[t + (e + 1) % 3]];
+					for (int direction = 0; direction < 2; ++direction, std::swap(a, b))
+					{
+						if (a == b || m_locked[a])
+							continue;
+						Quadric q = quadrics[a];
+						q.Add(quadrics[b]);
+						double cost = q.Evaluate(mesh.positions[b]);
+						if (cost <= maxCost && (best[a].from == Unassigned || cost < best[a].cost))
+							best[a] = Collapse{ a, b, cost };
+					}
+				}
+			}
+			for (const Collapse& collapse : best)
+				if (collapse.from != Unassigned)
+					candidates.push_back(collapse);
+			if (candidates.empty())
+				break;
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) {
+				return x.cost < y.cost || (x.cost == y.cost && x.from < y.from);
+			});
+
+			// Apply independent collapses, cheapest first, until the target is reached. Neighbours
+			// of a collapsed class are frozen for the rest of the pass so the flip test stays valid.
+			std::fill(touched.begin(), touched.end(), false);
+			size_t remainingTriangles = result.size() / 3;
+			size_t applied = 0;
+			for (const Collapse& collapse : candidates)
+			{
+				if (remainingTriangles * 3 <= targetIndexCount)
+					break;
+				if (touched[collapse.from] || touched[collapse.to])
+					continue;
+
+				const Float3& target = mesh.positions[collapse.to];
+				bool flips = false;
+				size_t removed = 0;
+				for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+				{
+					const uint32_t* triangle = &result[adjacency[a] * 3];
+					uint32_t c[3] = { classOf[triangle[0]], classOf[triangle[1]], classOf[triangle[2]] };
+					if (c[0] == collapse.to || c[1] == collapse.to || c[2] == collapse.to)
+					{
+						++removed;
+						continue;
+					}
+					Float3 p[3], q[3];
+					for (int i = 0; i < 3; ++i)
+					{
+						p[i] = mesh.positions[c[i]];
+						q[i] = c[i] == collapse.from ? target : p[i];
+					}
+					Float3 before = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+					Float3 after = Cross(Sub(q[1], q[0]), Sub(q[2], q[0]));
+					flips = Dot(before, after) <= 0.0f;
+				}
+				if (flips)
+					continue;
+
+				collapseTarget[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				m_resultCost = std::max(m_resultCost, collapse.cost);
+				remainingTriangles -= removed;
+				++applied;
+				for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+					for (int i = 0; i < 3; ++i)
+						touched[classOf[result[adjacency[a] * 3 + i]]] = true;
+			}
+			if (applied == 0)
+				break;
+
+			// Rewrite the corners of collapsed classes to the sibling at the target position whose
+			// normal matches best, then drop the triangles that became degenerate.
+			size_t write = 0;
+			for (size_t t = 0; t < result.size(); t += 3)
+			{
+				uint32_t triangle[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					uint32_t v = result[t + i];
+					uint32_t to = collapseTarget[classOf[v]];
+					if (to != Unassigned)
+					{
+						const Float3& normal = mesh.attributes[v].norm;
+						uint32_t bestSibling = to;
+						float bestDot = -2.0f;
+						for (uint32_t s = m_siblingOffsets[to]; s < m_siblingOffsets[to + 1]; ++s)
+						{
+							float d = Dot(normal, mesh.attributes[m_siblings[s]].norm);
+							if (d > bestDot)
+							{
+								bestDot = d;
+								bestSibling = m_siblings[s];
+							}
+						}
+						v = bestSibling;
+					}
+					triangle[i] = v;
+				}
+				uint32_t c0 = classOf[triangle[0]], c1 = classOf[triangle[1]], c2 = classOf[triangle[2]];
+				if (c0 == c1 || c1 == c2 || c0 == c2)
+					continue;
+				result[write++] = triangle[0];
+				result[write++] = triangle[1];
+				result[write++] = triangle[2];
+			}
+			result.resize(write);
+			for (const Collapse& collapse : candidates)
+				collapseTarget[collapse.from] = Unassigned;
+		}
+	}
+}
+
+float FogMap::SimplifyMesh(const Mesh& mesh, const uint32_t* indices, size_t indexCount,
+	size_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+{
+	Simplifier simplifier(mesh, indices, indexCount);
+	simplifier.Simplify(targetIndexCount, maxError);
+	result = simplifier.Result();
+	return simplifier.Error();
+}
+
+void FogMap::BuildLodChain(Mesh& mesh, const LodSettings& settings)
+{
+	mesh.lods.assign(1, MeshLod{ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+
+	// Every level continues the collapses of the one before, so its error bounds the deviation
+	// from LOD 0 rather than from the previous level.
+	Simplifier simplifier(mesh, mesh.indices.data(), mesh.indices.size());
+	std::vector<uint32_t> lodIndices;
+	while (mesh.lods.size() < settings.maxLods)
+	{
+		const MeshLod previous = mesh.lods.back();
+		size_t target = static_cast<size_t>(previous.indexCount / 3 * settings.triangleRatio) * 3;
+		simplifier.Simplify(target, settings.maxError);
+		lodIndices = simplifier.Result();
+		if (lodIndices.empty() || lodIndices.size() > previous.indexCount * 9 / 10)
+			break;
+
+		OptimizeVertexCache(lodIndices.data(), lodIndices.size(), mesh.positions.size());
+		mesh.lods.push_back(MeshLod{ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lodIndices.size()),
+			simplifier.Error() });
+		mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+}
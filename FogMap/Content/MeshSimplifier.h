@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+namespace FogMap
+{
+	// Simplifies a triangle list by quadric-error edge collapses onto existing vertices, so the
+	// result indexes the mesh's vertices and can share its vertex buffer. Open boundaries and
+	// non-manifold edges are never moved. Stops at targetIndexCount or when the next collapse
+	// would exceed maxError (model units). Returns the error of the result.
+	float SimplifyMesh(const Mesh& mesh, const uint32_t* indices, size_t indexCount,
+		size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+	struct LodSettings
+	{
+		uint32_t maxLods = 5;				// including LOD 0
+		float triangleRatio = 0.5f;			// target triangles relative to the previous level
+		float maxError = 0.1f;				// from LOD 0, in model units
+	};
+
+	// Appends successively coarser levels after the mesh's current indices and records them in
+	// mesh.lods. Each level is simplified further from the one before with the quadrics of LOD 0,
+	// so its error bounds its deviation from LOD 0. Stops early once a level no longer removes a
+	// meaningful number of triangles.
+	void BuildLodChain(Mesh& mesh, const LodSettings& settings);
+}
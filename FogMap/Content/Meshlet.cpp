@@ -0,0 +1,262 @@
+﻿#include "Meshlet.h"
+
+#include <algorithm>
+
+using namespace FogMap;
+
+namespace
+{
+	// Where a vertex was copied to in one of LOD 0's meshlets.
+	struct VertexCopy
+	{
+		uint32_t meshlet;
+		uint32_t local;
+	};
+}
+
+IndexFormat FogMap::ChooseIndexFormat(size_t vertexCount)
+{
+	return vertexCount <= MaxMeshletVertices ? IndexFormat::UInt16 : IndexFormat::UInt32;
+}
+
+void FogMap::BuildMeshlets(const Mesh& mesh, const uint32_t* indices, size_t indexCount, uint32_t maxVertices, MeshletMesh& result)
+{
+	static constexpr uint32_t unassigned = 0xffffffffu;
+
+	result.indices.reserve(result.indices.size() + indexCount);
+	if (maxVertices < 3 || maxVertices > MaxMeshletVertices)
+		maxVertices = MaxMeshletVertices;
+
+	// Global vertex index -> index local to the current meshlet.
+	std::vector<uint32_t> localIndex(mesh.positions.size(), unassigned);
+	std::vector<uint32_t> assigned;
+	assigned.reserve(maxVertices);
+
+	auto closeMeshlet = [&]() {
+		Meshlet meshlet;
+		meshlet.baseVertex = static_cast<uint32_t>(result.positions.size());
+		meshlet.vertexCount = static_cast<uint32_t>(assigned.size());
+		meshlet.startIndex = result.meshlets.empty() ? 0 : result.meshlets.back().startIndex + result.meshlets.back().indexCount;
+		meshlet.indexCount = static_cast<uint32_t>(result.indices.size()) - meshlet.startIndex;
+		for (uint32_t v : assigned)
+		{
+			result.positions.push_back(mesh.positions[v]);
+			result.attributes.push_back(mesh.attributes[v]);
+			localIndex[v] = unassigned;
+		}
+		ComputeBounds(result.positions.data() + meshlet.baseVertex, meshlet.vertexCount, meshlet.boundsMin, meshlet.boundsMax);
+		result.meshlets.push_back(meshlet);
+		assigned.clear();
+	};
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		const uint32_t* triangle = &indices[t];
+		uint32_t required = 0;
+		for (int i = 0; i < 3; ++i)
+			if (localIndex[triangle[i]] == unassigned && (i == 0 || triangle[i] != triangle[0]) && (i < 2 || triangle[2] != triangle[1]))
+				++required;
+		if (assigned.size() + required > maxVertices)
+			closeMeshlet();
+
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t& local = localIndex[triangle[i]];
+			if (local == unassigned)
+			{
+				local = static_cast<uint32_t>(assigned.size());
+				assigned.push_back(triangle[i]);
+			}
+			result.indices.push_back(static_cast<uint16_t>(local));
+		}
+	}
+	if (!assigned.empty())
+		closeMeshlet();
+}
+
+MeshBuffers FogMap::PackMesh(const Mesh& mesh, bool splitMeshlets, MeshletMesh& storage)
+{
+	const uint32_t vertexCount = static_cast<uint32_t>(mesh.positions.size());
+	const uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size());
+	std::vector<MeshLod> levels = mesh.lods;
+	if (levels.empty())
+		levels.push_back(MeshLod{ 0, indexCount, 0.0f });
+
+	storage.positions.clear();
+	storage.attributes.clear();
+	storage.indices.clear();
+	storage.meshlets.clear();
+	storage.lods.clear();
+
+	MeshBuffers buffers;
+	buffers.positions = mesh.positions.data();
+	buffers.attributes = mesh.attributes.data();
+	buffers.vertexCount = vertexCount;
+	buffers.indices = mesh.indices.data();
+	buffers.indexCount = indexCount;
+	buffers.indexFormat = IndexFormat::UInt32;
+	buffers.boundsMin = mesh.boundsMin;
+	buffers.boundsMax = mesh.boundsMax;
+
+	const bool narrow = ChooseIndexFormat(vertexCount) == IndexFormat::UInt16;
+	if (!narrow && splitMeshlets)
+	{
+		storage.positions.reserve(vertexCount);
+		storage.attributes.reserve(vertexCount);
+		const MeshLod& base = levels[0];
+		BuildMeshlets(mesh, mesh.indices.data() + base.startIndex, base.indexCount, MaxMeshletVertices, storage);
+		const uint32_t baseMeshletCount = static_cast<uint32_t>(storage.meshlets.size());
+		storage.lods.push_back(MeshletLod{ 0, baseMeshletCount, base.indexCount / 3, base.error });
+
+		// Copies of every vertex in LOD 0's meshlets, by meshlet. The meshlet indices line up
+		// with LOD 0's, so each local index names its vertex.
+		const uint32_t copyCount = static_cast<uint32_t>(storage.positions.size());
+		std::vector<uint32_t> copyOffsets(vertexCount + 1, 0);
+		std::vector<VertexCopy> copies(copyCount);
+		{
+			std::vector<uint32_t> vertexOf(copyCount);
+			for (const Meshlet& meshlet : storage.meshlets)
+				for (uint32_t i = meshlet.startIndex; i < meshlet.startIndex + meshlet.indexCount; ++i)
+					vertexOf[meshlet.baseVertex + storage.indices[i]] = mesh.indices[base.startIndex + i];
+
+			// Put the vertices that the coarsest levels keep first in every meshlet, so that a
+			// coarser level's vertices sit at the front of the range instead of all across it.
+			std::vector<uint32_t> coarsest(vertexCount, 0);
+			for (uint32_t l = 1; l < levels.size(); ++l)
+				for (uint32_t i = levels[l].startIndex; i < levels[l].startIndex + levels[l].indexCount; ++i)
+					coarsest[mesh.indices[i]] = l;
+			std::vector<uint32_t> order, localOf;
+			for (const Meshlet& meshlet : storage.meshlets)
+			{
+				order.resize(meshlet.vertexCount);
+				localOf.resize(meshlet.vertexCount);
+				for (uint32_t local = 0; local < meshlet.vertexCount; ++local)
+					order[local] = local;
+				std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+					return coarsest[vertexOf[meshlet.baseVertex + a]] > coarsest[vertexOf[meshlet.baseVertex + b]];
+				});
+				for (uint32_t local = 0; local < meshlet.vertexCount; ++local)
+				{
+					const uint32_t from = meshlet.baseVertex + order[local], to = meshlet.baseVertex + local;
+					localOf[order[local]] = local;
+					storage.positions[to] = mesh.positions[vertexOf[from]];
+					storage.attributes[to] = mesh.attributes[vertexOf[from]];
+				}
+				for (uint32_t i = meshlet.startIndex; i < meshlet.startIndex + meshlet.indexCount; ++i)
+					storage.indices[i] = static_cast<uint16_t>(localOf[storage.indices[i]]);
+				for (uint32_t i = meshlet.startIndex; i < meshlet.startIndex + meshlet.indexCount; ++i)
+					vertexOf[meshlet.baseVertex + storage.indices[i]] = mesh.indices[base.startIndex + i];
+			}
+
+			for (uint32_t copy = 0; copy < copyCount; ++copy) ++copyOffsets[vertexOf[copy] + 1];
+			for (uint32_t v = 0; v < vertexCount; ++v) copyOffsets[v + 1] += copyOffsets[v];
+			std::vector<uint32_t> fill(copyOffsets.begin(), copyOffsets.end() - 1);
+			for (uint32_t m = 0; m < baseMeshletCount; ++m)
+			{
+				const Meshlet& meshlet = storage.meshlets[m];
+				for (uint32_t local = 0; local < meshlet.vertexCount; ++local)
+					copies[fill[vertexOf[meshlet.baseVertex + local]]++] = VertexCopy{ m, local };
+			}
+		}
+		auto findCopy = [&](uint32_t vertex, uint32_t meshlet) -> const VertexCopy* {
+			for (uint32_t c = copyOffsets[vertex]; c < copyOffsets[vertex + 1]; ++c)
+				if (copies[c].meshlet == meshlet)
+					return &copies[c];
+			return nullptr;
+		};
+
+		// Coarser levels are made of LOD 0's vertices. A triangle whose corners all have a copy
+		// in one of LOD 0's meshlets draws from that meshlet's vertex range; only the others
+		// get copies of their own.
+		std::vector<std::vector<uint16_t>> groups(baseMeshletCount);
+		std::vector<uint32_t> spilled;
+		std::vector<Float3> used;
+		for (size_t l = 1; l < levels.size(); ++l)
+		{
+			const MeshLod& level = levels[l];
+			const uint32_t firstMeshlet = static_cast<uint32_t>(storage.meshlets.size());
+			spilled.clear();
+			for (uint32_t t = 0; t + 2 < level.indexCount; t += 3)
+			{
+				const uint32_t* triangle = &mesh.indices[level.startIndex + t];
+				const VertexCopy* corners[3] = { nullptr, nullptr, nullptr };
+				for (uint32_t c = copyOffsets[triangle[0]]; c < copyOffsets[triangle[0] + 1] && corners[2] == nullptr; ++c)
+				{
+					corners[0] = &copies[c];
+					corners[1] = findCopy(triangle[1], copies[c].meshlet);
+					corners[2] = corners[1] != nullptr ? findCopy(triangle[2], copies[c].meshlet) : nullptr;
+				}
+				if (corners[2] == nullptr)
+				{
+					spilled.insert(spilled.end(), triangle, triangle + 3);
+					continue;
+				}
+				for (const VertexCopy* corner : corners)
+					groups[corner->meshlet].push_back(static_cast<uint16_t>(corner->local));
+			}
+
+			for (uint32_t m = 0; m < baseMeshletCount; ++m)
+			{
+				std::vector<uint16_t>& group = groups[m];
+				if (group.empty())
+					continue;
+				// Narrow the range to the vertices the level uses.
+				const uint16_t first = *std::min_element(group.begin(), group.end());
+				const uint16_t last = *std::max_element(group.begin(), group.end());
+				Meshlet meshlet;
+				meshlet.baseVertex = storage.meshlets[m].baseVertex + first;
+				meshlet.vertexCount = last - first + 1u;
+				meshlet.startIndex = static_cast<uint32_t>(storage.indices.size());
+				meshlet.indexCount = static_cast<uint32_t>(group.size());
+				used.clear();
+				for (uint16_t local : group)
+				{
+					storage.indices.push_back(static_cast<uint16_t>(local - first));
+					used.push_back(storage.positions[meshlet.baseVertex + local - first]);
+				}
+				ComputeBounds(used.data(), used.size(), meshlet.boundsMin, meshlet.boundsMax);
+				storage.meshlets.push_back(meshlet);
+				group.clear();
+			}
+			if (!spilled.empty())
+				BuildMeshlets(mesh, spilled.data(), spilled.size(), MaxMeshletVertices, storage);
+			storage.lods.push_back(MeshletLod{ firstMeshlet, static_cast<uint32_t>(storage.meshlets.size()) - firstMeshlet,
+				level.indexCount / 3, level.error });
+		}
+		buffers.positions = storage.positions.data();
+		buffers.attributes = storage.attributes.data();
+		buffers.vertexCount = static_cast<uint32_t>(storage.positions.size());
+		buffers.indices = storage.indices.data();
+		buffers.indexCount = static_cast<uint32_t>(storage.indices.size());
+		buffers.indexFormat = IndexFormat::UInt16;
+	}
+	else
+	{
+		for (const MeshLod& level : levels)
+		{
+			storage.lods.push_back(MeshletLod{ static_cast<uint32_t>(storage.meshlets.size()), 1, level.indexCount / 3, level.error });
+			storage.meshlets.push_back(Meshlet{ 0, vertexCount, level.startIndex, level.indexCount, mesh.boundsMin, mesh.boundsMax });
+		}
+		if (narrow)
+		{
+			storage.indices.resize(indexCount);
+			for (uint32_t i = 0; i < indexCount; ++i)
+				storage.indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+			buffers.indices = storage.indices.data();
+			buffers.indexFormat = IndexFormat::UInt16;
+		}
+	}
+	buffers.meshlets = storage.meshlets.data();
+	buffers.meshletCount = static_cast<uint32_t>(storage.meshlets.size());
+	buffers.lods = storage.lods.data();
+	buffers.lodCount = static_cast<uint32_t>(storage.lods.size());
+	return buffers;
+}
+
+uint32_t FogMap::SelectLod(const MeshletLod* lods, uint32_t lodCount, float maxError, uint32_t maxTriangles)
+{
+	uint32_t lod = 0;
+	while (lod + 1 < lodCount && (lods[lod + 1].error <= maxError || (maxTriangles != 0 && lods[lod].triangleCount > maxTriangles)))
+		++lod;
+	return lod;
+}
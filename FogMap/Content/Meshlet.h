@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+namespace FogMap
+{
+	// Largest vertex count addressable with 16-bit indices.
+	static constexpr uint32_t MaxMeshletVertices = 65535;
+
+	// A run of consecutive triangles drawn with DrawIndexed(indexCount, startIndex, baseVertex).
+	struct Meshlet
+	{
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		uint32_t startIndex;
+		uint32_t indexCount;
+		Float3 boundsMin;
+		Float3 boundsMax;
+	};
+
+	// A level of detail as the run of meshlets that draws it.
+	struct MeshletLod
+	{
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t triangleCount;
+		float error;
+	};
+
+	// Mesh re-indexed into meshlets that each fit 16-bit indices. Vertices shared across a
+	// meshlet boundary are duplicated into both vertex ranges. Coarser levels draw from LOD 0's
+	// ranges, so they only add copies for triangles with no LOD 0 meshlet holding all three
+	// corners: a few percent more vertices than the welded mesh, where a copy per level
+	// about doubled it.
+	struct MeshletMesh
+	{
+		std::vector<Float3> positions;
+		std::vector<MeshAttributes> attributes;
+		std::vector<uint16_t> indices;
+		std::vector<Meshlet> meshlets;
+		std::vector<MeshletLod> lods;
+	};
+
+	// Upload-ready arrays, pointing either into a Mesh/MeshletMesh pair or into a mapped mesh cache.
+	// Positions and attributes are separate vertex streams of vertexCount elements each.
+	struct MeshBuffers
+	{
+		const Float3* positions;
+		const MeshAttributes* attributes;
+		uint32_t vertexCount;
+		const void* indices;
+		uint32_t indexCount;
+		IndexFormat indexFormat;
+		const Meshlet* meshlets;
+		uint32_t meshletCount;
+		const MeshletLod* lods;
+		uint32_t lodCount;
+		Float3 boundsMin;
+		Float3 boundsMax;
+	};
+
+	IndexFormat ChooseIndexFormat(size_t vertexCount);
+
+	// Splits a range of the triangle list in its original order, starting a new meshlet
+	// whenever the next triangle would exceed maxVertices unique vertices. Appends to result.
+	void BuildMeshlets(const Mesh& mesh, const uint32_t* indices, size_t indexCount, uint32_t maxVertices, MeshletMesh& result);
+
+	// Picks the index width for the mesh and fills in the arrays to upload. Data that has to
+	// be rebuilt (narrowed indices, meshlets) goes into storage; both mesh and storage must
+	// outlive the returned buffers. Without splitMeshlets, large meshes use 32-bit indices.
+	// Every level in mesh.lods (or the whole index list) becomes one MeshletLod. Split meshes
+	// keep each LOD 0 meshlet's vertices ordered coarsest level first, so a coarser level's
+	// meshlets cover little more than the vertices they use.
+	MeshBuffers PackMesh(const Mesh& mesh, bool splitMeshlets, MeshletMesh& storage);
+
+	// Coarsest level whose error is within maxError. Coarser levels are also taken while the
+	// current one has more than maxTriangles triangles (0 = no budget).
+	uint32_t SelectLod(const MeshletLod* lods, uint32_t lodCount, float maxError, uint32_t maxTriangles);
+}
@@ -0,0 +1,404 @@
+﻿#include "ObjLoader.h"
+#include "JobSystem.h"
+#include "VectorMath.h"
+#include "VertexWelder.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FOGMAP_OBJ_SSE2
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FOGMAP_OBJ_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace FogMap;
+
+namespace
+{
+	inline unsigned CountTrailingZeros(uint32_t mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// Returns the first '\n' in [p, end), or end.
+	const char* FindNewline(const char* p, const char* end)
+	{
+#if defined(FOGMAP_OBJ_SSE2)
+		const __m128i newline = _mm_set1_epi8('\n');
+		while (end - p >= 16)
+		{
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newline));
+			if (mask != 0)
+				return p + CountTrailingZeros(mask);
+			p += 16;
+		}
+#elif defined(FOGMAP_OBJ_NEON)
+		const uint8x16_t newline = vdupq_n_u8('\n');
+		while (end - p >= 16)
+		{
+			// Narrow the byte mask to one nibble per byte so it fits in 64 bits.
+			uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(p)), newline);
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+			if (mask != 0)
+			{
+				uint32_t low = static_cast<uint32_t>(mask);
+				return p + (low != 0 ? CountTrailingZeros(low) : 32 + CountTrailingZeros(static_cast<uint32_t>(mask >> 32))) / 4;
+			}
+			p += 16;
+		}
+#endif
+		while (p < end && *p != '\n') ++p;
+		return p;
+	}
+
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* SkipBlanks(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p)) ++p;
+		return p;
+	}
+
+#if !defined(__cpp_lib_to_chars)
+	// Fallback for standard libraries without floating-point from_chars.
+	std::from_chars_result ParseFloat(const char* first, const char* last, float& value)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		const char* p = first;
+		bool negative = p < last && *p == '-';
+		if (negative) ++p;
+
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		const char* digitsBegin = p;
+		for (; p < last && unsigned(*p - '0') < 10; ++p)
+		{
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); ++digits; }
+			else ++exponent;
+		}
+		bool hasDigits = p != digitsBegin;
+		if (p < last && *p == '.')
+		{
+			const char* fractionBegin = ++p;
+			for (; p < last && unsigned(*p - '0') < 10; ++p)
+			{
+				if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); ++digits; --exponent; }
+			}
+			hasDigits = hasDigits || p != fractionBegin;
+		}
+		if (!hasDigits)
+			return { first, std::errc::invalid_argument };
+
+		if (p < last && (*p == 'e' || *p == 'E'))
+		{
+			int explicitExponent = 0;
+			auto result = std::from_chars(p + 1 + (p + 1 < last && p[1] == '+'), last, explicitExponent);
+			if (result.ec == std::errc())
+			{
+				exponent += explicitExponent;
+				p = result.ptr;
+			}
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+			result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+		value = static_cast<float>(negative ? -result : result);
+		return { p, std::errc() };
+	}
+#else
+	inline std::from_chars_result ParseFloat(const char* first, const char* last, float& value)
+	{
+		return std::from_chars(first, last, value);
+	}
+#endif
+
+	// Parses three whitespace-separated floats; missing components stay zero.
+	const char* ParseFloat3(const char* p, const char* end, Float3& v)
+	{
+		float* components[] = { &v.x, &v.y, &v.z };
+		for (float* component : components)
+		{
+			p = SkipBlanks(p, end);
+			if (p < end && *p == '+') ++p;
+			auto result = ParseFloat(p, end, *component);
+			if (result.ec != std::errc())
+				return p;
+			p = result.ptr;
+		}
+		return p;
+	}
+
+	// Converts a 1-based or negative (relative) OBJ index to a 0-based one.
+	inline bool ResolveIndex(int index, size_t count, uint32_t& resolved)
+	{
+		if (index > 0 && static_cast<size_t>(index) <= count)
+			resolved = static_cast<uint32_t>(index - 1);
+		else if (index < 0 && static_cast<size_t>(-static_cast<int64_t>(index)) <= count)
+			resolved = static_cast<uint32_t>(count + index);
+		else
+			return false;
+		return true;
+	}
+
+	// Number of positions and normals defined before a chunk of the file.
+	struct RecordBase
+	{
+		size_t positions;
+		size_t normals;
+	};
+
+	// Parses one "v", "v/t", "v//n" or "v/t/n" token.
+	const char* ParseCorner(const char* p, const char* end, const ObjData& obj, RecordBase base, ObjCorner& corner, bool& ok)
+	{
+		int position = 0, normal = 0;
+		auto result = std::from_chars(p, end, position);
+		ok = result.ec == std::errc() && ResolveIndex(position, base.positions + obj.positions.size(), corner.position);
+		p = result.ptr;
+		corner.normal = ObjMissingIndex;
+		if (p < end && *p == '/')
+		{
+			++p;
+			int texcoord;
+			p = std::from_chars(p, end, texcoord).ptr;
+			if (p < end && *p == '/')
+			{
+				result = std::from_chars(p + 1, end, normal);
+				ok = ok && result.ec == std::errc() && ResolveIndex(normal, base.normals + obj.normals.size(), corner.normal);
+				p = result.ptr;
+			}
+		}
+		return p;
+	}
+
+	bool ParseFace(const char* p, const char* end, ObjData& obj, RecordBase base)
+	{
+		ObjCorner first, previous;
+		int count = 0;
+		for (p = SkipBlanks(p, end); p < end; p = SkipBlanks(p, end), ++count)
+		{
+			ObjCorner corner;
+			bool ok;
+			p = ParseCorner(p, end, obj, base, corner, ok);
+			if (!ok)
+				return false;
+			if (count == 0)
+				first = corner;
+			else if (count >= 2)
+			{
+				obj.corners.push_back(first);
+				obj.corners.push_back(previous);
+				obj.corners.push_back(corner);
+			}
+			previous = corner;
+		}
+		return count >= 3;
+	}
+
+	// Parses the lines in [p, end). Face indices are resolved against the records of all
+	// earlier chunks (base) plus the ones already parsed into obj.
+	bool ParseRange(const char* p, const char* end, RecordBase base, ObjData& obj)
+	{
+		const size_t firstNormal = obj.normals.size();
+		while (p < end)
+		{
+			const char* lineEnd = FindNewline(p, end);
+			p = SkipBlanks(p, lineEnd);
+			if (lineEnd - p >= 2 && p[0] == 'v' && IsBlank(p[1]))
+			{
+				Float3 v{};
+				ParseFloat3(p + 2, lineEnd, v);
+				obj.positions.push_back(v);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2]))
+			{
+				Float3 vn{};
+				ParseFloat3(p + 3, lineEnd, vn);
+				obj.normals.push_back(vn);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && IsBlank(p[1]))
+			{
+				if (!ParseFace(p + 2, lineEnd, obj, base))
+					return false;
+			}
+			p = lineEnd + 1;
+		}
+		// Normalised in one batch rather than per record.
+		NormalizeVectors(obj.normals.data() + firstNormal, obj.normals.size() - firstNormal);
+		return true;
+	}
+
+	// Counts "v" and "vn" records in [p, end) without parsing them.
+	RecordBase CountRecords(const char* p, const char* end)
+	{
+		RecordBase count{ 0, 0 };
+		while (p < end)
+		{
+			const char* lineEnd = FindNewline(p, end);
+			p = SkipBlanks(p, lineEnd);
+			if (lineEnd - p >= 2 && p[0] == 'v')
+			{
+				if (IsBlank(p[1]))
+					++count.positions;
+				else if (lineEnd - p >= 3 && p[1] == 'n' && IsBlank(p[2]))
+					++count.normals;
+			}
+			p = lineEnd + 1;
+		}
+		return count;
+	}
+
+	template <typename T>
+	void AppendChunks(std::vector<T> ObjData::* member, const std::vector<ObjData>& chunks, ObjData& obj)
+	{
+		size_t total = 0;
+		for (const ObjData& chunk : chunks) total += (chunk.*member).size();
+		(obj.*member).reserve(total);
+		for (const ObjData& chunk : chunks)
+			(obj.*member).insert((obj.*member).end(), (chunk.*member).begin(), (chunk.*member).end());
+	}
+}
+
+bool FogMap::ParseObj(const char* data, size_t size, ObjData& obj)
+{
+	obj.positions.clear();
+	obj.normals.clear();
+	obj.corners.clear();
+	return ParseRange(data, data + size, RecordBase{ 0, 0 }, obj);
+}
+
+bool FogMap::ParseObjParallel(const char* data, size_t size, JobSystem& jobs, ObjData& obj)
+{
+	static constexpr size_t minChunkSize = 1 << 20;
+
+	const char* end = data + size;
+	size_t chunkCount = std::min<size_t>(jobs.GetThreadCount(), size / minChunkSize);
+	if (chunkCount <= 1)
+		return ParseObj(data, size, obj);
+
+	// Cut the buffer into chunks that start right after a newline.
+	std::vector<const char*> bounds(chunkCount + 1, end);
+	bounds[0] = data;
+	for (size_t i = 1; i < chunkCount; ++i)
+	{
+		const char* cut = std::max(data + size / chunkCount * i, bounds[i - 1]);
+		bounds[i] = std::min(FindNewline(cut, end) + 1, end);
+	}
+
+	auto runChunks = [&jobs, chunkCount](const std::function<void(size_t)>& work) {
+		jobs.ParallelFor(chunkCount, 1, [&work](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				work(i);
+		});
+	};
+
+	// First pass counts records so every chunk knows its global index base; the second
+	// pass then resolves face indices exactly as a serial parse would.
+	std::vector<RecordBase> bases(chunkCount);
+	runChunks([&](size_t i) { bases[i] = CountRecords(bounds[i], bounds[i + 1]); });
+	RecordBase running{ 0, 0 };
+	for (RecordBase& base : bases)
+	{
+		RecordBase count = base;
+		base = running;
+		running.positions += count.positions;
+		running.normals += count.normals;
+	}
+
+	std::vector<ObjData> chunks(chunkCount);
+	std::unique_ptr<bool[]> succeeded(new bool[chunkCount]);
+	runChunks([&](size_t i) { succeeded[i] = ParseRange(bounds[i], bounds[i + 1], bases[i], chunks[i]); });
+	for (size_t i = 0; i < chunkCount; ++i)
+		if (!succeeded[i])
+			return false;
+
+	obj.positions.clear();
+	obj.normals.clear();
+	obj.corners.clear();
+	AppendChunks(&ObjData::positions, chunks, obj);
+	AppendChunks(&ObjData::normals, chunks, obj);
+	AppendChunks(&ObjData::corners, chunks, obj);
+	return true;
+}
+
+void FogMap::BuildMesh(const ObjData& obj, Mesh& mesh)
+{
+	static const Float3 color{ 0.9f, 0.9f, 0.9f };
+	static const Float3 missingNormal{ 0.0f, 0.0f, 0.0f };
+	VertexWelder welder(obj.positions.size());
+	std::vector<Float3>& positions = mesh.positions;
+	std::vector<MeshAttributes>& attributes = mesh.attributes;
+	std::vector<uint32_t>& indices = mesh.indices;
+
+	positions.clear();
+	positions.reserve(obj.positions.size());
+	attributes.clear();
+	attributes.reserve(obj.positions.size());
+	indices.clear();
+	indices.reserve(obj.corners.size());
+	for (size_t c = 0; c < obj.corners.size(); c += 3)
+	{
+		uint32_t ind[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const ObjCorner& corner = obj.corners[c + i];
+			if (welder.Insert(corner.position, corner.normal, ind[i]))
+			{
+				positions.push_back(obj.positions[corner.position]);
+				attributes.push_back(MeshAttributes{ color, corner.normal == ObjMissingIndex ? missingNormal : obj.normals[corner.normal] });
+			}
+		}
+		const Float3& v0 = positions[ind[0]];
+		const Float3& v1 = positions[ind[1]];
+		const Float3& v2 = positions[ind[2]];
+		const Float3& n1 = attributes[ind[1]].norm;
+		Float3 a{ v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+		Float3 b{ v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+		float dot = (a.y * b.z - a.z * b.y) * n1.x + (a.z * b.x - a.x * b.z) * n1.y + (a.x * b.y - a.y * b.x) * n1.z;
+		if (dot < 0) std::swap(ind[1], ind[2]);
+		for (int i = 0; i < 3; ++i) indices.push_back(ind[i]);
+	}
+	ComputeBounds(positions.data(), positions.size(), mesh.boundsMin, mesh.boundsMax);
+}
+
+bool FogMap::LoadObjMesh(const uint8_t* data, size_t size, Mesh& mesh)
+{
+	ObjData obj;
+	if (!ParseObj(reinterpret_cast<const char*>(data), size, obj))
+		return false;
+	BuildMesh(obj, mesh);
+	return true;
+}
+
+bool FogMap::LoadObjMesh(const uint8_t* data, size_t size, Mesh& mesh, JobSystem& jobs)
+{
+	ObjData obj;
+	if (!ParseObjParallel(reinterpret_cast<const char*>(data), size, jobs, obj))
+		return false;
+	BuildMesh(obj, mesh);
+	return true;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace FogMap
+{
+	class JobSystem;
+
+	// One face corner with 0-based indices into ObjData::positions and ObjData::normals.
+	struct ObjCorner
+	{
+		uint32_t position;
+		uint32_t normal;
+	};
+
+	static constexpr uint32_t ObjMissingIndex = 0xffffffffu;
+
+	// Raw records of an OBJ file. Polygons are fan-triangulated, so corners come in triples.
+	struct ObjData
+	{
+		std::vector<Float3> positions;
+		std::vector<Float3> normals;
+		std::vector<ObjCorner> corners;
+	};
+
+	// Scans the file contents in place; returns false on malformed or out-of-range face records.
+	bool ParseObj(const char* data, size_t size, ObjData& obj);
+
+	// Same result as ParseObj, with chunks of at least 1 MB split at line boundaries and
+	// parsed as jobs on up to jobs.GetThreadCount() threads.
+	bool ParseObjParallel(const char* data, size_t size, JobSystem& jobs, ObjData& obj);
+
+	// Welds the corners into a vertex/index list and fixes the winding against the stored normals.
+	void BuildMesh(const ObjData& obj, Mesh& mesh);
+
+	// Parses on the calling thread, or with ParseObjParallel on jobs.
+	bool LoadObjMesh(const uint8_t* data, size_t size, Mesh& mesh);
+	bool LoadObjMesh(const uint8_t* data, size_t size, Mesh& mesh, JobSystem& jobs);
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include "FogCells.h"
+#include "MatrixMath.h"
+#include "Meshlet.h"
+
+namespace FogMap
+{
+	static constexpr uint32_t ShadowMapSize = 1024;
+
+	// The fixed pipelines of the frame. Each one implies its render target, vertex streams,
+	// shaders and blend state:
+	//   Shadow   - clears and fills the square light depth map from mesh positions;
+	//   Scene    - lit mesh with the 5-tap shadow test into the cleared back buffer;
+	//   FogCells - fog slices alpha-blended over the scene, sampling the shadow map;
+	//   FogRayMarch - one full-screen triangle marching FrameDescription::fogMarch through the
+	//                 fog up to the scene depth, blended premultiplied over the scene. It has
+	//                 no draws.
+	enum class PassType
+	{
+		Shadow,
+		Scene,
+		FogCells,
+		FogRayMarch,
+	};
+
+	// DrawIndexed(indexCount, startIndex, baseVertex); the draw references vertices
+	// [baseVertex, baseVertex + vertexCount).
+	struct DrawCall
+	{
+		uint32_t startIndex;
+		uint32_t indexCount;
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+	};
+
+	// The matrices of one pass, composed on the CPU once per frame so that vertex shaders do one
+	// matrix multiply per output instead of three.
+	struct PassTransforms
+	{
+		Float4x4 modelViewProjection;
+		Float4x4 modelLightViewProjection;
+		Float4x4 normal;			// MatrixNormal(model)
+	};
+
+	inline PassTransforms ComposePassTransforms(const Float4x4& model, const Float4x4& viewProjection, const Float4x4& lightViewProjection)
+	{
+		return PassTransforms{ MatrixMultiply(model, viewProjection), MatrixMultiply(model, lightViewProjection), MatrixNormal(model) };
+	}
+
+	struct RenderPass
+	{
+		PassType type;
+		PassTransforms transforms;
+		uint32_t firstDraw;		// into FrameDescription::draws
+		uint32_t drawCount;
+	};
+
+	// The camera and light matrices the pass transforms are composed from.
+	struct ViewConstants
+	{
+		Float4x4 view;
+		Float4x4 projection;
+		Float4x4 lightView;
+		Float4x4 lightProjection;
+	};
+
+	// Same memory layout as LightBuffer.
+	struct LightConstants
+	{
+		Float4 diffuseColor;
+		Float4 ambientColor;
+		Float3 lightDirection;		// normalised
+		float padding;
+	};
+
+	// Everything a backend needs to draw one frame, in submission order.
+	struct FrameDescription
+	{
+		ViewConstants view;
+		LightConstants light;
+		std::vector<RenderPass> passes;
+		std::vector<DrawCall> draws;
+		// Fog cells built for this frame (FogSlicing::ViewAligned). When there are any, the
+		// FogCells pass draws from them instead of the geometry given to SetFogCells.
+		std::vector<FogCellVertex> fogVertices;
+		std::vector<uint16_t> fogIndices;
+		FogRayMarch fogMarch;
+		// How the FogRayMarch pass places its rays; lineCount is 0 unless FogSlicing::Epipolar.
+		// Backends without epipolar sampling march every pixel.
+		FogEpipolarSettings fogEpipolar;
+		// The froxel grid the FogRayMarch pass reads instead; width is 0 unless
+		// FogSlicing::Froxel. Backends without a froxel grid march every pixel.
+		FogFroxelSettings fogFroxels;
+	};
+
+	// A device that can execute frames built by RendererCore. Geometry is uploaded once;
+	// draws then refer to it by index range.
+	class RenderBackend
+	{
+	public:
+		virtual ~RenderBackend() {}
+
+		// Scene mesh for the Shadow and Scene passes, in the float vertex layout.
+		virtual void SetMesh(const MeshBuffers& buffers) = 0;
+		// Geometry for the FogCells pass.
+		virtual void SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices) = 0;
+		virtual void Submit(const FrameDescription& frame) = 0;
+	};
+}
@@ -0,0 +1,243 @@
+﻿#include "RendererCore.h"
+
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+using namespace FogMap;
+
+namespace
+{
+	const float Pi = 3.14159265f;
+	const float NearZ = 0.01f;
+}
+
+RendererCore::RendererCore(const RendererSettings& settings) :
+	m_settings(settings),
+	m_meshBuffers{},
+	m_meshCenter{ 0.0f, 0.0f, 0.0f },
+	m_meshRadius(0.0f),
+	m_fogLevel(0),
+	m_framesSinceFogChange(0),
+	m_frameTimeAverage(0.0),
+	m_model(MatrixRotationY(-Pi / 2)),
+	m_eyePosition{ 0.0f, 5.0f, 10.0f },
+	m_fovAngleY(70.0f * Pi / 180.0f),
+	m_targetHeight(1.0f),
+	m_lightDirection{ -std::sqrt(3.0f), -1.0f, 0.0f },
+	m_lightSpeed(0.3f),
+	m_shadowLod(0),
+	m_sceneLod(0),
+	m_viewProjection(MatrixIdentity()),
+	m_lightViewProjection(MatrixIdentity())
+{
+	m_frame.view.view = MatrixLookAtRH(m_eyePosition, Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 1.0f, 0.0f });
+	m_frame.view.projection = MatrixIdentity();
+	m_frame.view.lightProjection = MatrixOrthographicRH(12.0f, 12.0f, 0.0f, 24.0f);
+	m_frame.light.diffuseColor = Float4{ 0.8f, 0.8f, 0.7f, 1.0f };
+	m_frame.light.ambientColor = Float4{ 0.4f, 0.4f, 0.4f, 1.0f };
+	m_frame.light.padding = 0.0f;
+	m_frame.fogMarch = FogRayMarch{};
+	m_frame.fogEpipolar.lineCount = 0;
+	m_frame.fogFroxels.width = 0;
+	Update(0.0);
+
+	SetFogSettings(m_settings.fog);
+}
+
+bool RendererCore::LoadMesh(const uint8_t* source, size_t sourceSize, const uint8_t* cache, size_t cacheSize, JobSystem& jobs)
+{
+	bool loaded = cache != nullptr && ReadMeshCache(cache, cacheSize, HashMeshSource(source, sourceSize), sourceSize, m_meshBuffers);
+	if (!loaded)
+	{
+		m_mesh = Mesh();
+		if (!LoadObjMesh(source, sourceSize, m_mesh, jobs))
+			return false;
+		if (m_settings.optimizeMesh)
+		{
+			MeshOptimizationReport report = OptimizeMesh(m_mesh);
+			Log("Scene mesh ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+				report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+		}
+		if (m_settings.generateLods)
+		{
+			BuildLodChain(m_mesh, LodSettings());
+			for (size_t i = 0; i < m_mesh.lods.size(); ++i)
+				Log("Scene mesh LOD %zu: %u triangles, error %g\n", i, m_mesh.lods[i].indexCount / 3, m_mesh.lods[i].error);
+		}
+		m_meshBuffers = PackMesh(m_mesh, m_settings.splitMeshlets, m_meshletStorage);
+	}
+
+	const MeshBuffers& buffers = m_meshBuffers;
+	m_meshDraws.assign(buffers.meshlets, buffers.meshlets + buffers.meshletCount);
+	m_meshLods.assign(buffers.lods, buffers.lods + buffers.lodCount);
+	m_meshCenter = Float3{ 0.5f * (buffers.boundsMin.x + buffers.boundsMax.x), 0.5f * (buffers.boundsMin.y + buffers.boundsMax.y),
+		0.5f * (buffers.boundsMin.z + buffers.boundsMax.z) };
+	m_meshRadius = 0.5f * Length(Sub(buffers.boundsMax, buffers.boundsMin));
+	return true;
+}
+
+void RendererCore::BuildBvh(JobSystem& jobs)
+{
+	m_sceneBvh.Build(m_meshBuffers, 0, jobs);
+	Log("Scene BVH: %zu triangles, %zu nodes\n", m_sceneBvh.TriangleCount(), m_sceneBvh.Nodes().size());
+}
+
+void RendererCore::Upload(RenderBackend& backend) const
+{
+	backend.SetMesh(m_meshBuffers);
+	UploadFogCells(backend);
+}
+
+void RendererCore::UploadFogCells(RenderBackend& backend) const
+{
+	backend.SetFogCells(m_cellVertices, m_cellIndices);
+}
+
+void RendererCore::ReleaseMeshStorage()
+{
+	m_mesh = Mesh();
+	m_meshletStorage = MeshletMesh();
+	m_meshBuffers = MeshBuffers{};
+}
+
+void RendererCore::Resize(float aspectRatio, float targetHeight, const Float4x4& orientation)
+{
+	float fovAngleY = 70.0f * Pi / 180.0f;
+	if (aspectRatio < 1.0f) fovAngleY *= 2.0f;
+	m_fovAngleY = fovAngleY;
+	m_targetHeight = targetHeight;
+	m_frame.view.projection = MatrixMultiply(MatrixPerspectiveFovRH(fovAngleY, aspectRatio, NearZ, 100.0f), orientation);
+}
+
+void RendererCore::Update(double elapsedSeconds)
+{
+	m_lightDirection.z += static_cast<float>(m_lightSpeed * elapsedSeconds);
+	if (m_lightDirection.z > 0.3f) m_lightSpeed = -std::abs(m_lightSpeed);
+	if (m_lightDirection.z < -0.3f) m_lightSpeed = std::abs(m_lightSpeed);
+
+	const float length = Length(m_lightDirection);
+	const Float3 direction{ m_lightDirection.x / length, m_lightDirection.y / length, m_lightDirection.z / length };
+	m_frame.light.lightDirection = direction;
+	m_frame.view.lightView = MatrixLookAtRH(Float3{ -12.0f * direction.x, -12.0f * direction.y, -12.0f * direction.z },
+		Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 0.1f, 0.0f });
+}
+
+void RendererCore::SetFogSettings(const FogSettings& fog)
+{
+	m_settings.fog = fog;
+	BuildFogCells(fog, m_frame.light.diffuseColor, m_cellVertices, m_cellIndices, m_fogLevels);
+	m_fogLevel = 0;
+	m_framesSinceFogChange = 0;
+}
+
+void RendererCore::ReportFrameTime(double milliseconds)
+{
+	const double budget = m_settings.fog.frameBudgetMs;
+	if (budget <= 0.0 || m_fogLevels.size() < 2 || milliseconds <= 0.0)
+		return;
+
+	// Timings lag the frames they measure, so the first few after a change are dropped and the
+	// change is judged on an average of the ones after.
+	if (++m_framesSinceFogChange <= 4)
+	{
+		m_frameTimeAverage = milliseconds;
+		return;
+	}
+	m_frameTimeAverage += 0.125 * (milliseconds - m_frameTimeAverage);
+	if (m_framesSinceFogChange < 20)
+		return;
+
+	// Doubling the slices at most doubles the frame, so stepping up below half the budget
+	// cannot push the next level over it and the two never oscillate.
+	if (m_frameTimeAverage > budget && m_fogLevel + 1 < m_fogLevels.size())
+	{
+		++m_fogLevel;
+		m_framesSinceFogChange = 0;
+	}
+	else if (m_frameTimeAverage < 0.5 * budget && m_fogLevel > 0)
+	{
+		--m_fogLevel;
+		m_framesSinceFogChange = 0;
+	}
+}
+
+const FrameDescription& RendererCore::BuildFrame()
+{
+	m_frame.passes.clear();
+	m_frame.draws.clear();
+	m_frame.fogVertices.clear();
+	m_frame.fogIndices.clear();
+	if (m_meshLods.empty())
+		return m_frame;
+
+	// Each pass below only multiplies its model into these.
+	m_viewProjection = MatrixMultiply(m_frame.view.view, m_frame.view.projection);
+	m_lightViewProjection = MatrixMultiply(m_frame.view.lightView, m_frame.view.lightProjection);
+
+	// The shadow map only needs the silhouette to within one texel of the 12-unit light frustum.
+	const uint32_t lodCount = static_cast<uint32_t>(m_meshLods.size());
+	m_shadowLod = SelectLod(m_meshLods.data(), lodCount, 12.0f / ShadowMapSize, 0);
+	AddMeshPass(PassType::Shadow, m_shadowLod);
+
+	// Allow lodPixelError pixels of error at the nearest point of the mesh's bounding sphere.
+	const Float4 center = TransformPoint(m_meshCenter, m_model);
+	float distance = Length(Float3{ center.x - m_eyePosition.x, center.y - m_eyePosition.y, center.z - m_eyePosition.z }) - m_meshRadius;
+	if (distance < 0.01f) distance = 0.01f;
+	const float pixelSize = 2.0f * distance * std::tan(m_fovAngleY * 0.5f) / m_targetHeight;
+	m_sceneLod = SelectLod(m_meshLods.data(), lodCount, m_settings.lodPixelError * pixelSize, m_settings.maxSceneTriangles);
+	AddMeshPass(PassType::Scene, m_sceneLod);
+
+	// The fog is placed in world space.
+	const PassTransforms world{ m_viewProjection, m_lightViewProjection, MatrixIdentity() };
+	const FogCellLevel& fog = m_fogLevels[m_fogLevel];
+	if (m_settings.fog.slicing == FogSlicing::RayMarch || m_settings.fog.slicing == FogSlicing::Epipolar ||
+		m_settings.fog.slicing == FogSlicing::Froxel)
+	{
+		BuildFogRayMarch(m_settings.fog, fog.sliceCount, m_frame.light.diffuseColor, m_frame.view.view, m_frame.view.projection, NearZ,
+			m_frame.fogMarch);
+		m_frame.fogEpipolar = m_settings.fog.epipolar;
+		if (m_settings.fog.slicing != FogSlicing::Epipolar)
+			m_frame.fogEpipolar.lineCount = 0;
+		m_frame.fogFroxels = m_settings.fog.froxels;
+		if (m_settings.fog.slicing != FogSlicing::Froxel)
+			m_frame.fogFroxels.width = 0;
+		m_frame.passes.push_back(RenderPass{ PassType::FogRayMarch, world, static_cast<uint32_t>(m_frame.draws.size()), 0 });
+		return m_frame;
+	}
+	m_frame.passes.push_back(RenderPass{ PassType::FogCells, world, static_cast<uint32_t>(m_frame.draws.size()), 1 });
+	if (m_settings.fog.slicing == FogSlicing::ViewAligned)
+	{
+		BuildViewFogSlices(m_settings.fog, fog.sliceCount, m_frame.light.diffuseColor, m_frame.view.view, NearZ,
+			m_frame.fogVertices, m_frame.fogIndices);
+		m_frame.draws.push_back(DrawCall{ 0, static_cast<uint32_t>(m_frame.fogIndices.size()), 0, static_cast<uint32_t>(m_frame.fogVertices.size()) });
+	}
+	else
+		m_frame.draws.push_back(DrawCall{ fog.firstIndex, fog.indexCount, fog.baseVertex, fog.vertexCount });
+	return m_frame;
+}
+
+void RendererCore::AddMeshPass(PassType type, uint32_t lod)
+{
+	const MeshletLod& level = m_meshLods[lod];
+	m_frame.passes.push_back(RenderPass{ type, ComposePassTransforms(m_model, m_viewProjection, m_lightViewProjection),
+		static_cast<uint32_t>(m_frame.draws.size()), level.meshletCount });
+	for (uint32_t i = level.firstMeshlet; i < level.firstMeshlet + level.meshletCount; ++i)
+		m_frame.draws.push_back(DrawCall{ m_meshDraws[i].startIndex, m_meshDraws[i].indexCount, m_meshDraws[i].baseVertex, m_meshDraws[i].vertexCount });
+}
+
+void RendererCore::Log(const char* format, ...) const
+{
+	if (!m_settings.log)
+		return;
+	char message[256];
+	va_list args;
+	va_start(args, format);
+	std::vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	m_settings.log(message);
+}
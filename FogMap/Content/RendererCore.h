@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include "Bvh.h"
+#include "RenderBackend.h"
+
+#include <functional>
+
+namespace FogMap
+{
+	class JobSystem;
+
+	struct RendererSettings
+	{
+		bool splitMeshlets = true;
+		bool optimizeMesh = true;
+		bool generateLods = true;
+		float lodPixelError = 1.0f;
+		uint32_t maxSceneTriangles = 0;		// 0 = no budget
+		FogSettings fog;
+		std::function<void(const char*)> log;	// optional, one line per call
+	};
+
+	// Backend-neutral half of MainRenderer: scene mesh preparation, camera and light
+	// animation, LOD selection and the fog-cell geometry. Each frame is handed to a
+	// RenderBackend as a FrameDescription.
+	class RendererCore
+	{
+	public:
+		explicit RendererCore(const RendererSettings& settings = RendererSettings());
+
+		// Uses the .fmesh image when it was built from this exact source, otherwise parses the
+		// OBJ in chunks on jobs. Both images must stay valid until ReleaseMeshStorage. Like
+		// BuildBvh, may itself run as a job of the same JobSystem.
+		bool LoadMesh(const uint8_t* source, size_t sourceSize, const uint8_t* cache, size_t cacheSize, JobSystem& jobs);
+		// Model-space BVH over the full-detail level; it outlives ReleaseMeshStorage.
+		void BuildBvh(JobSystem& jobs);
+		// Hands the mesh and the fog cells to a backend.
+		void Upload(RenderBackend& backend) const;
+		void UploadFogCells(RenderBackend& backend) const;
+		// Drops the CPU copy of the mesh once every backend that needs it has uploaded it.
+		void ReleaseMeshStorage();
+
+		// aspectRatio is that of the output, targetHeight the render target height in pixels.
+		// orientation is appended to the projection, for rotated displays.
+		void Resize(float aspectRatio, float targetHeight, const Float4x4& orientation);
+		void Update(double elapsedSeconds);
+		// Rebuilds the fog cells; backends need UploadFogCells before the next frame.
+		void SetFogSettings(const FogSettings& fog);
+		// Time a recent frame took, for the adaptive fog mode to fit the slice count to its budget.
+		void ReportFrameTime(double milliseconds);
+		const FrameDescription& BuildFrame();
+
+		const MeshBuffers& GetMeshBuffers() const { return m_meshBuffers; }
+		const Bvh& GetBvh() const { return m_sceneBvh; }
+		const MeshletLod& GetLod(uint32_t lod) const { return m_meshLods[lod]; }
+		// LODs picked by the last BuildFrame.
+		uint32_t GetShadowLod() const { return m_shadowLod; }
+		uint32_t GetSceneLod() const { return m_sceneLod; }
+		// Fog slices the next BuildFrame draws.
+		const FogCellLevel& GetFogLevel() const { return m_fogLevels[m_fogLevel]; }
+
+	private:
+		void Log(const char* format, ...) const;
+		void AddMeshPass(PassType type, uint32_t lod);
+
+		RendererSettings m_settings;
+
+		Mesh m_mesh;
+		MeshletMesh m_meshletStorage;
+		MeshBuffers m_meshBuffers;
+		std::vector<Meshlet> m_meshDraws;
+		std::vector<MeshletLod> m_meshLods;
+		Bvh m_sceneBvh;
+		Float3 m_meshCenter;
+		float m_meshRadius;
+
+		std::vector<FogCellVertex> m_cellVertices;
+		std::vector<uint16_t> m_cellIndices;
+		std::vector<FogCellLevel> m_fogLevels;
+		uint32_t m_fogLevel;
+		uint32_t m_framesSinceFogChange;
+		double m_frameTimeAverage;
+
+		Float4x4 m_model;
+		Float3 m_eyePosition;
+		float m_fovAngleY;
+		float m_targetHeight;
+		Float3 m_lightDirection;
+		float m_lightSpeed;
+		uint32_t m_shadowLod;
+		uint32_t m_sceneLod;
+
+		FrameDescription m_frame;
+		Float4x4 m_viewProjection;
+		Float4x4 m_lightViewProjection;
+	};
+}
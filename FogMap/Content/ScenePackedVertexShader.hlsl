@@ -0,0 +1,46 @@
+cbuffer DrawConstantBuffer : register(b1)
+{
+	matrix modelViewProjection;
+	matrix modelLightViewProjection;
+	matrix normalMatrix;
+};
+
+cbuffer MeshConstantBuffer : register(b2)
+{
+	float4 positionOffset;
+	float4 positionScale;
+	float4 meshColor;
+};
+
+struct VertexShaderInput
+{
+	float4 pos : POSITION;
+	float2 norm : NORMAL;
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float3 color : COLOR0;
+	float3 norm : NORMAL;
+	float4 lightViewPos : TEXCOORD0;
+};
+
+float3 OctDecode(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
+PixelShaderInput main(VertexShaderInput input)
+{
+	PixelShaderInput output;
+	float4 pos = float4(positionOffset.xyz + input.pos.xyz * positionScale.xyz, 1.0f);
+	output.pos = mul(pos, modelViewProjection);
+	output.color = meshColor.rgb;
+	output.norm = normalize(mul(OctDecode(input.norm), (float3x3)normalMatrix));
+	output.lightViewPos = mul(pos, modelLightViewProjection);
+	return output;
+}
@@ -1,7 +1,7 @@
 Texture2D shadowMap : register(t0);
 SamplerState samplerClamp : register(s0);
 
-cbuffer LightBuffer
+cbuffer LightBuffer : register(b0)
 {
 	float4 diffuseColor;
 	float4 ambientColor;
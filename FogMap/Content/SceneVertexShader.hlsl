@@ -1,10 +1,8 @@
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+cbuffer DrawConstantBuffer : register(b1)
 {
-	matrix model;
-	matrix view;
-	matrix projection;
-	matrix lightView;
-	matrix lightProjection;
+	matrix modelViewProjection;
+	matrix modelLightViewProjection;
+	matrix normalMatrix;
 };
 
 struct VertexShaderInput
@@ -25,9 +23,10 @@ struct PixelShaderInput
 PixelShaderInput main(VertexShaderInput input)
 {
 	PixelShaderInput output;
-	output.pos = mul(mul(mul(float4(input.pos, 1.0f), model), view), projection);
+	float4 pos = float4(input.pos, 1.0f);
+	output.pos = mul(pos, modelViewProjection);
 	output.color = input.color;
-	output.norm = normalize(mul(input.norm, (float3x3)model));
-	output.lightViewPos = mul(mul(mul(float4(input.pos, 1.0f), model), lightView), lightProjection);
+	output.norm = normalize(mul(input.norm, (float3x3)normalMatrix));
+	output.lightViewPos = mul(pos, modelLightViewProjection);
 	return output;
 }
@@ -2,13 +2,14 @@
 
 namespace FogMap
 {
-	struct ModelViewProjectionConstantBuffer
+	// Vertex shader b1, written once per pass into a slot of a dynamic ring buffer and shared by
+	// the pass's draws: its transforms, already composed, so nothing per-frame is left for the
+	// vertex shaders.
+	struct DrawConstantBuffer
 	{
-		DirectX::XMFLOAT4X4 model;
-		DirectX::XMFLOAT4X4 view;
-		DirectX::XMFLOAT4X4 projection;
-		DirectX::XMFLOAT4X4 lightView;
-		DirectX::XMFLOAT4X4 lightProjection;
+		DirectX::XMFLOAT4X4 modelViewProjection;
+		DirectX::XMFLOAT4X4 modelLightViewProjection;
+		DirectX::XMFLOAT4X4 normal;
 	};
 
 	struct LightBuffer
@@ -19,9 +20,32 @@ namespace FogMap
 		float padding;
 	};
 
-	struct VertexPositionColorNormal
+	// Vertex shader b2, written once with the mesh: dequantisation and colour for meshes in the
+	// PackedPosition/PackedNormal layout.
+	struct MeshConstantBuffer
+	{
+		DirectX::XMFLOAT4 positionOffset;
+		DirectX::XMFLOAT4 positionScale;
+		DirectX::XMFLOAT4 color;
+	};
+
+	// Pixel shader b1 of FogRayMarchPixelShader, written once per frame: FogRayMarch with the
+	// fog pass's view and light matrices.
+	struct FogRayMarchConstantBuffer
+	{
+		DirectX::XMFLOAT4X4 clipToWorld;
+		DirectX::XMFLOAT4X4 viewProjection;
+		DirectX::XMFLOAT4X4 lightViewProjection;
+		DirectX::XMFLOAT4 eyePosition;		// w: firstDepth
+		DirectX::XMFLOAT4 viewAxis;			// w: spacing
+		DirectX::XMFLOAT4 boundsMin;		// w: alpha
+		DirectX::XMFLOAT4 boundsMax;		// w: sampleCount
+		DirectX::XMFLOAT4 color;
+	};
+
+	// Second vertex stream of the scene mesh; positions are a stream of XMFLOAT3 of their own.
+	struct VertexColorNormal
 	{
-		DirectX::XMFLOAT3 pos;
 		DirectX::XMFLOAT3 color;
 		DirectX::XMFLOAT3 norm;
 	};
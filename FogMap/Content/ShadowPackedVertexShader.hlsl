@@ -0,0 +1,35 @@
+cbuffer DrawConstantBuffer : register(b1)
+{
+	matrix modelViewProjection;
+	matrix modelLightViewProjection;
+	matrix normalMatrix;
+};
+
+cbuffer MeshConstantBuffer : register(b2)
+{
+	float4 positionOffset;
+	float4 positionScale;
+	float4 meshColor;
+};
+
+struct VertexShaderInput
+{
+	float4 pos : POSITION;
+};
+
+struct PixelShaderInput
+{
+	float4 pos : SV_POSITION;
+	float4 depthPos : TEXTURE0;
+};
+
+PixelShaderInput main(VertexShaderInput input)
+{
+	PixelShaderInput output;
+
+	float4 pos = float4(positionOffset.xyz + input.pos.xyz * positionScale.xyz, 1.0f);
+	output.pos = mul(pos, modelLightViewProjection);
+	output.depthPos = output.pos;
+
+	return output;
+}
@@ -1,17 +1,13 @@
-cbuffer ModelViewProjectionConstantBuffer : register(b0)
+cbuffer DrawConstantBuffer : register(b1)
 {
-	matrix model;
-	matrix view;
-	matrix projection;
-	matrix lightView;
-	matrix lightProjection;
+	matrix modelViewProjection;
+	matrix modelLightViewProjection;
+	matrix normalMatrix;
 };
 
 struct VertexShaderInput
 {
 	float3 pos : POSITION;
-	float3 color : COLOR0;
-	float3 norm : NORMAL;
 };
 
 struct PixelShaderInput
@@ -24,7 +20,7 @@ PixelShaderInput main(VertexShaderInput input)
 {
 	PixelShaderInput output;
 
-	output.pos = mul(mul(mul(float4(input.pos, 1.0f), model), lightView), lightProjection);
+	output.pos = mul(float4(input.pos, 1.0f), modelLightViewProjection);
 	output.depthPos = output.pos;
 
 	return output;
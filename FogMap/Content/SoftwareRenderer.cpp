@@ -0,0 +1,966 @@
+﻿#include "SoftwareRenderer.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FOGMAP_RASTER_SSE2 1
+#endif
+
+using namespace FogMap;
+
+namespace
+{
+	constexpr int TileSize = 64;
+	constexpr uint32_t DepthClear = 0xffffff;
+	// Clipping to +-GuardBand * w keeps snapped coordinates small enough for the edge
+	// functions below to be exact in double precision at any supported resolution.
+	constexpr float GuardBand = 2.0f;
+	constexpr int MaxClippedVertices = 9;
+	// Vertices shaded per job.
+	constexpr uint32_t VertexBatch = 1024;
+
+	template<int N>
+	struct ClipVertex
+	{
+		Float4 position;
+		float varyings[N];
+	};
+
+	// Edge function i is a * x + b * y + c, twice the signed area spanned with the opposite edge,
+	// so it doubles as the unnormalised barycentric of vertex i. Snapped coordinates are
+	// multiples of 1/256 and pixel centres of 1/2, which makes every value a multiple of 2^-16:
+	// "e > threshold" with a threshold of -2^-17 for top-left edges is an exact "e >= 0".
+	struct RasterTriangle
+	{
+		double a[3];
+		double b[3];
+		double c[3];
+		double threshold[3];
+		double inverseArea;
+		float z[3];
+		float inverseW[3];
+		int minX, minY, maxX, maxY;
+		uint32_t varyingOffset;		// 3 * N varyings pre-divided by w
+	};
+
+	struct RasterTarget
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t* depth;
+	};
+
+	inline uint32_t ReadIndex(const void* indices, IndexFormat format, size_t i)
+	{
+		return format == IndexFormat::UInt16 ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+	}
+
+	inline float Saturate(float value)
+	{
+		// Like HLSL, NaN saturates to 0.
+		return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+	}
+
+	inline uint8_t ToUnorm8(float value)
+	{
+		return static_cast<uint8_t>(Saturate(value) * 255.0f + 0.5f);
+	}
+
+	inline bool IsTopLeft(double ax, double ay, double bx, double by)
+	{
+		return (ay == by && bx > ax) || by < ay;
+	}
+
+	// Bilinear, clamped fetch of the shadow map's red channel with the 8-bit filter weights
+	// D3D11 guarantees.
+	float SampleShadowMap(const float* map, float u, float v)
+	{
+		const int size = ShadowMapSize;
+		const float x = u * size - 0.5f, y = v * size - 0.5f;
+		const float floorX = std::floor(x), floorY = std::floor(y);
+		const float fx = std::floor((x - floorX) * 256.0f) / 256.0f;
+		const float fy = std::floor((y - floorY) * 256.0f) / 256.0f;
+		const int x0 = std::min(std::max(static_cast<int>(floorX), 0), size - 1), x1 = std::min(std::max(static_cast<int>(floorX) + 1, 0), size - 1);
+		const int y0 = std::min(std::max(static_cast<int>(floorY), 0), size - 1), y1 = std::min(std::max(static_cast<int>(floorY) + 1, 0), size - 1);
+		const float top = map[y0 * size + x0] + (map[y0 * size + x1] - map[y0 * size + x0]) * fx;
+		const float bottom = map[y1 * size + x0] + (map[y1 * size + x1] - map[y1 * size + x0]) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	// The texture coordinate ScenePixelShader and CellPixelShader derive from lightViewPos;
+	// false when it falls outside the shadow map.
+	inline bool ProjectToShadowMap(const float* lightViewPos, float& u, float& v)
+	{
+		u = lightViewPos[0] / lightViewPos[3] / 2.0f + 0.5f;
+		v = -lightViewPos[1] / lightViewPos[3] / 2.0f + 0.5f;
+		return Saturate(u) == u && Saturate(v) == v;
+	}
+
+	// ShadowVertexShader + ShadowPixelShader.
+	struct ShadowShader
+	{
+		static constexpr int VaryingCount = 2;		// depthPos.zw
+
+		const Float3* positions;
+		const PassTransforms* transforms;
+		float* shadowMap;
+
+		void Vertex(uint32_t index, ClipVertex<VaryingCount>& out) const
+		{
+			Float4 pos = TransformPoint(positions[index], transforms->modelLightViewProjection);
+			out.position = pos;
+			out.varyings[0] = pos.z;
+			out.varyings[1] = pos.w;
+		}
+
+		void Pixel(const float* varyings, size_t pixel) const
+		{
+			shadowMap[pixel] = varyings[0] / varyings[1];
+		}
+	};
+
+	// SceneVertexShader + ScenePixelShader.
+	struct SceneShader
+	{
+		static constexpr int VaryingCount = 10;		// color.rgb, norm.xyz, lightViewPos.xyzw
+
+		const Float3* positions;
+		const MeshAttributes* attributes;
+		const PassTransforms* transforms;
+		const LightConstants* light;
+		const float* shadowMap;
+		uint8_t* color;
+
+		void Vertex(uint32_t index, ClipVertex<VaryingCount>& out) const
+		{
+			out.position = TransformPoint(positions[index], transforms->modelViewProjection);
+
+			const MeshAttributes& attribute = attributes[index];
+			Float3 norm = TransformNormal(attribute.norm, transforms->normal);
+			const float inverseLength = 1.0f / std::sqrt(norm.x * norm.x + norm.y * norm.y + norm.z * norm.z);
+			const Float4 lightViewPos = TransformPoint(positions[index], transforms->modelLightViewProjection);
+			const float values[VaryingCount]{ attribute.color.x, attribute.color.y, attribute.color.z,
+				norm.x * inverseLength, norm.y * inverseLength, norm.z * inverseLength,
+				lightViewPos.x, lightViewPos.y, lightViewPos.z, lightViewPos.w };
+			std::copy(values, values + VaryingCount, out.varyings);
+		}
+
+		void Pixel(const float* varyings, size_t pixel) const
+		{
+			const Float3& direction = light->lightDirection;
+			const float cosTheta = -(varyings[3] * direction.x + varyings[4] * direction.y + varyings[5] * direction.z);
+			float visibility = 1.0f;
+
+			float u, v;
+			if (ProjectToShadowMap(varyings + 6, u, v))
+			{
+				const float bias = 0.0005f * std::tan(std::acos(cosTheta));
+				const float selfDepth = varyings[8] / varyings[9] - bias;
+
+				static const float offset[5][2]{ { 0.0f, 0.0f }, { 1.0f, 0.0f }, { -1.0f, 0.0f }, { 0.0f, 1.0f }, { 0.0f, -1.0f } };
+				for (int i = 0; i < 5; ++i)
+					if (selfDepth > SampleShadowMap(shadowMap, u + offset[i][0] / 1024.0f, v + offset[i][1] / 1024.0f))
+						visibility -= 0.15f;
+			}
+
+			const float diffuse = Saturate(cosTheta);
+			const Float4& ambientColor = light->ambientColor;
+			const Float4& diffuseColor = light->diffuseColor;
+			uint8_t* out = color + pixel * 4;
+			out[0] = ToUnorm8(Saturate(ambientColor.x + visibility * diffuseColor.x * diffuse) * varyings[0]);
+			out[1] = ToUnorm8(Saturate(ambientColor.y + visibility * diffuseColor.y * diffuse) * varyings[1]);
+			out[2] = ToUnorm8(Saturate(ambientColor.z + visibility * diffuseColor.z * diffuse) * varyings[2]);
+			out[3] = ToUnorm8(Saturate(ambientColor.w + visibility * diffuseColor.w * diffuse));
+		}
+	};
+
+	// CellVertexShader + CellPixelShader under MainRenderer's SRC_ALPHA / INV_SRC_ALPHA blend.
+	struct FogShader
+	{
+		static constexpr int VaryingCount = 8;		// color.rgba, lightViewPos.xyzw
+
+		const FogCellVertex* vertices;
+		const PassTransforms* transforms;
+		const float* shadowMap;
+		uint8_t* color;
+
+		void Vertex(uint32_t index, ClipVertex<VaryingCount>& out) const
+		{
+			const FogCellVertex& vertex = vertices[index];
+			out.position = TransformPoint(vertex.pos, transforms->modelViewProjection);
+			const Float4 lightViewPos = TransformPoint(vertex.pos, transforms->modelLightViewProjection);
+			const float values[VaryingCount]{ vertex.color.x, vertex.color.y, vertex.color.z, vertex.color.w,
+				lightViewPos.x, lightViewPos.y, lightViewPos.z, lightViewPos.w };
+			std::copy(values, values + VaryingCount, out.varyings);
+		}
+
+		void Pixel(const float* varyings, size_t pixel) const
+		{
+			float visibility = 1.0f;
+			float u, v;
+			if (ProjectToShadowMap(varyings + 4, u, v))
+			{
+				const float selfDepth = varyings[6] / varyings[7] - 0.001f;
+				if (selfDepth > SampleShadowMap(shadowMap, u, v))
+					visibility = 0.0f;
+			}
+
+			const float alpha = Saturate(varyings[3] * visibility);
+			uint8_t* out = color + pixel * 4;
+			for (int i = 0; i < 3; ++i)
+				out[i] = ToUnorm8(Saturate(varyings[i]) * alpha + out[i] / 255.0f * (1.0f - alpha));
+			out[3] = ToUnorm8(alpha);
+		}
+	};
+
+	// FogRayMarchVertexShader + FogRayMarchPixelShader under MainRenderer's ONE / INV_SRC_ALPHA
+	// blend: the samples of the view-aligned slices, taken front to back along each pixel's ray
+	// until one fails the depth test against the scene, as a slice fragment there would.
+	struct FogRayMarchShader
+	{
+		const FogRayMarch* march;
+		const PassTransforms* transforms;
+		const float* shadowMap;
+		const uint32_t* depth;
+		uint8_t* color;
+		uint32_t width;
+		uint32_t height;
+
+		// Returns the number of samples taken; pixels without any are left alone, as the
+		// pixel shader discards them.
+		uint32_t Pixel(uint32_t x, uint32_t y) const
+		{
+			FogRayResult result;
+			const uint32_t samples = March(x + 0.5f, y + 0.5f, depth[size_t(y) * width + x], result);
+			if (samples != 0)
+				Composite(x, y, result);
+			return samples;
+		}
+
+		// The ray through the point (x, y) in pixels, up to the D24 scene depth sceneDepth.
+		uint32_t March(float x, float y, uint32_t sceneDepth, FogRayResult& result) const
+		{
+			result = FogRayResult{ 0.0f, 1.0f };
+			// The ray, from the eye (t = 0) to the far plane (t = 1).
+			const Float4 end = Transform(Float4{ x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f, 1.0f, 1.0f }, march->clipToWorld);
+			const Float3& eye = march->eyePosition;
+			const Float3 ray{ end.x / end.w - eye.x, end.y / end.w - eye.y, end.z / end.w - eye.z };
+			const float rayDepth = Dot(ray, march->viewAxis);
+			if (!(rayDepth > 0.0f) || march->sampleCount <= 0.0f)
+				return 0;
+
+			// The part of the ray inside the volume.
+			float enter = 0.0f, exit = 1.0f;
+			const float origin[3]{ eye.x, eye.y, eye.z }, direction[3]{ ray.x, ray.y, ray.z };
+			const float lo[3]{ march->boundsMin.x, march->boundsMin.y, march->boundsMin.z };
+			const float hi[3]{ march->boundsMax.x, march->boundsMax.y, march->boundsMax.z };
+			for (int k = 0; k < 3; ++k)
+			{
+				if (direction[k] == 0.0f)
+				{
+					if (origin[k] < lo[k] || origin[k] > hi[k])
+						return 0;
+					continue;
+				}
+				float t0 = (lo[k] - origin[k]) / direction[k], t1 = (hi[k] - origin[k]) / direction[k];
+				if (t0 > t1)
+					std::swap(t0, t1);
+				enter = std::max(enter, t0);
+				exit = std::min(exit, t1);
+			}
+			if (!(exit > enter))
+				return 0;
+
+			// Sample planes between the two view depths, nearest first.
+			const int nearest = static_cast<int>(std::min(std::floor((march->firstDepth - enter * rayDepth) / march->spacing), march->sampleCount - 1.0f));
+			const int farthest = static_cast<int>(std::max(std::ceil((march->firstDepth - exit * rayDepth) / march->spacing), 0.0f));
+			float scattering = 0.0f, transmittance = 1.0f;
+			uint32_t samples = 0;
+			for (int s = nearest; s >= farthest; --s)
+			{
+				const Float3 position = Add(eye, Scale(ray, (march->firstDepth - s * march->spacing) / rayDepth));
+				const Float4 clip = TransformPoint(position, transforms->modelViewProjection);
+				if (!(static_cast<uint32_t>(Saturate(clip.z / clip.w) * 16777215.0f + 0.5f) < sceneDepth))
+					break;
+
+				const float alpha = march->alpha * Visibility(position);
+				scattering += transmittance * alpha;
+				transmittance *= 1.0f - alpha;
+				++samples;
+				if (transmittance < FogRayMarchMinTransmittance)
+					break;
+			}
+			result = FogRayResult{ scattering, transmittance };
+			return samples;
+		}
+
+		// 1 where the world position is lit, 0 where it is in shadow.
+		float Visibility(const Float3& position) const
+		{
+			const Float4 lightViewPos = TransformPoint(position, transforms->modelLightViewProjection);
+			const float lightView[4]{ lightViewPos.x, lightViewPos.y, lightViewPos.z, lightViewPos.w };
+			float u, v;
+			return ProjectToShadowMap(lightView, u, v) && lightView[2] / lightView[3] - 0.001f > SampleShadowMap(shadowMap, u, v) ? 0.0f : 1.0f;
+		}
+
+		// The premultiplied blend of the fog over pixel (x, y).
+		void Composite(uint32_t x, uint32_t y, const FogRayResult& result) const
+		{
+			const float light[3]{ result.scattering * march->color.x, result.scattering * march->color.y, result.scattering * march->color.z };
+			uint8_t* out = color + (size_t(y) * width + x) * 4;
+			for (int i = 0; i < 3; ++i)
+				out[i] = ToUnorm8(light[i] + out[i] / 255.0f * result.transmittance);
+			out[3] = ToUnorm8(1.0f - result.transmittance);
+		}
+	};
+
+	// Screen rectangle [bounds[0], bounds[2]) x [bounds[1], bounds[3]) of the fog volume; the
+	// whole screen once a corner is behind the eye.
+	void FogScreenBounds(const FogRayMarch& march, const Float4x4& viewProjection, uint32_t width, uint32_t height, uint32_t bounds[4])
+	{
+		float lo[2]{ float(width), float(height) }, hi[2]{ 0.0f, 0.0f };
+		for (int i = 0; i < 8; ++i)
+		{
+			const Float4 clip = TransformPoint(Float3{ (i & 1) ? march.boundsMax.x : march.boundsMin.x, (i & 2) ? march.boundsMax.y : march.boundsMin.y,
+				(i & 4) ? march.boundsMax.z : march.boundsMin.z }, viewProjection);
+			if (!(clip.w > 0.0f))
+			{
+				bounds[0] = bounds[1] = 0;
+				bounds[2] = width;
+				bounds[3] = height;
+				return;
+			}
+			const float x = (clip.x / clip.w * 0.5f + 0.5f) * width, y = (0.5f - clip.y / clip.w * 0.5f) * height;
+			lo[0] = std::min(lo[0], x);
+			lo[1] = std::min(lo[1], y);
+			hi[0] = std::max(hi[0], x);
+			hi[1] = std::max(hi[1], y);
+		}
+		const float size[2]{ float(width), float(height) };
+		for (int k = 0; k < 2; ++k)
+		{
+			bounds[k] = static_cast<uint32_t>(std::min(std::max(std::floor(lo[k]), 0.0f), size[k]));
+			bounds[k + 2] = std::max(bounds[k], static_cast<uint32_t>(std::min(std::max(std::ceil(hi[k]), 0.0f), size[k])));
+		}
+	}
+
+	// FogRayMarchShader's rays for an EpipolarSampler, with the view depth of every pixel.
+	class FogRayMarchSource : public FogRaySource
+	{
+	public:
+		FogRayMarchSource(const FogRayMarchShader& shader, const float* viewDepth) : m_shader(shader), m_viewDepth(viewDepth) {}
+
+		// View depth of the D24 scene depth of pixel (x, y).
+		static float ViewDepth(const FogRayMarchShader& shader, uint32_t x, uint32_t y)
+		{
+			const Float4 world = Transform(Float4{ (x + 0.5f) / shader.width * 2.0f - 1.0f, 1.0f - (y + 0.5f) / shader.height * 2.0f,
+				shader.depth[size_t(y) * shader.width + x] / 16777215.0f, 1.0f }, shader.march->clipToWorld);
+			const Float3& eye = shader.march->eyePosition;
+			return Dot(Float3{ world.x / world.w - eye.x, world.y / world.w - eye.y, world.z / world.w - eye.z }, shader.march->viewAxis);
+		}
+
+		float SceneDepth(float x, float y) const override
+		{
+			return m_viewDepth[PixelIndex(x, y)];
+		}
+
+		uint32_t March(float x, float y, FogRayResult& result) const override
+		{
+			return m_shader.March(x, y, m_shader.depth[PixelIndex(x, y)], result);
+		}
+
+	private:
+		// The pixel under the point, clamped to the target.
+		size_t PixelIndex(float x, float y) const
+		{
+			const uint32_t px = std::min(static_cast<uint32_t>(std::max(x, 0.0f)), m_shader.width - 1);
+			const uint32_t py = std::min(static_cast<uint32_t>(std::max(y, 0.0f)), m_shader.height - 1);
+			return size_t(py) * m_shader.width + px;
+		}
+
+		const FogRayMarchShader& m_shader;
+		const float* m_viewDepth;
+	};
+
+	// Every pixel of the FogRayMarch pass resolved from an EpipolarSampler's lines, within the
+	// screen rectangle [x0, x1) x [y0, y1) of the fog volume; the rest see no fog.
+	struct EpipolarResolveShader
+	{
+		const EpipolarSampler* sampler;
+		const FogRaySource* source;
+		const FogRayMarchShader* march;
+		uint32_t x0, y0, x1, y1;
+
+		// Returns 0; the sampler counts the samples taken.
+		uint32_t Pixel(uint32_t x, uint32_t y) const
+		{
+			if (x < x0 || x >= x1 || y < y0 || y >= y1)
+				return 0;
+			FogRayResult result;
+			sampler->Resolve(x, y, *source, result);
+			if (result.scattering > 0.0f || result.transmittance < 1.0f)
+				march->Composite(x, y, result);
+			return 0;
+		}
+	};
+
+	// FogRayMarchShader's shadow test for a FroxelGrid.
+	class ShadowMapLight : public FogLightSource
+	{
+	public:
+		explicit ShadowMapLight(const FogRayMarchShader& shader) : m_shader(shader) {}
+
+		float Visibility(const Float3& position) const override
+		{
+			return m_shader.Visibility(position);
+		}
+
+	private:
+		const FogRayMarchShader& m_shader;
+	};
+
+	// Every pixel of the FogRayMarch pass read from a FroxelGrid at its scene depth, within the
+	// screen rectangle [x0, x1) x [y0, y1) of the fog volume; the rest see no fog.
+	struct FroxelCompositeShader
+	{
+		const FroxelGrid* grid;
+		const FogRayMarchShader* march;
+		uint32_t x0, y0, x1, y1;
+
+		// Returns 0; the grid's froxels are counted instead.
+		uint32_t Pixel(uint32_t x, uint32_t y) const
+		{
+			if (x < x0 || x >= x1 || y < y0 || y >= y1)
+				return 0;
+			const FogRayResult result = grid->Sample((x + 0.5f) / march->width, (y + 0.5f) / march->height,
+				FogRayMarchSource::ViewDepth(*march, x, y));
+			if (result.scattering > 0.0f || result.transmittance < 1.0f)
+				march->Composite(x, y, result);
+			return 0;
+		}
+	};
+}
+
+namespace FogMap
+{
+	// Vertex shading, clipping and tile binning for one indexed draw, followed by per-tile
+	// rasterisation. Each bin holds the setup of a contiguous run of triangles, so walking the
+	// bins of a tile in order replays them in submission order.
+	class RasterPipeline
+	{
+	public:
+		explicit RasterPipeline(unsigned threadCount) :
+			m_jobs(std::max(threadCount, 1u)),
+			m_bins(m_jobs.GetThreadCount())
+		{
+		}
+
+		// Returns the number of fragments shaded.
+		template<typename Shader>
+		uint64_t Draw(const Shader& shader, const void* indices, IndexFormat indexFormat,
+			const DrawCall* ranges, size_t rangeCount, uint32_t vertexCount, const RasterTarget& target)
+		{
+			constexpr int N = Shader::VaryingCount;
+			m_vertexStorage.resize(size_t(vertexCount) * sizeof(ClipVertex<N>) / sizeof(float));
+			ClipVertex<N>* vertices = reinterpret_cast<ClipVertex<N>*>(m_vertexStorage.data());
+			ShadeVertices(shader, ranges, rangeCount, vertices);
+
+			m_triangleStarts.resize(rangeCount + 1);
+			m_triangleStarts[0] = 0;
+			for (size_t r = 0; r < rangeCount; ++r)
+				m_triangleStarts[r + 1] = m_triangleStarts[r] + ranges[r].indexCount / 3;
+
+			const int tilesX = (target.width + TileSize - 1) / TileSize, tilesY = (target.height + TileSize - 1) / TileSize;
+			const size_t binCount = m_bins.size();
+			m_jobs.ParallelFor(binCount, 1, [&](size_t begin, size_t end) {
+				const size_t triangleCount = m_triangleStarts.back();
+				for (size_t bin = begin; bin < end; ++bin)
+					SetupTriangles(vertices, indices, indexFormat, ranges, triangleCount * bin / binCount,
+						triangleCount * (bin + 1) / binCount, target, tilesX, tilesY, m_bins[bin]);
+			});
+
+			std::atomic<uint64_t> fragments(0);
+			m_jobs.ParallelFor(size_t(tilesX) * tilesY, 1, [&](size_t begin, size_t end) {
+				uint64_t shaded = 0;
+				for (size_t tile = begin; tile < end; ++tile)
+				{
+					const int x0 = static_cast<int>(tile % tilesX) * TileSize, y0 = static_cast<int>(tile / tilesX) * TileSize;
+					const int x1 = std::min(x0 + TileSize, static_cast<int>(target.width)) - 1;
+					const int y1 = std::min(y0 + TileSize, static_cast<int>(target.height)) - 1;
+					for (const WorkerBins& bins : m_bins)
+						for (uint32_t triangle : bins.tiles[tile])
+						{
+							const RasterTriangle& setup = bins.triangles[triangle];
+							shaded += RasterizeTriangle<N>(shader, setup, &bins.varyings[setup.varyingOffset], target, x0, y0, x1, y1);
+						}
+				}
+				fragments.fetch_add(shaded, std::memory_order_relaxed);
+			});
+			return fragments.load();
+		}
+
+		// A full-screen pass: shader.Pixel(x, y) for every pixel, rows spread over the workers.
+		// Returns the sum of what Pixel returns.
+		template<typename Shader>
+		uint64_t DrawFullScreen(const Shader& shader, uint32_t width, uint32_t height)
+		{
+			std::atomic<uint64_t> total(0);
+			m_jobs.ParallelFor(height, 8, [&](size_t begin, size_t end) {
+				uint64_t sum = 0;
+				for (size_t y = begin; y < end; ++y)
+					for (uint32_t x = 0; x < width; ++x)
+						sum += shader.Pixel(x, static_cast<uint32_t>(y));
+				total.fetch_add(sum, std::memory_order_relaxed);
+			});
+			return total.load();
+		}
+
+		JobSystem& GetJobs() { return m_jobs; }
+
+	private:
+		struct WorkerBins
+		{
+			std::vector<RasterTriangle> triangles;
+			std::vector<float> varyings;
+			std::vector<std::vector<uint32_t>> tiles;
+		};
+
+		template<typename Shader, int N = Shader::VaryingCount>
+		void ShadeVertices(const Shader& shader, const DrawCall* ranges, size_t rangeCount, ClipVertex<N>* vertices)
+		{
+			// Meshlets may share or overlap vertex ranges: merge the ranges into disjoint spans so
+			// every vertex is shaded by one worker only, then cut the spans into batches.
+			m_vertexSpans.clear();
+			for (size_t r = 0; r < rangeCount; ++r)
+				if (ranges[r].vertexCount != 0)
+					m_vertexSpans.push_back(std::make_pair(ranges[r].baseVertex, ranges[r].baseVertex + ranges[r].vertexCount));
+			std::sort(m_vertexSpans.begin(), m_vertexSpans.end());
+			size_t merged = 0;
+			for (size_t s = 0; s < m_vertexSpans.size(); ++s)
+			{
+				if (merged != 0 && m_vertexSpans[s].first <= m_vertexSpans[merged - 1].second)
+					m_vertexSpans[merged - 1].second = std::max(m_vertexSpans[merged - 1].second, m_vertexSpans[s].second);
+				else
+					m_vertexSpans[merged++] = m_vertexSpans[s];
+			}
+			m_vertexSpans.resize(merged);
+			for (size_t s = 0; s < merged; ++s)
+			{
+				const std::pair<uint32_t, uint32_t> span = m_vertexSpans[s];
+				m_vertexSpans[s].second = std::min(span.second, span.first + VertexBatch);
+				for (uint32_t first = m_vertexSpans[s].second; first < span.second; first += VertexBatch)
+					m_vertexSpans.push_back(std::make_pair(first, std::min(span.second, first + VertexBatch)));
+			}
+
+			m_jobs.ParallelFor(m_vertexSpans.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; ++s)
+					for (uint32_t v = m_vertexSpans[s].first; v < m_vertexSpans[s].second; ++v)
+						shader.Vertex(v, vertices[v]);
+			});
+		}
+
+		template<int N>
+		static float PlaneDistance(const ClipVertex<N>& v, int plane)
+		{
+			const Float4& p = v.position;
+			switch (plane)
+			{
+			case 0: return p.z;
+			case 1: return p.w - p.z;
+			case 2: return GuardBand * p.w - p.x;
+			case 3: return GuardBand * p.w + p.x;
+			case 4: return GuardBand * p.w - p.y;
+			default: return GuardBand * p.w + p.y;
+			}
+		}
+
+		template<int N>
+		static unsigned Outcode(const ClipVertex<N>& v)
+		{
+			unsigned code = 0;
+			for (int plane = 0; plane < 6; ++plane)
+				if (PlaneDistance(v, plane) < 0.0f)
+					code |= 1u << plane;
+			return code;
+		}
+
+		template<int N>
+		static int ClipPolygon(const ClipVertex<N>* in, int count, ClipVertex<N>* out, int plane)
+		{
+			int written = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const ClipVertex<N>& a = in[i];
+				const ClipVertex<N>& b = in[(i + 1) % count];
+				const float da = PlaneDistance(a, plane), db = PlaneDistance(b, plane);
+				if (da >= 0.0f)
+					out[written++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					const float t = da / (da - db);
+					ClipVertex<N>& v = out[written++];
+					v.position = Float4{ a.position.x + (b.position.x - a.position.x) * t, a.position.y + (b.position.y - a.position.y) * t,
+						a.position.z + (b.position.z - a.position.z) * t, a.position.w + (b.position.w - a.position.w) * t };
+					for (int k = 0; k < N; ++k)
+						v.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+				}
+			}
+			return written;
+		}
+
+		template<int N>
+		void SetupTriangles(const ClipVertex<N>* vertices, const void* indices, IndexFormat indexFormat,
+			const DrawCall* ranges, size_t first, size_t last, const RasterTarget& target,
+			int tilesX, int tilesY, WorkerBins& bins)
+		{
+			bins.triangles.clear();
+			bins.varyings.clear();
+			bins.tiles.resize(size_t(tilesX) * tilesY);
+			for (std::vector<uint32_t>& tile : bins.tiles)
+				tile.clear();
+
+			size_t range = std::upper_bound(m_triangleStarts.begin(), m_triangleStarts.end(), first) - m_triangleStarts.begin() - 1;
+			for (size_t triangle = first; triangle < last; ++triangle)
+			{
+				while (triangle >= m_triangleStarts[range + 1])
+					++range;
+				const DrawCall& draw = ranges[range];
+				const size_t index = draw.startIndex + (triangle - m_triangleStarts[range]) * 3;
+				const ClipVertex<N>& v0 = vertices[ReadIndex(indices, indexFormat, index) + draw.baseVertex];
+				const ClipVertex<N>& v1 = vertices[ReadIndex(indices, indexFormat, index + 1) + draw.baseVertex];
+				const ClipVertex<N>& v2 = vertices[ReadIndex(indices, indexFormat, index + 2) + draw.baseVertex];
+
+				const unsigned code0 = Outcode(v0), code1 = Outcode(v1), code2 = Outcode(v2);
+				if (code0 & code1 & code2)
+					continue;
+				if (!(code0 | code1 | code2))
+				{
+					SetupTriangle(v0, v1, v2, target, tilesX, bins);
+					continue;
+				}
+
+				ClipVertex<N> polygon[MaxClippedVertices], clipped[MaxClippedVertices];
+				polygon[0] = v0;
+				polygon[1] = v1;
+				polygon[2] = v2;
+				int count = 3;
+				const unsigned planes = code0 | code1 | code2;
+				for (int plane = 0; plane < 6 && count >= 3; ++plane)
+				{
+					if (planes & (1u << plane))
+					{
+						count = ClipPolygon(polygon, count, clipped, plane);
+						std::copy(clipped, clipped + count, polygon);
+					}
+				}
+				for (int i = 1; i + 1 < count; ++i)
+					SetupTriangle(polygon[0], polygon[i], polygon[i + 1], target, tilesX, bins);
+			}
+		}
+
+		template<int N>
+		static void SetupTriangle(const ClipVertex<N>& v0, const ClipVertex<N>& v1, const ClipVertex<N>& v2,
+			const RasterTarget& target, int tilesX, WorkerBins& bins)
+		{
+			const ClipVertex<N>* v[3]{ &v0, &v1, &v2 };
+			const float halfWidth = target.width * 0.5f, halfHeight = target.height * 0.5f;
+			RasterTriangle setup;
+			double x[3], y[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				const Float4& p = v[i]->position;
+				setup.inverseW[i] = 1.0f / p.w;
+				setup.z[i] = p.z * setup.inverseW[i];
+				x[i] = std::nearbyint(double((p.x * setup.inverseW[i] + 1.0f) * halfWidth) * 256.0) / 256.0;
+				y[i] = std::nearbyint(double((1.0f - p.y * setup.inverseW[i]) * halfHeight) * 256.0) / 256.0;
+			}
+
+			const double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (!(area > 0.0))
+				return;
+
+			setup.minX = std::max(0, static_cast<int>(std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5)));
+			setup.minY = std::max(0, static_cast<int>(std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5)));
+			setup.maxX = std::min(static_cast<int>(target.width) - 1, static_cast<int>(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5)));
+			setup.maxY = std::min(static_cast<int>(target.height) - 1, static_cast<int>(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5)));
+			if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+				return;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				// Edge opposite vertex i, from a to b.
+				const int a = (i + 1) % 3, b = (i + 2) % 3;
+				setup.a[i] = -(y[b] - y[a]);
+				setup.b[i] = x[b] - x[a];
+				setup.c[i] = (y[b] - y[a]) * x[a] - (x[b] - x[a]) * y[a];
+				setup.threshold[i] = IsTopLeft(x[a], y[a], x[b], y[b]) ? -1.0 / 131072.0 : 0.0;
+			}
+			setup.inverseArea = 1.0 / area;
+
+			setup.varyingOffset = static_cast<uint32_t>(bins.varyings.size());
+			for (int i = 0; i < 3; ++i)
+				for (int k = 0; k < N; ++k)
+					bins.varyings.push_back(v[i]->varyings[k] * setup.inverseW[i]);
+
+			const uint32_t id = static_cast<uint32_t>(bins.triangles.size());
+			bins.triangles.push_back(setup);
+			for (int ty = setup.minY / TileSize; ty <= setup.maxY / TileSize; ++ty)
+				for (int tx = setup.minX / TileSize; tx <= setup.maxX / TileSize; ++tx)
+					bins.tiles[size_t(ty) * tilesX + tx].push_back(id);
+		}
+
+		template<int N, typename Shader>
+		static uint32_t RasterizeTriangle(const Shader& shader, const RasterTriangle& setup, const float* varyings,
+			const RasterTarget& target, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY)
+		{
+			const int minX = std::max(setup.minX, tileMinX), maxX = std::min(setup.maxX, tileMaxX);
+			const int minY = std::max(setup.minY, tileMinY), maxY = std::min(setup.maxY, tileMaxY);
+			uint32_t shaded = 0;
+
+			auto shadePixel = [&](int x, int y, double e0, double e1, double e2) {
+				const float l0 = static_cast<float>(e0 * setup.inverseArea);
+				const float l1 = static_cast<float>(e1 * setup.inverseArea);
+				const float l2 = static_cast<float>(e2 * setup.inverseArea);
+				const size_t pixel = size_t(y) * target.width + x;
+
+				// Depth is clamped to the [0, 1] viewport range and stored as D24 UNORM.
+				const float z = Saturate(l0 * setup.z[0] + l1 * setup.z[1] + l2 * setup.z[2]);
+				const uint32_t depth = static_cast<uint32_t>(z * 16777215.0f + 0.5f);
+				if (!(depth < target.depth[pixel]))
+					return;
+				target.depth[pixel] = depth;
+
+				const float w = 1.0f / (l0 * setup.inverseW[0] + l1 * setup.inverseW[1] + l2 * setup.inverseW[2]);
+				float interpolated[N];
+				for (int k = 0; k < N; ++k)
+					interpolated[k] = (l0 * varyings[k] + l1 * varyings[N + k] + l2 * varyings[2 * N + k]) * w;
+				shader.Pixel(interpolated, pixel);
+				++shaded;
+			};
+
+			for (int y = minY; y <= maxY; ++y)
+			{
+				const double px = minX + 0.5, py = y + 0.5;
+				double e[3];
+				for (int i = 0; i < 3; ++i)
+					e[i] = setup.a[i] * px + setup.b[i] * py + setup.c[i];
+
+#if FOGMAP_RASTER_SSE2
+				// Four pixels per step as two pairs of doubles.
+				__m128d e01[3], e23[3], step[3], threshold[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					const __m128d a = _mm_set1_pd(setup.a[i]);
+					e01[i] = _mm_add_pd(_mm_set1_pd(e[i]), _mm_mul_pd(a, _mm_set_pd(1.0, 0.0)));
+					e23[i] = _mm_add_pd(_mm_set1_pd(e[i]), _mm_mul_pd(a, _mm_set_pd(3.0, 2.0)));
+					step[i] = _mm_mul_pd(a, _mm_set1_pd(4.0));
+					threshold[i] = _mm_set1_pd(setup.threshold[i]);
+				}
+				for (int x = minX; x <= maxX; x += 4)
+				{
+					__m128d inside01 = _mm_cmpgt_pd(e01[0], threshold[0]), inside23 = _mm_cmpgt_pd(e23[0], threshold[0]);
+					for (int i = 1; i < 3; ++i)
+					{
+						inside01 = _mm_and_pd(inside01, _mm_cmpgt_pd(e01[i], threshold[i]));
+						inside23 = _mm_and_pd(inside23, _mm_cmpgt_pd(e23[i], threshold[i]));
+					}
+					unsigned mask = unsigned(_mm_movemask_pd(inside01)) | (unsigned(_mm_movemask_pd(inside23)) << 2);
+					if (maxX - x < 3)
+						mask &= (1u << (maxX - x + 1)) - 1;
+					for (int lane = 0; mask; ++lane, mask >>= 1)
+					{
+						if (mask & 1)
+						{
+							const double offset = double(x - minX + lane);
+							shadePixel(x + lane, y, e[0] + offset * setup.a[0], e[1] + offset * setup.a[1], e[2] + offset * setup.a[2]);
+						}
+					}
+					for (int i = 0; i < 3; ++i)
+					{
+						e01[i] = _mm_add_pd(e01[i], step[i]);
+						e23[i] = _mm_add_pd(e23[i], step[i]);
+					}
+				}
+#else
+				for (int x = minX; x <= maxX; ++x)
+				{
+					const double offset = double(x - minX);
+					const double e0 = e[0] + offset * setup.a[0], e1 = e[1] + offset * setup.a[1], e2 = e[2] + offset * setup.a[2];
+					if (e0 > setup.threshold[0] && e1 > setup.threshold[1] && e2 > setup.threshold[2])
+						shadePixel(x, y, e0, e1, e2);
+				}
+#endif
+			}
+			return shaded;
+		}
+
+		JobSystem m_jobs;
+		std::vector<WorkerBins> m_bins;
+		std::vector<float> m_vertexStorage;
+		std::vector<std::pair<uint32_t, uint32_t>> m_vertexSpans;
+		std::vector<size_t> m_triangleStarts;
+	};
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned threadCount) :
+	m_pipeline(new RasterPipeline(threadCount)),
+	m_mesh{},
+	m_timings{},
+	m_counters{},
+	m_width(0),
+	m_height(0),
+	m_shadowMap(size_t(ShadowMapSize) * ShadowMapSize),
+	m_shadowDepth(size_t(ShadowMapSize) * ShadowMapSize)
+{
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+}
+
+void SoftwareRenderer::Resize(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_color.resize(size_t(width) * height * 4);
+	m_depth.resize(size_t(width) * height);
+}
+
+void SoftwareRenderer::SetMesh(const MeshBuffers& buffers)
+{
+	m_mesh = buffers;
+}
+
+void SoftwareRenderer::SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices)
+{
+	m_cellVertices = vertices;
+	m_cellIndices = indices;
+}
+
+void SoftwareRenderer::DrawEpipolarFog(const FrameDescription& frame, const RenderPass& pass)
+{
+	const FogRayMarchShader march{ &frame.fogMarch, &pass.transforms, m_shadowMap.data(), m_depth.data(), m_color.data(), m_width, m_height };
+	uint32_t bounds[4];
+	FogScreenBounds(frame.fogMarch, pass.transforms.modelViewProjection, m_width, m_height, bounds);
+	if (bounds[2] == bounds[0] || bounds[3] == bounds[1])
+		return;
+
+	// The view depth of the pixels the lines cross; they end on the right and bottom edges of
+	// the rectangle, one pixel past it.
+	const uint32_t right = std::min(bounds[2] + 1, m_width), bottom = std::min(bounds[3] + 1, m_height);
+	m_viewDepth.resize(m_depth.size());
+	m_pipeline->GetJobs().ParallelFor(bottom - bounds[1], 8, [&](size_t begin, size_t end) {
+		for (size_t y = bounds[1] + begin; y < bounds[1] + end; ++y)
+			for (uint32_t x = bounds[0]; x < right; ++x)
+				m_viewDepth[y * m_width + x] = FogRayMarchSource::ViewDepth(march, x, static_cast<uint32_t>(y));
+	});
+	const FogRayMarchSource source(march, m_viewDepth.data());
+
+	float lightX, lightY;
+	ProjectLightDirection(frame.light.lightDirection, pass.transforms.modelViewProjection, m_width, m_height, lightX, lightY);
+	m_epipolar.Build(frame.fogEpipolar, bounds[0], bounds[1], bounds[2] - bounds[0], bounds[3] - bounds[1], lightX, lightY, source,
+		m_pipeline->GetJobs());
+	const EpipolarResolveShader resolve{ &m_epipolar, &source, &march, bounds[0], bounds[1], bounds[2], bounds[3] };
+	m_pipeline->DrawFullScreen(resolve, m_width, m_height);
+
+	const EpipolarCounters counters = m_epipolar.GetCounters();
+	m_counters.fogFragments += counters.samples;
+	m_counters.fogRays += counters.coarseRays + counters.refinedRays + counters.fallbackRays;
+}
+
+void SoftwareRenderer::DrawFroxelFog(const FrameDescription& frame, const RenderPass& pass)
+{
+	const FogRayMarchShader march{ &frame.fogMarch, &pass.transforms, m_shadowMap.data(), m_depth.data(), m_color.data(), m_width, m_height };
+	const ShadowMapLight light(march);
+	m_froxels.Build(frame.fogFroxels, frame.fogMarch, pass.transforms.modelViewProjection, pass.transforms.modelLightViewProjection, light,
+		m_pipeline->GetJobs());
+	const FogFroxelSettings& grid = frame.fogFroxels;
+	m_counters.fogFragments += uint64_t(grid.width) * grid.height * grid.depth;
+	m_counters.fogRays += uint64_t(grid.width) * grid.height;
+
+	uint32_t bounds[4];
+	FogScreenBounds(frame.fogMarch, pass.transforms.modelViewProjection, m_width, m_height, bounds);
+	const FroxelCompositeShader composite{ &m_froxels, &march, bounds[0], bounds[1], bounds[2], bounds[3] };
+	if (bounds[2] != bounds[0] && bounds[3] != bounds[1])
+		m_pipeline->DrawFullScreen(composite, m_width, m_height);
+}
+
+void SoftwareRenderer::Submit(const FrameDescription& frame)
+{
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+	m_timings = SoftwareFrameTimings{ 0.0, 0.0, 0.0, 0.0 };
+	m_counters = SoftwareFrameCounters{ 0, 0, 0, 0 };
+
+	const RasterTarget shadowTarget{ ShadowMapSize, ShadowMapSize, m_shadowDepth.data() };
+	const RasterTarget target{ m_width, m_height, m_depth.data() };
+	for (const RenderPass& pass : frame.passes)
+	{
+		const Clock::time_point passStart = Clock::now();
+		const DrawCall* draws = frame.draws.data() + pass.firstDraw;
+		switch (pass.type)
+		{
+		case PassType::Shadow:
+		{
+			// Cleared like m_shadowRTV and m_shadowDSV.
+			std::fill(m_shadowMap.begin(), m_shadowMap.end(), 0.0f);
+			std::fill(m_shadowDepth.begin(), m_shadowDepth.end(), DepthClear);
+			const ShadowShader shadow{ m_mesh.positions, &pass.transforms, m_shadowMap.data() };
+			m_counters.shadowFragments += m_pipeline->Draw(shadow, m_mesh.indices, m_mesh.indexFormat, draws, pass.drawCount, m_mesh.vertexCount, shadowTarget);
+			break;
+		}
+		case PassType::Scene:
+		{
+			// Into a back buffer cleared to opaque black.
+			for (size_t i = 0; i < m_color.size(); i += 4)
+			{
+				m_color[i + 0] = m_color[i + 1] = m_color[i + 2] = 0;
+				m_color[i + 3] = 255;
+			}
+			std::fill(m_depth.begin(), m_depth.end(), DepthClear);
+			const SceneShader scene{ m_mesh.positions, m_mesh.attributes, &pass.transforms, &frame.light, m_shadowMap.data(), m_color.data() };
+			m_counters.sceneFragments += m_pipeline->Draw(scene, m_mesh.indices, m_mesh.indexFormat, draws, pass.drawCount, m_mesh.vertexCount, target);
+			break;
+		}
+		case PassType::FogCells:
+		{
+			// Blended back to front over the scene with depth testing and writes left on.
+			const bool frameCells = !frame.fogIndices.empty();
+			const std::vector<FogCellVertex>& vertices = frameCells ? frame.fogVertices : m_cellVertices;
+			const std::vector<uint16_t>& indices = frameCells ? frame.fogIndices : m_cellIndices;
+			const FogShader fog{ vertices.data(), &pass.transforms, m_shadowMap.data(), m_color.data() };
+			m_counters.fogFragments += m_pipeline->Draw(fog, indices.data(), IndexFormat::UInt16, draws, pass.drawCount,
+				static_cast<uint32_t>(vertices.size()), target);
+			break;
+		}
+		case PassType::FogRayMarch:
+		{
+			if (frame.fogFroxels.width != 0)
+			{
+				DrawFroxelFog(frame, pass);
+				break;
+			}
+			if (frame.fogEpipolar.lineCount != 0)
+			{
+				DrawEpipolarFog(frame, pass);
+				break;
+			}
+			const FogRayMarchShader march{ &frame.fogMarch, &pass.transforms, m_shadowMap.data(),
+				m_depth.data(), m_color.data(), m_width, m_height };
+			m_counters.fogFragments += m_pipeline->DrawFullScreen(march, m_width, m_height);
+			m_counters.fogRays += uint64_t(m_width) * m_height;
+			break;
+		}
+		}
+
+		const double ms = std::chrono::duration<double, std::milli>(Clock::now() - passStart).count();
+		double& passMs = pass.type == PassType::Shadow ? m_timings.shadowMs : pass.type == PassType::Scene ? m_timings.sceneMs : m_timings.fogMs;
+		passMs += ms;
+	}
+	m_timings.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "EpipolarSampler.h"
+#include "FroxelGrid.h"
+#include "RenderBackend.h"
+
+#include <memory>
+
+namespace FogMap
+{
+	struct SoftwareFrameTimings
+	{
+		double shadowMs;
+		double sceneMs;
+		double fogMs;
+		double totalMs;
+	};
+
+	// Fragments that passed the depth test and were shaded, per pass type; for the FogRayMarch
+	// pass, the samples taken along all rays, or the froxels filled.
+	struct SoftwareFrameCounters
+	{
+		uint64_t shadowFragments;
+		uint64_t sceneFragments;
+		uint64_t fogFragments;
+		uint64_t fogRays;		// marched by the FogRayMarch pass, or froxel columns filled
+	};
+
+	class RasterPipeline;
+
+	// Headless CPU RenderBackend reproducing MainRenderer's frame: the shadow depth pass into a
+	// ShadowMapSize square float map, then the lit scene with the 5-tap shadow test and the blended
+	// fog slices, or the ray-marched fog read against the scene depth, into an RGBA8 target. With
+	// FrameDescription::fogEpipolar set, the rays are marched on epipolar lines by an
+	// EpipolarSampler and interpolated; with FrameDescription::fogFroxels set, the fog is read
+	// from a FroxelGrid filled from the shadow map once per frame. Rasterisation follows the
+	// D3D11 rules (8-bit sub-pixel snapping, top-left fill, clockwise front faces, D24 LESS
+	// depth). Triangles are binned into 64x64 tiles in submission order and the tiles are shaded
+	// on all worker threads.
+	class SoftwareRenderer : public RenderBackend
+	{
+	public:
+		explicit SoftwareRenderer(unsigned threadCount);
+		~SoftwareRenderer();
+
+		void Resize(uint32_t width, uint32_t height);
+		// Float-layout buffers; they must stay valid while frames are rendered from them.
+		void SetMesh(const MeshBuffers& buffers) override;
+		void SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices) override;
+		void Submit(const FrameDescription& frame) override;
+
+		// Time spent in each pass type by the last Submit.
+		const SoftwareFrameTimings& GetTimings() const { return m_timings; }
+		const SoftwareFrameCounters& GetCounters() const { return m_counters; }
+		// Of the last epipolar FogRayMarch pass.
+		EpipolarCounters GetEpipolarCounters() const { return m_epipolar.GetCounters(); }
+		// Of the last froxel FogRayMarch pass; the composite takes the rest of the fog time.
+		const FroxelTimings& GetFroxelTimings() const { return m_froxels.GetTimings(); }
+		// Drops the froxel grid's history, as after a cut.
+		void ResetFroxelHistory() { m_froxels.Reset(); }
+		uint32_t GetWidth() const { return m_width; }
+		uint32_t GetHeight() const { return m_height; }
+		// Row-major RGBA8 with row 0 at the top.
+		const std::vector<uint8_t>& GetColor() const { return m_color; }
+		const std::vector<float>& GetShadowMap() const { return m_shadowMap; }
+
+	private:
+		// The FogRayMarch pass with FrameDescription::fogEpipolar.
+		void DrawEpipolarFog(const FrameDescription& frame, const RenderPass& pass);
+		// The FogRayMarch pass with FrameDescription::fogFroxels.
+		void DrawFroxelFog(const FrameDescription& frame, const RenderPass& pass);
+
+		std::unique_ptr<RasterPipeline> m_pipeline;
+		MeshBuffers m_mesh;
+		std::vector<FogCellVertex> m_cellVertices;
+		std::vector<uint16_t> m_cellIndices;
+		SoftwareFrameTimings m_timings;
+		SoftwareFrameCounters m_counters;
+		EpipolarSampler m_epipolar;
+		FroxelGrid m_froxels;
+
+		uint32_t m_width;
+		uint32_t m_height;
+		std::vector<uint8_t> m_color;
+		std::vector<uint32_t> m_depth;
+		std::vector<float> m_viewDepth;	// of m_depth, for epipolar sampling
+		std::vector<float> m_shadowMap;
+		std::vector<uint32_t> m_shadowDepth;
+	};
+}
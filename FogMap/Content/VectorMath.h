@@ -0,0 +1,129 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+#include <cmath>
+
+// FOGMAP_SCALAR_MATH turns the vector paths off, e.g. to time them against the scalar ones.
+#if !defined(FOGMAP_SCALAR_MATH)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FOGMAP_VECTOR_SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FOGMAP_VECTOR_AVX2
+#endif
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FOGMAP_VECTOR_NEON
+#endif
+#endif
+
+namespace FogMap
+{
+	// Float3 arithmetic shared by the portable code. Every vector path in this header and in
+	// MatrixMath.h evaluates the same expressions in the same order as these scalar functions,
+	// with correctly rounded square roots and divisions and no fused multiply-adds, so batch
+	// and element-wise results are bit-identical on every target.
+	inline Float3 Add(const Float3& a, const Float3& b) { return Float3{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Float3 Sub(const Float3& a, const Float3& b) { return Float3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Float3 Scale(const Float3& v, float s) { return Float3{ v.x * s, v.y * s, v.z * s }; }
+	inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline Float3 Cross(const Float3& a, const Float3& b) { return Float3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	inline float Length(const Float3& v) { return std::sqrt(Dot(v, v)); }
+
+	// v / |v|; zero-length (and NaN) vectors are returned unchanged.
+	inline Float3 Normalize(const Float3& v)
+	{
+		const float length = Length(v);
+		return length > 0.0f ? Float3{ v.x / length, v.y / length, v.z / length } : v;
+	}
+
+#if defined(FOGMAP_VECTOR_SSE2)
+	namespace Detail
+	{
+		// Four packed Float3 (a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3) to and from
+		// one register per component.
+		inline void Deinterleave3(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+		{
+			x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+			y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+		}
+
+		inline void Interleave3(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+		{
+			a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+			b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+			c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		}
+
+		inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+	}
+#endif
+
+	// Normalize applied to vectors[0, count) in place.
+	inline void NormalizeVectors(Float3* vectors, size_t count)
+	{
+		size_t i = 0;
+#if defined(FOGMAP_VECTOR_AVX2)
+		for (; i + 8 <= count; i += 8)
+		{
+			float* p = &vectors[i].x;
+			__m128 x0, y0, z0, x1, y1, z1;
+			Detail::Deinterleave3(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x0, y0, z0);
+			Detail::Deinterleave3(_mm_loadu_ps(p + 12), _mm_loadu_ps(p + 16), _mm_loadu_ps(p + 20), x1, y1, z1);
+			const __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+			const __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+			const __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+			const __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+			const __m256 mask = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+			const __m256 nx = _mm256_blendv_ps(x, _mm256_div_ps(x, length), mask);
+			const __m256 ny = _mm256_blendv_ps(y, _mm256_div_ps(y, length), mask);
+			const __m256 nz = _mm256_blendv_ps(z, _mm256_div_ps(z, length), mask);
+			__m128 a, b, c;
+			Detail::Interleave3(_mm256_castps256_ps128(nx), _mm256_castps256_ps128(ny), _mm256_castps256_ps128(nz), a, b, c);
+			_mm_storeu_ps(p, a);
+			_mm_storeu_ps(p + 4, b);
+			_mm_storeu_ps(p + 8, c);
+			Detail::Interleave3(_mm256_extractf128_ps(nx, 1), _mm256_extractf128_ps(ny, 1), _mm256_extractf128_ps(nz, 1), a, b, c);
+			_mm_storeu_ps(p + 12, a);
+			_mm_storeu_ps(p + 16, b);
+			_mm_storeu_ps(p + 20, c);
+		}
+#endif
+#if defined(FOGMAP_VECTOR_SSE2)
+		for (; i + 4 <= count; i += 4)
+		{
+			float* p = &vectors[i].x;
+			__m128 x, y, z;
+			Detail::Deinterleave3(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x, y, z);
+			const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			const __m128 mask = _mm_cmpgt_ps(length, _mm_setzero_ps());
+			__m128 a, b, c;
+			Detail::Interleave3(Detail::Select(mask, _mm_div_ps(x, length), x), Detail::Select(mask, _mm_div_ps(y, length), y),
+				Detail::Select(mask, _mm_div_ps(z, length), z), a, b, c);
+			_mm_storeu_ps(p, a);
+			_mm_storeu_ps(p + 4, b);
+			_mm_storeu_ps(p + 8, c);
+		}
+#elif defined(FOGMAP_VECTOR_NEON) && (defined(_M_ARM64) || defined(__aarch64__))
+		// 32-bit NEON has no exact square root or division, so it keeps the scalar loop.
+		for (; i + 4 <= count; i += 4)
+		{
+			float* p = &vectors[i].x;
+			float32x4x3_t v = vld3q_f32(p);
+			const float32x4_t length = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(v.val[0], v.val[0]), vmulq_f32(v.val[1], v.val[1])), vmulq_f32(v.val[2], v.val[2])));
+			const uint32x4_t mask = vcgtq_f32(length, vdupq_n_f32(0.0f));
+			for (int k = 0; k < 3; ++k)
+				v.val[k] = vbslq_f32(mask, vdivq_f32(v.val[k], length), v.val[k]);
+			vst3q_f32(p, v);
+		}
+#endif
+		for (; i < count; ++i)
+			vectors[i] = Normalize(vectors[i]);
+	}
+}
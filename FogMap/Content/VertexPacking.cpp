@@ -0,0 +1,119 @@
+﻿#include "VertexPacking.h"
+#include "VectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace FogMap;
+
+namespace
+{
+	inline float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	inline int16_t QuantizeSnorm(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+	}
+
+	inline float DequantizeSnorm(int16_t value)
+	{
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	inline uint16_t QuantizeUnorm(float value, float offset, float scale)
+	{
+		if (scale <= 0.0f)
+			return 0;
+		return static_cast<uint16_t>(std::lround(std::min(std::max((value - offset) / scale, 0.0f), 1.0f) * 65535.0f));
+	}
+}
+
+VertexQuantization FogMap::ComputeQuantization(const Float3& boundsMin, const Float3& boundsMax)
+{
+	return VertexQuantization{ boundsMin, Float3{ boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z } };
+}
+
+void FogMap::EncodeOctahedral(const Float3& normal, int16_t encoded[2])
+{
+	float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (sum == 0.0f)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+	float x = normal.x / sum, y = normal.y / sum;
+	if (normal.z < 0.0f)
+	{
+		float folded = (1.0f - std::abs(y)) * SignNotZero(x);
+		y = (1.0f - std::abs(x)) * SignNotZero(y);
+		x = folded;
+	}
+	encoded[0] = QuantizeSnorm(x);
+	encoded[1] = QuantizeSnorm(y);
+}
+
+Float3 FogMap::DecodeOctahedral(const int16_t encoded[2])
+{
+	// Mirrors OctDecode in the packed vertex shaders.
+	Float3 n{ DequantizeSnorm(encoded[0]), DequantizeSnorm(encoded[1]), 0.0f };
+	n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return Normalize(n);
+}
+
+VertexPackingError FogMap::PackVertices(const Float3* positions, const MeshAttributes* attributes, size_t count,
+	const VertexQuantization& quantization, PackedPosition* packedPositions, PackedNormal* packedNormals)
+{
+	const Float3& offset = quantization.offset;
+	const Float3& scale = quantization.scale;
+	VertexPackingError error{ 0.0f, 0.0f };
+	// Sine and cosine of the largest normal error so far. The sine comes from the cross
+	// product: acos of a float cosine cannot resolve the few thousandths of a degree involved.
+	float worstSine = 0.0f, worstCosine = 1.0f;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Float3& v = positions[i];
+		const Float3& normal = attributes[i].norm;
+		uint16_t* p = packedPositions[i].xyzw;
+		p[0] = QuantizeUnorm(v.x, offset.x, scale.x);
+		p[1] = QuantizeUnorm(v.y, offset.y, scale.y);
+		p[2] = QuantizeUnorm(v.z, offset.z, scale.z);
+		p[3] = 0;
+		EncodeOctahedral(normal, packedNormals[i].xy);
+
+		Float3 pos{ offset.x + p[0] / 65535.0f * scale.x, offset.y + p[1] / 65535.0f * scale.y, offset.z + p[2] / 65535.0f * scale.z };
+		error.maxPosition = std::max({ error.maxPosition, std::abs(pos.x - v.x), std::abs(pos.y - v.y), std::abs(pos.z - v.z) });
+
+		float length = Length(normal);
+		if (length > 0.0f)
+		{
+			Float3 n = DecodeOctahedral(packedNormals[i].xy);
+			float sine = Length(Cross(n, normal)) / length, cosine = Dot(n, normal) / length;
+			// Both angles lie in [0, pi], so the sign of sin(angle - worst) orders them.
+			if (sine * worstCosine > worstSine * cosine)
+			{
+				worstSine = sine;
+				worstCosine = cosine;
+			}
+		}
+	}
+	error.maxNormalDegrees = std::atan2(worstSine, worstCosine) * (180.0f / 3.14159265f);
+	return error;
+}
+
+void FogMap::LogPackingError(const VertexPackingError& error, const std::function<void(const char*)>& log)
+{
+	if (!log)
+		return;
+	char message[128];
+	std::snprintf(message, sizeof(message), "Packed scene vertices: max position error %g, max normal error %g degrees\n",
+		error.maxPosition, error.maxNormalDegrees);
+	log(message);
+}
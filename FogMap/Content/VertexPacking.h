@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "MeshData.h"
+
+#include <functional>
+
+namespace FogMap
+{
+	// 12-byte scene vertex in two streams: position as R16G16B16A16_UNORM relative to the mesh
+	// bounds and an octahedral normal as R16G16_SNORM. Colour lives in a per-mesh constant.
+	struct PackedPosition
+	{
+		uint16_t xyzw[4];
+	};
+
+	struct PackedNormal
+	{
+		int16_t xy[2];
+	};
+
+	// position = offset + unorm * scale
+	struct VertexQuantization
+	{
+		Float3 offset;
+		Float3 scale;
+	};
+
+	// Largest deviation of the decoded vertices from the originals.
+	struct VertexPackingError
+	{
+		float maxPosition;			// in model units
+		float maxNormalDegrees;
+	};
+
+	VertexQuantization ComputeQuantization(const Float3& boundsMin, const Float3& boundsMax);
+
+	void EncodeOctahedral(const Float3& normal, int16_t encoded[2]);
+	Float3 DecodeOctahedral(const int16_t encoded[2]);
+
+	VertexPackingError PackVertices(const Float3* positions, const MeshAttributes* attributes, size_t count,
+		const VertexQuantization& quantization, PackedPosition* packedPositions, PackedNormal* packedNormals);
+
+	// Reports the error as one line to log (see RendererSettings::log); does nothing without one.
+	void LogPackingError(const VertexPackingError& error, const std::function<void(const char*)>& log);
+}
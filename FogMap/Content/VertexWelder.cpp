@@ -0,0 +1,64 @@
+﻿#include "VertexWelder.h"
+
+using namespace FogMap;
+
+namespace
+{
+	inline uint64_t HashKey(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ull;
+		key ^= key >> 33;
+		return key;
+	}
+}
+
+VertexWelder::VertexWelder(size_t expectedVertices) :
+	m_mask(0),
+	m_count(0)
+{
+	size_t capacity = 64;
+	while (capacity < expectedVertices * 2) capacity *= 2;
+	Rehash(capacity);
+}
+
+bool VertexWelder::Insert(uint32_t position, uint32_t normal, uint32_t& index)
+{
+	// Keep the load factor at or below one half so probe sequences stay short.
+	if ((m_count + 1) * 2 > m_slots.size())
+		Rehash(m_slots.size() * 2);
+
+	const uint64_t key = static_cast<uint64_t>(position) << 32 | normal;
+	for (size_t i = HashKey(key) & m_mask; ; i = (i + 1) & m_mask)
+	{
+		Slot& slot = m_slots[i];
+		if (slot.key == key)
+		{
+			index = slot.index;
+			return false;
+		}
+		if (slot.key == EmptyKey)
+		{
+			slot.key = key;
+			slot.index = index = static_cast<uint32_t>(m_count++);
+			return true;
+		}
+	}
+}
+
+void VertexWelder::Rehash(size_t capacity)
+{
+	std::vector<Slot> slots(capacity, Slot{ EmptyKey, 0 });
+	m_mask = capacity - 1;
+	for (const Slot& slot : m_slots)
+	{
+		if (slot.key == EmptyKey)
+			continue;
+		size_t i = HashKey(slot.key) & m_mask;
+		while (slots[i].key != EmptyKey) i = (i + 1) & m_mask;
+		slots[i] = slot;
+	}
+	m_slots.swap(slots);
+}
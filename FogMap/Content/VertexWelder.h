@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace FogMap
+{
+	// Open-addressing hash table mapping exact (position index, normal index) pairs to
+	// welded vertex indices. Indices are handed out in insertion order.
+	class VertexWelder
+	{
+	public:
+		explicit VertexWelder(size_t expectedVertices = 0);
+
+		// Looks up the pair with a single probe sequence. Returns true and assigns the next
+		// free index if the pair has not been seen before.
+		bool Insert(uint32_t position, uint32_t normal, uint32_t& index);
+		size_t Size() const { return m_count; }
+
+	private:
+		struct Slot
+		{
+			uint64_t key;
+			uint32_t index;
+		};
+
+		static constexpr uint64_t EmptyKey = ~0ull;
+
+		void Rehash(size_t capacity);
+
+		std::vector<Slot> m_slots;
+		size_t m_mask;
+		size_t m_count;
+	};
+}
@@ -0,0 +1,811 @@
+﻿#include "VulkanBackend.h"
+
+#include "../Common/MappedFile.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using namespace FogMap;
+
+namespace
+{
+	// The shadow target keeps the format of m_shadowTexture; depth is 32-bit float where D3D
+	// uses D24, which lavapipe does not render to.
+	constexpr VkFormat ShadowColorFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	constexpr VkFormat ColorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	constexpr VkFormat DepthFormat = VK_FORMAT_D32_SFLOAT;
+
+	// DrawConstantBuffer: three column-major matrices.
+	constexpr VkDeviceSize DrawConstantsSize = 3 * sizeof(Float4x4);
+
+	void ThrowIfFailed(VkResult result, const char* call)
+	{
+		if (result != VK_SUCCESS)
+			throw std::runtime_error(std::string(call) + " failed with VkResult " + std::to_string(result));
+	}
+
+	inline Float4x4 Transposed(const Float4x4& m)
+	{
+		Float4x4 result;
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+				result.m[i][j] = m.m[j][i];
+		return result;
+	}
+
+	inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+VulkanBackend::VulkanBackend(const std::string& shaderDirectory) :
+	m_instance(VK_NULL_HANDLE),
+	m_physicalDevice(VK_NULL_HANDLE),
+	m_memoryProperties{},
+	m_device(VK_NULL_HANDLE),
+	m_queueFamily(0),
+	m_queue(VK_NULL_HANDLE),
+	m_commandPool(VK_NULL_HANDLE),
+	m_commandBuffer(VK_NULL_HANDLE),
+	m_fence(VK_NULL_HANDLE),
+	m_uniformAlignment(256),
+	m_deviceName{},
+	m_shadowRenderPass(VK_NULL_HANDLE),
+	m_sceneRenderPass(VK_NULL_HANDLE),
+	m_fogRenderPass(VK_NULL_HANDLE),
+	m_descriptorSetLayout(VK_NULL_HANDLE),
+	m_descriptorPool(VK_NULL_HANDLE),
+	m_descriptorSet(VK_NULL_HANDLE),
+	m_pipelineLayout(VK_NULL_HANDLE),
+	m_shadowPipeline(VK_NULL_HANDLE),
+	m_scenePipeline(VK_NULL_HANDLE),
+	m_fogPipeline(VK_NULL_HANDLE),
+	m_sampler(VK_NULL_HANDLE),
+	m_shadowColor{},
+	m_shadowDepth{},
+	m_shadowFramebuffer(VK_NULL_HANDLE),
+	m_color{},
+	m_depth{},
+	m_framebuffer(VK_NULL_HANDLE),
+	m_width(0),
+	m_height(0),
+	m_drawBuffer{},
+	m_drawSlots(0),
+	m_lightBuffer{},
+	m_positionBuffer{},
+	m_attributeBuffer{},
+	m_indexBuffer{},
+	m_indexType(VK_INDEX_TYPE_UINT16),
+	m_cellVertexBuffer{},
+	m_cellIndexBuffer{},
+	m_frameCellVertexBuffer{},
+	m_frameCellIndexBuffer{},
+	m_timings{}
+{
+	CreateDevice();
+	CreateRenderPasses();
+	CreateDescriptors();
+	CreatePipelines(shaderDirectory);
+	CreateShadowTarget();
+	WriteDescriptors();
+}
+
+VulkanBackend::~VulkanBackend()
+{
+	if (m_device != VK_NULL_HANDLE)
+	{
+		vkDeviceWaitIdle(m_device);
+		DestroySceneTarget();
+		vkDestroyFramebuffer(m_device, m_shadowFramebuffer, nullptr);
+		DestroyImage(m_shadowColor);
+		DestroyImage(m_shadowDepth);
+		for (Buffer* buffer : { &m_drawBuffer, &m_lightBuffer, &m_positionBuffer, &m_attributeBuffer, &m_indexBuffer, &m_cellVertexBuffer, &m_cellIndexBuffer,
+			&m_frameCellVertexBuffer, &m_frameCellIndexBuffer })
+			DestroyBuffer(*buffer);
+		vkDestroyPipeline(m_device, m_shadowPipeline, nullptr);
+		vkDestroyPipeline(m_device, m_scenePipeline, nullptr);
+		vkDestroyPipeline(m_device, m_fogPipeline, nullptr);
+		vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+		vkDestroySampler(m_device, m_sampler, nullptr);
+		vkDestroyRenderPass(m_device, m_shadowRenderPass, nullptr);
+		vkDestroyRenderPass(m_device, m_sceneRenderPass, nullptr);
+		vkDestroyRenderPass(m_device, m_fogRenderPass, nullptr);
+		vkDestroyFence(m_device, m_fence, nullptr);
+		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+		vkDestroyDevice(m_device, nullptr);
+	}
+	if (m_instance != VK_NULL_HANDLE)
+		vkDestroyInstance(m_instance, nullptr);
+}
+
+void VulkanBackend::CreateDevice()
+{
+	VkApplicationInfo application{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	application.pApplicationName = "FogMap";
+	application.apiVersion = VK_API_VERSION_1_0;
+	VkInstanceCreateInfo instanceInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	instanceInfo.pApplicationInfo = &application;
+	ThrowIfFailed(vkCreateInstance(&instanceInfo, nullptr, &m_instance), "vkCreateInstance");
+
+	uint32_t deviceCount = 0;
+	ThrowIfFailed(vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr), "vkEnumeratePhysicalDevices");
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	ThrowIfFailed(vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data()), "vkEnumeratePhysicalDevices");
+	if (devices.empty())
+		throw std::runtime_error("no Vulkan device");
+
+	// Prefer a CPU implementation, which is what the numbers are meant to be comparable on.
+	m_physicalDevice = devices[0];
+	for (VkPhysicalDevice device : devices)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+		{
+			m_physicalDevice = device;
+			break;
+		}
+	}
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+	std::strncpy(m_deviceName, properties.deviceName, sizeof(m_deviceName) - 1);
+	m_uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+	vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &familyCount, families.data());
+	m_queueFamily = familyCount;
+	for (uint32_t i = 0; i < familyCount && m_queueFamily == familyCount; ++i)
+		if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			m_queueFamily = i;
+	if (m_queueFamily == familyCount)
+		throw std::runtime_error("no Vulkan graphics queue");
+
+	const float priority = 1.0f;
+	VkDeviceQueueCreateInfo queueInfo{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+	queueInfo.queueFamilyIndex = m_queueFamily;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+	VkDeviceCreateInfo deviceInfo{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+	ThrowIfFailed(vkCreateDevice(m_physicalDevice, &deviceInfo, nullptr, &m_device), "vkCreateDevice");
+	vkGetDeviceQueue(m_device, m_queueFamily, 0, &m_queue);
+
+	VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_queueFamily;
+	ThrowIfFailed(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool), "vkCreateCommandPool");
+	VkCommandBufferAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	allocateInfo.commandPool = m_commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+	ThrowIfFailed(vkAllocateCommandBuffers(m_device, &allocateInfo, &m_commandBuffer), "vkAllocateCommandBuffers");
+	VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	ThrowIfFailed(vkCreateFence(m_device, &fenceInfo, nullptr, &m_fence), "vkCreateFence");
+}
+
+void VulkanBackend::CreateRenderPasses()
+{
+	VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorReference;
+	subpass.pDepthStencilAttachment = &depthReference;
+
+	auto createRenderPass = [&](VkFormat colorFormat, VkAttachmentLoadOp load, VkImageLayout initialColor, VkImageLayout finalColor,
+		VkImageLayout initialDepth, const VkSubpassDependency* dependencies, uint32_t dependencyCount) {
+		VkAttachmentDescription attachments[2]{};
+		attachments[0].format = colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = load;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = initialColor;
+		attachments[0].finalLayout = finalColor;
+		attachments[1] = attachments[0];
+		attachments[1].format = DepthFormat;
+		attachments[1].initialLayout = initialDepth;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkRenderPassCreateInfo info{ VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+		info.attachmentCount = 2;
+		info.pAttachments = attachments;
+		info.subpassCount = 1;
+		info.pSubpasses = &subpass;
+		info.dependencyCount = dependencyCount;
+		info.pDependencies = dependencies;
+		VkRenderPass renderPass;
+		ThrowIfFailed(vkCreateRenderPass(m_device, &info, nullptr, &renderPass), "vkCreateRenderPass");
+		return renderPass;
+	};
+
+	// The shadow map is read by the scene and fog pixel shaders once the pass ends.
+	const VkSubpassDependency shadowDependency{ 0, VK_SUBPASS_EXTERNAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 0 };
+	m_shadowRenderPass = createRenderPass(ShadowColorFormat, VK_ATTACHMENT_LOAD_OP_CLEAR,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, &shadowDependency, 1);
+
+	// The fog blends over, and depth tests against, what the scene pass left behind.
+	const VkPipelineStageFlags attachmentStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	const VkAccessFlags attachmentAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	const VkSubpassDependency sceneDependency{ VK_SUBPASS_EXTERNAL, 0,
+		attachmentStages | VK_PIPELINE_STAGE_TRANSFER_BIT, attachmentStages,
+		attachmentAccess | VK_ACCESS_TRANSFER_READ_BIT, attachmentAccess, 0 };
+	m_sceneRenderPass = createRenderPass(ColorFormat, VK_ATTACHMENT_LOAD_OP_CLEAR,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, &sceneDependency, 1);
+	m_fogRenderPass = createRenderPass(ColorFormat, VK_ATTACHMENT_LOAD_OP_LOAD,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, &sceneDependency, 1);
+}
+
+void VulkanBackend::CreateDescriptors()
+{
+	// The sampler of m_sceneSampler: bilinear, clamped in u and v.
+	VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	ThrowIfFailed(vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler), "vkCreateSampler");
+
+	const VkDescriptorSetLayoutBinding bindings[]
+	{
+		{ 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr },
+		{ 2, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		{ 3, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+		{ 4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+	};
+	VkDescriptorSetLayoutCreateInfo layoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+	ThrowIfFailed(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout), "vkCreateDescriptorSetLayout");
+
+	const VkDescriptorPoolSize poolSizes[]
+	{
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+	};
+	VkDescriptorPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 4;
+	poolInfo.pPoolSizes = poolSizes;
+	ThrowIfFailed(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool), "vkCreateDescriptorPool");
+
+	VkDescriptorSetAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocateInfo.descriptorPool = m_descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+	ThrowIfFailed(vkAllocateDescriptorSets(m_device, &allocateInfo, &m_descriptorSet), "vkAllocateDescriptorSets");
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	ThrowIfFailed(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout), "vkCreatePipelineLayout");
+
+	m_lightBuffer = CreateBuffer(sizeof(LightConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, nullptr);
+}
+
+void VulkanBackend::CreatePipelines(const std::string& shaderDirectory)
+{
+	auto load = [&](const char* name) { return LoadShader(shaderDirectory + "/" + name + ".spv"); };
+	VkShaderModule shadowVS = load("ShadowVertexShader"), shadowPS = load("ShadowPixelShader");
+	VkShaderModule sceneVS = load("SceneVertexShader"), scenePS = load("ScenePixelShader");
+	VkShaderModule cellVS = load("CellVertexShader"), cellPS = load("CellPixelShader");
+
+	// The input layouts of MainRenderer: positions in slot 0, colour and normal in slot 1.
+	const VkVertexInputBindingDescription meshBindings[]
+	{
+		{ 0, sizeof(Float3), VK_VERTEX_INPUT_RATE_VERTEX },
+		{ 1, sizeof(MeshAttributes), VK_VERTEX_INPUT_RATE_VERTEX },
+	};
+	const VkVertexInputAttributeDescription meshAttributes[]
+	{
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ 1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ 2, 1, VK_FORMAT_R32G32B32_SFLOAT, 12 },
+	};
+	const VkVertexInputBindingDescription cellBinding{ 0, sizeof(FogCellVertex), VK_VERTEX_INPUT_RATE_VERTEX };
+	const VkVertexInputAttributeDescription cellAttributes[]
+	{
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ 1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, 12 },
+	};
+
+	m_shadowPipeline = CreatePipeline(shadowVS, shadowPS, m_shadowRenderPass, meshBindings, 1, meshAttributes, 1, false);
+	m_scenePipeline = CreatePipeline(sceneVS, scenePS, m_sceneRenderPass, meshBindings, 2, meshAttributes, 3, false);
+	m_fogPipeline = CreatePipeline(cellVS, cellPS, m_fogRenderPass, &cellBinding, 1, cellAttributes, 2, true);
+
+	for (VkShaderModule module : { shadowVS, shadowPS, sceneVS, scenePS, cellVS, cellPS })
+		vkDestroyShaderModule(m_device, module, nullptr);
+}
+
+VkPipeline VulkanBackend::CreatePipeline(VkShaderModule vertexShader, VkShaderModule pixelShader, VkRenderPass renderPass,
+	const VkVertexInputBindingDescription* bindings, uint32_t bindingCount,
+	const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount, bool blend)
+{
+	VkPipelineShaderStageCreateInfo stages[2]{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertexShader;
+	stages[0].pName = "main";
+	stages[1] = stages[0];
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = pixelShader;
+
+	VkPipelineVertexInputStateCreateInfo vertexInput{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	vertexInput.vertexBindingDescriptionCount = bindingCount;
+	vertexInput.pVertexBindingDescriptions = bindings;
+	vertexInput.vertexAttributeDescriptionCount = attributeCount;
+	vertexInput.pVertexAttributeDescriptions = attributes;
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPipelineViewportStateCreateInfo viewport{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewport.viewportCount = 1;
+	viewport.scissorCount = 1;
+
+	// D3D11 defaults: back faces culled, clockwise front faces (the vertex shaders flip y, so
+	// framebuffer winding matches D3D), LESS depth test with writes.
+	VkPipelineRasterizationStateCreateInfo rasterization{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterization.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterization.lineWidth = 1.0f;
+	VkPipelineMultisampleStateCreateInfo multisample{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkPipelineDepthStencilStateCreateInfo depthStencil{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	// m_blendState: SRC_ALPHA / INV_SRC_ALPHA on colour, ONE / ZERO on alpha.
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.blendEnable = blend ? VK_TRUE : VK_FALSE;
+	blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VkPipelineColorBlendStateCreateInfo colorBlend{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	colorBlend.attachmentCount = 1;
+	colorBlend.pAttachments = &blendAttachment;
+
+	const VkDynamicState dynamicStates[]{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamicStates;
+
+	VkGraphicsPipelineCreateInfo info{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	info.stageCount = 2;
+	info.pStages = stages;
+	info.pVertexInputState = &vertexInput;
+	info.pInputAssemblyState = &inputAssembly;
+	info.pViewportState = &viewport;
+	info.pRasterizationState = &rasterization;
+	info.pMultisampleState = &multisample;
+	info.pDepthStencilState = &depthStencil;
+	info.pColorBlendState = &colorBlend;
+	info.pDynamicState = &dynamic;
+	info.layout = m_pipelineLayout;
+	info.renderPass = renderPass;
+	VkPipeline pipeline;
+	ThrowIfFailed(vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &info, nullptr, &pipeline), "vkCreateGraphicsPipelines");
+	return pipeline;
+}
+
+VkShaderModule VulkanBackend::LoadShader(const std::string& path)
+{
+	DX::MappedFile file;
+	if (!file.Open(path) || file.GetSize() % 4 != 0)
+		throw std::runtime_error("cannot read SPIR-V module " + path);
+	// The mapping is page aligned, as code must be.
+	VkShaderModuleCreateInfo info{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	info.codeSize = file.GetSize();
+	info.pCode = reinterpret_cast<const uint32_t*>(file.GetData());
+	VkShaderModule module;
+	ThrowIfFailed(vkCreateShaderModule(m_device, &info, nullptr, &module), "vkCreateShaderModule");
+	return module;
+}
+
+void VulkanBackend::CreateShadowTarget()
+{
+	m_shadowColor = CreateImage(ShadowMapSize, ShadowMapSize, ShadowColorFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	m_shadowDepth = CreateImage(ShadowMapSize, ShadowMapSize, DepthFormat,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	const VkImageView attachments[]{ m_shadowColor.view, m_shadowDepth.view };
+	VkFramebufferCreateInfo info{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	info.renderPass = m_shadowRenderPass;
+	info.attachmentCount = 2;
+	info.pAttachments = attachments;
+	info.width = ShadowMapSize;
+	info.height = ShadowMapSize;
+	info.layers = 1;
+	ThrowIfFailed(vkCreateFramebuffer(m_device, &info, nullptr, &m_shadowFramebuffer), "vkCreateFramebuffer");
+}
+
+void VulkanBackend::CreateSceneTarget()
+{
+	m_color = CreateImage(m_width, m_height, ColorFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	m_depth = CreateImage(m_width, m_height, DepthFormat,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	const VkImageView attachments[]{ m_color.view, m_depth.view };
+	VkFramebufferCreateInfo info{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	info.renderPass = m_sceneRenderPass;
+	info.attachmentCount = 2;
+	info.pAttachments = attachments;
+	info.width = m_width;
+	info.height = m_height;
+	info.layers = 1;
+	ThrowIfFailed(vkCreateFramebuffer(m_device, &info, nullptr, &m_framebuffer), "vkCreateFramebuffer");
+}
+
+void VulkanBackend::DestroySceneTarget()
+{
+	vkDestroyFramebuffer(m_device, m_framebuffer, nullptr);
+	m_framebuffer = VK_NULL_HANDLE;
+	DestroyImage(m_color);
+	DestroyImage(m_depth);
+}
+
+void VulkanBackend::WriteDescriptors()
+{
+	const VkDescriptorBufferInfo drawInfo{ m_drawBuffer.buffer, 0, DrawConstantsSize };
+	const VkDescriptorImageInfo shadowInfo{ VK_NULL_HANDLE, m_shadowColor.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	const VkDescriptorImageInfo samplerInfo{ m_sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+	const VkDescriptorBufferInfo lightInfo{ m_lightBuffer.buffer, 0, sizeof(LightConstants) };
+
+	VkWriteDescriptorSet writes[4]{};
+	for (VkWriteDescriptorSet& write : writes)
+	{
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_descriptorSet;
+		write.descriptorCount = 1;
+	}
+	writes[0].dstBinding = 1;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	writes[0].pBufferInfo = &drawInfo;
+	writes[1].dstBinding = 2;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	writes[1].pImageInfo = &shadowInfo;
+	writes[2].dstBinding = 3;
+	writes[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	writes[2].pImageInfo = &samplerInfo;
+	writes[3].dstBinding = 4;
+	writes[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writes[3].pBufferInfo = &lightInfo;
+
+	// The per-pass constants are only bound once there is a buffer for them.
+	const uint32_t first = m_drawBuffer.buffer != VK_NULL_HANDLE ? 0 : 1;
+	vkUpdateDescriptorSets(m_device, 4 - first, writes + first, 0, nullptr);
+}
+
+uint32_t VulkanBackend::FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+		if ((typeBits & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	throw std::runtime_error("no suitable Vulkan memory type");
+}
+
+VulkanBackend::Buffer VulkanBackend::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const void* data)
+{
+	// Host-visible throughout: on a CPU device all memory is host memory, and the mesh is
+	// uploaded only once.
+	Buffer result{ VK_NULL_HANDLE, VK_NULL_HANDLE, nullptr, size };
+	VkBufferCreateInfo info{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	info.size = size;
+	info.usage = usage;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ThrowIfFailed(vkCreateBuffer(m_device, &info, nullptr, &result.buffer), "vkCreateBuffer");
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(m_device, result.buffer, &requirements);
+	VkMemoryAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocateInfo.allocationSize = requirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	ThrowIfFailed(vkAllocateMemory(m_device, &allocateInfo, nullptr, &result.memory), "vkAllocateMemory");
+	ThrowIfFailed(vkBindBufferMemory(m_device, result.buffer, result.memory, 0), "vkBindBufferMemory");
+	ThrowIfFailed(vkMapMemory(m_device, result.memory, 0, size, 0, &result.mapped), "vkMapMemory");
+	if (data != nullptr)
+		std::memcpy(result.mapped, data, size);
+	return result;
+}
+
+void VulkanBackend::DestroyBuffer(Buffer& buffer)
+{
+	if (buffer.buffer == VK_NULL_HANDLE)
+		return;
+	vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+	vkFreeMemory(m_device, buffer.memory, nullptr);
+	buffer = Buffer{};
+}
+
+VulkanBackend::Image VulkanBackend::CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect)
+{
+	Image result{};
+	VkImageCreateInfo info{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	info.imageType = VK_IMAGE_TYPE_2D;
+	info.format = format;
+	info.extent = VkExtent3D{ width, height, 1 };
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = VK_SAMPLE_COUNT_1_BIT;
+	info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	info.usage = usage;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ThrowIfFailed(vkCreateImage(m_device, &info, nullptr, &result.image), "vkCreateImage");
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(m_device, result.image, &requirements);
+	VkMemoryAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocateInfo.allocationSize = requirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	ThrowIfFailed(vkAllocateMemory(m_device, &allocateInfo, nullptr, &result.memory), "vkAllocateMemory");
+	ThrowIfFailed(vkBindImageMemory(m_device, result.image, result.memory, 0), "vkBindImageMemory");
+
+	VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	viewInfo.image = result.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange = VkImageSubresourceRange{ aspect, 0, 1, 0, 1 };
+	ThrowIfFailed(vkCreateImageView(m_device, &viewInfo, nullptr, &result.view), "vkCreateImageView");
+	return result;
+}
+
+void VulkanBackend::DestroyImage(Image& image)
+{
+	if (image.image == VK_NULL_HANDLE)
+		return;
+	vkDestroyImageView(m_device, image.view, nullptr);
+	vkDestroyImage(m_device, image.image, nullptr);
+	vkFreeMemory(m_device, image.memory, nullptr);
+	image = Image{};
+}
+
+void VulkanBackend::Resize(uint32_t width, uint32_t height)
+{
+	vkDeviceWaitIdle(m_device);
+	DestroySceneTarget();
+	m_width = width;
+	m_height = height;
+	CreateSceneTarget();
+}
+
+void VulkanBackend::SetMesh(const MeshBuffers& buffers)
+{
+	vkDeviceWaitIdle(m_device);
+	DestroyBuffer(m_positionBuffer);
+	DestroyBuffer(m_attributeBuffer);
+	DestroyBuffer(m_indexBuffer);
+	if (buffers.vertexCount == 0 || buffers.indexCount == 0)
+		return;
+	const VkDeviceSize indexSize = buffers.indexFormat == IndexFormat::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	m_indexType = buffers.indexFormat == IndexFormat::UInt16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	m_positionBuffer = CreateBuffer(sizeof(Float3) * buffers.vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, buffers.positions);
+	m_attributeBuffer = CreateBuffer(sizeof(MeshAttributes) * buffers.vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, buffers.attributes);
+	m_indexBuffer = CreateBuffer(indexSize * buffers.indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, buffers.indices);
+}
+
+void VulkanBackend::SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices)
+{
+	vkDeviceWaitIdle(m_device);
+	DestroyBuffer(m_cellVertexBuffer);
+	DestroyBuffer(m_cellIndexBuffer);
+	m_cellVertexBuffer = CreateBuffer(sizeof(FogCellVertex) * vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.data());
+	m_cellIndexBuffer = CreateBuffer(sizeof(uint16_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices.data());
+}
+
+void VulkanBackend::Submit(const FrameDescription& frame)
+{
+	using Clock = std::chrono::steady_clock;
+	auto milliseconds = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+	const Clock::time_point start = Clock::now();
+	m_timings = VulkanFrameTimings{};
+	for (const RenderPass& pass : frame.passes)
+	{
+		if (pass.type == PassType::FogRayMarch)
+			throw std::runtime_error("FogRayMarch passes are not supported by the Vulkan backend");
+	}
+
+	// Constants for every pass go up front, each into its own slot of the dynamic buffer, as
+	// in the D3D11 ring.
+	const VkDeviceSize slotSize = AlignUp(DrawConstantsSize, m_uniformAlignment);
+	if (frame.passes.size() > m_drawSlots)
+	{
+		DestroyBuffer(m_drawBuffer);
+		m_drawSlots = static_cast<uint32_t>(frame.passes.size());
+		m_drawBuffer = CreateBuffer(slotSize * m_drawSlots, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, nullptr);
+		WriteDescriptors();
+	}
+	for (size_t i = 0; i < frame.passes.size(); ++i)
+	{
+		const PassTransforms& transforms = frame.passes[i].transforms;
+		const Float4x4 constants[3]{ Transposed(transforms.modelViewProjection),
+			Transposed(transforms.modelLightViewProjection), Transposed(transforms.normal) };
+		std::memcpy(static_cast<uint8_t*>(m_drawBuffer.mapped) + slotSize * i, constants, sizeof(constants));
+	}
+	std::memcpy(m_lightBuffer.mapped, &frame.light, sizeof(LightConstants));
+
+	// The previous frame has been waited for, so its cells can be overwritten in place.
+	if (!frame.fogIndices.empty())
+	{
+		const VkDeviceSize vertexSize = sizeof(FogCellVertex) * frame.fogVertices.size();
+		const VkDeviceSize indexSize = sizeof(uint16_t) * frame.fogIndices.size();
+		if (vertexSize > m_frameCellVertexBuffer.size)
+		{
+			DestroyBuffer(m_frameCellVertexBuffer);
+			m_frameCellVertexBuffer = CreateBuffer(vertexSize * 2, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, nullptr);
+		}
+		if (indexSize > m_frameCellIndexBuffer.size)
+		{
+			DestroyBuffer(m_frameCellIndexBuffer);
+			m_frameCellIndexBuffer = CreateBuffer(indexSize * 2, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, nullptr);
+		}
+		std::memcpy(m_frameCellVertexBuffer.mapped, frame.fogVertices.data(), vertexSize);
+		std::memcpy(m_frameCellIndexBuffer.mapped, frame.fogIndices.data(), indexSize);
+	}
+
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	ThrowIfFailed(vkResetCommandBuffer(m_commandBuffer, 0), "vkResetCommandBuffer");
+	ThrowIfFailed(vkBeginCommandBuffer(m_commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+	for (size_t i = 0; i < frame.passes.size(); ++i)
+		RecordPass(frame.passes[i], frame, static_cast<uint32_t>(i));
+	ThrowIfFailed(vkEndCommandBuffer(m_commandBuffer), "vkEndCommandBuffer");
+	const Clock::time_point recorded = Clock::now();
+
+	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_commandBuffer;
+	ThrowIfFailed(vkQueueSubmit(m_queue, 1, &submitInfo, m_fence), "vkQueueSubmit");
+	const Clock::time_point submitted = Clock::now();
+
+	ThrowIfFailed(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+	ThrowIfFailed(vkResetFences(m_device, 1, &m_fence), "vkResetFences");
+	const Clock::time_point end = Clock::now();
+
+	m_timings.recordMs = milliseconds(start, recorded);
+	m_timings.submitMs = milliseconds(recorded, submitted);
+	m_timings.waitMs = milliseconds(submitted, end);
+}
+
+void VulkanBackend::RecordPass(const RenderPass& pass, const FrameDescription& frame, uint32_t passIndex)
+{
+	VkClearValue clearValues[2]{};
+	VkRenderPassBeginInfo beginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	beginInfo.clearValueCount = 2;
+	beginInfo.pClearValues = clearValues;
+	VkPipeline pipeline;
+	uint32_t width = m_width, height = m_height;
+	switch (pass.type)
+	{
+	case PassType::Shadow:
+		// Cleared like m_shadowRTV and m_shadowDSV.
+		clearValues[0].color = VkClearColorValue{ { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = VkClearDepthStencilValue{ 1.0f, 0 };
+		beginInfo.renderPass = m_shadowRenderPass;
+		beginInfo.framebuffer = m_shadowFramebuffer;
+		width = height = ShadowMapSize;
+		pipeline = m_shadowPipeline;
+		break;
+	case PassType::Scene:
+		clearValues[0].color = VkClearColorValue{ { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = VkClearDepthStencilValue{ 1.0f, 0 };
+		beginInfo.renderPass = m_sceneRenderPass;
+		beginInfo.framebuffer = m_framebuffer;
+		pipeline = m_scenePipeline;
+		break;
+	default:
+		beginInfo.renderPass = m_fogRenderPass;
+		beginInfo.framebuffer = m_framebuffer;
+		pipeline = m_fogPipeline;
+		break;
+	}
+	beginInfo.renderArea = VkRect2D{ { 0, 0 }, { width, height } };
+	vkCmdBeginRenderPass(m_commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	const VkViewport viewport{ 0.0f, 0.0f, float(width), float(height), 0.0f, 1.0f };
+	vkCmdSetViewport(m_commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(m_commandBuffer, 0, 1, &beginInfo.renderArea);
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	const uint32_t dynamicOffset = static_cast<uint32_t>(AlignUp(DrawConstantsSize, m_uniformAlignment) * passIndex);
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &dynamicOffset);
+	++m_timings.descriptorBinds;
+
+	const VkDeviceSize offsets[]{ 0, 0 };
+	if (pass.type == PassType::FogCells)
+	{
+		const bool frameCells = !frame.fogIndices.empty();
+		vkCmdBindVertexBuffers(m_commandBuffer, 0, 1, frameCells ? &m_frameCellVertexBuffer.buffer : &m_cellVertexBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(m_commandBuffer, frameCells ? m_frameCellIndexBuffer.buffer : m_cellIndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+	}
+	else if (m_indexBuffer.buffer != VK_NULL_HANDLE)
+	{
+		// The shadow pass only fetches the position stream.
+		const VkBuffer streams[]{ m_positionBuffer.buffer, m_attributeBuffer.buffer };
+		vkCmdBindVertexBuffers(m_commandBuffer, 0, pass.type == PassType::Shadow ? 1 : 2, streams, offsets);
+		vkCmdBindIndexBuffer(m_commandBuffer, m_indexBuffer.buffer, 0, m_indexType);
+	}
+
+	if (pass.type == PassType::FogCells || m_indexBuffer.buffer != VK_NULL_HANDLE)
+	{
+		for (uint32_t i = pass.firstDraw; i < pass.firstDraw + pass.drawCount; ++i)
+		{
+			const DrawCall& draw = frame.draws[i];
+			vkCmdDrawIndexed(m_commandBuffer, draw.indexCount, 1, draw.startIndex, static_cast<int32_t>(draw.baseVertex), 0);
+			++m_timings.drawCalls;
+		}
+	}
+	vkCmdEndRenderPass(m_commandBuffer);
+}
+
+void VulkanBackend::ReadColor(std::vector<uint8_t>& rgba)
+{
+	const VkDeviceSize size = VkDeviceSize(m_width) * m_height * 4;
+	Buffer readback = CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, nullptr);
+
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	ThrowIfFailed(vkResetCommandBuffer(m_commandBuffer, 0), "vkResetCommandBuffer");
+	ThrowIfFailed(vkBeginCommandBuffer(m_commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+
+	VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_color.image;
+	barrier.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.imageSubresource = VkImageSubresourceLayers{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = VkExtent3D{ m_width, m_height, 1 };
+	vkCmdCopyImageToBuffer(m_commandBuffer, m_color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+	// Back to the layout the next frame's scene pass starts from.
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+	ThrowIfFailed(vkEndCommandBuffer(m_commandBuffer), "vkEndCommandBuffer");
+
+	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_commandBuffer;
+	ThrowIfFailed(vkQueueSubmit(m_queue, 1, &submitInfo, m_fence), "vkQueueSubmit");
+	ThrowIfFailed(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+	ThrowIfFailed(vkResetFences(m_device, 1, &m_fence), "vkResetFences");
+
+	rgba.resize(static_cast<size_t>(size));
+	std::memcpy(rgba.data(), readback.mapped, rgba.size());
+	DestroyBuffer(readback);
+}
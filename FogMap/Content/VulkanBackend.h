@@ -0,0 +1,136 @@
+﻿#pragma once
+
+#include "RenderBackend.h"
+
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+namespace FogMap
+{
+	struct VulkanFrameTimings
+	{
+		double recordMs;		// command buffer recording, all passes
+		double submitMs;		// vkQueueSubmit
+		double waitMs;			// until the frame's fence signals
+		uint32_t drawCalls;
+		uint32_t descriptorBinds;
+	};
+
+	// Headless RenderBackend on the first Vulkan device (a CPU device such as Mesa lavapipe is
+	// preferred), drawing MainRenderer's passes with the .hlsl shaders compiled to SPIR-V:
+	// <shaderDirectory>/<Name>.spv for ShadowVertexShader, ShadowPixelShader, SceneVertexShader,
+	// ScenePixelShader, CellVertexShader and CellPixelShader. Vertex shaders must be compiled
+	// with -fvk-invert-y and pixel shaders with -fvk-b-shift 4 0 -fvk-t-shift 2 0
+	// -fvk-s-shift 3 0, as Tools/CompileVulkanShaders.sh does, so that the D3D register layout
+	// maps onto one descriptor set:
+	//   1 - DrawConstantBuffer, dynamic offset per pass (b1, vertex)
+	//   2 - shadow map (t0), 3 - clamp sampler (s0), 4 - LightBuffer (b0, pixel)
+	// Every frame is recorded into one command buffer and waited for, so Submit returns with
+	// the image complete. FogRayMarch passes are out of scope for this backend, which draws
+	// only the shadow, scene and fog cell passes; they throw std::runtime_error, as do Vulkan
+	// failures.
+	class VulkanBackend : public RenderBackend
+	{
+	public:
+		explicit VulkanBackend(const std::string& shaderDirectory);
+		~VulkanBackend();
+		VulkanBackend(const VulkanBackend&) = delete;
+		VulkanBackend& operator=(const VulkanBackend&) = delete;
+
+		void Resize(uint32_t width, uint32_t height);
+		void SetMesh(const MeshBuffers& buffers) override;
+		void SetFogCells(const std::vector<FogCellVertex>& vertices, const std::vector<uint16_t>& indices) override;
+		void Submit(const FrameDescription& frame) override;
+
+		const VulkanFrameTimings& GetTimings() const { return m_timings; }
+		const char* GetDeviceName() const { return m_deviceName; }
+		uint32_t GetWidth() const { return m_width; }
+		uint32_t GetHeight() const { return m_height; }
+		// Copies the last frame out as row-major RGBA8 with row 0 at the top.
+		void ReadColor(std::vector<uint8_t>& rgba);
+
+	private:
+		struct Buffer
+		{
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			void* mapped;
+			VkDeviceSize size;
+		};
+
+		struct Image
+		{
+			VkImage image;
+			VkDeviceMemory memory;
+			VkImageView view;
+		};
+
+		void CreateDevice();
+		void CreateRenderPasses();
+		void CreateDescriptors();
+		void CreatePipelines(const std::string& shaderDirectory);
+		void CreateShadowTarget();
+		void CreateSceneTarget();
+		void DestroySceneTarget();
+
+		uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+		Buffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const void* data);
+		void DestroyBuffer(Buffer& buffer);
+		Image CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+		void DestroyImage(Image& image);
+		VkShaderModule LoadShader(const std::string& path);
+		VkPipeline CreatePipeline(VkShaderModule vertexShader, VkShaderModule pixelShader, VkRenderPass renderPass,
+			const VkVertexInputBindingDescription* bindings, uint32_t bindingCount,
+			const VkVertexInputAttributeDescription* attributes, uint32_t attributeCount, bool blend);
+		void WriteDescriptors();
+		void RecordPass(const RenderPass& pass, const FrameDescription& frame, uint32_t passIndex);
+
+		VkInstance m_instance;
+		VkPhysicalDevice m_physicalDevice;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties;
+		VkDevice m_device;
+		uint32_t m_queueFamily;
+		VkQueue m_queue;
+		VkCommandPool m_commandPool;
+		VkCommandBuffer m_commandBuffer;
+		VkFence m_fence;
+		VkDeviceSize m_uniformAlignment;
+		char m_deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+
+		VkRenderPass m_shadowRenderPass;
+		VkRenderPass m_sceneRenderPass;		// clears colour and depth
+		VkRenderPass m_fogRenderPass;		// loads them; compatible with m_sceneRenderPass
+		VkDescriptorSetLayout m_descriptorSetLayout;
+		VkDescriptorPool m_descriptorPool;
+		VkDescriptorSet m_descriptorSet;
+		VkPipelineLayout m_pipelineLayout;
+		VkPipeline m_shadowPipeline;
+		VkPipeline m_scenePipeline;
+		VkPipeline m_fogPipeline;
+		VkSampler m_sampler;
+
+		Image m_shadowColor;
+		Image m_shadowDepth;
+		VkFramebuffer m_shadowFramebuffer;
+		Image m_color;
+		Image m_depth;
+		VkFramebuffer m_framebuffer;
+		uint32_t m_width;
+		uint32_t m_height;
+
+		Buffer m_drawBuffer;			// one DrawConstantBuffer slot per pass
+		uint32_t m_drawSlots;
+		Buffer m_lightBuffer;
+		Buffer m_positionBuffer;
+		Buffer m_attributeBuffer;
+		Buffer m_indexBuffer;
+		VkIndexType m_indexType;
+		Buffer m_cellVertexBuffer;
+		Buffer m_cellIndexBuffer;
+		Buffer m_frameCellVertexBuffer;	// FrameDescription's fog cells, grown as needed
+		Buffer m_frameCellIndexBuffer;
+
+		VulkanFrameTimings m_timings;
+	};
+}
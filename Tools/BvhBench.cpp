@@ -0,0 +1,181 @@
+﻿// Build time and ray throughput of the scene BVH (FogMap/Content/Bvh.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o BvhBench BvhBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,Bvh,JobSystem}.cpp
+//
+//   BvhBench [--threads N] [triangles... | model.obj]
+//
+// Without arguments it runs displaced terrain grids of 10k, 100k, 1M and 10M triangles.
+// Every mesh is hit by a 512x512 pinhole camera looking down at it, traced once as single
+// rays, once as 2x2 packets and once as occlusion rays.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/Bvh.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/ObjLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// Grid over [-1, 1]^2 in xz with a few octaves of sine displacement in y.
+	void MakeTerrain(size_t triangleCount, Mesh& mesh)
+	{
+		const uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(triangleCount / 2.0)));
+		mesh.positions.clear();
+		mesh.indices.clear();
+		mesh.positions.reserve(size_t(side + 1) * (side + 1));
+		mesh.indices.reserve(size_t(side) * side * 6);
+		for (uint32_t z = 0; z <= side; ++z)
+		{
+			for (uint32_t x = 0; x <= side; ++x)
+			{
+				float fx = 2.0f * x / side - 1.0f, fz = 2.0f * z / side - 1.0f;
+				float y = 0.1f * std::sin(fx * 7.0f) * std::cos(fz * 5.0f) + 0.03f * std::sin(fx * 31.0f + fz * 17.0f);
+				mesh.positions.push_back(Float3{ fx, y, fz });
+			}
+		}
+		for (uint32_t z = 0; z < side; ++z)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				uint32_t a = z * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+				uint32_t quad[] = { a, c, b, b, c, d };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	Ray CameraRay(const Float3& center, float extent, int x, int y, int resolution)
+	{
+		const Float3 eye{ center.x, center.y + 2.0f * extent, center.z + 2.0f * extent };
+		float sx = (x + 0.5f) / resolution * 2.0f - 1.0f, sy = (y + 0.5f) / resolution * 2.0f - 1.0f;
+		Float3 target{ center.x + sx * extent, center.y, center.z + sy * extent };
+		Float3 direction{ target.x - eye.x, target.y - eye.y, target.z - eye.z };
+		return Ray{ eye, direction, 0.0f, 1e30f };
+	}
+
+	void Run(const char* name, const Mesh& mesh, JobSystem& jobs)
+	{
+		Bvh bvh;
+		Clock::time_point start = Clock::now();
+		bvh.Build(mesh.positions.data(), mesh.indices.data(), mesh.indices.size(), jobs);
+		const double buildSeconds = SecondsSince(start);
+
+		Float3 boundsMin, boundsMax;
+		ComputeBounds(mesh.positions.data(), mesh.positions.size(), boundsMin, boundsMax);
+		const Float3 center{ (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+		const float extent = 0.5f * std::max({ boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z });
+
+		const int resolution = 512;
+		const double rayCount = double(resolution) * resolution;
+		size_t singleHits = 0, packetHits = 0, occluded = 0, mismatches = 0;
+		std::vector<RayHit> reference(size_t(resolution) * resolution);
+
+		start = Clock::now();
+		for (int y = 0; y < resolution; ++y)
+			for (int x = 0; x < resolution; ++x)
+				singleHits += bvh.Intersect(CameraRay(center, extent, x, y, resolution), reference[size_t(y) * resolution + x]);
+		const double singleSeconds = SecondsSince(start);
+
+		start = Clock::now();
+		for (int y = 0; y < resolution; y += 2)
+		{
+			for (int x = 0; x < resolution; x += 2)
+			{
+				RayPacket4 packet;
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					Ray ray = CameraRay(center, extent, x + (lane & 1), y + (lane >> 1), resolution);
+					packet.originX[lane] = ray.origin.x; packet.originY[lane] = ray.origin.y; packet.originZ[lane] = ray.origin.z;
+					packet.directionX[lane] = ray.direction.x; packet.directionY[lane] = ray.direction.y; packet.directionZ[lane] = ray.direction.z;
+					packet.tMin[lane] = ray.tMin;
+					packet.tMax[lane] = ray.tMax;
+				}
+				RayHit hits[4];
+				bvh.Intersect(packet, hits);
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					packetHits += hits[lane].triangle != BvhMiss;
+					const RayHit& expected = reference[size_t(y + (lane >> 1)) * resolution + x + (lane & 1)];
+					mismatches += hits[lane].triangle != expected.triangle && std::abs(hits[lane].t - expected.t) > 1e-5f * expected.t;
+				}
+			}
+		}
+		const double packetSeconds = SecondsSince(start);
+
+		start = Clock::now();
+		for (int y = 0; y < resolution; ++y)
+			for (int x = 0; x < resolution; ++x)
+				occluded += bvh.Occluded(CameraRay(center, extent, x, y, resolution));
+		const double occlusionSeconds = SecondsSince(start);
+
+		std::printf("%-12s %9zu tris %9zu nodes  build %8.1f ms  single %6.2f  packet %6.2f  occlusion %6.2f Mrays/s  (%zu/%zu/%zu hits, %zu packet mismatches)\n",
+			name, bvh.TriangleCount(), bvh.Nodes().size(), buildSeconds * 1e3,
+			rayCount / singleSeconds * 1e-6, rayCount / packetSeconds * 1e-6, rayCount / occlusionSeconds * 1e-6,
+			singleHits, packetHits, occluded, mismatches);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	int arg = 1;
+	if (arg + 1 < argc && std::strcmp(argv[arg], "--threads") == 0)
+	{
+		threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		arg += 2;
+	}
+	std::printf("%u build threads\n", threadCount);
+	JobSystem jobs(threadCount);
+
+	if (arg == argc)
+	{
+		for (size_t triangles : { 10000, 100000, 1000000, 10000000 })
+		{
+			Mesh mesh;
+			MakeTerrain(triangles, mesh);
+			Run("terrain", mesh, jobs);
+		}
+		return 0;
+	}
+
+	for (; arg < argc; ++arg)
+	{
+		Mesh mesh;
+		char* end;
+		unsigned long long triangles = std::strtoull(argv[arg], &end, 10);
+		if (*end == '\0')
+		{
+			MakeTerrain(static_cast<size_t>(triangles), mesh);
+			Run("terrain", mesh, jobs);
+			continue;
+		}
+
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])) || !LoadObjMesh(file.GetData(), file.GetSize(), mesh, jobs))
+		{
+			std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+			return 1;
+		}
+		Run(argv[arg], mesh, jobs);
+	}
+	return 0;
+}
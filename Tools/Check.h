@@ -0,0 +1,13 @@
+﻿#pragma once
+
+#include <cstdio>
+
+namespace Tools
+{
+	// Prints one line of a bench's pass/fail summary and returns condition.
+	inline bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+}
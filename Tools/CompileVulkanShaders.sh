@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compiles the shaders VulkanBackend loads (FogMap/Content/VulkanBackend.h) from HLSL to SPIR-V
+# with dxc, into DIR (../FogMap/Content/spv by default, where VulkanRender looks for them).
+# Every shader is rebuilt on every run and its old .spv deleted first, so a failed compile
+# leaves no stale SPIR-V behind; the script exits non-zero on the first failure.
+#
+#   ./CompileVulkanShaders.sh [DIR]
+#
+# VulkanRender's build line (Tools/VulkanRender.cpp) runs it before compiling the tool.
+# FogRayMarch and the packed-vertex shaders are not compiled: the Vulkan backend has no
+# pipelines for them.
+
+set -e
+content="$(dirname "$0")/../FogMap/Content"
+output="${1:-$content/spv}"
+if ! command -v dxc >/dev/null 2>&1; then
+	echo "dxc not found: install the DirectX Shader Compiler or the Vulkan SDK" >&2
+	exit 1
+fi
+mkdir -p "$output"
+for s in Shadow Scene Cell; do
+	rm -f "$output/${s}VertexShader.spv" "$output/${s}PixelShader.spv"
+	dxc -spirv -T vs_5_0 -E main -fvk-invert-y -Fo "$output/${s}VertexShader.spv" "$content/${s}VertexShader.hlsl"
+	dxc -spirv -T ps_5_0 -E main -fvk-b-shift 4 0 -fvk-t-shift 2 0 -fvk-s-shift 3 0 \
+		-Fo "$output/${s}PixelShader.spv" "$content/${s}PixelShader.hlsl"
+done
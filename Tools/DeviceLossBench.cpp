@@ -0,0 +1,224 @@
+﻿// Device-loss recovery on the software backend: the startup assets stay mapped in an
+// AssetCache (FogMap/Content/AssetCache.h) and the parsed mesh in RendererCore, as in
+// MainRenderer, so a restored device only gets its objects back.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o DeviceLossBench DeviceLossBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{AssetPack,AssetCache,MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore,SoftwareRenderer,EpipolarSampler,FroxelGrid}.cpp
+//
+//   DeviceLossBench [--threads N] [--size WxH] [--cycles N] model.obj
+//
+// Loads the model (through the .fmesh next to it when that matches) and renders a frame, then
+// loses and restores the device N times: the SoftwareRenderer that stands in for the device is
+// destroyed and a new one is handed the retained mesh by RendererCore::Upload. Checks that
+//   - restores map no further files,
+//   - live heap memory after every restore equals that after the first,
+//   - every restored device renders the same image as the original one,
+//   - a restore takes less than a 60 Hz frame,
+// and exits with 1 if any check fails. For comparison it also times the reload from the
+// mapped files that every restore used to do.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/AssetCache.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/RendererCore.h"
+#include "../FogMap/Content/SoftwareRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+// Live heap bytes, counted through a size header in front of every allocation.
+static std::atomic<size_t> g_liveBytes(0);
+
+namespace
+{
+	constexpr size_t HeaderSize = 16;
+
+	void* Allocate(size_t size)
+	{
+		uint8_t* block = static_cast<uint8_t*>(std::malloc(size + HeaderSize));
+		if (block == nullptr)
+			return nullptr;
+		std::memcpy(block, &size, sizeof(size));
+		g_liveBytes.fetch_add(size, std::memory_order_relaxed);
+		return block + HeaderSize;
+	}
+
+	void Free(void* pointer)
+	{
+		if (pointer == nullptr)
+			return;
+		uint8_t* block = static_cast<uint8_t*>(pointer) - HeaderSize;
+		size_t size;
+		std::memcpy(&size, block, sizeof(size));
+		g_liveBytes.fetch_sub(size, std::memory_order_relaxed);
+		std::free(block);
+	}
+}
+
+void* operator new(size_t size)
+{
+	if (void* pointer = Allocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void operator delete(void* pointer) noexcept { Free(pointer); }
+void operator delete[](void* pointer) noexcept { Free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr double FrameBudgetMs = 1000.0 / 60.0;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	bool LoadMesh(AssetCache& assets, const std::string& sourceName, const std::string& cacheName, RendererCore& core, JobSystem& jobs)
+	{
+		AssetView source{ nullptr, 0 }, cache{ nullptr, 0 };
+		if (!assets.Find(sourceName.c_str(), source))
+			return false;
+		assets.Find(cacheName.c_str(), cache);
+		if (!core.LoadMesh(source.data, source.size, cache.data, cache.size, jobs))
+			return false;
+		core.BuildBvh(jobs);
+		return true;
+	}
+
+	// Creates the stand-in device and uploads the retained scene, as MainRenderer's final load
+	// job does.
+	std::unique_ptr<SoftwareRenderer> CreateDevice(RendererCore& core, unsigned threadCount, unsigned width, unsigned height)
+	{
+		std::unique_ptr<SoftwareRenderer> device(new SoftwareRenderer(threadCount));
+		device->Resize(width, height);
+		core.Upload(*device);
+		return device;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	unsigned width = 1280, height = 720;
+	int cycles = 20;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--threads") == 0)
+			threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--size") == 0)
+		{
+			if (std::sscanf(argv[arg + 1], "%ux%u", &width, &height) != 2 || width == 0 || height == 0)
+				break;
+		}
+		else if (std::strcmp(argv[arg], "--cycles") == 0)
+			cycles = std::max(1, std::atoi(argv[arg + 1]));
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--threads N] [--size WxH] [--cycles N] model.obj\n", argv[0]);
+		return 1;
+	}
+
+	// Names resolve next to the model, as the app resolves them inside its package.
+	const std::string path = argv[arg];
+	const size_t slash = path.find_last_of("/\\");
+	const std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	const std::string sourceName = path.substr(directory.size());
+	const std::string cacheName = sourceName.substr(0, sourceName.find_last_of('.')) + ".fmesh";
+	AssetCache assets([&directory](const char* name, DX::MappedFile& file) { return file.Open(directory + name); });
+
+	// Outlives the device, like MainRenderer's.
+	JobSystem jobs(threadCount);
+	Clock::time_point start = Clock::now();
+	RendererCore core;
+	if (!LoadMesh(assets, sourceName, cacheName, core, jobs))
+	{
+		std::fprintf(stderr, "cannot load %s\n", path.c_str());
+		return 1;
+	}
+	core.Resize(float(width) / height, float(height), MatrixIdentity());
+	std::unique_ptr<SoftwareRenderer> device = CreateDevice(core, threadCount, width, height);
+	const double coldMs = MillisecondsSince(start);
+	device->Submit(core.BuildFrame());
+	const std::vector<uint8_t> reference = device->GetColor();
+	const size_t mappedFiles = assets.GetMappedFileCount();
+
+	double worstRestoreMs = 0.0, totalRestoreMs = 0.0;
+	size_t firstLiveBytes = 0, minLiveBytes = SIZE_MAX, maxLiveBytes = 0;
+	bool sameImage = true, sameFiles = true;
+	for (int cycle = 0; cycle < cycles; ++cycle)
+	{
+		// Lost: every device object goes, the caches stay.
+		device.reset();
+
+		start = Clock::now();
+		device = CreateDevice(core, threadCount, width, height);
+		const double restoreMs = MillisecondsSince(start);
+		worstRestoreMs = std::max(worstRestoreMs, restoreMs);
+		totalRestoreMs += restoreMs;
+
+		const size_t liveBytes = g_liveBytes.load();
+		if (cycle == 0)
+			firstLiveBytes = liveBytes;
+		minLiveBytes = std::min(minLiveBytes, liveBytes);
+		maxLiveBytes = std::max(maxLiveBytes, liveBytes);
+		sameFiles &= assets.GetMappedFileCount() == mappedFiles;
+
+		device->Submit(core.BuildFrame());
+		sameImage &= device->GetColor() == reference;
+	}
+
+	// What every restore did before: map the files again and redo the whole load.
+	double reloadMs = 1e30;
+	for (int run = 0; run < 3; ++run)
+	{
+		start = Clock::now();
+		AssetCache reloaded([&directory](const char* name, DX::MappedFile& file) { return file.Open(directory + name); });
+		RendererCore reloadedCore;
+		LoadMesh(reloaded, sourceName, cacheName, reloadedCore, jobs);
+		std::unique_ptr<SoftwareRenderer> reloadedDevice = CreateDevice(reloadedCore, threadCount, width, height);
+		reloadMs = std::min(reloadMs, MillisecondsSince(start));
+	}
+
+	std::printf("%ux%u, %u threads, %u vertices, %zu files mapped (%.1f MB)\n", width, height, threadCount,
+		core.GetMeshBuffers().vertexCount, mappedFiles, assets.GetMappedSize() / 1e6);
+	std::printf("cold load %.2f ms, full reload %.2f ms\n", coldMs, reloadMs);
+	std::printf("%d restores: mean %.3f ms, worst %.3f ms; live heap %zu..%zu bytes\n\n", cycles,
+		totalRestoreMs / cycles, worstRestoreMs, minLiveBytes, maxLiveBytes);
+
+	bool passed = true;
+	passed &= Check(sameFiles, "restores map no further files");
+	passed &= Check(minLiveBytes == firstLiveBytes && maxLiveBytes == firstLiveBytes, "live heap is constant across restores");
+	passed &= Check(sameImage, "restored devices render the original image");
+	passed &= Check(worstRestoreMs < FrameBudgetMs, "every restore fits in a 60 Hz frame");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
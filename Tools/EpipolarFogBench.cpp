@@ -0,0 +1,156 @@
+﻿// Sample count and time of epipolar sampling of the ray-marched fog (FogSlicing::Epipolar)
+// against marching every pixel (FogSlicing::RayMarch), on the CPU reference path
+// (FogMap/Content/SoftwareRenderer.h, FogMap/Content/EpipolarSampler.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o EpipolarFogBench EpipolarFogBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore,SoftwareRenderer,EpipolarSampler,FroxelGrid}.cpp
+//
+//   EpipolarFogBench [--threads N] [--frames N] [--out diff.ppm] model.obj
+//
+// Renders the frame for two positions of the moving light at 640x360, 1280x720 and 1920x1080,
+// marching every pixel and with the default epipolar settings, and prints for each the fog
+// pass time, the rays marched (for the epipolar pass split into coarse rays, rays refined at
+// depth edges and shadow boundaries, and pixels that fell back to their own ray), the rays and
+// fog samples per pixel, how many times fewer of both the epipolar pass takes, and the
+// per-channel difference between the two images: mean, the largest, and the share of pixels
+// off by more than two 8-bit steps. Checks that from 1280x720 up the epipolar pass marches at
+// least ten times fewer rays and samples in less time, and that its images stay within a
+// quarter step on average, and within two steps for 99% of pixels, of marching every pixel.
+// --out writes the absolute difference at 1280x720 for the first light, scaled by 16, as a
+// binary PPM. Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/RendererCore.h"
+#include "../FogMap/Content/SoftwareRenderer.h"
+#include "Check.h"
+#include "ImageDiff.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+using namespace Tools;
+
+namespace
+{
+	struct Render
+	{
+		double fogMs;
+		SoftwareFrameCounters counters;
+		EpipolarCounters epipolar;
+		std::vector<uint8_t> color;
+	};
+
+	// Best fog time over frames renders of the current frame.
+	Render RenderFog(RendererCore& core, SoftwareRenderer& renderer, FogSlicing slicing, int frames)
+	{
+		FogSettings fog;
+		fog.slicing = slicing;
+		core.SetFogSettings(fog);
+		core.UploadFogCells(renderer);
+		Render render{ 1e30, {}, {}, {} };
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			renderer.Submit(core.BuildFrame());
+			render.fogMs = std::min(render.fogMs, renderer.GetTimings().fogMs);
+		}
+		render.counters = renderer.GetCounters();
+		render.epipolar = renderer.GetEpipolarCounters();
+		render.color = renderer.GetColor();
+		return render;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	int frames = 3;
+	std::string outputPath;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--threads") == 0)
+			threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--frames") == 0)
+			frames = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--out") == 0)
+			outputPath = argv[arg + 1];
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--threads N] [--frames N] [--out diff.ppm] model.obj\n", argv[0]);
+		return 1;
+	}
+
+	DX::MappedFile source;
+	RendererCore core;
+	JobSystem jobs(threadCount);
+	if (!source.Open(std::string(argv[arg])) || !core.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs))
+	{
+		std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+		return 1;
+	}
+	SoftwareRenderer renderer(threadCount);
+	core.Upload(renderer);
+
+	const FogEpipolarSettings epipolar;
+	std::printf("%u threads, best of %d frames, %u lines of %u samples, marched every %u\n", threadCount, frames,
+		epipolar.lineCount, epipolar.lineSamples, epipolar.marchStep);
+	std::printf("size       light  pixel ms  epipolar ms  pixel rays  coarse  refined  fallback  rays/px  samples/px"
+		"  fewer rays  fewer samples  mean diff  max diff  >2 steps\n");
+	bool passed = true, fewerRays = true, fewerSamples = true, faster = true, close = true;
+	const unsigned sizes[][2]{ { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+	for (int light = 0; light < 2; ++light)
+	{
+		// Update moves the light along z; the second position is two seconds on.
+		if (light == 1)
+			core.Update(2.0);
+		for (const auto& size : sizes)
+		{
+			const unsigned width = size[0], height = size[1];
+			core.Resize(float(width) / height, float(height), MatrixIdentity());
+			renderer.Resize(width, height);
+			const Render marched = RenderFog(core, renderer, FogSlicing::RayMarch, frames);
+			const Render sampled = RenderFog(core, renderer, FogSlicing::Epipolar, frames);
+			const Difference difference = Compare(marched.color, sampled.color);
+			const double pixels = double(width) * height;
+			const double rayRatio = double(marched.counters.fogRays) / std::max<uint64_t>(sampled.counters.fogRays, 1);
+			const double sampleRatio = double(marched.counters.fogFragments) / std::max<uint64_t>(sampled.counters.fogFragments, 1);
+			std::printf("%4ux%-4u  %6d  %8.2f  %11.2f  %10llu  %6llu  %7llu  %8llu  %7.3f  %10.3f  %9.1fx  %12.1fx  %9.3f  %8d  %7.3f%%\n",
+				width, height, light, marched.fogMs, sampled.fogMs, static_cast<unsigned long long>(marched.counters.fogRays),
+				static_cast<unsigned long long>(sampled.epipolar.coarseRays), static_cast<unsigned long long>(sampled.epipolar.refinedRays),
+				static_cast<unsigned long long>(sampled.epipolar.fallbackRays), sampled.counters.fogRays / pixels,
+				sampled.counters.fogFragments / pixels, rayRatio, sampleRatio, difference.mean, difference.largest, 100.0 * difference.outliers);
+
+			if (height >= 720)
+			{
+				fewerRays &= rayRatio >= 10.0;
+				fewerSamples &= sampleRatio >= 10.0;
+				faster &= sampled.fogMs < marched.fogMs;
+			}
+			close &= difference.mean <= 0.25 && difference.outliers <= 0.01;
+			if (width == 1280 && light == 0 && !outputPath.empty() && !WriteDifference(outputPath, marched.color, sampled.color, width, height))
+			{
+				std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+				return 1;
+			}
+		}
+	}
+	std::printf("\n");
+	passed &= Check(fewerRays, "ten times fewer rays from 1280x720 up");
+	passed &= Check(fewerSamples, "ten times fewer samples from 1280x720 up");
+	passed &= Check(faster, "faster fog pass from 1280x720 up");
+	passed &= Check(close, "epipolar images match marching every pixel");
+
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+﻿// Cold and warm startup cost of getting the scene mesh ready to upload, from the OBJ or from
+// a current .fmesh cache (FogMap/Content/MeshCache.h). Linux only: cold runs evict the files
+// from the page cache with posix_fadvise.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o FMeshBench FMeshBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore}.cpp
+//
+//   FMeshBench [--runs N] [--threads N] [--cache bench.fmesh] model.obj
+//
+// Converts the model as FMeshConvert does (optimized, with LODs, split into meshlets) and
+// then loads it, and reads every byte of the buffers handed to the backend, in three ways:
+//   parse   map the OBJ and LoadObjMesh only, the floor of any OBJ path
+//   obj     map the OBJ and RendererCore::LoadMesh without a cache: parse, optimize, LODs, pack
+//   fmesh   map the OBJ and the cache and RendererCore::LoadMesh, which hashes the OBJ to
+//           check the cache is current and points the buffers into it
+// Each is timed warm (files cached) and cold (evicted before every run), best of N runs (5 by
+// default). Checks that the cache is current, that both loads hand over identical buffers and
+// that the cache is the faster cold start. Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/MeshCache.h"
+#include "../FogMap/Content/MeshOptimizer.h"
+#include "../FogMap/Content/MeshSimplifier.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "../FogMap/Content/RendererCore.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	bool Evict(const std::string& path)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		fdatasync(fd);
+		const bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		close(fd);
+		return evicted;
+	}
+
+	// Stands in for the upload: touches every byte of an array.
+	uint64_t Consume(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t sum = 0;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			sum += word;
+		}
+		for (; i < size; ++i)
+			sum += bytes[i];
+		return sum;
+	}
+
+	size_t IndexBytes(const MeshBuffers& buffers)
+	{
+		return size_t(buffers.indexCount) * (buffers.indexFormat == IndexFormat::UInt16 ? 2 : 4);
+	}
+
+	uint64_t Consume(const MeshBuffers& buffers)
+	{
+		return Consume(buffers.positions, buffers.vertexCount * sizeof(Float3)) +
+			Consume(buffers.attributes, buffers.vertexCount * sizeof(MeshAttributes)) +
+			Consume(buffers.indices, IndexBytes(buffers)) +
+			Consume(buffers.meshlets, buffers.meshletCount * sizeof(Meshlet)) +
+			Consume(buffers.lods, buffers.lodCount * sizeof(MeshletLod));
+	}
+
+	bool SameBuffers(const MeshBuffers& a, const MeshBuffers& b)
+	{
+		return a.vertexCount == b.vertexCount && a.indexCount == b.indexCount && a.indexFormat == b.indexFormat &&
+			a.meshletCount == b.meshletCount && a.lodCount == b.lodCount &&
+			std::memcmp(a.positions, b.positions, a.vertexCount * sizeof(Float3)) == 0 &&
+			std::memcmp(a.attributes, b.attributes, a.vertexCount * sizeof(MeshAttributes)) == 0 &&
+			std::memcmp(a.indices, b.indices, IndexBytes(a)) == 0 &&
+			std::memcmp(a.meshlets, b.meshlets, a.meshletCount * sizeof(Meshlet)) == 0 &&
+			std::memcmp(a.lods, b.lods, a.lodCount * sizeof(MeshletLod)) == 0 &&
+			std::memcmp(&a.boundsMin, &b.boundsMin, sizeof(Float3)) == 0 && std::memcmp(&a.boundsMax, &b.boundsMax, sizeof(Float3)) == 0;
+	}
+
+	// The cache FMeshConvert writes with its default options.
+	bool WriteCache(const DX::MappedFile& source, const std::string& path, JobSystem& jobs)
+	{
+		Mesh mesh;
+		if (!LoadObjMesh(source.GetData(), source.GetSize(), mesh, jobs))
+			return false;
+		OptimizeMesh(mesh);
+		BuildLodChain(mesh, LodSettings());
+		MeshletMesh storage;
+		std::vector<uint8_t> image;
+		WriteMeshCache(PackMesh(mesh, true, storage), HashMeshSource(source.GetData(), source.GetSize()), source.GetSize(), image);
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+		return std::fclose(file) == 0 && written;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::string cachePath = "bench.fmesh";
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--runs") == 0)
+			runs = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--threads") == 0)
+			threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--cache") == 0)
+			cachePath = argv[arg + 1];
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--runs N] [--threads N] [--cache bench.fmesh] model.obj\n", argv[0]);
+		return 1;
+	}
+	const std::string sourcePath = argv[arg];
+	JobSystem jobs(threadCount);
+
+	size_t sourceSize = 0, cacheSize = 0;
+	bool current = false;
+	{
+		DX::MappedFile source, cache;
+		if (!source.Open(sourcePath) || !WriteCache(source, cachePath, jobs))
+		{
+			std::fprintf(stderr, "cannot convert %s into %s\n", sourcePath.c_str(), cachePath.c_str());
+			return 1;
+		}
+		MeshBuffers buffers;
+		current = cache.Open(cachePath) &&
+			ReadMeshCache(cache.GetData(), cache.GetSize(), HashMeshSource(source.GetData(), source.GetSize()), source.GetSize(), buffers);
+		sourceSize = source.GetSize();
+		cacheSize = cache.GetSize();
+	}
+	std::printf("%s %.1f MB, %s %.1f MB, %u threads\n", sourcePath.c_str(), sourceSize / 1e6, cachePath.c_str(), cacheSize / 1e6, threadCount);
+
+	// Each loader returns the sum of Consume over the buffers it produced, or 0 if it failed.
+	const std::pair<const char*, std::function<uint64_t()>> loaders[] = {
+		{ "parse", [&]() {
+			DX::MappedFile source;
+			Mesh mesh;
+			if (!source.Open(sourcePath) || !LoadObjMesh(source.GetData(), source.GetSize(), mesh, jobs))
+				return uint64_t(0);
+			return Consume(mesh.positions.data(), mesh.positions.size() * sizeof(Float3)) +
+				Consume(mesh.attributes.data(), mesh.attributes.size() * sizeof(MeshAttributes)) +
+				Consume(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		} },
+		{ "obj", [&]() {
+			DX::MappedFile source;
+			RendererCore core;
+			if (!source.Open(sourcePath) || !core.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs))
+				return uint64_t(0);
+			return Consume(core.GetMeshBuffers());
+		} },
+		{ "fmesh", [&]() {
+			DX::MappedFile source, cache;
+			RendererCore core;
+			if (!source.Open(sourcePath) || !cache.Open(cachePath) ||
+				!core.LoadMesh(source.GetData(), source.GetSize(), cache.GetData(), cache.GetSize(), jobs))
+				return uint64_t(0);
+			return Consume(core.GetMeshBuffers());
+		} },
+	};
+
+	bool loaded = true, evicted = true;
+	double cold[3] = { 0.0, 0.0, 0.0 };
+	std::printf("loader   warm ms   cold ms\n");
+	for (size_t l = 0; l < 3; ++l)
+	{
+		double best[2] = { 1e30, 1e30 };
+		for (int c = 0; c < 2; ++c)
+		{
+			for (int run = 0; run < runs; ++run)
+			{
+				if (c)
+				{
+					evicted &= Evict(sourcePath);
+					evicted &= Evict(cachePath);
+				}
+				const Clock::time_point start = Clock::now();
+				const uint64_t sum = loaders[l].second();
+				best[c] = std::min(best[c], std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+				loaded &= sum != 0;
+			}
+		}
+		cold[l] = best[1];
+		std::printf("%-6s %9.2f %9.2f\n", loaders[l].first, best[0], best[1]);
+	}
+	if (!evicted)
+		std::printf("note: some files could not be evicted; cold numbers may be warm\n");
+
+	bool same = false;
+	{
+		DX::MappedFile source, cache;
+		RendererCore fromObj, fromCache;
+		same = source.Open(sourcePath) && cache.Open(cachePath) &&
+			fromObj.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs) &&
+			fromCache.LoadMesh(source.GetData(), source.GetSize(), cache.GetData(), cache.GetSize(), jobs) &&
+			SameBuffers(fromObj.GetMeshBuffers(), fromCache.GetMeshBuffers());
+	}
+
+	std::printf("\n");
+	bool passed = Check(current, "cache is current for the model");
+	passed &= Check(loaded, "every load succeeded");
+	passed &= Check(same, "OBJ and cache hand over identical buffers");
+	passed &= Check(cold[2] < cold[1], "cache is the faster cold start");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
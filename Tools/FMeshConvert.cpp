@@ -0,0 +1,177 @@
+﻿// Offline converter from model.obj to the .fmesh cache loaded by MainRenderer.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o FMeshConvert FMeshConvert.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,DepthRasterizer,JobSystem}.cpp
+//
+//   FMeshConvert [--no-meshlets] [--no-optimize] [--no-lods] [--check-shadow] model.obj model.fmesh
+//
+// --check-shadow renders the initial shadow map of every LOD on the CPU twice, once from
+// the written cache and once from an interleaved position/colour/normal copy of the source
+// mesh, and fails unless both are identical.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/DepthRasterizer.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/MeshCache.h"
+#include "../FogMap/Content/MeshOptimizer.h"
+#include "../FogMap/Content/MeshSimplifier.h"
+#include "../FogMap/Content/ObjLoader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	// model * lightView * lightProjection as MainRenderer sets them up for the first frame.
+	Float4x4 InitialLightTransform()
+	{
+		const float length = std::sqrt(3.0f + 1.0f);
+		const Float3 direction{ -std::sqrt(3.0f) / length, -1.0f / length, 0.0f };
+		const Float4x4 model = MatrixRotationY(-3.14159265f / 2);
+		const Float4x4 view = MatrixLookAtRH(Float3{ -12.0f * direction.x, -12.0f * direction.y, -12.0f * direction.z },
+			Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 0.1f, 0.0f });
+		const Float4x4 projection = MatrixOrthographicRH(12.0f, 12.0f, 0.0f, 24.0f);
+		return MatrixMultiply(MatrixMultiply(model, view), projection);
+	}
+
+	bool CheckShadow(const Mesh& mesh, const std::vector<uint8_t>& image, uint64_t sourceHash, uint64_t sourceSize)
+	{
+		MeshBuffers cached;
+		if (!ReadMeshCache(image.data(), image.size(), sourceHash, sourceSize, cached))
+		{
+			std::fprintf(stderr, "written cache does not read back\n");
+			return false;
+		}
+
+		// The layout the shadow pass bound before positions got a stream of their own.
+		struct InterleavedVertex
+		{
+			Float3 pos;
+			MeshAttributes attributes;
+		};
+		std::vector<InterleavedVertex> interleaved(mesh.positions.size());
+		for (size_t v = 0; v < interleaved.size(); ++v)
+			interleaved[v] = InterleavedVertex{ mesh.positions[v], mesh.attributes[v] };
+
+		const Float4x4 transform = InitialLightTransform();
+		const uint32_t lodCount = static_cast<uint32_t>(mesh.lods.empty() ? 1 : mesh.lods.size());
+		bool identical = cached.lodCount == lodCount;
+		for (uint32_t lod = 0; lod < lodCount && identical; ++lod)
+		{
+			const MeshLod level = mesh.lods.empty() ? MeshLod{ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f } : mesh.lods[lod];
+			DepthTarget reference, split;
+			ResizeDepthTarget(reference, 1024, 1024);
+			ResizeDepthTarget(split, 1024, 1024);
+			RasterizeDepth(interleaved.data(), sizeof(InterleavedVertex), mesh.indices.data(), IndexFormat::UInt32,
+				level.startIndex, level.indexCount, 0, transform, reference);
+			RasterizeDepth(cached, lod, transform, split);
+
+			size_t covered = 0;
+			for (float depth : reference.depth)
+				covered += depth < 1.0f;
+			DepthComparison comparison = CompareDepth(reference, split);
+			std::printf("shadow LOD %u: %zu covered texels, %zu differ (max %g)\n", lod, covered,
+				comparison.differingPixels, comparison.maxDifference);
+			identical = comparison.differingPixels == 0;
+		}
+		return identical;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool splitMeshlets = true;
+	bool optimize = true;
+	bool generateLods = true;
+	bool checkShadow = false;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; ++arg)
+	{
+		if (std::strcmp(argv[arg], "--no-meshlets") == 0)
+			splitMeshlets = false;
+		else if (std::strcmp(argv[arg], "--no-optimize") == 0)
+			optimize = false;
+		else if (std::strcmp(argv[arg], "--no-lods") == 0)
+			generateLods = false;
+		else if (std::strcmp(argv[arg], "--check-shadow") == 0)
+			checkShadow = true;
+		else
+			break;
+	}
+	if (argc - arg != 2)
+	{
+		std::fprintf(stderr, "usage: %s [--no-meshlets] [--no-optimize] [--no-lods] [--check-shadow] input.obj output.fmesh\n", argv[0]);
+		return 1;
+	}
+	const std::string inputPath = argv[arg];
+	const std::string outputPath = argv[arg + 1];
+
+	DX::MappedFile source;
+	if (!source.Open(inputPath))
+	{
+		std::fprintf(stderr, "cannot open %s\n", inputPath.c_str());
+		return 1;
+	}
+
+	Mesh mesh;
+	JobSystem jobs(std::thread::hardware_concurrency());
+	if (!LoadObjMesh(source.GetData(), source.GetSize(), mesh, jobs))
+	{
+		std::fprintf(stderr, "malformed OBJ: %s\n", inputPath.c_str());
+		return 1;
+	}
+
+	if (optimize)
+	{
+		MeshOptimizationReport report = OptimizeMesh(mesh);
+		std::printf("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+			report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+	}
+
+	if (generateLods)
+	{
+		BuildLodChain(mesh, LodSettings());
+		for (size_t i = 0; i < mesh.lods.size(); ++i)
+			std::printf("LOD %zu: %u triangles, error %g\n", i, mesh.lods[i].indexCount / 3, mesh.lods[i].error);
+	}
+
+	MeshletMesh storage;
+	MeshBuffers buffers = PackMesh(mesh, splitMeshlets, storage);
+	std::vector<uint8_t> image;
+	const uint64_t sourceHash = HashMeshSource(source.GetData(), source.GetSize());
+	WriteMeshCache(buffers, sourceHash, source.GetSize(), image);
+	if (checkShadow && !CheckShadow(mesh, image, sourceHash, source.GetSize()))
+	{
+		std::fprintf(stderr, "shadow map differs between the source mesh and %s\n", outputPath.c_str());
+		return 1;
+	}
+
+	// Write to a temporary file first so a failed run never leaves a truncated cache behind.
+	const std::string temporaryPath = outputPath + ".tmp";
+	FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::fprintf(stderr, "cannot create %s\n", temporaryPath.c_str());
+		return 1;
+	}
+	bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+	written = std::fclose(file) == 0 && written;
+	std::remove(outputPath.c_str());
+	if (!written || std::rename(temporaryPath.c_str(), outputPath.c_str()) != 0)
+	{
+		std::remove(temporaryPath.c_str());
+		std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+		return 1;
+	}
+
+	std::printf("%s: %u vertices, %u indices (%s), %u meshlets, %u LODs, %zu bytes\n", outputPath.c_str(),
+		buffers.vertexCount, buffers.indexCount, buffers.indexFormat == IndexFormat::UInt16 ? "16-bit" : "32-bit",
+		buffers.meshletCount, buffers.lodCount, image.size());
+	return 0;
+}
@@ -0,0 +1,211 @@
+﻿// Cold and warm startup cost of loading the app's assets loose or from one .fpak pack
+// (FogMap/Content/AssetPack.h). Linux only: cold runs evict the files from the page cache
+// with posix_fadvise.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -o FPakBench FPakBench.cpp ../FogMap/Common/MappedFile.cpp ../FogMap/Content/AssetPack.cpp
+//
+//   FPakBench [--runs N] [--pack bench.fpak] file...
+//
+// Packs the files (the compiled shaders and model.obj, say) and then loads all of them, and
+// reads every byte, in three ways:
+//   read    open, read into a fresh std::vector and close each file, as DX::ReadDataAsync did
+//   map     map each file on its own with DX::MappedFile
+//   pack    map the pack once and look every asset up in its table of contents
+// Each is timed warm (files cached) and cold (evicted before every run), best of N runs.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/AssetPack.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::string BaseName(const std::string& path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	// Stands in for the consumer (CreateVertexShader, the OBJ parser): touches every byte.
+	uint64_t Consume(const uint8_t* data, size_t size)
+	{
+		uint64_t sum = 0;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, sizeof(word));
+			sum += word;
+		}
+		for (; i < size; ++i)
+			sum += data[i];
+		return sum;
+	}
+
+	bool Evict(const std::string& path)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		fdatasync(fd);
+		const bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		close(fd);
+		return evicted;
+	}
+
+	bool ReadFile(const std::string& path, std::vector<uint8_t>& data)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		const off_t size = lseek(fd, 0, SEEK_END);
+		lseek(fd, 0, SEEK_SET);
+		data.resize(static_cast<size_t>(std::max<off_t>(size, 0)));
+		size_t done = 0;
+		while (done < data.size())
+		{
+			const ssize_t n = read(fd, data.data() + done, data.size() - done);
+			if (n <= 0)
+				break;
+			done += static_cast<size_t>(n);
+		}
+		close(fd);
+		return done == data.size();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	std::string packPath = "bench.fpak";
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+			packPath = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		std::fprintf(stderr, "usage: %s [--runs N] [--pack bench.fpak] file...\n", argv[0]);
+		return 1;
+	}
+
+	size_t totalBytes = 0;
+	{
+		std::vector<std::unique_ptr<DX::MappedFile>> sources;
+		std::vector<AssetPackInput> assets;
+		for (const std::string& path : files)
+		{
+			sources.emplace_back(new DX::MappedFile);
+			if (!sources.back()->Open(path))
+			{
+				std::fprintf(stderr, "cannot read %s\n", path.c_str());
+				return 1;
+			}
+			assets.push_back(AssetPackInput{ BaseName(path), sources.back()->GetData(), sources.back()->GetSize() });
+			totalBytes += sources.back()->GetSize();
+		}
+		std::vector<uint8_t> image;
+		FILE* out = std::fopen(packPath.c_str(), "wb");
+		if (!WriteAssetPack(assets, image) || !out || std::fwrite(image.data(), 1, image.size(), out) != image.size() || std::fclose(out) != 0)
+		{
+			std::fprintf(stderr, "cannot write %s\n", packPath.c_str());
+			return 1;
+		}
+	}
+	std::printf("%zu files, %.1f MB\n", files.size(), totalBytes / 1e6);
+
+	uint64_t expected = 0;
+	for (const std::string& path : files)
+	{
+		std::vector<uint8_t> data;
+		ReadFile(path, data);
+		expected += Consume(data.data(), data.size());
+	}
+
+	// Each loader returns the sum of Consume over all assets.
+	const std::pair<const char*, std::function<uint64_t()>> loaders[] = {
+		{ "read", [&]() {
+			uint64_t sum = 0;
+			for (const std::string& path : files)
+			{
+				std::vector<uint8_t> data;
+				if (ReadFile(path, data))
+					sum += Consume(data.data(), data.size());
+			}
+			return sum;
+		} },
+		{ "map", [&]() {
+			uint64_t sum = 0;
+			for (const std::string& path : files)
+			{
+				DX::MappedFile file;
+				if (file.Open(path))
+					sum += Consume(file.GetData(), file.GetSize());
+			}
+			return sum;
+		} },
+		{ "pack", [&]() {
+			uint64_t sum = 0;
+			DX::MappedFile file;
+			AssetPack pack;
+			if (file.Open(packPath) && pack.Open(file.GetData(), file.GetSize()))
+			{
+				for (const std::string& path : files)
+				{
+					AssetView asset;
+					if (pack.Find(BaseName(path).c_str(), asset))
+						sum += Consume(asset.data, asset.size);
+				}
+			}
+			return sum;
+		} },
+	};
+
+	bool passed = true, evicted = true;
+	std::printf("loader   warm ms   cold ms\n");
+	for (const auto& loader : loaders)
+	{
+		double best[2] = { 1e30, 1e30 };
+		for (int cold = 0; cold < 2; ++cold)
+		{
+			for (int run = 0; run < runs; ++run)
+			{
+				if (cold)
+				{
+					for (const std::string& path : files)
+						evicted &= Evict(path);
+					evicted &= Evict(packPath);
+				}
+				const Clock::time_point start = Clock::now();
+				const uint64_t sum = loader.second();
+				best[cold] = std::min(best[cold], std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+				passed &= sum == expected;
+			}
+		}
+		std::printf("%-6s %9.3f %9.3f\n", loader.first, best[0], best[1]);
+	}
+	if (!evicted)
+		std::printf("note: some files could not be evicted; cold numbers may be warm\n");
+	std::printf("%s\n", passed ? "all loaders read identical bytes" : "FAILED: loaders disagree");
+	return passed ? 0 : 1;
+}
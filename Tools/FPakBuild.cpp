@@ -0,0 +1,88 @@
+﻿// Offline builder for the assets.fpak pack loaded by MainRenderer.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -o FPakBuild FPakBuild.cpp ../FogMap/Common/MappedFile.cpp ../FogMap/Content/AssetPack.cpp
+//
+//   FPakBuild assets.fpak file...
+//   FPakBuild --list assets.fpak
+//
+// Every file is stored under its name without the directory. For the app, pack the compiled
+// shaders of the build output with the model and its cache, e.g.
+//   FPakBuild ../FogMap/Assets/assets.fpak <OutDir>/*.cso ../FogMap/Assets/model.obj ../FogMap/Assets/model.fmesh
+// and rebuild the pack whenever one of them changes; without a pack the app loads the loose files.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/AssetPack.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+using namespace FogMap;
+
+namespace
+{
+	std::string BaseName(const std::string& path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+
+	int List(const char* path)
+	{
+		DX::MappedFile file;
+		AssetPack pack;
+		if (!file.Open(std::string(path)) || !pack.Open(file.GetData(), file.GetSize()))
+		{
+			std::fprintf(stderr, "cannot read pack %s\n", path);
+			return 1;
+		}
+		for (uint32_t i = 0; i < pack.GetAssetCount(); ++i)
+		{
+			const AssetView asset = pack.GetAsset(i);
+			std::printf("%10zu  %10zu  %s\n", static_cast<size_t>(asset.data - file.GetData()), asset.size, pack.GetName(i));
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 3 && std::strcmp(argv[1], "--list") == 0)
+		return List(argv[2]);
+	if (argc < 3 || argv[1][0] == '-')
+	{
+		std::fprintf(stderr, "usage: %s assets.fpak file...\n       %s --list assets.fpak\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	// The sources stay mapped until the pack is written.
+	std::vector<std::unique_ptr<DX::MappedFile>> sources;
+	std::vector<AssetPackInput> assets;
+	for (int i = 2; i < argc; ++i)
+	{
+		sources.emplace_back(new DX::MappedFile);
+		if (!sources.back()->Open(std::string(argv[i])))
+		{
+			std::fprintf(stderr, "cannot read %s\n", argv[i]);
+			return 1;
+		}
+		assets.push_back(AssetPackInput{ BaseName(argv[i]), sources.back()->GetData(), sources.back()->GetSize() });
+	}
+
+	std::vector<uint8_t> image;
+	if (!WriteAssetPack(assets, image))
+	{
+		std::fprintf(stderr, "two inputs share a file name\n");
+		return 1;
+	}
+	FILE* out = std::fopen(argv[1], "wb");
+	if (!out || std::fwrite(image.data(), 1, image.size(), out) != image.size() || std::fclose(out) != 0)
+	{
+		std::fprintf(stderr, "cannot write %s\n", argv[1]);
+		return 1;
+	}
+	std::printf("%s: %zu assets, %zu bytes\n", argv[1], assets.size(), image.size());
+	return 0;
+}
@@ -0,0 +1,232 @@
+﻿// Cost of the fog pass against its slice count on the CPU reference path
+// (FogMap/Content/SoftwareRenderer.h), and the adaptive slice count of FogSettings::frameBudgetMs.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o FogSliceBench FogSliceBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore,SoftwareRenderer,EpipolarSampler,FroxelGrid}.cpp
+//
+//   FogSliceBench [--threads N] [--size WxH] [--frames N] [--budget ms] [--csv cost.csv] model.obj
+//
+// Renders the same frame with 8, 16, ... 512 slices, both world-z and view-aligned, and prints
+// for each the fog pass and frame times with a bar plot (and as CSV for plotting elsewhere),
+// the fog overdraw as shaded fragments per screen pixel, and how far the image is from that
+// of 64 world-z slices. Checks that every world-z count lets the same fraction of the
+// background through, exp(-opticalDepth), that view-aligned slices shade fewer fragments, and
+// that the adaptive mode, starting from 512 slices, settles within the budget (by default the
+// frame time at 64 slices) or on its coarsest level. Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/RendererCore.h"
+#include "../FogMap/Content/SoftwareRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	constexpr uint32_t MinSlices = 8;
+	constexpr uint32_t MaxSlices = 512;
+	constexpr uint32_t ReferenceSlices = 64;
+
+	struct Sample
+	{
+		FogSlicing slicing;
+		uint32_t slices;
+		double fogMs;
+		double totalMs;
+		double overdraw;			// fog fragments per screen pixel
+		double meanDifference;		// per channel, in 8-bit steps, against ReferenceSlices world-z slices
+	};
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	// Best fog and frame time over frames renders of the current frame.
+	void Measure(RendererCore& core, SoftwareRenderer& renderer, int frames, double& fogMs, double& totalMs)
+	{
+		fogMs = totalMs = 1e30;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			renderer.Submit(core.BuildFrame());
+			fogMs = std::min(fogMs, renderer.GetTimings().fogMs);
+			totalMs = std::min(totalMs, renderer.GetTimings().totalMs);
+		}
+	}
+
+	const char* SlicingName(FogSlicing slicing)
+	{
+		return slicing == FogSlicing::WorldZ ? "world-z" : "view";
+	}
+
+	double MeanDifference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+	{
+		uint64_t sum = 0, count = 0;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (i % 4 == 3)
+				continue;
+			sum += static_cast<uint64_t>(std::abs(int(a[i]) - int(b[i])));
+			++count;
+		}
+		return count != 0 ? double(sum) / count : 0.0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	unsigned width = 640, height = 360;
+	int frames = 3;
+	double budgetMs = 0.0;
+	std::string csvPath;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--threads") == 0)
+			threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--size") == 0)
+		{
+			if (std::sscanf(argv[arg + 1], "%ux%u", &width, &height) != 2 || width == 0 || height == 0)
+				break;
+		}
+		else if (std::strcmp(argv[arg], "--frames") == 0)
+			frames = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--budget") == 0)
+			budgetMs = std::atof(argv[arg + 1]);
+		else if (std::strcmp(argv[arg], "--csv") == 0)
+			csvPath = argv[arg + 1];
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--threads N] [--size WxH] [--frames N] [--budget ms] [--csv cost.csv] model.obj\n", argv[0]);
+		return 1;
+	}
+
+	DX::MappedFile source;
+	RendererCore core;
+	JobSystem jobs(threadCount);
+	if (!source.Open(std::string(argv[arg])) || !core.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs))
+	{
+		std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+		return 1;
+	}
+	core.Resize(float(width) / height, float(height), MatrixIdentity());
+
+	SoftwareRenderer renderer(threadCount);
+	renderer.Resize(width, height);
+	core.Upload(renderer);
+
+	bool passed = true;
+	FogSettings fog;
+	const double transmittance = std::exp(-double(fog.opticalDepth));
+	bool sameDensity = true;
+	std::vector<Sample> samples;
+	std::vector<std::vector<uint8_t>> images;
+	const size_t pixelCount = size_t(width) * height;
+	for (FogSlicing slicing : { FogSlicing::WorldZ, FogSlicing::ViewAligned })
+	{
+		for (uint32_t slices = MinSlices; slices <= MaxSlices; slices *= 2)
+		{
+			fog.slicing = slicing;
+			fog.sliceCount = slices;
+			core.SetFogSettings(fog);
+			core.UploadFogCells(renderer);
+			if (slicing == FogSlicing::WorldZ)
+				sameDensity &= std::fabs(std::pow(1.0 - core.GetFogLevel().alpha, double(slices)) - transmittance) < 1e-5;
+
+			Sample sample{ slicing, slices, 0.0, 0.0, 0.0, 0.0 };
+			Measure(core, renderer, frames, sample.fogMs, sample.totalMs);
+			sample.overdraw = double(renderer.GetCounters().fogFragments) / pixelCount;
+			samples.push_back(sample);
+			images.push_back(renderer.GetColor());
+		}
+	}
+	const size_t reference = static_cast<size_t>(std::log2(double(ReferenceSlices) / MinSlices));
+	const size_t viewReference = reference + samples.size() / 2;
+	for (size_t i = 0; i < samples.size(); ++i)
+		samples[i].meanDifference = MeanDifference(images[i], images[reference]);
+
+	std::printf("%ux%u, %u threads, best of %d frames\n", width, height, threadCount, frames);
+	std::printf("slicing  slices    fog ms  frame ms  frags/px  diff vs %u\n", ReferenceSlices);
+	const double maxFogMs = std::max_element(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) {
+		return a.fogMs < b.fogMs;
+	})->fogMs;
+	for (const Sample& sample : samples)
+	{
+		char bar[41];
+		const int length = maxFogMs > 0.0 ? static_cast<int>(40.0 * sample.fogMs / maxFogMs + 0.5) : 0;
+		std::memset(bar, '#', length);
+		bar[length] = 0;
+		std::printf("%-7s  %6u  %8.2f  %8.2f  %8.2f  %9.2f  %s\n", SlicingName(sample.slicing), sample.slices,
+			sample.fogMs, sample.totalMs, sample.overdraw, sample.meanDifference, bar);
+	}
+	if (!csvPath.empty())
+	{
+		FILE* csv = std::fopen(csvPath.c_str(), "w");
+		if (csv == nullptr)
+		{
+			std::fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+			return 1;
+		}
+		std::fprintf(csv, "slicing,slices,fog_ms,frame_ms,fragments_per_pixel,mean_difference\n");
+		for (const Sample& sample : samples)
+			std::fprintf(csv, "%s,%u,%.4f,%.4f,%.4f,%.4f\n", SlicingName(sample.slicing), sample.slices,
+				sample.fogMs, sample.totalMs, sample.overdraw, sample.meanDifference);
+		std::fclose(csv);
+	}
+	std::printf("overdraw at %u slices: %.2f -> %.2f fog fragments per pixel, fog pass %.2f -> %.2f ms\n\n", ReferenceSlices,
+		samples[reference].overdraw, samples[viewReference].overdraw, samples[reference].fogMs, samples[viewReference].fogMs);
+	passed &= Check(sameDensity, "every world-z slice count has the same optical depth");
+	bool lessOverdraw = true;
+	for (size_t i = 0; i < samples.size() / 2; ++i)
+		lessOverdraw &= samples[i + samples.size() / 2].overdraw < samples[i].overdraw;
+	passed &= Check(lessOverdraw, "view-aligned slices shade fewer fragments");
+
+	// Adaptive mode, fed the software frame times as MainRenderer feeds it GPU times.
+	if (budgetMs <= 0.0)
+		budgetMs = samples[reference].totalMs;
+	fog.slicing = FogSlicing::WorldZ;
+	fog.sliceCount = MaxSlices;
+	fog.minSliceCount = MinSlices;
+	fog.frameBudgetMs = static_cast<float>(budgetMs);
+	core.SetFogSettings(fog);
+	core.UploadFogCells(renderer);
+	uint32_t slices = core.GetFogLevel().sliceCount;
+	int stableFrames = 0, frame = 0;
+	std::printf("adaptive, %.2f ms budget: %u", budgetMs, slices);
+	for (; frame < 500 && stableFrames < 60; ++frame)
+	{
+		renderer.Submit(core.BuildFrame());
+		core.ReportFrameTime(renderer.GetTimings().totalMs);
+		if (core.GetFogLevel().sliceCount != slices)
+		{
+			slices = core.GetFogLevel().sliceCount;
+			std::printf(" -> %u", slices);
+			stableFrames = 0;
+		}
+		else
+			++stableFrames;
+	}
+	double fogMs, totalMs;
+	Measure(core, renderer, frames, fogMs, totalMs);
+	std::printf(" slices after %d frames, %.2f ms/frame\n\n", frame, totalMs);
+	passed &= Check(stableFrames >= 60, "adaptive slice count settles");
+	// A 5% margin for timing noise between the settling run and the measurement.
+	passed &= Check(totalMs <= budgetMs * 1.05 || slices == MinSlices, "settled frame time is within the budget");
+
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
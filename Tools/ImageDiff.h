@@ -0,0 +1,58 @@
+﻿#pragma once
+
+// Per-channel comparison of RGBA8 images, shared by the fog benches (FogRayMarchDiff,
+// EpipolarFogBench, FroxelFogBench).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace Tools
+{
+	struct Difference
+	{
+		double mean;			// per channel, in 8-bit steps
+		int largest;
+		double outliers;		// share of pixels with a channel more than 2 steps off
+	};
+
+	inline Difference Compare(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+	{
+		Difference difference{ 0.0, 0, 0.0 };
+		uint64_t sum = 0, outliers = 0;
+		for (size_t i = 0; i < a.size(); i += 4)
+		{
+			int pixelLargest = 0;
+			for (size_t c = 0; c < 3; ++c)
+			{
+				const int d = std::abs(int(a[i + c]) - int(b[i + c]));
+				sum += d;
+				pixelLargest = std::max(pixelLargest, d);
+			}
+			difference.largest = std::max(difference.largest, pixelLargest);
+			outliers += pixelLargest > 2;
+		}
+		const size_t pixels = a.size() / 4;
+		difference.mean = pixels != 0 ? double(sum) / (pixels * 3) : 0.0;
+		difference.outliers = pixels != 0 ? double(outliers) / pixels : 0.0;
+		return difference;
+	}
+
+	// Writes the absolute difference, scaled by 16, as a binary PPM.
+	inline bool WriteDifference(const std::string& path, const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, unsigned width, unsigned height)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+		std::vector<uint8_t> rgb(a.size() / 4 * 3);
+		for (size_t i = 0, j = 0; i < a.size(); i += 4, j += 3)
+			for (size_t c = 0; c < 3; ++c)
+				rgb[j + c] = static_cast<uint8_t>(std::min(255, 16 * std::abs(int(a[i + c]) - int(b[i + c]))));
+		const bool written = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+		return std::fclose(file) == 0 && written;
+	}
+}
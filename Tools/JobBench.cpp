@@ -0,0 +1,198 @@
+﻿// Correctness and scheduling overhead of the job system (FogMap/Content/JobSystem.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o JobBench JobBench.cpp ../FogMap/Content/JobSystem.cpp
+//
+//   JobBench [--threads N] [jobs]
+//
+// First checks, on N threads (all hardware threads by default), that
+//   - dependencies order jobs (diamonds, and a Then chain run without data races),
+//   - every one of a large fan-out runs exactly once and WhenAll waits for all of them,
+//   - an exception skips the dependent jobs and is rethrown by Wait,
+//   - ParallelFor covers every index once, also when nested inside jobs,
+//   - jobs spawned on one worker are stolen by others,
+//   - the destructor runs everything still scheduled,
+// and exits with 1 if any check fails. It then times empty jobs scheduled from the main
+// thread and spawned recursively from inside jobs, for 1, 2, 4, ... threads up to N.
+
+#include "../FogMap/Content/JobSystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	// Spawns two children per job down to depth 0, waiting for them inside the parent; a
+	// binary tree of depth d makes 2^(d+1) - 1 jobs.
+	void SpawnTree(JobSystem& jobs, int depth)
+	{
+		if (depth == 0)
+			return;
+		JobHandle left = jobs.Schedule([&jobs, depth]() { SpawnTree(jobs, depth - 1); });
+		JobHandle right = jobs.Schedule([&jobs, depth]() { SpawnTree(jobs, depth - 1); });
+		jobs.Wait(left);
+		jobs.Wait(right);
+	}
+
+	bool RunChecks(unsigned threadCount)
+	{
+		bool passed = true;
+		JobSystem jobs(threadCount);
+
+		bool ordered = true;
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::atomic<int> stage(0);
+			std::atomic<bool> failed(false);
+			JobHandle a = jobs.Schedule([&]() { stage = 1; });
+			auto middle = [&]() { if (stage.load() < 1) failed = true; };
+			JobHandle b = jobs.Then(a, middle), c = jobs.Then(a, middle);
+			JobHandle d = jobs.Schedule([&]() { if (stage.load() != 1) failed = true; stage = 2; }, { b, c });
+			jobs.Wait(d);
+			ordered &= !failed && stage == 2;
+		}
+		passed &= Check(ordered, "diamond dependencies run in order");
+
+		// Plain int: a chain has to serialise its jobs with the right memory ordering.
+		int chained = 0;
+		JobHandle last;
+		for (int i = 0; i < 10000; ++i)
+			last = last ? jobs.Then(last, [&chained]() { ++chained; }) : jobs.Schedule([&chained]() { ++chained; });
+		jobs.Wait(last);
+		passed &= Check(chained == 10000, "Then chain of 10000 jobs");
+
+		std::vector<std::atomic<int>> runs(100000);
+		std::vector<JobHandle> fanOut;
+		for (size_t i = 0; i < runs.size(); ++i)
+			fanOut.push_back(jobs.Schedule([&runs, i]() { runs[i].fetch_add(1); }));
+		jobs.Wait(jobs.WhenAll(fanOut));
+		bool once = true;
+		for (const std::atomic<int>& count : runs)
+			once &= count.load() == 1;
+		passed &= Check(once, "fan-out of 100000 jobs runs each once");
+
+		std::atomic<bool> skipped(true);
+		JobHandle thrower = jobs.Schedule([]() { throw std::runtime_error("job failed"); });
+		JobHandle dependent = jobs.Then(jobs.Then(thrower, [&]() { skipped = false; }), [&]() { skipped = false; });
+		bool rethrown = false;
+		try
+		{
+			jobs.Wait(dependent);
+		}
+		catch (const std::runtime_error&)
+		{
+			rethrown = true;
+		}
+		passed &= Check(rethrown && skipped, "exceptions skip dependents and reach Wait");
+
+		std::vector<std::atomic<int>> covered(1000 * 64);
+		jobs.ParallelFor(64, 1, [&](size_t begin, size_t end) {
+			for (size_t outer = begin; outer < end; ++outer)
+				jobs.ParallelFor(1000, 7, [&](size_t b, size_t e) {
+					for (size_t inner = b; inner < e; ++inner)
+						covered[outer * 1000 + inner].fetch_add(1);
+				});
+		});
+		bool coveredOnce = true;
+		for (const std::atomic<int>& count : covered)
+			coveredOnce &= count.load() == 1;
+		passed &= Check(coveredOnce, "nested ParallelFor covers each index once");
+
+		if (threadCount > 1)
+		{
+			std::mutex mutex;
+			std::set<std::thread::id> threads;
+			JobHandle spawner = jobs.Schedule([&]() {
+				std::vector<JobHandle> children;
+				for (int i = 0; i < 256; ++i)
+					children.push_back(jobs.Schedule([&]() {
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							threads.insert(std::this_thread::get_id());
+						}
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+					}));
+				jobs.Wait(jobs.WhenAll(children));
+			});
+			jobs.Wait(spawner);
+			passed &= Check(threads.size() > 1, "jobs spawned on one worker are stolen");
+		}
+
+		std::atomic<int> drained(0);
+		{
+			JobSystem temporary(threadCount);
+			JobHandle first = temporary.Schedule([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); ++drained; });
+			for (int i = 0; i < 100; ++i)
+				temporary.Then(first, [&]() { ++drained; });
+		}
+		passed &= Check(drained == 101, "destructor runs the jobs still scheduled");
+		return passed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	size_t jobCount = 200000;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threadCount = std::max(1, std::atoi(argv[++i]));
+		else
+			jobCount = std::max(1, std::atoi(argv[i]));
+	}
+
+	std::printf("checks on %u threads\n", threadCount);
+	const bool passed = RunChecks(threadCount);
+
+	int depth = 1;
+	while ((size_t(2) << (depth + 1)) - 1 <= jobCount)
+		++depth;
+	const size_t treeJobs = (size_t(2) << depth) - 1;
+	std::printf("\n%zu empty jobs from the main thread, a %zu-job recursive tree:\n", jobCount, treeJobs);
+	std::printf("threads  scheduled ns/job  tree ns/job\n");
+	for (unsigned threads = 1;; threads = std::min(threads * 2, threadCount))
+	{
+		JobSystem jobs(threads);
+		double best = 1e30, bestTree = 1e30;
+		for (int run = 0; run < 3; ++run)
+		{
+			std::vector<JobHandle> handles;
+			handles.reserve(jobCount);
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < jobCount; ++i)
+				handles.push_back(jobs.Schedule([]() {}));
+			jobs.Wait(jobs.WhenAll(handles));
+			best = std::min(best, SecondsSince(start));
+
+			start = Clock::now();
+			jobs.Wait(jobs.Schedule([&jobs, depth]() { SpawnTree(jobs, depth); }));
+			bestTree = std::min(bestTree, SecondsSince(start));
+		}
+		std::printf("%7u  %16.1f  %11.1f\n", threads, best * 1e9 / jobCount, bestTree * 1e9 / treeJobs);
+		if (threads == threadCount)
+			break;
+	}
+
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+﻿// Throughput of the batch kernels of FogMap/Content/VectorMath.h and MatrixMath.h.
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -o MathBench MathBench.cpp
+// and again with -mavx2 for the AVX2 paths, or with -DFOGMAP_SCALAR_MATH to time the
+// scalar fallbacks against themselves.
+//
+//   MathBench [vectors]
+//
+// Times NormalizeVectors and TransformPoints against loops over the element-wise Normalize
+// and TransformPoint they replace, checks that both give bit-identical results, including
+// for zero, denormal and huge vectors and for counts that leave a scalar tail, and exits
+// with 1 if they do not.
+
+#include "../FogMap/Content/MatrixMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	const char* VectorPath()
+	{
+#if defined(FOGMAP_VECTOR_AVX2)
+		return "AVX2";
+#elif defined(FOGMAP_VECTOR_SSE2)
+		return "SSE2";
+#elif defined(FOGMAP_VECTOR_NEON)
+		return "NEON";
+#else
+		return "scalar";
+#endif
+	}
+
+	template <typename T>
+	bool SameBits(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+	}
+
+	// Best of a few runs, in nanoseconds per element.
+	template <typename Body>
+	double Time(size_t count, Body body)
+	{
+		double best = std::numeric_limits<double>::max();
+		for (int run = 0; run < 5; ++run)
+		{
+			const Clock::time_point start = Clock::now();
+			body();
+			best = std::min(best, SecondsSince(start));
+		}
+		return best * 1e9 / count;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t count = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000000;
+	std::printf("vector path: %s\n", VectorPath());
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(-3.0f, 3.0f);
+	std::vector<Float3> vectors(count);
+	for (Float3& v : vectors)
+		v = Float3{ coordinate(random), coordinate(random), coordinate(random) };
+	// Cases the masks and the scalar tail have to get right.
+	const float tiny = std::numeric_limits<float>::denorm_min(), huge = std::numeric_limits<float>::max();
+	const Float3 special[]{ { 0, 0, 0 }, { -0.0f, 0, 0 }, { tiny, 0, 0 }, { tiny, tiny, -tiny }, { huge, huge, 0 }, { 1e-20f, 0, 0 } };
+	for (size_t i = 0; i < sizeof(special) / sizeof(special[0]) && i < count; ++i)
+		vectors[(i * 7919) % count] = special[i];
+
+	const Float4x4 transform = MatrixMultiply(MatrixMultiply(MatrixRotationY(-1.2f),
+		MatrixLookAtRH(Float3{ 0.0f, 5.0f, 10.0f }, Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 1.0f, 0.0f })),
+		MatrixPerspectiveFovRH(70.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, 0.01f, 100.0f));
+
+	std::vector<Float3> scalarNormals(vectors), batchNormals(vectors);
+	const double scalarNormalize = Time(count, [&] {
+		scalarNormals = vectors;
+		for (Float3& v : scalarNormals)
+			v = Normalize(v);
+	});
+	const double batchNormalize = Time(count, [&] {
+		batchNormals = vectors;
+		NormalizeVectors(batchNormals.data(), batchNormals.size());
+	});
+	std::printf("normalize: scalar %.2f ns, batch %.2f ns per vector (%.2fx)\n",
+		scalarNormalize, batchNormalize, scalarNormalize / batchNormalize);
+
+	std::vector<Float4> scalarPoints(count), batchPoints(count);
+	const double scalarTransform = Time(count, [&] {
+		for (size_t i = 0; i < count; ++i)
+			scalarPoints[i] = TransformPoint(vectors[i], transform);
+	});
+	const double batchTransform = Time(count, [&] {
+		TransformPoints(vectors.data(), count, transform, batchPoints.data());
+	});
+	std::printf("transform: scalar %.2f ns, batch %.2f ns per point (%.2fx)\n",
+		scalarTransform, batchTransform, scalarTransform / batchTransform);
+
+	bool passed = SameBits(scalarNormals, batchNormals) && SameBits(scalarPoints, batchPoints);
+	// Every tail length of both kernels.
+	for (size_t n = 0; n <= 17 && n <= count; ++n)
+	{
+		std::vector<Float3> scalar(vectors.begin(), vectors.begin() + n), batch(scalar);
+		std::vector<Float4> scalarOut(n), batchOut(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			scalar[i] = Normalize(scalar[i]);
+			scalarOut[i] = TransformPoint(vectors[i], transform);
+		}
+		NormalizeVectors(batch.data(), n);
+		TransformPoints(vectors.data(), n, transform, batchOut.data());
+		passed &= SameBits(scalar, batch) && SameBits(scalarOut, batchOut);
+	}
+	std::printf("batch kernels bit-identical to element-wise: %s\n", passed ? "yes" : "NO");
+
+	double checksum = 0.0;
+	for (size_t i = 0; i < count; i += 997)
+		checksum += batchNormals[i].x + batchPoints[i].w;
+	std::printf("%s (checksum %g)\n", passed ? "passed" : "FAILED", checksum);
+	return passed ? 0 : 1;
+}
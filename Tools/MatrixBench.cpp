@@ -0,0 +1,174 @@
+﻿// Cost and accuracy of the CPU-composed pass transforms (FogMap/Content/RenderBackend.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -o MatrixBench MatrixBench.cpp
+//
+//   MatrixBench [vertices]
+//
+// Times composing the pass transforms of a frame with the vector MatrixMultiply against the
+// scalar loop it replaced, and transforming a vertex array the way the vertex shaders did
+// before (model, then view, then projection, for the camera and the light) against one
+// multiply by each composed matrix. It then checks that
+//   - the vector and scalar products are bit-identical,
+//   - composed and chained clip positions agree to a relative 1e-5,
+//   - MatrixNormal keeps transformed normals perpendicular to transformed tangents under a
+//     non-uniform scale, and matches the model itself for a rotation,
+// and exits with 1 if any check fails.
+
+#include "../FogMap/Content/RenderBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	Float4x4 ScalarMultiply(const Float4x4& a, const Float4x4& b)
+	{
+		Float4x4 result;
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+				result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		return result;
+	}
+
+	Float4x4 Scaling(float x, float y, float z)
+	{
+		return Float4x4{ { { x, 0, 0, 0 }, { 0, y, 0, 0 }, { 0, 0, z, 0 }, { 0, 0, 0, 1 } } };
+	}
+
+	Float4x4 Translation(float x, float y, float z)
+	{
+		return Float4x4{ { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { x, y, z, 1 } } };
+	}
+
+	float RelativeError(const Float4& a, const Float4& b)
+	{
+		const float scale = std::max({ 1.0f, std::abs(a.x), std::abs(a.y), std::abs(a.z), std::abs(a.w) });
+		return std::max({ std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z), std::abs(a.w - b.w) }) / scale;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t vertexCount = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000000;
+
+	// The transforms of RendererCore, with a scaled and moved model in place of its rotation.
+	const Float4x4 model = MatrixMultiply(MatrixMultiply(Scaling(1.0f, 2.5f, 0.5f), MatrixRotationY(-1.2f)), Translation(0.5f, -1.0f, 2.0f));
+	const ViewConstants view{
+		MatrixLookAtRH(Float3{ 0.0f, 5.0f, 10.0f }, Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 1.0f, 0.0f }),
+		MatrixPerspectiveFovRH(70.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, 0.01f, 100.0f),
+		MatrixLookAtRH(Float3{ 12.0f * 0.866f, 12.0f * 0.5f, 0.0f }, Float3{ 0.0f, 0.0f, 0.0f }, Float3{ 0.0f, 0.1f, 0.0f }),
+		MatrixOrthographicRH(12.0f, 12.0f, 0.0f, 24.0f) };
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(-3.0f, 3.0f);
+	std::vector<Float3> positions(vertexCount);
+	for (Float3& p : positions)
+		p = Float3{ coordinate(random), coordinate(random), coordinate(random) };
+
+	// Composition: a frame's worth of passes, repeated until the time is measurable.
+	const int compositions = 1000000;
+	float sink = 0.0f;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < compositions; ++i)
+	{
+		const Float4x4 viewProjection = ScalarMultiply(view.view, view.projection);
+		const Float4x4 lightViewProjection = ScalarMultiply(view.lightView, view.lightProjection);
+		const Float4x4 a = ScalarMultiply(model, viewProjection), b = ScalarMultiply(model, lightViewProjection);
+		sink += a.m[i & 3][0] + b.m[0][i & 3];
+	}
+	const double scalarSeconds = SecondsSince(start);
+	start = Clock::now();
+	for (int i = 0; i < compositions; ++i)
+	{
+		const Float4x4 viewProjection = MatrixMultiply(view.view, view.projection);
+		const Float4x4 lightViewProjection = MatrixMultiply(view.lightView, view.lightProjection);
+		const PassTransforms t = ComposePassTransforms(model, viewProjection, lightViewProjection);
+		sink += t.modelViewProjection.m[i & 3][0] + t.modelLightViewProjection.m[0][i & 3];
+	}
+	const double vectorSeconds = SecondsSince(start);
+	std::printf("compose view-projections + one pass: scalar %.1f ns, vector %.1f ns (incl. normal matrix)\n",
+		scalarSeconds * 1e9 / compositions, vectorSeconds * 1e9 / compositions);
+
+	const Float4x4 viewProjection = MatrixMultiply(view.view, view.projection);
+	const Float4x4 lightViewProjection = MatrixMultiply(view.lightView, view.lightProjection);
+	const PassTransforms transforms = ComposePassTransforms(model, viewProjection, lightViewProjection);
+
+	// Per-vertex work, as the vertex shaders do it.
+	std::vector<Float4> chained(vertexCount * 2), composed(vertexCount * 2);
+	start = Clock::now();
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const Float4 world = TransformPoint(positions[i], model);
+		chained[2 * i] = Transform(Transform(world, view.view), view.projection);
+		chained[2 * i + 1] = Transform(Transform(world, view.lightView), view.lightProjection);
+	}
+	const double chainedSeconds = SecondsSince(start);
+	start = Clock::now();
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		composed[2 * i] = TransformPoint(positions[i], transforms.modelViewProjection);
+		composed[2 * i + 1] = TransformPoint(positions[i], transforms.modelLightViewProjection);
+	}
+	const double composedSeconds = SecondsSince(start);
+	std::printf("%zu vertices: chained %.2f ns/vertex, composed %.2f ns/vertex (%.2fx)\n", vertexCount,
+		chainedSeconds * 1e9 / vertexCount, composedSeconds * 1e9 / vertexCount, chainedSeconds / composedSeconds);
+
+	bool passed = true;
+
+	bool identical = true;
+	for (int i = 0; i < 1000 && identical; ++i)
+	{
+		Float4x4 a, b;
+		for (int j = 0; j < 16; ++j)
+		{
+			a.m[j / 4][j % 4] = coordinate(random);
+			b.m[j / 4][j % 4] = coordinate(random);
+		}
+		const Float4x4 vector = MatrixMultiply(a, b), scalar = ScalarMultiply(a, b);
+		for (int j = 0; j < 16; ++j)
+			identical &= vector.m[j / 4][j % 4] == scalar.m[j / 4][j % 4];
+	}
+	std::printf("vector MatrixMultiply bit-identical to scalar: %s\n", identical ? "yes" : "NO");
+	passed &= identical;
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < chained.size(); ++i)
+		maxError = std::max(maxError, RelativeError(chained[i], composed[i]));
+	std::printf("max relative clip-space difference, composed vs chained: %g\n", maxError);
+	passed &= maxError <= 1e-5f;
+
+	// Any tangent of a surface stays perpendicular to its normal under the model transform.
+	float maxCosine = 0.0f;
+	for (int i = 0; i < 1000; ++i)
+	{
+		const Float3 n{ coordinate(random), coordinate(random), coordinate(random) };
+		const Float3 r{ coordinate(random), coordinate(random), coordinate(random) };
+		const Float3 t{ n.y * r.z - n.z * r.y, n.z * r.x - n.x * r.z, n.x * r.y - n.y * r.x };
+		const Float3 tn = TransformNormal(n, transforms.normal), tt = TransformNormal(t, model);
+		maxCosine = std::max(maxCosine, std::abs(Dot(tn, tt)) / std::sqrt(Dot(tn, tn) * Dot(tt, tt)));
+	}
+	const Float4x4 rotation = MatrixRotationY(-3.14159265f / 2), rotationNormal = MatrixNormal(rotation);
+	float rotationError = 0.0f;
+	for (int j = 0; j < 16; ++j)
+		rotationError = std::max(rotationError, std::abs(rotation.m[j / 4][j % 4] - rotationNormal.m[j / 4][j % 4]));
+	std::printf("normal matrix: max |cos(normal, tangent)| %g, rotation mismatch %g\n", maxCosine, rotationError);
+	passed &= maxCosine <= 1e-5f && rotationError <= 1e-6f;
+
+	std::printf("%s (checksum %g)\n", passed ? "passed" : "FAILED", sink);
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+﻿// Correctness and throughput of the in-place OBJ parser (FogMap/Content/ObjLoader.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o ObjParseBench ObjParseBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,JobSystem}.cpp
+//
+//   ObjParseBench [--runs N] [--megabytes N] [model.obj...]
+//
+// First checks ParseObj and BuildMesh on small hand-written files: every corner form ("v",
+// "v/t", "v//n", "v/t/n"), negative indices, polygons, signs and exponents, tabs and CRLF line
+// ends, ignored records, and the malformed faces that must be rejected. Then loads a generated
+// terrain of about N MB (32 by default) and every model given three ways, best of N runs (5 by
+// default), and prints MB/s:
+//   stream   the std::stringstream loader MainRenderer used before ObjLoader, kept here as the
+//            reference; it reads "f v//n v//n v//n" triangles only
+//   parse    ParseObj on its own
+//   load     LoadObjMesh on one thread: ParseObj, welding and the winding fix
+// Checks that load gives exactly the vertices and indices of the reference. Exits with 1 if
+// a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "TerrainObj.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	bool Near(const Float3& a, const Float3& b)
+	{
+		return std::abs(a.x - b.x) <= 1e-6f && std::abs(a.y - b.y) <= 1e-6f && std::abs(a.z - b.z) <= 1e-6f;
+	}
+
+	bool Parse(const char* text, ObjData& obj)
+	{
+		return ParseObj(text, std::strlen(text), obj);
+	}
+
+	bool SameCorners(const ObjData& obj, std::initializer_list<ObjCorner> corners)
+	{
+		if (obj.corners.size() != corners.size())
+			return false;
+		size_t i = 0;
+		for (const ObjCorner& corner : corners)
+		{
+			if (obj.corners[i].position != corner.position || obj.corners[i].normal != corner.normal)
+				return false;
+			++i;
+		}
+		return true;
+	}
+
+	bool RunUnitChecks()
+	{
+		const uint32_t none = ObjMissingIndex;
+		bool passed = true;
+		ObjData obj;
+
+		passed &= Check(Parse("v 1 2 3\nv -4.5 +5e-1 6E2\nv .25 0 -0\nf 1 2 3\n", obj) && obj.positions.size() == 3 &&
+			Near(obj.positions[1], Float3{ -4.5f, 0.5f, 600.0f }) && Near(obj.positions[2], Float3{ 0.25f, 0.0f, 0.0f }) &&
+			SameCorners(obj, { { 0, none }, { 1, none }, { 2, none } }), "positions, signs and exponents, \"v\" corners");
+		passed &= Check(Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 2\nf 1/1 2/1 3/1\nf 1//1 2//1 3//1\nf 1/1/1 2/1/1 3/1/1\n", obj) &&
+			obj.normals.size() == 1 && Near(obj.normals[0], Float3{ 0.0f, 0.0f, 1.0f }) &&
+			SameCorners(obj, { { 0, none }, { 1, none }, { 2, none }, { 0, 0 }, { 1, 0 }, { 2, 0 }, { 0, 0 }, { 1, 0 }, { 2, 0 } }),
+			"\"v/t\", \"v//n\" and \"v/t/n\", normals normalised");
+		passed &= Check(Parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\nf -4//-1 -3//-1 -2//-1 -1//-1\n", obj) &&
+			SameCorners(obj, { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 0, 0 }, { 2, 0 }, { 3, 0 } }), "negative indices, quad fan-triangulated");
+		passed &= Check(Parse("# comment\r\no name\r\ng group\r\ns 1\r\n\tv\t1 2 3\r\nvt 0 0\r\n  v 4 5 6 \r\nv 7 8 9\r\nmtllib x.mtl\r\nf\t1 2\t3\r\n", obj) &&
+			obj.positions.size() == 3 && Near(obj.positions[0], Float3{ 1.0f, 2.0f, 3.0f }) && SameCorners(obj, { { 0, none }, { 1, none }, { 2, none } }),
+			"tabs, CRLF and ignored records");
+		passed &= Check(Parse("v 1 2 3\nv 4 5 6\nv 7 8 9\nf 1 2 3", obj) && obj.corners.size() == 3, "last line without a newline");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n", obj), "rejects an index past the positions");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n", obj), "rejects index 0");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 1 2\n", obj), "rejects a negative index before the first");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1//1 2//1 3//1\n", obj), "rejects a normal index without normals");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nf 1 2\n", obj), "rejects a face of two corners");
+		passed &= Check(!Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 x 3\n", obj), "rejects a corner that is not a number");
+
+		// Two triangles sharing an edge, the first one wound against its normal (clockwise is
+		// front facing), then the first one again with the opposite normal.
+		Mesh mesh;
+		passed &= Check(Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nvn 0 0 1\nvn 0 0 -1\n"
+			"f 1//1 2//1 3//1\nf 2//1 3//1 4//1\nf 1//2 2//2 3//2\n", obj), "welding input parses");
+		BuildMesh(obj, mesh);
+		const uint32_t expected[] = { 0, 2, 1, 1, 2, 3, 4, 5, 6 };
+		passed &= Check(mesh.positions.size() == 7 && mesh.indices.size() == 9 && std::equal(mesh.indices.begin(), mesh.indices.end(), expected),
+			"welds exact pairs in order and fixes the winding");
+		passed &= Check(Near(mesh.boundsMin, Float3{ 0.0f, 0.0f, 0.0f }) && Near(mesh.boundsMax, Float3{ 1.0f, 1.0f, 0.0f }), "bounds");
+		return passed;
+	}
+
+	// The loader MainRenderer used before ObjLoader, without DirectXMath: copies the file into
+	// a stringstream and reads every line through an istringstream.
+	void StreamLoad(const uint8_t* data, size_t size, Mesh& mesh)
+	{
+		std::stringstream ss;
+		for (size_t i = 0; i < size; ++i) ss << static_cast<char>(data[i]);
+		std::vector<Float3> vert;
+		std::vector<Float3> norm;
+		std::unordered_map<int, std::pair<int, MeshAttributes>> vnBuffer;
+		std::unordered_map<int, Float3> positionOf;
+		mesh.indices.clear();
+
+		while (!ss.eof())
+		{
+			std::string line;
+			std::getline(ss, line);
+			std::istringstream iss(line);
+			std::string head; iss >> head;
+			if (head == "v")
+			{
+				Float3 v;
+				iss >> v.x >> v.y >> v.z;
+				vert.push_back(v);
+			}
+			else if (head == "vn")
+			{
+				Float3 vn;
+				iss >> vn.x >> vn.y >> vn.z;
+				float length = std::sqrt(vn.x * vn.x + vn.y * vn.y + vn.z * vn.z);
+				norm.push_back(length > 0.0f ? Float3{ vn.x / length, vn.y / length, vn.z / length } : vn);
+			}
+			else if (head == "f")
+			{
+				int ind[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					int vi, ni;
+					iss >> vi; iss.get(); iss.get(); iss >> ni;
+					ind[i] = static_cast<int>(vi * norm.size() + ni);
+					if (vnBuffer.count(ind[i]) == 0)
+					{
+						vnBuffer[ind[i]] = std::make_pair(static_cast<int>(vnBuffer.size()), MeshAttributes{ Float3{ 0.9f, 0.9f, 0.9f }, norm[ni - 1] });
+						positionOf[ind[i]] = vert[vi - 1];
+					}
+				}
+				const Float3& v0 = positionOf[ind[0]];
+				const Float3& v1 = positionOf[ind[1]];
+				const Float3& v2 = positionOf[ind[2]];
+				const Float3& n1 = vnBuffer[ind[1]].second.norm;
+				Float3 a{ v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+				Float3 b{ v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+				float dot = (a.y * b.z - a.z * b.y) * n1.x + (a.z * b.x - a.x * b.z) * n1.y + (a.x * b.y - a.y * b.x) * n1.z;
+				if (dot < 0) std::swap(ind[1], ind[2]);
+				for (int i = 0; i < 3; ++i) mesh.indices.push_back(vnBuffer[ind[i]].first);
+			}
+		}
+
+		mesh.positions.resize(vnBuffer.size());
+		mesh.attributes.resize(vnBuffer.size());
+		for (const auto& p : vnBuffer)
+		{
+			mesh.positions[p.second.first] = positionOf[p.first];
+			mesh.attributes[p.second.first] = p.second.second;
+		}
+	}
+
+	bool SameMesh(const Mesh& a, const Mesh& b)
+	{
+		if (a.positions.size() != b.positions.size() || a.indices != b.indices)
+			return false;
+		for (size_t i = 0; i < a.positions.size(); ++i)
+			if (std::memcmp(&a.positions[i], &b.positions[i], sizeof(Float3)) != 0 || !Near(a.attributes[i].norm, b.attributes[i].norm))
+				return false;
+		return true;
+	}
+
+	// Loads data three ways and prints MB/s; returns whether load matched the reference.
+	bool Run(const char* name, const uint8_t* data, size_t size, int runs)
+	{
+		double best[3] = { 1e30, 1e30, 1e30 };
+		Mesh reference, loaded;
+		ObjData obj;
+		bool parsed = true;
+		for (int run = 0; run < runs; ++run)
+		{
+			Clock::time_point start = Clock::now();
+			StreamLoad(data, size, reference);
+			best[0] = std::min(best[0], std::chrono::duration<double>(Clock::now() - start).count());
+
+			start = Clock::now();
+			parsed &= ParseObj(reinterpret_cast<const char*>(data), size, obj);
+			best[1] = std::min(best[1], std::chrono::duration<double>(Clock::now() - start).count());
+
+			start = Clock::now();
+			parsed &= LoadObjMesh(data, size, loaded);
+			best[2] = std::min(best[2], std::chrono::duration<double>(Clock::now() - start).count());
+		}
+		const double megabytes = size / 1e6;
+		std::printf("%-24s %8.1f %10.1f %10.1f %10.1f  %zu triangles\n", name, megabytes, megabytes / best[0], megabytes / best[1],
+			megabytes / best[2], loaded.indices.size() / 3);
+		return parsed && SameMesh(reference, loaded);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	size_t megabytes = 32;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--runs") == 0)
+			runs = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--megabytes") == 0)
+			megabytes = std::max(1, std::atoi(argv[arg + 1]));
+		else
+		{
+			std::fprintf(stderr, "usage: %s [--runs N] [--megabytes N] [model.obj...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bool passed = RunUnitChecks();
+
+	std::printf("\nfile                           MB  stream MB/s  parse MB/s  load MB/s\n");
+	bool same = true;
+	const std::string terrain = Tools::MakeTerrainObj(megabytes);
+	same &= Run("terrain", reinterpret_cast<const uint8_t*>(terrain.data()), terrain.size(), runs);
+	for (; arg < argc; ++arg)
+	{
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])))
+		{
+			std::fprintf(stderr, "cannot read %s\n", argv[arg]);
+			return 1;
+		}
+		same &= Run(argv[arg], file.GetData(), file.GetSize(), runs);
+	}
+	std::printf("\n");
+	passed &= Check(same, "load matches the stringstream loader");
+
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
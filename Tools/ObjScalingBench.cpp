@@ -0,0 +1,148 @@
+﻿// Thread scaling of the chunked OBJ parser (ParseObjParallel, FogMap/Content/ObjLoader.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o ObjScalingBench ObjScalingBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,JobSystem}.cpp
+//
+//   ObjScalingBench [--runs N] [--threads N] [--megabytes N] [model.obj...]
+//
+// Parses a generated terrain of about N MB (64 by default) and every model given with
+// ParseObj, then with ParseObjParallel and LoadObjMesh on 1, 2, 4, ... threads up to the
+// --threads count (the hardware concurrency by default), best of N runs (5 by default).
+// Prints MB/s and the speedup over one thread for both. Files are split into chunks of at
+// least 1 MB, so small files do not scale. Checks that every thread count parses exactly what
+// ParseObj does and loads the same mesh. Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "TerrainObj.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	template <typename T>
+	bool SameArray(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	bool SameObj(const ObjData& a, const ObjData& b)
+	{
+		return SameArray(a.positions, b.positions) && SameArray(a.normals, b.normals) && SameArray(a.corners, b.corners);
+	}
+
+	bool SameMesh(const Mesh& a, const Mesh& b)
+	{
+		return SameArray(a.positions, b.positions) && SameArray(a.attributes, b.attributes) && SameArray(a.indices, b.indices);
+	}
+
+	template <typename Function>
+	double BestMs(int runs, Function function)
+	{
+		double best = 1e30;
+		for (int run = 0; run < runs; ++run)
+		{
+			const Clock::time_point start = Clock::now();
+			function();
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// Prints one line per thread count; returns whether every one matched the serial parse.
+	bool Run(const char* name, const uint8_t* data, size_t size, unsigned maxThreads, int runs)
+	{
+		const char* text = reinterpret_cast<const char*>(data);
+		ObjData reference, obj;
+		Mesh referenceMesh, mesh;
+		if (!ParseObj(text, size, reference) || !LoadObjMesh(data, size, referenceMesh))
+		{
+			std::printf("%s: not a valid OBJ\n", name);
+			return false;
+		}
+		const double serialMs = BestMs(runs, [&]() { ParseObj(text, size, obj); });
+		const double megabytes = size / 1e6;
+		std::printf("%s: %.1f MB, ParseObj %.1f MB/s\n", name, megabytes, megabytes / serialMs * 1e3);
+		std::printf("threads  parse MB/s  speedup   load MB/s  speedup\n");
+
+		bool same = true;
+		double parseOne = 0.0, loadOne = 0.0;
+		for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads))
+		{
+			JobSystem jobs(threads);
+			const double parseMs = BestMs(runs, [&]() { ParseObjParallel(text, size, jobs, obj); });
+			same &= SameObj(obj, reference);
+			const double loadMs = BestMs(runs, [&]() { LoadObjMesh(data, size, mesh, jobs); });
+			same &= SameMesh(mesh, referenceMesh);
+			if (threads == 1)
+			{
+				parseOne = parseMs;
+				loadOne = loadMs;
+			}
+			std::printf("%7u  %10.1f  %6.2fx  %10.1f  %6.2fx\n", threads, megabytes / parseMs * 1e3, parseOne / parseMs,
+				megabytes / loadMs * 1e3, loadOne / loadMs);
+			if (threads == maxThreads)
+				break;
+		}
+		std::printf("\n");
+		return same;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t megabytes = 64;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--runs") == 0)
+			runs = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--threads") == 0)
+			maxThreads = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--megabytes") == 0)
+			megabytes = std::max(1, std::atoi(argv[arg + 1]));
+		else
+			break;
+	}
+	const unsigned hardwareThreads = std::thread::hardware_concurrency();
+	std::printf("%u hardware threads\n\n", hardwareThreads);
+	if (maxThreads > hardwareThreads)
+		std::printf("note: more threads than the hardware runs at once; expect no speedup past %u\n\n", hardwareThreads);
+
+	const std::string terrain = Tools::MakeTerrainObj(megabytes);
+	bool same = Run("terrain", reinterpret_cast<const uint8_t*>(terrain.data()), terrain.size(), maxThreads, runs);
+	for (; arg < argc; ++arg)
+	{
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])))
+		{
+			std::fprintf(stderr, "cannot read %s\n", argv[arg]);
+			return 1;
+		}
+		same &= Run(argv[arg], file.GetData(), file.GetSize(), maxThreads, runs);
+	}
+
+	const bool passed = Check(same, "every thread count matches ParseObj");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
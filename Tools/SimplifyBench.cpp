@@ -0,0 +1,338 @@
+﻿// Geometric error and throughput of the LOD chain (FogMap/Content/MeshSimplifier.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o SimplifyBench SimplifyBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,MeshOptimizer,MeshSimplifier,JobSystem}.cpp
+//
+//   SimplifyBench [model.obj...]
+//
+// Builds the default LOD chain of UV spheres and displaced terrain grids of 20k and 160k
+// triangles, and of every model given. For each level it measures the deviation from LOD 0
+// both ways: the distance of every LOD 0 vertex to the level's surface, and of points spread
+// over the level's triangles to the LOD 0 surface. Prints the recorded error next to it, and
+// the throughput of the whole chain and of a single halving with SimplifyMesh. Checks that
+// the recorded errors never decrease down the chain and bound the measured deviation. Exits
+// with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/MeshSimplifier.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "../FogMap/Content/VectorMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double SecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	// Unit sphere of stacks x slices quads with single-vertex poles; normals point outwards.
+	void MakeSphere(size_t triangleCount, Mesh& mesh)
+	{
+		const uint32_t slices = std::max<uint32_t>(3, static_cast<uint32_t>(std::sqrt(triangleCount)));
+		const uint32_t stacks = std::max<uint32_t>(2, static_cast<uint32_t>(triangleCount / (2 * slices)) + 1);
+		mesh.positions.clear();
+		mesh.attributes.clear();
+		mesh.indices.clear();
+		mesh.positions.push_back(Float3{ 0.0f, 1.0f, 0.0f });
+		for (uint32_t i = 1; i < stacks; ++i)
+		{
+			const float theta = 3.14159265f * i / stacks;
+			for (uint32_t j = 0; j < slices; ++j)
+			{
+				const float phi = 2.0f * 3.14159265f * j / slices;
+				mesh.positions.push_back(Float3{ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) });
+			}
+		}
+		mesh.positions.push_back(Float3{ 0.0f, -1.0f, 0.0f });
+		const uint32_t south = static_cast<uint32_t>(mesh.positions.size() - 1);
+		const auto ring = [slices](uint32_t i, uint32_t j) { return 1 + (i - 1) * slices + j % slices; };
+		for (uint32_t j = 0; j < slices; ++j)
+		{
+			const uint32_t top[] = { 0, ring(1, j + 1), ring(1, j) };
+			const uint32_t bottom[] = { south, ring(stacks - 1, j), ring(stacks - 1, j + 1) };
+			mesh.indices.insert(mesh.indices.end(), top, top + 3);
+			mesh.indices.insert(mesh.indices.end(), bottom, bottom + 3);
+		}
+		for (uint32_t i = 1; i + 1 < stacks; ++i)
+		{
+			for (uint32_t j = 0; j < slices; ++j)
+			{
+				const uint32_t a = ring(i, j), b = ring(i, j + 1), c = ring(i + 1, j), d = ring(i + 1, j + 1);
+				const uint32_t quad[] = { a, b, c, b, d, c };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		for (const Float3& p : mesh.positions)
+			mesh.attributes.push_back(MeshAttributes{ Float3{ 0.9f, 0.9f, 0.9f }, p });
+		ComputeBounds(mesh.positions.data(), mesh.positions.size(), mesh.boundsMin, mesh.boundsMax);
+	}
+
+	// Grid over [-1, 1]^2 in xz with a few octaves of sine displacement in y, as in BvhBench.
+	void MakeTerrain(size_t triangleCount, Mesh& mesh)
+	{
+		const uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(triangleCount / 2.0)));
+		mesh.positions.clear();
+		mesh.attributes.clear();
+		mesh.indices.clear();
+		for (uint32_t z = 0; z <= side; ++z)
+		{
+			for (uint32_t x = 0; x <= side; ++x)
+			{
+				float fx = 2.0f * x / side - 1.0f, fz = 2.0f * z / side - 1.0f;
+				float y = 0.1f * std::sin(fx * 7.0f) * std::cos(fz * 5.0f) + 0.03f * std::sin(fx * 31.0f + fz * 17.0f);
+				mesh.positions.push_back(Float3{ fx, y, fz });
+				mesh.attributes.push_back(MeshAttributes{ Float3{ 0.9f, 0.9f, 0.9f }, Float3{ 0.0f, 1.0f, 0.0f } });
+			}
+		}
+		for (uint32_t z = 0; z < side; ++z)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				uint32_t a = z * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+				uint32_t quad[] = { a, c, b, b, c, d };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		ComputeBounds(mesh.positions.data(), mesh.positions.size(), mesh.boundsMin, mesh.boundsMax);
+	}
+
+	// Squared distance from p to the triangle abc (Ericson, Real-Time Collision Detection 5.1.5).
+	float DistanceSquared(const Float3& p, const Float3& a, const Float3& b, const Float3& c)
+	{
+		const Float3 ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+		const float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		Float3 closest;
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			closest = a;
+		else
+		{
+			const Float3 bp = Sub(p, b);
+			const float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+			const Float3 cp = Sub(p, c);
+			const float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+			const float vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+			if (d3 >= 0.0f && d4 <= d3)
+				closest = b;
+			else if (d6 >= 0.0f && d5 <= d6)
+				closest = c;
+			else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+				closest = Add(a, Scale(ab, d1 / (d1 - d3)));
+			else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+				closest = Add(a, Scale(ac, d2 / (d2 - d6)));
+			else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+				closest = Add(b, Scale(Sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+			else
+			{
+				const float denominator = 1.0f / (va + vb + vc);
+				closest = Add(a, Add(Scale(ab, vb * denominator), Scale(ac, vc * denominator)));
+			}
+		}
+		const Float3 d = Sub(p, closest);
+		return Dot(d, d);
+	}
+
+	// Uniform grid over the triangles of one index range, for nearest-surface queries.
+	class SurfaceGrid
+	{
+	public:
+		SurfaceGrid(const Mesh& mesh, const uint32_t* indices, size_t indexCount) :
+			m_mesh(mesh),
+			m_indices(indices),
+			m_origin(mesh.boundsMin)
+		{
+			const Float3 extent = Sub(mesh.boundsMax, mesh.boundsMin);
+			const float volume = std::max(extent.x, 1e-6f) * std::max(extent.y, 1e-6f) * std::max(extent.z, 1e-6f);
+			m_cellSize = std::cbrt(volume / std::max<size_t>(indexCount / 3, 1));
+			m_cellSize = std::max(m_cellSize, 1e-3f * std::max({ extent.x, extent.y, extent.z }));
+			m_size[0] = std::max(1, static_cast<int>(extent.x / m_cellSize) + 1);
+			m_size[1] = std::max(1, static_cast<int>(extent.y / m_cellSize) + 1);
+			m_size[2] = std::max(1, static_cast<int>(extent.z / m_cellSize) + 1);
+
+			std::vector<std::vector<uint32_t>> cells(size_t(m_size[0]) * m_size[1] * m_size[2]);
+			for (size_t t = 0; t + 3 <= indexCount; t += 3)
+			{
+				Float3 lo, hi;
+				const Float3 corners[] = { mesh.positions[indices[t]], mesh.positions[indices[t + 1]], mesh.positions[indices[t + 2]] };
+				ComputeBounds(corners, 3, lo, hi);
+				int a[3], b[3];
+				CellOf(lo, a);
+				CellOf(hi, b);
+				for (int z = a[2]; z <= b[2]; ++z)
+					for (int y = a[1]; y <= b[1]; ++y)
+						for (int x = a[0]; x <= b[0]; ++x)
+							cells[Cell(x, y, z)].push_back(static_cast<uint32_t>(t));
+			}
+			m_offsets.assign(cells.size() + 1, 0);
+			for (size_t c = 0; c < cells.size(); ++c)
+				m_offsets[c + 1] = m_offsets[c] + static_cast<uint32_t>(cells[c].size());
+			for (const std::vector<uint32_t>& cell : cells)
+				m_triangles.insert(m_triangles.end(), cell.begin(), cell.end());
+		}
+
+		// Distance from p to the nearest triangle, searching shells of cells outwards until no
+		// unvisited cell can hold anything nearer.
+		float Distance(const Float3& p) const
+		{
+			int center[3];
+			CellOf(p, center);
+			float best = 1e30f;
+			const int maxRadius = std::max({ m_size[0], m_size[1], m_size[2] });
+			for (int radius = 0; radius <= maxRadius; ++radius)
+			{
+				for (int z = center[2] - radius; z <= center[2] + radius; ++z)
+					for (int y = center[1] - radius; y <= center[1] + radius; ++y)
+						for (int x = center[0] - radius; x <= center[0] + radius; ++x)
+						{
+							const bool shell = std::abs(x - center[0]) == radius || std::abs(y - center[1]) == radius || std::abs(z - center[2]) == radius;
+							if (!shell || x < 0 || y < 0 || z < 0 || x >= m_size[0] || y >= m_size[1] || z >= m_size[2])
+								continue;
+							const size_t cell = Cell(x, y, z);
+							for (uint32_t i = m_offsets[cell]; i < m_offsets[cell + 1]; ++i)
+							{
+								const uint32_t* triangle = m_indices + m_triangles[i];
+								best = std::min(best, DistanceSquared(p, m_mesh.positions[triangle[0]], m_mesh.positions[triangle[1]],
+									m_mesh.positions[triangle[2]]));
+							}
+						}
+				// Cells beyond this shell are at least radius cells away from p's cell.
+				const float reach = radius * m_cellSize;
+				if (best <= reach * reach)
+					break;
+			}
+			return std::sqrt(best);
+		}
+
+	private:
+		void CellOf(const Float3& p, int cell[3]) const
+		{
+			const float d[3] = { p.x - m_origin.x, p.y - m_origin.y, p.z - m_origin.z };
+			for (int k = 0; k < 3; ++k)
+				cell[k] = std::min(std::max(static_cast<int>(std::floor(d[k] / m_cellSize)), 0), m_size[k] - 1);
+		}
+
+		size_t Cell(int x, int y, int z) const
+		{
+			return (size_t(z) * m_size[1] + y) * m_size[0] + x;
+		}
+
+		const Mesh& m_mesh;
+		const uint32_t* m_indices;
+		Float3 m_origin;
+		float m_cellSize;
+		int m_size[3];
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_triangles;
+	};
+
+	// Largest distance of LOD 0 vertices to the level's surface, and of points on the level's
+	// triangles (corners, edge midpoints, centroid) to the LOD 0 surface.
+	float MeasureDeviation(const Mesh& mesh, const SurfaceGrid& lod0, const MeshLod& level)
+	{
+		const uint32_t* indices = mesh.indices.data() + level.startIndex;
+		const SurfaceGrid surface(mesh, indices, level.indexCount);
+		float deviation = 0.0f;
+		std::vector<bool> used(mesh.positions.size(), false);
+		for (uint32_t i = 0; i < mesh.lods[0].indexCount; ++i)
+			used[mesh.indices[i]] = true;
+		for (size_t v = 0; v < mesh.positions.size(); ++v)
+			if (used[v])
+				deviation = std::max(deviation, surface.Distance(mesh.positions[v]));
+
+		static const float weights[][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0.5f, 0.5f, 0 }, { 0, 0.5f, 0.5f },
+			{ 0.5f, 0, 0.5f }, { 1 / 3.0f, 1 / 3.0f, 1 / 3.0f } };
+		for (uint32_t t = 0; t + 3 <= level.indexCount; t += 3)
+		{
+			const Float3& a = mesh.positions[indices[t]];
+			const Float3& b = mesh.positions[indices[t + 1]];
+			const Float3& c = mesh.positions[indices[t + 2]];
+			for (const float* w : weights)
+				deviation = std::max(deviation, lod0.Distance(Add(Add(Scale(a, w[0]), Scale(b, w[1])), Scale(c, w[2]))));
+		}
+		return deviation;
+	}
+
+	// Prints the chain of mesh and returns whether its errors pass the checks.
+	bool Run(const char* name, Mesh& mesh, bool& monotonic)
+	{
+		std::vector<uint32_t> halved;
+		Clock::time_point start = Clock::now();
+		SimplifyMesh(mesh, mesh.indices.data(), mesh.indices.size(), mesh.indices.size() / 6 * 3, LodSettings().maxError, halved);
+		const double halveSeconds = SecondsSince(start);
+
+		start = Clock::now();
+		BuildLodChain(mesh, LodSettings());
+		const double chainSeconds = SecondsSince(start);
+
+		const double triangles = mesh.lods[0].indexCount / 3.0;
+		std::printf("%s: %.0f triangles, chain %.1f ms (%.2f Mtris/s), halving %.1f ms (%.2f Mtris/s)\n", name, triangles,
+			chainSeconds * 1e3, triangles / chainSeconds * 1e-6, halveSeconds * 1e3, triangles / halveSeconds * 1e-6);
+		std::printf("  lod  triangles  recorded error  measured deviation\n");
+
+		const Float3 extent = Sub(mesh.boundsMax, mesh.boundsMin);
+		const float tolerance = 1e-5f * std::max({ extent.x, extent.y, extent.z });
+		const SurfaceGrid lod0(mesh, mesh.indices.data(), mesh.lods[0].indexCount);
+		bool bounded = true;
+		for (size_t i = 0; i < mesh.lods.size(); ++i)
+		{
+			const MeshLod& level = mesh.lods[i];
+			const float deviation = i == 0 ? 0.0f : MeasureDeviation(mesh, lod0, level);
+			std::printf("  %3zu  %9u  %14.6f  %18.6f%s\n", i, level.indexCount / 3, level.error, deviation,
+				deviation > level.error + tolerance ? "  above the recorded error" : "");
+			bounded &= deviation <= level.error + tolerance;
+			if (i != 0)
+				monotonic &= level.error >= mesh.lods[i - 1].error;
+		}
+		return bounded;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool bounded = true, monotonic = true;
+	for (size_t triangles : { 20000, 160000 })
+	{
+		Mesh mesh;
+		MakeSphere(triangles, mesh);
+		bounded &= Run(("sphere " + std::to_string(triangles)).c_str(), mesh, monotonic);
+		MakeTerrain(triangles, mesh);
+		bounded &= Run(("terrain " + std::to_string(triangles)).c_str(), mesh, monotonic);
+	}
+	JobSystem jobs(std::max(1u, std::thread::hardware_concurrency()));
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		Mesh mesh;
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])) || !LoadObjMesh(file.GetData(), file.GetSize(), mesh, jobs))
+		{
+			std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+			return 1;
+		}
+		bounded &= Run(argv[arg], mesh, monotonic);
+	}
+
+	std::printf("\n");
+	bool passed = true;
+	passed &= Check(monotonic, "errors never decrease down the chain");
+	passed &= Check(bounded, "recorded errors bound the deviation from LOD 0");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
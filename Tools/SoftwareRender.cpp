@@ -0,0 +1,119 @@
+﻿// Headless CPU render of MainRenderer's frame (FogMap/Content/SoftwareRenderer.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o SoftwareRender SoftwareRender.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore,SoftwareRenderer,EpipolarSampler,FroxelGrid}.cpp
+//
+//   SoftwareRender [--threads N] [--size WxH] [--frames N] [--out frame.ppm] model.obj
+//
+// Frames come from the same RendererCore as MainRenderer's, so the mesh goes through the same
+// optimisation and LOD chain and the light advances as in MainRenderer::Update at 60 Hz. The
+// per-pass times of every frame after the first are averaged and the last frame is written as
+// a binary PPM.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/RendererCore.h"
+#include "../FogMap/Content/SoftwareRenderer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	bool WritePpm(const std::string& path, const SoftwareRenderer& renderer)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		std::fprintf(file, "P6\n%u %u\n255\n", renderer.GetWidth(), renderer.GetHeight());
+		const std::vector<uint8_t>& color = renderer.GetColor();
+		std::vector<uint8_t> rgb(color.size() / 4 * 3);
+		for (size_t i = 0, j = 0; i < color.size(); i += 4, j += 3)
+		{
+			rgb[j + 0] = color[i + 0];
+			rgb[j + 1] = color[i + 1];
+			rgb[j + 2] = color[i + 2];
+		}
+		bool written = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+		return std::fclose(file) == 0 && written;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	unsigned width = 1280, height = 720;
+	int frames = 10;
+	std::string outputPath;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--threads") == 0)
+			threadCount = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--size") == 0)
+		{
+			if (std::sscanf(argv[arg + 1], "%ux%u", &width, &height) != 2 || width == 0 || height == 0)
+				break;
+		}
+		else if (std::strcmp(argv[arg], "--frames") == 0)
+			frames = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--out") == 0)
+			outputPath = argv[arg + 1];
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--threads N] [--size WxH] [--frames N] [--out frame.ppm] model.obj\n", argv[0]);
+		return 1;
+	}
+
+	DX::MappedFile source;
+	RendererCore core;
+	JobSystem jobs(threadCount);
+	if (!source.Open(std::string(argv[arg])) || !core.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs))
+	{
+		std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+		return 1;
+	}
+	core.Resize(float(width) / height, float(height), MatrixIdentity());
+
+	SoftwareRenderer renderer(threadCount);
+	renderer.Resize(width, height);
+	core.Upload(renderer);
+
+	// The first frame only warms up caches and allocations.
+	SoftwareFrameTimings sum{ 0.0, 0.0, 0.0, 0.0 };
+	for (int frame = 0; frame <= frames; ++frame)
+	{
+		core.Update(1.0 / 60.0);
+		renderer.Submit(core.BuildFrame());
+		if (frame == 0)
+			continue;
+		const SoftwareFrameTimings& timings = renderer.GetTimings();
+		sum.shadowMs += timings.shadowMs;
+		sum.sceneMs += timings.sceneMs;
+		sum.fogMs += timings.fogMs;
+		sum.totalMs += timings.totalMs;
+	}
+
+	std::printf("%ux%u, %u threads, %u vertices, shadow LOD %u (%u tris), scene LOD %u (%u tris)\n", width, height, threadCount,
+		core.GetMeshBuffers().vertexCount, core.GetShadowLod(), core.GetLod(core.GetShadowLod()).triangleCount,
+		core.GetSceneLod(), core.GetLod(core.GetSceneLod()).triangleCount);
+	std::printf("ms/frame over %d frames: shadow %.2f  scene %.2f  fog %.2f  total %.2f\n", frames,
+		sum.shadowMs / frames, sum.sceneMs / frames, sum.fogMs / frames, sum.totalMs / frames);
+
+	if (!outputPath.empty() && !WritePpm(outputPath, renderer))
+	{
+		std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+		return 1;
+	}
+	return 0;
+}
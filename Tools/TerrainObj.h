@@ -0,0 +1,42 @@
+﻿#pragma once
+
+// OBJ text shared by the parser benchmarks (ObjParseBench, ObjScalingBench).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace Tools
+{
+	// Terrain grid with one normal per vertex and "v//n" triangles, about megabytes in size.
+	inline std::string MakeTerrainObj(size_t megabytes)
+	{
+		// A grid vertex costs about 140 bytes of text: a position, a normal and two triangles.
+		const uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(megabytes * 1e6 / 140.0)));
+		std::string text;
+		text.reserve(megabytes * 1100000);
+		char line[128];
+		for (uint32_t z = 0; z <= side; ++z)
+		{
+			for (uint32_t x = 0; x <= side; ++x)
+			{
+				float fx = 2.0f * x / side - 1.0f, fz = 2.0f * z / side - 1.0f;
+				float y = 0.1f * std::sin(fx * 7.0f) * std::cos(fz * 5.0f) + 0.03f * std::sin(fx * 31.0f + fz * 17.0f);
+				text.append(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", fx, y, fz));
+				float nx = -0.7f * std::cos(fx * 7.0f) * std::cos(fz * 5.0f), nz = 0.5f * std::sin(fx * 7.0f) * std::sin(fz * 5.0f);
+				text.append(line, std::snprintf(line, sizeof(line), "vn %.6f 1 %.6f\n", nx, nz));
+			}
+		}
+		for (uint32_t z = 0; z < side; ++z)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				uint32_t a = z * (side + 1) + x + 1, b = a + 1, c = a + side + 1, d = c + 1;
+				text.append(line, std::snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u\nf %u//%u %u//%u %u//%u\n", a, a, c, c, b, b, b, b, c, c, d, d));
+			}
+		}
+		return text;
+	}
+}
@@ -0,0 +1,161 @@
+﻿// Cost and accuracy of converting scene vertices to the 12-byte packed layout
+// (FogMap/Content/VertexPacking.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o VertexPackBench VertexPackBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,VertexPacking,JobSystem}.cpp
+//
+//   VertexPackBench [--runs N] [--vertices N] [model.obj...]
+//
+// Packs N random vertices (1M by default: positions in a 10x2x6 box, uniformly distributed
+// unit normals) and the vertices of every model given, best of N runs (5 by default), and
+// prints nanoseconds per vertex, MB/s of the 36-byte unpacked input (position, colour and
+// normal) and the error report as the renderer logs it. Decodes the packed vertices again and
+// checks that the report is the largest error they actually have, that positions are within
+// half a 16-bit step of the bounds (plus float rounding) and normals within 0.01 degrees.
+// Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "../FogMap/Content/VectorMath.h"
+#include "../FogMap/Content/VertexPacking.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Results
+	{
+		bool honest;		// the report matches the decoded vertices
+		bool positions;		// within half a 16-bit step
+		bool normals;		// within 0.01 degrees
+	};
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	void MakeRandom(size_t count, Mesh& mesh)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		mesh.positions.resize(count);
+		mesh.attributes.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			mesh.positions[i] = Float3{ 5.0f * unit(random), unit(random), 3.0f * unit(random) };
+			Float3 normal;
+			do
+				normal = Float3{ unit(random), unit(random), unit(random) };
+			while (Dot(normal, normal) > 1.0f || Dot(normal, normal) < 1e-4f);
+			mesh.attributes[i] = MeshAttributes{ Float3{ 0.5f, 0.5f, 0.5f }, Normalize(normal) };
+		}
+		ComputeBounds(mesh.positions.data(), count, mesh.boundsMin, mesh.boundsMax);
+	}
+
+	Results Run(const char* name, const Mesh& mesh, int runs)
+	{
+		const size_t count = mesh.positions.size();
+		const VertexQuantization quantization = ComputeQuantization(mesh.boundsMin, mesh.boundsMax);
+		std::vector<PackedPosition> positions(count);
+		std::vector<PackedNormal> normals(count);
+		VertexPackingError error{ 0.0f, 0.0f };
+		double best = 1e30;
+		for (int run = 0; run < runs; ++run)
+		{
+			const Clock::time_point start = Clock::now();
+			error = PackVertices(mesh.positions.data(), mesh.attributes.data(), count, quantization, positions.data(), normals.data());
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		std::printf("%-22s %9zu vertices  %7.1f ns/vertex  %7.1f MB/s\n", name, count, best * 1e6 / std::max<size_t>(count, 1),
+			count * (sizeof(Float3) + sizeof(MeshAttributes)) / 1e3 / best);
+		std::printf("  ");
+		LogPackingError(error, [](const char* message) { std::fputs(message, stdout); });
+
+		// The same error measured on the decoded vertices, in double precision.
+		const Float3& offset = quantization.offset;
+		const Float3& scale = quantization.scale;
+		double maxPosition = 0.0, maxDegrees = 0.0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Float3& v = mesh.positions[i];
+			const uint16_t* p = positions[i].xyzw;
+			maxPosition = std::max({ maxPosition, std::abs(offset.x + p[0] / 65535.0 * scale.x - v.x),
+				std::abs(offset.y + p[1] / 65535.0 * scale.y - v.y), std::abs(offset.z + p[2] / 65535.0 * scale.z - v.z) });
+			const Float3& normal = mesh.attributes[i].norm;
+			const double length = Length(normal);
+			if (length > 0.0)
+			{
+				const Float3 n = DecodeOctahedral(normals[i].xy);
+				const double cx = double(n.y) * normal.z - double(n.z) * normal.y, cy = double(n.z) * normal.x - double(n.x) * normal.z,
+					cz = double(n.x) * normal.y - double(n.y) * normal.x;
+				const double cosine = double(n.x) * normal.x + double(n.y) * normal.y + double(n.z) * normal.z;
+				maxDegrees = std::max(maxDegrees, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), cosine) * 180.0 / 3.14159265358979);
+			}
+		}
+		const double step = std::max({ scale.x, scale.y, scale.z }) / 65535.0;
+		std::printf("  decoded: max position error %g (%.3f steps), max normal error %g degrees\n\n", maxPosition, maxPosition / step, maxDegrees);
+
+		// The report is computed in float; its rounding stays well inside these margins.
+		Results results;
+		results.honest = std::abs(error.maxPosition - maxPosition) <= 0.01 * step && std::abs(error.maxNormalDegrees - maxDegrees) <= 1e-4;
+		results.positions = maxPosition <= 0.52 * step;
+		results.normals = maxDegrees <= 0.01;
+		return results;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	size_t vertices = 1000000;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--runs") == 0)
+			runs = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--vertices") == 0)
+			vertices = std::max(1, std::atoi(argv[arg + 1]));
+		else
+			break;
+	}
+
+	Results all{ true, true, true };
+	const auto merge = [&all](const Results& results) {
+		all.honest &= results.honest;
+		all.positions &= results.positions;
+		all.normals &= results.normals;
+	};
+	Mesh mesh;
+	MakeRandom(vertices, mesh);
+	merge(Run("random", mesh, runs));
+	for (; arg < argc; ++arg)
+	{
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])) || !LoadObjMesh(file.GetData(), file.GetSize(), mesh))
+		{
+			std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+			return 1;
+		}
+		merge(Run(argv[arg], mesh, runs));
+	}
+
+	bool passed = Check(all.honest, "reported error matches the decoded vertices");
+	passed &= Check(all.positions, "positions within half a 16-bit step");
+	passed &= Check(all.normals, "normals within 0.01 degrees");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}
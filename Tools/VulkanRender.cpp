@@ -0,0 +1,183 @@
+// Headless Vulkan render of MainRenderer's frame (FogMap/Content/VulkanBackend.h), checked
+// against the CPU reference renderer. Meant for Mesa's lavapipe, so that frame costs can be
+// measured on Linux machines without a GPU.
+//
+// Build from this directory with dxc and the Vulkan headers installed; the first step
+// recompiles the shaders to SPIR-V in ../FogMap/Content/spv (see CompileVulkanShaders.sh):
+//   ./CompileVulkanShaders.sh && g++ -std=c++17 -O2 -pthread -o VulkanRender VulkanRender.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,Meshlet,MeshCache,MeshOptimizer,MeshSimplifier,Bvh,FogCells,JobSystem,RendererCore,SoftwareRenderer,EpipolarSampler,FroxelGrid,VulkanBackend}.cpp
+//       -lvulkan
+//
+//   VulkanRender [--shaders DIR] [--size WxH] [--frames N] [--tolerance N] [--out frame.ppm] model.obj
+//
+// Run with VK_ICD_FILENAMES pointing at lvp_icd.x86_64.json to force lavapipe when other
+// drivers are installed. Both backends draw the same RendererCore frames; the last one is
+// compared per channel and the run fails when more than 0.1% of the pixels differ by more than
+// the tolerance. Depth is D32 here and D24 on the D3D11 path, and lavapipe samples and blends
+// with its own rounding, so small differences along shadow and cell edges are expected.
+// Refuses to run when a shader's .hlsl in ../FogMap/Content is newer than its .spv.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/JobSystem.h"
+#include "../FogMap/Content/RendererCore.h"
+#include "../FogMap/Content/SoftwareRenderer.h"
+#include "../FogMap/Content/VulkanBackend.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace FogMap;
+
+namespace
+{
+	// The shaders VulkanBackend loads, as CompileVulkanShaders.sh builds them.
+	const char* const ShaderNames[]{ "ShadowVertexShader", "ShadowPixelShader", "SceneVertexShader", "ScenePixelShader",
+		"CellVertexShader", "CellPixelShader" };
+
+	// The first shader whose SPIR-V is older than its source, or nullptr.
+	const char* FindStaleShader(const std::string& shaderDirectory)
+	{
+		for (const char* name : ShaderNames)
+		{
+			struct stat source, binary;
+			if (stat(("../FogMap/Content/" + std::string(name) + ".hlsl").c_str(), &source) == 0 &&
+				stat((shaderDirectory + "/" + name + ".spv").c_str(), &binary) == 0 && source.st_mtime > binary.st_mtime)
+				return name;
+		}
+		return nullptr;
+	}
+
+	bool WritePpm(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& color)
+	{
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+		std::vector<uint8_t> rgb(color.size() / 4 * 3);
+		for (size_t i = 0, j = 0; i < color.size(); i += 4, j += 3)
+		{
+			rgb[j + 0] = color[i + 0];
+			rgb[j + 1] = color[i + 1];
+			rgb[j + 2] = color[i + 2];
+		}
+		bool written = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+		return std::fclose(file) == 0 && written;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string shaderDirectory = "../FogMap/Content/spv";
+	unsigned width = 1280, height = 720;
+	int frames = 10;
+	int tolerance = 8;
+	std::string outputPath;
+	int arg = 1;
+	for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		if (std::strcmp(argv[arg], "--shaders") == 0)
+			shaderDirectory = argv[arg + 1];
+		else if (std::strcmp(argv[arg], "--size") == 0)
+		{
+			if (std::sscanf(argv[arg + 1], "%ux%u", &width, &height) != 2 || width == 0 || height == 0)
+				break;
+		}
+		else if (std::strcmp(argv[arg], "--frames") == 0)
+			frames = std::max(1, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--tolerance") == 0)
+			tolerance = std::max(0, std::atoi(argv[arg + 1]));
+		else if (std::strcmp(argv[arg], "--out") == 0)
+			outputPath = argv[arg + 1];
+		else
+			break;
+	}
+	if (argc - arg != 1)
+	{
+		std::fprintf(stderr, "usage: %s [--shaders DIR] [--size WxH] [--frames N] [--tolerance N] [--out frame.ppm] model.obj\n", argv[0]);
+		return 1;
+	}
+
+	const unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+	DX::MappedFile source;
+	RendererCore core;
+	JobSystem jobs(threadCount);
+	if (!source.Open(std::string(argv[arg])) || !core.LoadMesh(source.GetData(), source.GetSize(), nullptr, 0, jobs))
+	{
+		std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+		return 1;
+	}
+	core.Resize(float(width) / height, float(height), MatrixIdentity());
+	if (const char* stale = FindStaleShader(shaderDirectory))
+	{
+		std::fprintf(stderr, "%s/%s.spv is older than its source; rerun CompileVulkanShaders.sh\n", shaderDirectory.c_str(), stale);
+		return 1;
+	}
+
+	try
+	{
+		VulkanBackend vulkan(shaderDirectory);
+		vulkan.Resize(width, height);
+		core.Upload(vulkan);
+		SoftwareRenderer reference(threadCount);
+		reference.Resize(width, height);
+		core.Upload(reference);
+
+		// The first frame only warms up pipelines and allocations.
+		VulkanFrameTimings sum{ 0.0, 0.0, 0.0, 0, 0 };
+		for (int frame = 0; frame <= frames; ++frame)
+		{
+			core.Update(1.0 / 60.0);
+			vulkan.Submit(core.BuildFrame());
+			if (frame == 0)
+				continue;
+			const VulkanFrameTimings& timings = vulkan.GetTimings();
+			sum.recordMs += timings.recordMs;
+			sum.submitMs += timings.submitMs;
+			sum.waitMs += timings.waitMs;
+			sum.drawCalls = timings.drawCalls;
+			sum.descriptorBinds = timings.descriptorBinds;
+		}
+		reference.Submit(core.BuildFrame());
+
+		std::printf("%s, %ux%u, %u vertices, shadow LOD %u (%u tris), scene LOD %u (%u tris)\n", vulkan.GetDeviceName(), width, height,
+			core.GetMeshBuffers().vertexCount, core.GetShadowLod(), core.GetLod(core.GetShadowLod()).triangleCount,
+			core.GetSceneLod(), core.GetLod(core.GetSceneLod()).triangleCount);
+		std::printf("CPU ms/frame over %d frames: record %.3f  submit %.3f  wait %.2f  (%u draws, %u descriptor binds)\n", frames,
+			sum.recordMs / frames, sum.submitMs / frames, sum.waitMs / frames, sum.drawCalls, sum.descriptorBinds);
+
+		std::vector<uint8_t> color;
+		vulkan.ReadColor(color);
+		const std::vector<uint8_t>& expected = reference.GetColor();
+		int maxDifference = 0;
+		size_t differingPixels = 0;
+		for (size_t i = 0; i < color.size(); i += 4)
+		{
+			int pixelDifference = 0;
+			for (size_t c = 0; c < 3; ++c)
+				pixelDifference = std::max(pixelDifference, std::abs(int(color[i + c]) - int(expected[i + c])));
+			maxDifference = std::max(maxDifference, pixelDifference);
+			differingPixels += pixelDifference > tolerance;
+		}
+		const size_t pixelCount = color.size() / 4;
+		std::printf("vs. SoftwareRenderer: max difference %d, %zu of %zu pixels over %d\n", maxDifference, differingPixels, pixelCount, tolerance);
+
+		if (!outputPath.empty() && !WritePpm(outputPath, width, height, color))
+		{
+			std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+			return 1;
+		}
+		return differingPixels * 1000 > pixelCount ? 2 : 0;
+	}
+	catch (const std::runtime_error& error)
+	{
+		std::fprintf(stderr, "%s\n", error.what());
+		return 1;
+	}
+}
@@ -0,0 +1,201 @@
+﻿// Cost of welding OBJ corners into vertices (FogMap/Content/VertexWelder.h).
+//
+// Build from this directory with any C++17 compiler, e.g.
+//   g++ -std=c++17 -O2 -pthread -o WeldBench WeldBench.cpp ../FogMap/Common/MappedFile.cpp
+//       ../FogMap/Content/{MeshData,ObjLoader,VertexWelder,JobSystem}.cpp
+//
+//   WeldBench [--runs N] [faces... | model.obj...]
+//
+// Without arguments it welds terrain grids of 1M and 4M faces, once with one normal per
+// position (smooth, about six corners per vertex) and once with one normal per face (flat,
+// nothing to weld). Every corner list is welded four ways, best of N runs (5 by default):
+//   map      std::unordered_map keyed on the exact pair, one find and one insert per new pair
+//   legacy   the old loader's scheme: key position * normalCount + normal, looked up with
+//            count and operator[], several hashes per corner
+//   welder   VertexWelder, one probe sequence per corner
+//   build    BuildMesh: VertexWelder plus the vertex copies and the winding fix
+// and reports milliseconds per million faces. Checks that map and welder assign the same
+// index to every corner. Exits with 1 if a check fails.
+
+#include "../FogMap/Common/MappedFile.h"
+#include "../FogMap/Content/ObjLoader.h"
+#include "../FogMap/Content/VertexWelder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+using namespace FogMap;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	bool Check(bool condition, const char* what)
+	{
+		std::printf("%-52s %s\n", what, condition ? "ok" : "FAILED");
+		return condition;
+	}
+
+	// Grid over [-1, 1]^2 in xz, two triangles per quad. Smooth grids share one normal per
+	// position; flat ones give every face a normal of its own.
+	void MakeTerrain(size_t faceCount, bool flat, ObjData& obj)
+	{
+		const uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(faceCount / 2.0)));
+		obj.positions.clear();
+		obj.normals.clear();
+		obj.corners.clear();
+		for (uint32_t z = 0; z <= side; ++z)
+		{
+			for (uint32_t x = 0; x <= side; ++x)
+			{
+				float fx = 2.0f * x / side - 1.0f, fz = 2.0f * z / side - 1.0f;
+				obj.positions.push_back(Float3{ fx, 0.1f * std::sin(fx * 7.0f) * std::cos(fz * 5.0f), fz });
+				if (!flat)
+					obj.normals.push_back(Float3{ 0.0f, 1.0f, 0.0f });
+			}
+		}
+		for (uint32_t z = 0; z < side; ++z)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				uint32_t a = z * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+				const uint32_t quad[] = { a, c, b, b, c, d };
+				for (int i = 0; i < 6; ++i)
+				{
+					uint32_t normal = quad[i];
+					if (flat)
+					{
+						if (i % 3 == 0)
+							obj.normals.push_back(Float3{ 0.0f, 1.0f, 0.0f });
+						normal = static_cast<uint32_t>(obj.normals.size() - 1);
+					}
+					obj.corners.push_back(ObjCorner{ quad[i], normal });
+				}
+			}
+		}
+	}
+
+	void WeldMap(const ObjData& obj, std::vector<uint32_t>& indices)
+	{
+		std::unordered_map<uint64_t, uint32_t> vertices;
+		vertices.reserve(obj.positions.size());
+		indices.resize(obj.corners.size());
+		for (size_t i = 0; i < obj.corners.size(); ++i)
+		{
+			const uint64_t key = uint64_t(obj.corners[i].position) << 32 | obj.corners[i].normal;
+			auto found = vertices.find(key);
+			if (found == vertices.end())
+				found = vertices.emplace(key, static_cast<uint32_t>(vertices.size())).first;
+			indices[i] = found->second;
+		}
+	}
+
+	// The pre-ObjLoader scheme, for comparison; its key collides once normals run past the
+	// count taken at the time.
+	void WeldLegacy(const ObjData& obj, std::vector<uint32_t>& indices)
+	{
+		std::unordered_map<int64_t, std::pair<uint32_t, Float3>> vnBuffer;
+		indices.resize(obj.corners.size());
+		const int64_t normalCount = static_cast<int64_t>(obj.normals.size());
+		for (size_t i = 0; i < obj.corners.size(); ++i)
+		{
+			const ObjCorner& corner = obj.corners[i];
+			const int64_t key = (int64_t(corner.position) + 1) * normalCount + corner.normal + 1;
+			if (vnBuffer.count(key) == 0)
+				vnBuffer[key] = std::make_pair(static_cast<uint32_t>(vnBuffer.size()), obj.positions[corner.position]);
+			indices[i] = vnBuffer[key].first;
+		}
+	}
+
+	void WeldFlat(const ObjData& obj, std::vector<uint32_t>& indices)
+	{
+		VertexWelder welder(obj.positions.size());
+		indices.resize(obj.corners.size());
+		for (size_t i = 0; i < obj.corners.size(); ++i)
+			welder.Insert(obj.corners[i].position, obj.corners[i].normal, indices[i]);
+	}
+
+	// Welds obj every way and prints ms per million faces; returns whether map and welder agree.
+	bool Run(const char* name, const ObjData& obj, int runs)
+	{
+		std::vector<uint32_t> mapIndices, legacyIndices, welderIndices;
+		Mesh mesh;
+		const std::function<void()> welds[] = {
+			[&]() { WeldMap(obj, mapIndices); },
+			[&]() { WeldLegacy(obj, legacyIndices); },
+			[&]() { WeldFlat(obj, welderIndices); },
+			[&]() { BuildMesh(obj, mesh); },
+		};
+		double best[4] = { 1e30, 1e30, 1e30, 1e30 };
+		for (int run = 0; run < runs; ++run)
+		{
+			for (int w = 0; w < 4; ++w)
+			{
+				const Clock::time_point start = Clock::now();
+				welds[w]();
+				best[w] = std::min(best[w], std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			}
+		}
+		const double millions = obj.corners.size() / 3 * 1e-6;
+		std::printf("%-22s %8.2f M faces %9zu vertices  %8.1f %8.1f %8.1f %8.1f\n", name, millions, mesh.positions.size(),
+			best[0] / millions, best[1] / millions, best[2] / millions, best[3] / millions);
+		return mapIndices == welderIndices;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	int arg = 1;
+	if (arg + 1 < argc && std::strcmp(argv[arg], "--runs") == 0)
+	{
+		runs = std::max(1, std::atoi(argv[arg + 1]));
+		arg += 2;
+	}
+
+	std::printf("%-22s %16s %18s  %8s %8s %8s %8s   (ms per million faces)\n", "corners", "", "", "map", "legacy", "welder", "build");
+	bool same = true;
+	ObjData obj;
+	if (arg == argc)
+	{
+		for (size_t faces : { 1000000, 4000000 })
+		{
+			for (bool flat : { false, true })
+			{
+				MakeTerrain(faces, flat, obj);
+				same &= Run(flat ? "flat terrain" : "smooth terrain", obj, runs);
+			}
+		}
+	}
+	for (; arg < argc; ++arg)
+	{
+		char* end;
+		unsigned long long faces = std::strtoull(argv[arg], &end, 10);
+		if (*end == '\0')
+		{
+			MakeTerrain(static_cast<size_t>(faces), false, obj);
+			same &= Run("smooth terrain", obj, runs);
+			continue;
+		}
+
+		DX::MappedFile file;
+		if (!file.Open(std::string(argv[arg])) || !ParseObj(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), obj))
+		{
+			std::fprintf(stderr, "cannot load %s\n", argv[arg]);
+			return 1;
+		}
+		same &= Run(argv[arg], obj, runs);
+	}
+
+	std::printf("\n");
+	const bool passed = Check(same, "welder indices match the exact-key map");
+	std::printf("%s\n", passed ? "passed" : "FAILED");
+	return passed ? 0 : 1;
+}